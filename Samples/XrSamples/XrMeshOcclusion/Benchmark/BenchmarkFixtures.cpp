@@ -0,0 +1,276 @@
+#include "BenchmarkFixtures.h"
+#include "SceneTrace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+namespace BenchmarkFixtures {
+
+namespace {
+
+struct Box {
+    XrVector3f Min;
+    XrVector3f Max;
+};
+
+// Room shell (x right, y up, z back, meters) and the furniture standing in it. The
+// furniture starts a millimeter above the floor so it stays a separate surface.
+const Box kRoom = {{0.0f, 0.0f, 0.0f}, {5.0f, 2.7f, 4.0f}};
+const Box kFurniture[] = {
+    // Table top and legs
+    {{1.5f, 0.72f, 1.5f}, {3.1f, 0.77f, 2.4f}},
+    {{1.55f, 0.001f, 1.55f}, {1.6f, 0.72f, 1.6f}},
+    {{3.0f, 0.001f, 1.55f}, {3.05f, 0.72f, 1.6f}},
+    {{1.55f, 0.001f, 2.3f}, {1.6f, 0.72f, 2.35f}},
+    {{3.0f, 0.001f, 2.3f}, {3.05f, 0.72f, 2.35f}},
+    // Two chairs, seat and back
+    {{1.9f, 0.001f, 0.9f}, {2.35f, 0.45f, 1.35f}},
+    {{1.9f, 0.45f, 0.9f}, {2.35f, 0.95f, 0.95f}},
+    {{2.3f, 0.001f, 2.55f}, {2.75f, 0.45f, 3.0f}},
+    {{2.3f, 0.45f, 2.95f}, {2.75f, 0.95f, 3.0f}},
+    // Sofa base, back and arms
+    {{0.3f, 0.001f, 3.0f}, {2.3f, 0.42f, 3.9f}},
+    {{0.3f, 0.42f, 3.6f}, {2.3f, 0.85f, 3.9f}},
+    {{0.1f, 0.001f, 3.0f}, {0.3f, 0.62f, 3.9f}},
+    {{2.3f, 0.001f, 3.0f}, {2.5f, 0.62f, 3.9f}},
+    // Shelves against the right wall
+    {{4.6f, 0.001f, 0.5f}, {4.95f, 2.0f, 1.7f}},
+    // Boxes on the floor
+    {{3.6f, 0.001f, 3.2f}, {4.0f, 0.3f, 3.6f}},
+    {{4.05f, 0.001f, 3.3f}, {4.35f, 0.25f, 3.6f}},
+    {{3.7f, 0.3f, 3.3f}, {3.95f, 0.5f, 3.55f}},
+};
+
+class MeshBuilder {
+public:
+    // Adds the six faces of a box, each as a grid of at most cellSize squares.
+    void AddBox(const Box& box, float cellSize, bool inward) {
+        const float dx = box.Max.x - box.Min.x;
+        const float dy = box.Max.y - box.Min.y;
+        const float dz = box.Max.z - box.Min.z;
+        const XrVector3f& lo = box.Min;
+        const XrVector3f& hi = box.Max;
+        // Origin, U and V with U x V pointing out of the box.
+        AddQuad({lo.x, lo.y, lo.z}, {0, 0, dz}, {0, dy, 0}, cellSize, inward);
+        AddQuad({hi.x, lo.y, lo.z}, {0, dy, 0}, {0, 0, dz}, cellSize, inward);
+        AddQuad({lo.x, lo.y, lo.z}, {dx, 0, 0}, {0, 0, dz}, cellSize, inward);
+        AddQuad({lo.x, hi.y, lo.z}, {0, 0, dz}, {dx, 0, 0}, cellSize, inward);
+        AddQuad({lo.x, lo.y, lo.z}, {0, dy, 0}, {dx, 0, 0}, cellSize, inward);
+        AddQuad({lo.x, lo.y, hi.z}, {dx, 0, 0}, {0, dy, 0}, cellSize, inward);
+    }
+
+    // Moves every vertex by up to amplitude along each axis.
+    void AddNoise(float amplitude, unsigned seed) {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> offset(-amplitude, amplitude);
+        for (auto& v : Vertices_) {
+            v.x += offset(random);
+            v.y += offset(random);
+            v.z += offset(random);
+        }
+    }
+
+    BenchmarkFixture Finish(const std::string& name) {
+        BenchmarkFixture fixture;
+        fixture.Name = name;
+        fixture.Vertices = std::move(Vertices_);
+        fixture.Indices = std::move(Indices_);
+        Vertices_.clear();
+        Indices_.clear();
+        VertexLookup_.clear();
+        return fixture;
+    }
+
+private:
+    struct PositionKey {
+        int64_t X, Y, Z;
+        bool operator==(const PositionKey& other) const {
+            return X == other.X && Y == other.Y && Z == other.Z;
+        }
+    };
+    struct PositionKeyHash {
+        size_t operator()(const PositionKey& key) const {
+            uint64_t h = static_cast<uint64_t>(key.X) * 0x9E3779B97F4A7C15ull;
+            h ^= static_cast<uint64_t>(key.Y) + 0x7F4A7C15ull + (h << 6) + (h >> 2);
+            h ^= static_cast<uint64_t>(key.Z) + 0x9E3779B9ull + (h << 6) + (h >> 2);
+            return static_cast<size_t>(h);
+        }
+    };
+
+    // Vertices closer than 0.1 mm are merged, so faces sharing a box edge are welded.
+    uint32_t AddVertex(const XrVector3f& p) {
+        const PositionKey key = {
+            std::llround(p.x * 1e4), std::llround(p.y * 1e4), std::llround(p.z * 1e4)};
+        auto it = VertexLookup_.find(key);
+        if (it != VertexLookup_.end()) {
+            return it->second;
+        }
+        const uint32_t index = static_cast<uint32_t>(Vertices_.size());
+        Vertices_.push_back(p);
+        VertexLookup_.emplace(key, index);
+        return index;
+    }
+
+    void AddQuad(
+        const XrVector3f& origin,
+        const XrVector3f& u,
+        const XrVector3f& v,
+        float cellSize,
+        bool inward) {
+        auto length = [](const XrVector3f& a) { return std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z); };
+        const int nu = std::max(1, static_cast<int>(std::ceil(length(u) / cellSize)));
+        const int nv = std::max(1, static_cast<int>(std::ceil(length(v) / cellSize)));
+        std::vector<uint32_t> grid((nu + 1) * (nv + 1));
+        for (int j = 0; j <= nv; ++j) {
+            const float t = static_cast<float>(j) / nv;
+            for (int i = 0; i <= nu; ++i) {
+                const float s = static_cast<float>(i) / nu;
+                grid[j * (nu + 1) + i] = AddVertex(
+                    {origin.x + u.x * s + v.x * t,
+                     origin.y + u.y * s + v.y * t,
+                     origin.z + u.z * s + v.z * t});
+            }
+        }
+        for (int j = 0; j < nv; ++j) {
+            for (int i = 0; i < nu; ++i) {
+                const uint32_t a = grid[j * (nu + 1) + i];
+                const uint32_t b = grid[j * (nu + 1) + i + 1];
+                const uint32_t c = grid[(j + 1) * (nu + 1) + i + 1];
+                const uint32_t d = grid[(j + 1) * (nu + 1) + i];
+                if (inward) {
+                    Indices_.insert(Indices_.end(), {a, c, b, a, d, c});
+                } else {
+                    Indices_.insert(Indices_.end(), {a, b, c, a, c, d});
+                }
+            }
+        }
+    }
+
+    std::vector<XrVector3f> Vertices_;
+    std::vector<uint32_t> Indices_;
+    std::unordered_map<PositionKey, uint32_t, PositionKeyHash> VertexLookup_;
+};
+
+float SurfaceArea(const Box& box) {
+    const float dx = box.Max.x - box.Min.x;
+    const float dy = box.Max.y - box.Min.y;
+    const float dz = box.Max.z - box.Min.z;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+void AddClutter(MeshBuilder& builder, float cellSize) {
+    builder.AddBox(kRoom, cellSize, true);
+    for (const Box& box : kFurniture) {
+        builder.AddBox(box, cellSize, false);
+    }
+}
+
+} // namespace
+
+BenchmarkFixture MakeBoxRoom(float cellSize) {
+    MeshBuilder builder;
+    builder.AddBox(kRoom, cellSize, true);
+    return builder.Finish("box_room");
+}
+
+BenchmarkFixture MakeClutteredRoom(float cellSize) {
+    MeshBuilder builder;
+    AddClutter(builder, cellSize);
+    return builder.Finish("cluttered_room");
+}
+
+BenchmarkFixture MakeRoomScan(size_t triangleCount) {
+    // Two triangles per cell; thin furniture parts round up, so the count is approximate.
+    float area = SurfaceArea(kRoom);
+    for (const Box& box : kFurniture) {
+        area += SurfaceArea(box);
+    }
+    const float cellSize = std::sqrt(2.0f * area / static_cast<float>(std::max<size_t>(triangleCount, 1)));
+    MeshBuilder builder;
+    AddClutter(builder, cellSize);
+    builder.AddNoise(0.003f, 1234u);
+    std::ostringstream name;
+    name << "room_scan_" << (triangleCount >= 1000000 ? triangleCount / 1000000 : triangleCount / 1000)
+         << (triangleCount >= 1000000 ? "m" : "k");
+    return builder.Finish(name.str());
+}
+
+bool LoadObj(const std::string& path, BenchmarkFixture& fixture) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    fixture.Vertices.clear();
+    fixture.Indices.clear();
+    const size_t slash = path.find_last_of("/\\");
+    const std::string fileName = slash == std::string::npos ? path : path.substr(slash + 1);
+    fixture.Name = fileName.substr(0, fileName.find_last_of('.'));
+
+    std::string line;
+    std::vector<uint32_t> polygon;
+    while (std::getline(file, line)) {
+        std::istringstream record(line);
+        std::string type;
+        record >> type;
+        if (type == "v") {
+            XrVector3f v = {0.0f, 0.0f, 0.0f};
+            record >> v.x >> v.y >> v.z;
+            fixture.Vertices.push_back(v);
+        } else if (type == "f") {
+            // Corners are "v", "v/vt", "v//vn" or "v/vt/vn"; negative indices count back
+            // from the last vertex read so far.
+            polygon.clear();
+            std::string corner;
+            while (record >> corner) {
+                const long index = std::strtol(corner.c_str(), nullptr, 10);
+                const long resolved = index < 0 ? static_cast<long>(fixture.Vertices.size()) + index : index - 1;
+                if (resolved < 0 || resolved >= static_cast<long>(fixture.Vertices.size())) {
+                    polygon.clear();
+                    break;
+                }
+                polygon.push_back(static_cast<uint32_t>(resolved));
+            }
+            for (size_t i = 2; i < polygon.size(); ++i) {
+                fixture.Indices.insert(fixture.Indices.end(), {polygon[0], polygon[i - 1], polygon[i]});
+            }
+        }
+    }
+    return !fixture.Vertices.empty() && !fixture.Indices.empty();
+}
+
+bool LoadSceneTrace(const std::string& path, std::vector<BenchmarkFixture>& fixtures) {
+    SceneTraceReader trace;
+    if (!trace.Open(path)) {
+        return false;
+    }
+    const size_t slash = path.find_last_of("/\\");
+    const std::string fileName = slash == std::string::npos ? path : path.substr(slash + 1);
+    const std::string baseName = fileName.substr(0, fileName.find_last_of('.'));
+
+    // Later records of a space replace its earlier ones, as they do in the app.
+    const size_t firstFixture = fixtures.size();
+    std::unordered_map<uint64_t, size_t> fixtureOfSpace;
+    for (const uint32_t index : trace.RecordsOfType(SceneTraceRecordType::TriangleMesh)) {
+        const SceneTraceReader::Record record = trace.GetRecord(index);
+        SceneTraceReader::TriangleMesh mesh;
+        if (!SceneTraceReader::ReadTriangleMesh(record, mesh)) {
+            continue;
+        }
+        auto found = fixtureOfSpace.find(record.Space);
+        if (found == fixtureOfSpace.end()) {
+            found = fixtureOfSpace.emplace(record.Space, fixtures.size()).first;
+            fixtures.emplace_back();
+            fixtures.back().Name = baseName + "_" + std::to_string(fixtures.size() - 1 - firstFixture);
+        }
+        BenchmarkFixture& fixture = fixtures[found->second];
+        fixture.Vertices.assign(mesh.Vertices, mesh.Vertices + mesh.VertexCount);
+        fixture.Indices.assign(mesh.Indices, mesh.Indices + mesh.IndexCount);
+    }
+    return fixtures.size() > firstFixture;
+}
+
+} // namespace BenchmarkFixtures
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <openxr/openxr.h>
+
+// Room meshes for the headless benchmark. The synthetic ones are built the way the
+// runtime reports scene meshes: one welded triangle soup per room, walls facing inward,
+// with roughly uniform triangle size. All of them are deterministic.
+struct BenchmarkFixture {
+    std::string Name;
+    std::vector<XrVector3f> Vertices;
+    std::vector<uint32_t> Indices;
+
+    size_t TriangleCount() const { return Indices.size() / 3; }
+};
+
+namespace BenchmarkFixtures {
+
+// Empty 5 x 4 x 2.7 m room with walls tessellated at cellSize.
+BenchmarkFixture MakeBoxRoom(float cellSize = 0.25f);
+
+// The box room with a table, chairs, a sofa, shelves and a few boxes on the floor.
+BenchmarkFixture MakeClutteredRoom(float cellSize = 0.1f);
+
+// The cluttered room tessellated finely enough for about triangleCount triangles, with
+// a few millimeters of noise like a raw depth reconstruction.
+BenchmarkFixture MakeRoomScan(size_t triangleCount = 1000000);
+
+// Loads the "v" and "f" records of a Wavefront OBJ file, e.g. a room mesh exported from
+// a device capture. Polygons are fan triangulated. Returns false if nothing was read.
+bool LoadObj(const std::string& path, BenchmarkFixture& fixture);
+
+// Appends the room meshes of a scene trace, the last one recorded for each space, named
+// after the file and the space. Returns false if the trace cannot be read or has none.
+bool LoadSceneTrace(const std::string& path, std::vector<BenchmarkFixture>& fixtures);
+
+} // namespace BenchmarkFixtures
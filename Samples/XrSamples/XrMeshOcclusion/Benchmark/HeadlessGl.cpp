@@ -0,0 +1,105 @@
+#include "HeadlessGl.h"
+
+#include <cstring>
+
+#include <EGL/eglext.h>
+
+HeadlessGl::~HeadlessGl() {
+    Destroy();
+}
+
+bool HeadlessGl::Create() {
+    Destroy();
+    Error_.clear();
+
+    EGLint major = 0;
+    EGLint minor = 0;
+    Display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (Display_ == EGL_NO_DISPLAY || !eglInitialize(Display_, &major, &minor)) {
+        // No display server; Mesa renders without one on its surfaceless platform.
+        auto getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        Display_ = getPlatformDisplay != nullptr
+            ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+            : EGL_NO_DISPLAY;
+        if (Display_ == EGL_NO_DISPLAY || !eglInitialize(Display_, &major, &minor)) {
+            Display_ = EGL_NO_DISPLAY;
+            Error_ = "no EGL display";
+            return false;
+        }
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE,
+        EGL_OPENGL_ES3_BIT,
+        EGL_SURFACE_TYPE,
+        EGL_PBUFFER_BIT,
+        EGL_RED_SIZE,
+        8,
+        EGL_GREEN_SIZE,
+        8,
+        EGL_BLUE_SIZE,
+        8,
+        EGL_ALPHA_SIZE,
+        8,
+        EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(Display_, configAttributes, &config, 1, &configCount) ||
+        configCount == 0) {
+        Error_ = "no EGL config for OpenGL ES 3";
+        Destroy();
+        return false;
+    }
+
+    eglBindAPI(EGL_OPENGL_ES_API);
+    const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE};
+    Context_ = eglCreateContext(Display_, config, EGL_NO_CONTEXT, contextAttributes);
+    if (Context_ == EGL_NO_CONTEXT) {
+        Error_ = "eglCreateContext failed";
+        Destroy();
+        return false;
+    }
+    const EGLint surfaceAttributes[] = {EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE};
+    Surface_ = eglCreatePbufferSurface(Display_, config, surfaceAttributes);
+    if (Surface_ == EGL_NO_SURFACE || !eglMakeCurrent(Display_, Surface_, Surface_, Context_)) {
+        Error_ = "eglMakeCurrent failed";
+        Destroy();
+        return false;
+    }
+    return true;
+}
+
+void HeadlessGl::Destroy() {
+    if (Display_ == EGL_NO_DISPLAY) {
+        return;
+    }
+    eglMakeCurrent(Display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (Surface_ != EGL_NO_SURFACE) {
+        eglDestroySurface(Display_, Surface_);
+        Surface_ = EGL_NO_SURFACE;
+    }
+    if (Context_ != EGL_NO_CONTEXT) {
+        eglDestroyContext(Display_, Context_);
+        Context_ = EGL_NO_CONTEXT;
+    }
+    eglTerminate(Display_);
+    Display_ = EGL_NO_DISPLAY;
+}
+
+std::string HeadlessGl::Renderer() const {
+    const GLubyte* renderer = glGetString(GL_RENDERER);
+    return renderer != nullptr ? reinterpret_cast<const char*>(renderer) : std::string();
+}
+
+bool HeadlessGl::HasExtension(const char* name) const {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const GLubyte* extension = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+        if (extension != nullptr && std::strcmp(reinterpret_cast<const char*>(extension), name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+
+// An OpenGL ES 3 context without a window, for running the sample's GL code on a host
+// without a display: EGL's default display when there is one, Mesa's surfaceless
+// platform otherwise, which in CI usually means llvmpipe. The context is current on the
+// thread that created it, with a small pbuffer surface; rendering goes to framebuffers
+// the caller makes.
+class HeadlessGl {
+public:
+    HeadlessGl() = default;
+    ~HeadlessGl();
+
+    HeadlessGl(const HeadlessGl&) = delete;
+    HeadlessGl& operator=(const HeadlessGl&) = delete;
+
+    // Returns false, with Error() set, when no ES 3 context can be made.
+    bool Create();
+    void Destroy();
+
+    const std::string& Error() const {
+        return Error_;
+    }
+
+    // GL_RENDERER, e.g. "llvmpipe (LLVM 15.0.6, 256 bits)", for the benchmark's report
+    std::string Renderer() const;
+    bool HasExtension(const char* name) const;
+
+private:
+    EGLDisplay Display_ = EGL_NO_DISPLAY;
+    EGLContext Context_ = EGL_NO_CONTEXT;
+    EGLSurface Surface_ = EGL_NO_SURFACE;
+    std::string Error_;
+};
@@ -0,0 +1,796 @@
+// Headless benchmark of the occluder mesh processing stages (Linux).
+//
+// Runs every stage on a set of room meshes and reports the median time, triangles per
+// second, heap allocations, peak heap growth and peak resident memory of each stage, as
+// JSON or CSV so results from different versions can be compared by a script. The mesh
+// codec stages also report the encoded size and throughput, and fail the run when a
+// decoded mesh does not match its fixture; adaptive subdivision fails it when a closed
+// fixture comes out with holes.
+//
+//   meshocclusion_benchmark [--fixtures box_room,cluttered_room,room_scan_1m]
+//                           [--obj recorded_room.obj]... [--trace room.xrtrace]...
+//                           [--stages topology,expand,...]
+//                           [--iterations 5] [--warmup 1] [--threads 1]
+//                           [--format json|csv] [--label <version>] [--output <file>]
+//   meshocclusion_benchmark --help
+//
+// Unknown options, stages or fixtures exit with 2.
+
+#include "AdaptiveSubdivision.h"
+#include "BenchmarkFixtures.h"
+#include "FrustumCulling.h"
+#include "MeshCodec.h"
+#include "MeshOptimization.h"
+#include "MeshSimplification.h"
+#include "MeshSubdivision.h"
+#include "MeshTopology.h"
+#include "MeshletMesh.h"
+#include "QuantizedPositions.h"
+#include "SubdivisionStencils.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <malloc.h>
+#include <sys/resource.h>
+
+/*
+================================================================================
+
+Allocation tracking
+
+================================================================================
+*/
+
+// Every operator new in the process goes through these counters, including the ones made
+// on pool worker threads. Sizes come from malloc_usable_size, so the byte counts include
+// allocator rounding, which is what the process actually pays for.
+namespace {
+std::atomic<uint64_t> gAllocationCount{0};
+std::atomic<int64_t> gHeapBytes{0};
+std::atomic<int64_t> gPeakHeapBytes{0};
+
+void* TrackedAlloc(size_t size) {
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p != nullptr) {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+        const int64_t current =
+            gHeapBytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed) + malloc_usable_size(p);
+        int64_t peak = gPeakHeapBytes.load(std::memory_order_relaxed);
+        while (current > peak &&
+               !gPeakHeapBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+        }
+    }
+    return p;
+}
+
+void TrackedFree(void* p) {
+    if (p != nullptr) {
+        gHeapBytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+        std::free(p);
+    }
+}
+} // namespace
+
+void* operator new(size_t size) {
+    void* p = TrackedAlloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return TrackedAlloc(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return TrackedAlloc(size);
+}
+void operator delete(void* p) noexcept {
+    TrackedFree(p);
+}
+void operator delete[](void* p) noexcept {
+    TrackedFree(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    TrackedFree(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+    TrackedFree(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    TrackedFree(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    TrackedFree(p);
+}
+
+namespace {
+
+// The kernel's resident set high-water mark can be reset per process (Linux 4.0+), which
+// gives a per-stage peak RSS. Returns -1 where that is not available.
+void ResetPeakRss() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs) {
+        clearRefs << "5";
+    }
+}
+
+long ReadPeakRssKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtol(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return -1;
+}
+
+/*
+================================================================================
+
+Measurement
+
+================================================================================
+*/
+
+// Every stage, in the order they run.
+const std::vector<std::string> kStages = {
+    "topology",
+    "wireframe",
+    "subdivide_uniform",
+    "subdivide_adaptive",
+    "stencil_apply",
+    "simplify",
+    "optimize",
+    "meshlets",
+    "meshlet_cull",
+    "quantize",
+    "expand",
+    "vertex_normals",
+    "encode",
+    "decode"};
+
+struct Options {
+    std::vector<std::string> Fixtures = {"box_room", "cluttered_room", "room_scan_1m"};
+    std::vector<std::string> ObjFiles;
+    std::vector<std::string> TraceFiles;
+    std::vector<std::string> Stages = kStages;
+    bool Help = false;
+    int Iterations = 5;
+    int Warmup = 1;
+    int Threads = 1;
+    std::string Format = "json";
+    std::string Label;
+    std::string Output;
+};
+
+struct StageResult {
+    std::string Fixture;
+    std::string Stage;
+    size_t InputTriangles = 0;
+    size_t OutputPrimitives = 0; // triangles, or lines for the wireframe stage
+    double MedianMs = 0.0;
+    double MinMs = 0.0;
+    double MaxMs = 0.0;
+    double TrianglesPerSecond = 0.0;
+    uint64_t Allocations = 0; // per run, measured on the last iteration
+    int64_t PeakHeapBytes = 0; // largest growth over the heap in use before the run
+    long PeakRssKb = -1;
+    // Codec stages only: the raw mesh is 12 bytes per vertex and 4 per index, and the
+    // throughput is of raw mesh bytes, in and out alike.
+    size_t RawBytes = 0;
+    size_t EncodedBytes = 0;
+    double MegabytesPerSecond = 0.0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Runs prepare (untimed) and run (timed) for warmup + iterations rounds. run returns the
+// number of primitives it produced.
+StageResult Measure(
+    const Options& options,
+    const BenchmarkFixture& fixture,
+    const std::string& stage,
+    const std::function<void()>& prepare,
+    const std::function<size_t()>& run) {
+    StageResult result;
+    result.Fixture = fixture.Name;
+    result.Stage = stage;
+    result.InputTriangles = fixture.TriangleCount();
+
+    std::vector<double> times;
+    ResetPeakRss();
+    for (int i = 0; i < options.Warmup + options.Iterations; ++i) {
+        prepare();
+        const int64_t heapBefore = gHeapBytes.load();
+        gPeakHeapBytes.store(heapBefore);
+        const uint64_t allocationsBefore = gAllocationCount.load();
+
+        const auto start = Clock::now();
+        result.OutputPrimitives = run();
+        const auto end = Clock::now();
+
+        if (i < options.Warmup) {
+            continue;
+        }
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        result.Allocations = gAllocationCount.load() - allocationsBefore;
+        result.PeakHeapBytes = std::max(result.PeakHeapBytes, gPeakHeapBytes.load() - heapBefore);
+    }
+    result.PeakRssKb = ReadPeakRssKb();
+
+    std::sort(times.begin(), times.end());
+    result.MinMs = times.front();
+    result.MaxMs = times.back();
+    result.MedianMs = times.size() % 2 == 1
+        ? times[times.size() / 2]
+        : 0.5 * (times[times.size() / 2 - 1] + times[times.size() / 2]);
+    result.TrianglesPerSecond = result.MedianMs > 0.0
+        ? static_cast<double>(result.InputTriangles) / (result.MedianMs * 1e-3)
+        : 0.0;
+    return result;
+}
+
+bool Contains(const std::vector<std::string>& list, const std::string& value) {
+    return std::find(list.begin(), list.end(), value) != list.end();
+}
+
+void SetCodecSizes(StageResult& result, size_t rawBytes, size_t encodedBytes) {
+    result.RawBytes = rawBytes;
+    result.EncodedBytes = encodedBytes;
+    result.MegabytesPerSecond = result.MedianMs > 0.0 ? rawBytes * 1e-6 / (result.MedianMs * 1e-3) : 0.0;
+}
+
+// Whether the decoded mesh is the fixture as MeshCodec promises: the same triangles in
+// the same order, each possibly starting at another corner, with every corner within
+// half a grid step.
+bool MatchesDecoded(
+    const BenchmarkFixture& fixture,
+    const std::vector<XrVector3f>& vertices,
+    const std::vector<uint32_t>& indices,
+    const MeshCodec::Settings& settings) {
+    // The step is Precision for anything the size of a room; the rest is float rounding.
+    const float tolerance = 0.5f * settings.Precision + 1e-5f;
+    if (indices.size() != fixture.TriangleCount() * 3) {
+        return false;
+    }
+    auto near = [&](const XrVector3f& a, const XrVector3f& b) {
+        return std::fabs(a.x - b.x) <= tolerance && std::fabs(a.y - b.y) <= tolerance &&
+            std::fabs(a.z - b.z) <= tolerance;
+    };
+    for (size_t t = 0; t < indices.size(); t += 3) {
+        bool matched = false;
+        for (int r = 0; r < 3 && !matched; ++r) {
+            matched = true;
+            for (int c = 0; c < 3 && matched; ++c) {
+                matched = near(vertices[indices[t + c]], fixture.Vertices[fixture.Indices[t + (c + r) % 3]]);
+            }
+        }
+        if (!matched) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether every edge of the mesh is used by exactly two triangles.
+bool IsClosed(const MeshTopology& topology) {
+    for (uint32_t e = 0; e < topology.EdgeCount(); ++e) {
+        if (topology.EdgeFaceCount(e) != 2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Subdivides a closed fixture with the stage's settings and with four levels around a
+// viewer in the middle of the room, where neighbors differ by the most levels, and
+// checks that the output is still closed: a T-junction leaves edges with one triangle.
+bool AdaptiveSubdivisionIsClosed(
+    const BenchmarkFixture& fixture,
+    const AdaptiveSubdivision::Settings& settings,
+    ThreadPool* pool) {
+    XrVector3f boxMin = fixture.Vertices.front();
+    XrVector3f boxMax = boxMin;
+    for (const XrVector3f& v : fixture.Vertices) {
+        boxMin = {std::min(boxMin.x, v.x), std::min(boxMin.y, v.y), std::min(boxMin.z, v.z)};
+        boxMax = {std::max(boxMax.x, v.x), std::max(boxMax.y, v.y), std::max(boxMax.z, v.z)};
+    }
+    AdaptiveSubdivision::Settings deep = settings;
+    deep.MaxLevels = 4;
+    deep.MinEdgeLength = 0.01f;
+    deep.HasViewer = true;
+    deep.ViewerPosition = {
+        0.5f * (boxMin.x + boxMax.x), 0.5f * (boxMin.y + boxMax.y), 0.5f * (boxMin.z + boxMax.z)};
+
+    const AdaptiveSubdivision::Settings runs[] = {settings, deep};
+    MeshTopology topology;
+    for (const AdaptiveSubdivision::Settings& run : runs) {
+        const auto subdivided = AdaptiveSubdivision::subdivide(fixture.Vertices, fixture.Indices, run, pool);
+        topology.Build(subdivided.second, subdivided.first.size(), pool);
+        if (!IsClosed(topology)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Benchmarks the selected stages on one fixture. Each stage gets the input it sees in
+// ovrMesh::Update; state that the app keeps between updates (the topology, stencils,
+// output vectors) is kept between iterations here too. Returns false when a codec round
+// trip fails or adaptive subdivision opens a closed fixture.
+bool RunFixture(
+    const Options& options,
+    const BenchmarkFixture& fixture,
+    ThreadPool* pool,
+    std::vector<StageResult>& results) {
+    const auto& vertices = fixture.Vertices;
+    const auto& indices = fixture.Indices;
+    auto noPrepare = []() {};
+
+    MeshTopology topology;
+    if (Contains(options.Stages, "topology")) {
+        results.push_back(Measure(options, fixture, "topology", noPrepare, [&]() {
+            topology.Build(indices, vertices.size(), pool);
+            return topology.TriangleCount();
+        }));
+    }
+    topology.Build(indices, vertices.size(), pool);
+
+    if (Contains(options.Stages, "wireframe")) {
+        std::vector<uint32_t> lines;
+        results.push_back(Measure(options, fixture, "wireframe", noPrepare, [&]() {
+            topology.GetEdgeLineIndices(lines);
+            return lines.size() / 2;
+        }));
+    }
+
+    if (Contains(options.Stages, "subdivide_uniform")) {
+        results.push_back(Measure(options, fixture, "subdivide_uniform", noPrepare, [&]() {
+            return LoopSubdivision::subdivide(vertices, indices, 1, pool).second.size() / 3;
+        }));
+    }
+
+    if (Contains(options.Stages, "subdivide_adaptive")) {
+        const AdaptiveSubdivision::Settings settings;
+        results.push_back(Measure(options, fixture, "subdivide_adaptive", noPrepare, [&]() {
+            return AdaptiveSubdivision::subdivide(vertices, indices, settings, pool).second.size() / 3;
+        }));
+        if (IsClosed(topology) && !AdaptiveSubdivisionIsClosed(fixture, settings, pool)) {
+            std::fprintf(stderr, "%s: adaptive subdivision left T-junctions\n", fixture.Name.c_str());
+            return false;
+        }
+    }
+
+    if (Contains(options.Stages, "stencil_apply")) {
+        SubdivisionStencils stencils;
+        const size_t outputTriangles =
+            LoopSubdivision::subdivide(vertices, indices, 1, pool, &stencils).second.size() / 3;
+        std::vector<XrVector3f> refreshed;
+        results.push_back(Measure(options, fixture, "stencil_apply", noPrepare, [&]() {
+            stencils.Apply(vertices.data(), refreshed, pool);
+            return outputTriangles;
+        }));
+    }
+
+    if (Contains(options.Stages, "simplify")) {
+        const MeshSimplification::Settings settings;
+        results.push_back(Measure(options, fixture, "simplify", noPrepare, [&]() {
+            return MeshSimplification::simplify(vertices, indices, settings).second.size() / 3;
+        }));
+    }
+
+    if (Contains(options.Stages, "optimize")) {
+        const MeshOptimization::Settings settings;
+        std::vector<XrVector3f> optimizedVertices;
+        std::vector<uint32_t> optimizedIndices;
+        std::vector<uint32_t> remap;
+        results.push_back(Measure(
+            options,
+            fixture,
+            "optimize",
+            [&]() {
+                optimizedVertices.assign(vertices.begin(), vertices.end());
+                optimizedIndices.assign(indices.begin(), indices.end());
+            },
+            [&]() {
+                MeshOptimization::optimize_triangle_order(optimizedIndices, optimizedVertices, settings);
+                const size_t vertexCount =
+                    MeshOptimization::optimize_vertex_fetch(optimizedIndices, optimizedVertices.size(), remap);
+                MeshOptimization::remap_vertices(optimizedVertices, remap, vertexCount);
+                return optimizedIndices.size() / 3;
+            }));
+    }
+
+    if (Contains(options.Stages, "meshlets")) {
+        const MeshletMesh::Settings settings;
+        MeshletMesh meshlets;
+        results.push_back(Measure(options, fixture, "meshlets", noPrepare, [&]() {
+            meshlets.Build(indices, vertices.size(), topology, settings);
+            meshlets.UpdateBounds(vertices, indices, pool);
+            return meshlets.Indices().size() / 3;
+        }));
+    }
+
+    if (Contains(options.Stages, "meshlet_cull")) {
+        // Both eyes in the middle of the fixture's bounding box, looking along -z with
+        // a 90 degree field of view and an infinite far plane. The matrices are stored
+        // transposed, like the renderer's.
+        OVR::Bounds3f bounds(OVR::Bounds3f::Init);
+        for (const XrVector3f& v : vertices) {
+            bounds.AddPoint(OVR::Vector3f(v.x, v.y, v.z));
+        }
+        const float nearZ = 0.1f;
+        OVR::Matrix4f proj = OVR::Matrix4f::Identity();
+        proj.M[2][2] = -1.0f;
+        proj.M[2][3] = -2.0f * nearZ;
+        proj.M[3][2] = -1.0f;
+        proj.M[3][3] = 0.0f;
+        OVR::Matrix4f view[2];
+        OVR::Matrix4f projections[2];
+        for (int eye = 0; eye < 2; ++eye) {
+            const OVR::Vector3f position = bounds.GetCenter() + OVR::Vector3f(eye == 0 ? -0.032f : 0.032f, 0, 0);
+            view[eye] = OVR::Matrix4f::Translation(-position).Transposed();
+            projections[eye] = proj.Transposed();
+        }
+        StereoFrustum frustum;
+        frustum.Set(view, projections);
+
+        const MeshletMesh::Settings settings;
+        MeshletMesh meshlets;
+        meshlets.Build(indices, vertices.size(), topology, settings);
+        meshlets.UpdateBounds(vertices, indices, pool);
+        std::vector<uint8_t> visible;
+        results.push_back(Measure(options, fixture, "meshlet_cull", noPrepare, [&]() {
+            frustum.CullMeshlets(meshlets, OVR::Posef(), 0.015f, 0.0f, true, visible);
+            size_t triangles = 0;
+            for (size_t m = 0; m < visible.size(); ++m) {
+                triangles += visible[m] ? meshlets.Meshlets()[m].TriangleCount : 0;
+            }
+            return triangles;
+        }));
+    }
+
+    if (Contains(options.Stages, "quantize")) {
+        QuantizedPositions quantized;
+        results.push_back(Measure(options, fixture, "quantize", noPrepare, [&]() {
+            quantized.Quantize(vertices.data(), vertices.size());
+            return indices.size() / 3;
+        }));
+    }
+
+    if (Contains(options.Stages, "expand")) {
+        std::vector<XrVector3f> expanded;
+        results.push_back(Measure(
+            options,
+            fixture,
+            "expand",
+            [&]() { expanded.assign(vertices.begin(), vertices.end()); },
+            [&]() {
+                LoopSubdivision::expand_mesh(expanded, topology, indices, 0.015f, pool);
+                return indices.size() / 3;
+            }));
+    }
+
+    if (Contains(options.Stages, "vertex_normals")) {
+        std::vector<XrVector3f> normals;
+        results.push_back(Measure(options, fixture, "vertex_normals", noPrepare, [&]() {
+            LoopSubdivision::compute_vertex_normals(vertices, topology, indices, normals, pool);
+            return indices.size() / 3;
+        }));
+    }
+
+    if (Contains(options.Stages, "encode") || Contains(options.Stages, "decode")) {
+        const MeshCodec::Settings settings;
+        const size_t rawBytes = vertices.size() * sizeof(XrVector3f) + indices.size() * sizeof(uint32_t);
+        std::vector<uint8_t> encoded;
+        if (!MeshCodec::Encode(vertices, indices, settings, encoded)) {
+            std::fprintf(stderr, "%s: mesh could not be encoded\n", fixture.Name.c_str());
+            return false;
+        }
+
+        if (Contains(options.Stages, "encode")) {
+            std::vector<uint8_t> output;
+            StageResult result = Measure(
+                options, fixture, "encode", [&]() { output.clear(); }, [&]() {
+                    MeshCodec::Encode(vertices, indices, settings, output);
+                    return indices.size() / 3;
+                });
+            SetCodecSizes(result, rawBytes, output.size());
+            results.push_back(result);
+        }
+
+        std::vector<XrVector3f> decodedVertices;
+        std::vector<uint32_t> decodedIndices;
+        if (Contains(options.Stages, "decode")) {
+            StageResult result = Measure(options, fixture, "decode", noPrepare, [&]() {
+                MeshCodec::Decode(encoded.data(), encoded.size(), decodedVertices, decodedIndices);
+                return decodedIndices.size() / 3;
+            });
+            SetCodecSizes(result, rawBytes, encoded.size());
+            results.push_back(result);
+        }
+        if (!MeshCodec::Decode(encoded.data(), encoded.size(), decodedVertices, decodedIndices) ||
+            !MatchesDecoded(fixture, decodedVertices, decodedIndices, settings)) {
+            std::fprintf(stderr, "%s: decoded mesh does not match\n", fixture.Name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+================================================================================
+
+Output
+
+================================================================================
+*/
+
+std::string JsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void WriteJson(std::ostream& out, const Options& options, int threadCount, const std::vector<StageResult>& results) {
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    char number[64];
+    out << "{\n";
+    out << "  \"benchmark\": \"XrMeshOcclusion\",\n";
+    out << "  \"format_version\": 1,\n";
+    out << "  \"label\": " << JsonString(options.Label) << ",\n";
+    out << "  \"timestamp\": " << static_cast<long long>(std::time(nullptr)) << ",\n";
+    out << "  \"threads\": " << threadCount << ",\n";
+    out << "  \"iterations\": " << options.Iterations << ",\n";
+    out << "  \"max_rss_kb\": " << usage.ru_maxrss << ",\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const StageResult& r = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\"fixture\": " << JsonString(r.Fixture) << ", \"stage\": " << JsonString(r.Stage);
+        out << ", \"input_triangles\": " << r.InputTriangles;
+        out << ", \"output_primitives\": " << r.OutputPrimitives;
+        std::snprintf(number, sizeof(number), "%.4f", r.MedianMs);
+        out << ", \"median_ms\": " << number;
+        std::snprintf(number, sizeof(number), "%.4f", r.MinMs);
+        out << ", \"min_ms\": " << number;
+        std::snprintf(number, sizeof(number), "%.4f", r.MaxMs);
+        out << ", \"max_ms\": " << number;
+        std::snprintf(number, sizeof(number), "%.0f", r.TrianglesPerSecond);
+        out << ", \"triangles_per_second\": " << number;
+        out << ", \"allocations\": " << r.Allocations;
+        out << ", \"peak_heap_bytes\": " << r.PeakHeapBytes;
+        out << ", \"peak_rss_kb\": " << r.PeakRssKb;
+        out << ", \"raw_bytes\": " << r.RawBytes;
+        out << ", \"encoded_bytes\": " << r.EncodedBytes;
+        std::snprintf(number, sizeof(number), "%.1f", r.MegabytesPerSecond);
+        out << ", \"megabytes_per_second\": " << number << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void WriteCsv(std::ostream& out, const Options& options, int threadCount, const std::vector<StageResult>& results) {
+    out << "label,threads,fixture,stage,input_triangles,output_primitives,median_ms,min_ms,max_ms,"
+           "triangles_per_second,allocations,peak_heap_bytes,peak_rss_kb,raw_bytes,encoded_bytes,"
+           "megabytes_per_second\n";
+    char line[512];
+    for (const StageResult& r : results) {
+        std::snprintf(
+            line,
+            sizeof(line),
+            "%s,%d,%s,%s,%zu,%zu,%.4f,%.4f,%.4f,%.0f,%llu,%lld,%ld,%zu,%zu,%.1f\n",
+            options.Label.c_str(),
+            threadCount,
+            r.Fixture.c_str(),
+            r.Stage.c_str(),
+            r.InputTriangles,
+            r.OutputPrimitives,
+            r.MedianMs,
+            r.MinMs,
+            r.MaxMs,
+            r.TrianglesPerSecond,
+            static_cast<unsigned long long>(r.Allocations),
+            static_cast<long long>(r.PeakHeapBytes),
+            r.PeakRssKb,
+            r.RawBytes,
+            r.EncodedBytes,
+            r.MegabytesPerSecond);
+        out << line;
+    }
+}
+
+std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+void PrintUsage(FILE* out) {
+    std::fprintf(
+        out,
+        "Usage: meshocclusion_benchmark [--fixtures box_room,cluttered_room,room_scan_1m]\n"
+        "                               [--obj recorded_room.obj]... [--trace room.xrtrace]...\n"
+        "                               [--stages topology,expand,...]\n"
+        "                               [--iterations 5] [--warmup 1] [--threads 1]\n"
+        "                               [--format json|csv] [--label <version>] [--output <file>]\n"
+        "\nStages:");
+    for (const std::string& stage : kStages) {
+        std::fprintf(out, " %s", stage.c_str());
+    }
+    std::fprintf(out, "\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    bool clearedFixtures = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            options.Help = true;
+            return true;
+        }
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--fixtures") {
+            options.Fixtures = SplitList(value);
+            clearedFixtures = true;
+        } else if (arg == "--obj" || arg == "--trace") {
+            // Recorded meshes replace the default fixtures unless --fixtures is given too.
+            if (!clearedFixtures) {
+                options.Fixtures.clear();
+                clearedFixtures = true;
+            }
+            (arg == "--obj" ? options.ObjFiles : options.TraceFiles).push_back(value);
+        } else if (arg == "--stages") {
+            options.Stages = SplitList(value);
+        } else if (arg == "--iterations") {
+            options.Iterations = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--warmup") {
+            options.Warmup = std::max(0, std::atoi(value.c_str()));
+        } else if (arg == "--threads") {
+            options.Threads = std::atoi(value.c_str());
+        } else if (arg == "--format") {
+            options.Format = value;
+        } else if (arg == "--label") {
+            options.Label = value;
+        } else if (arg == "--output") {
+            options.Output = value;
+        } else {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    if (options.Format != "json" && options.Format != "csv") {
+        std::fprintf(stderr, "Unknown format %s\n", options.Format.c_str());
+        return false;
+    }
+    // A misspelled stage would otherwise run nothing and still succeed.
+    if (options.Stages.empty()) {
+        std::fprintf(stderr, "No stages given\n");
+        return false;
+    }
+    for (const std::string& stage : options.Stages) {
+        if (!Contains(kStages, stage)) {
+            std::fprintf(stderr, "Unknown stage %s\n", stage.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(stderr);
+        return 2;
+    }
+    if (options.Help) {
+        PrintUsage(stdout);
+        return 0;
+    }
+
+    // --threads 1 (the default) runs every stage on the calling thread for numbers that
+    // are comparable across machines; 0 uses all hardware threads.
+    std::unique_ptr<ThreadPool> pool;
+    if (options.Threads != 1) {
+        pool.reset(new ThreadPool(options.Threads > 1 ? options.Threads - 1 : -1));
+    }
+    const int threadCount = pool ? pool->ThreadCount() : 1;
+
+    std::vector<StageResult> results;
+    for (const std::string& name : options.Fixtures) {
+        BenchmarkFixture fixture;
+        if (name == "box_room") {
+            fixture = BenchmarkFixtures::MakeBoxRoom();
+        } else if (name == "cluttered_room") {
+            fixture = BenchmarkFixtures::MakeClutteredRoom();
+        } else if (name == "room_scan_1m") {
+            fixture = BenchmarkFixtures::MakeRoomScan(1000000);
+        } else {
+            std::fprintf(stderr, "Unknown fixture %s\n", name.c_str());
+            return 2;
+        }
+        std::fprintf(stderr, "%s: %zu vertices, %zu triangles\n", fixture.Name.c_str(), fixture.Vertices.size(), fixture.TriangleCount());
+        if (!RunFixture(options, fixture, pool.get(), results)) {
+            return 1;
+        }
+    }
+    std::vector<BenchmarkFixture> recorded;
+    for (const std::string& path : options.ObjFiles) {
+        recorded.emplace_back();
+        if (!BenchmarkFixtures::LoadObj(path, recorded.back())) {
+            std::fprintf(stderr, "Could not load %s\n", path.c_str());
+            return 1;
+        }
+    }
+    for (const std::string& path : options.TraceFiles) {
+        if (!BenchmarkFixtures::LoadSceneTrace(path, recorded)) {
+            std::fprintf(stderr, "Could not load room meshes from %s\n", path.c_str());
+            return 1;
+        }
+    }
+    for (const BenchmarkFixture& fixture : recorded) {
+        std::fprintf(stderr, "%s: %zu vertices, %zu triangles\n", fixture.Name.c_str(), fixture.Vertices.size(), fixture.TriangleCount());
+        if (!RunFixture(options, fixture, pool.get(), results)) {
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!options.Output.empty()) {
+        file.open(options.Output);
+        if (!file) {
+            std::fprintf(stderr, "Could not open %s\n", options.Output.c_str());
+            return 1;
+        }
+    }
+    std::ostream& out = options.Output.empty() ? std::cout : file;
+    if (options.Format == "csv") {
+        WriteCsv(out, options, threadCount, results);
+    } else {
+        WriteJson(out, options, threadCount, results);
+    }
+    return 0;
+}
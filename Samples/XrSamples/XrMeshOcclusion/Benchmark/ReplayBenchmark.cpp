@@ -0,0 +1,730 @@
+// Whole-scene replay benchmark (Linux).
+//
+// Replays a recorded scene trace through the sample's scene code on a headless GL
+// context: the spaces are queried, made locatable and added like SceneSharingXr.cpp
+// does, through the runtime functions it loads, which ReplayRuntime answers from the
+// trace. Meshes go through MeshPipeline and are committed within the per-frame upload
+// budget; then every frame of the trace is run: anchors located, poses and levels of
+// detail updated, and the environment depth image acquired and uploaded. Reports the
+// time to the first occluder mesh on the GPU, the time to the whole scene, frame times
+// and the runtime calls per frame, as JSON or CSV.
+//
+//   meshocclusion_replay --trace room.xrtrace [--frames 0] [--fps 72] [--threads 0]
+//                        [--upload-budget 4194304] [--mesh-cache <dir>]
+//                        [--format json|csv] [--label <version>] [--output <file>]
+//
+// --frames 0 (the default) runs as many frames as the trace spans at --fps. With
+// --mesh-cache, processed meshes are kept in that directory between runs like the app
+// keeps them in its data directory, so a second run of a trace measures a warm start;
+// the load then ends once every mesh is drawn, and the runtime meshes are checked against
+// the cache after that on the pipeline thread. Exits with 1
+// when the trace cannot be replayed or no GL context can be made, so a CI job can run it
+// as a regression test.
+//
+// The sample renders both eyes at once with GL_OVR_multiview2, which software GL
+// drivers do not have, so the stereo draw itself is not replayed.
+
+#include "AnchorLocator.h"
+#include "HeadlessGl.h"
+#include "MeshPipeline.h"
+#include "ProcessedMeshCache.h"
+#include "ReplayRuntime.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string Trace;
+    int Frames = 0;
+    double Fps = 72.0;
+    int Threads = 0;
+    size_t UploadBudget = 4 << 20;
+    std::string MeshCache;
+    std::string Format = "json";
+    std::string Label;
+    std::string Output;
+};
+
+struct ReplayResult {
+    std::string Renderer;
+    int Threads = 1;
+    size_t Spaces = 0;
+    size_t Planes = 0;
+    size_t Volumes = 0;
+    size_t Meshes = 0;
+    size_t MeshTriangles = 0; // processed, level 0
+    size_t CachedMeshes = 0; // drawn from the mesh cache first
+    double FirstOcclusionMs = -1.0;
+    double SceneLoadMs = 0.0;
+    int LoadFrames = 0;
+    int Frames = 0;
+    double FrameMedianMs = 0.0;
+    double FrameP95Ms = 0.0;
+    double FrameMaxMs = 0.0;
+    uint64_t DepthImages = 0;
+    ReplayRuntime::Counters LoadCalls;
+    ReplayRuntime::Counters FrameCalls;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double MillisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// The runtime functions the sample loads, from the replay.
+struct ReplayFunctions {
+    PFN_xrQuerySpacesFB xrQuerySpacesFB = nullptr;
+    PFN_xrRetrieveSpaceQueryResultsFB xrRetrieveSpaceQueryResultsFB = nullptr;
+    PFN_xrGetSpaceComponentStatusFB xrGetSpaceComponentStatusFB = nullptr;
+    PFN_xrGetSpaceUuidFB xrGetSpaceUuidFB = nullptr;
+    PFN_xrSetSpaceComponentStatusFB xrSetSpaceComponentStatusFB = nullptr;
+    PFN_xrGetSpaceBoundary2DFB xrGetSpaceBoundary2DFB = nullptr;
+    PFN_xrGetSpaceBoundingBox3DFB xrGetSpaceBoundingBox3DFB = nullptr;
+    PFN_xrGetSpaceTriangleMeshMETA xrGetSpaceTriangleMeshMETA = nullptr;
+#if defined(XR_KHR_locate_spaces)
+    PFN_xrLocateSpacesKHR xrLocateSpacesKHR = nullptr;
+#endif
+#if defined(XR_META_environment_depth)
+    PFN_xrAcquireEnvironmentDepthImageMETA xrAcquireEnvironmentDepthImageMETA = nullptr;
+#endif
+};
+
+template <typename Function>
+bool LoadFunction(XrInstance instance, const char* name, Function& function) {
+    return XR_SUCCEEDED(
+        xrGetInstanceProcAddr(instance, name, reinterpret_cast<PFN_xrVoidFunction*>(&function)));
+}
+
+bool LoadFunctions(XrInstance instance, ReplayFunctions& functions) {
+    bool loaded = LoadFunction(instance, "xrQuerySpacesFB", functions.xrQuerySpacesFB) &&
+        LoadFunction(instance, "xrRetrieveSpaceQueryResultsFB", functions.xrRetrieveSpaceQueryResultsFB) &&
+        LoadFunction(instance, "xrGetSpaceComponentStatusFB", functions.xrGetSpaceComponentStatusFB) &&
+        LoadFunction(instance, "xrGetSpaceUuidFB", functions.xrGetSpaceUuidFB) &&
+        LoadFunction(instance, "xrSetSpaceComponentStatusFB", functions.xrSetSpaceComponentStatusFB) &&
+        LoadFunction(instance, "xrGetSpaceBoundary2DFB", functions.xrGetSpaceBoundary2DFB) &&
+        LoadFunction(instance, "xrGetSpaceBoundingBox3DFB", functions.xrGetSpaceBoundingBox3DFB) &&
+        LoadFunction(instance, "xrGetSpaceTriangleMeshMETA", functions.xrGetSpaceTriangleMeshMETA);
+#if defined(XR_KHR_locate_spaces)
+    loaded = loaded && LoadFunction(instance, "xrLocateSpacesKHR", functions.xrLocateSpacesKHR);
+#endif
+#if defined(XR_META_environment_depth)
+    loaded = loaded &&
+        LoadFunction(
+                 instance,
+                 "xrAcquireEnvironmentDepthImageMETA",
+                 functions.xrAcquireEnvironmentDepthImageMETA);
+#endif
+    return loaded;
+}
+
+bool IsComponentEnabled(const ReplayFunctions& functions, XrSpace space, XrSpaceComponentTypeFB type) {
+    XrSpaceComponentStatusFB status = {XR_TYPE_SPACE_COMPONENT_STATUS_FB, nullptr};
+    return XR_SUCCEEDED(functions.xrGetSpaceComponentStatusFB(space, type, &status)) &&
+        status.enabled && !status.changePending;
+}
+
+// FetchOvrMesh of SceneSharingXr.cpp
+bool FetchMesh(
+    const ReplayFunctions& functions,
+    XrSpace space,
+    std::vector<XrVector3f>& vertices,
+    std::vector<uint32_t>& indices) {
+    const XrSpaceTriangleMeshGetInfoMETA getInfo = {XR_TYPE_SPACE_TRIANGLE_MESH_GET_INFO_META};
+    XrSpaceTriangleMeshMETA triangleMesh = {XR_TYPE_SPACE_TRIANGLE_MESH_META};
+    if (XR_FAILED(functions.xrGetSpaceTriangleMeshMETA(space, &getInfo, &triangleMesh))) {
+        return false;
+    }
+    vertices.resize(triangleMesh.vertexCountOutput);
+    indices.resize(triangleMesh.indexCountOutput);
+    triangleMesh.vertexCapacityInput = vertices.size();
+    triangleMesh.vertices = vertices.data();
+    triangleMesh.indexCapacityInput = indices.size();
+    triangleMesh.indices = indices.data();
+    if (XR_FAILED(functions.xrGetSpaceTriangleMeshMETA(space, &getInfo, &triangleMesh))) {
+        return false;
+    }
+    vertices.resize(triangleMesh.vertexCountOutput);
+    indices.resize(triangleMesh.indexCountOutput);
+    return true;
+}
+
+// The scene as SceneSharingXr.cpp builds it, without the programs that need multiview.
+struct ReplayScene {
+    std::vector<ovrPlane> Planes;
+    std::vector<ovrVolume> Volumes;
+    std::vector<ovrMesh> Meshes;
+    size_t PendingMeshes = 0;
+
+    void Destroy() {
+        for (auto& plane : Planes) {
+            plane.Geometry.DestroyVAO();
+            plane.Geometry.Destroy();
+        }
+        Planes.clear();
+        for (auto& volume : Volumes) {
+            volume.Geometry.DestroyVAO();
+            volume.Geometry.Destroy();
+        }
+        Volumes.clear();
+        for (auto& mesh : Meshes) {
+            mesh.DestroyGeometry();
+        }
+        Meshes.clear();
+        ovrGeometry::VertexBuffers().Destroy();
+        ovrGeometry::IndexBuffers().Destroy();
+    }
+};
+
+// AddSpaceToScene of SceneSharingXr.cpp, with one color for every plane and volume.
+void AddSpace(
+    const ReplayFunctions& functions,
+    ReplayRuntime& replay,
+    XrSpace space,
+    const ovrMeshProcessingSettings& settings,
+    MeshPipeline& pipeline,
+    AnchorLocator& anchors,
+    ReplayScene& scene) {
+    const XrColor4f color = {0.5f, 0.5f, 0.5f, 1.0f};
+    if (IsComponentEnabled(functions, space, XR_SPACE_COMPONENT_TYPE_BOUNDED_2D_FB)) {
+        XrBoundary2DFB boundary2D = {XR_TYPE_BOUNDARY_2D_FB, nullptr, 0};
+        if (XR_SUCCEEDED(functions.xrGetSpaceBoundary2DFB(replay.Session(), space, &boundary2D))) {
+            std::vector<XrVector2f> vertices(boundary2D.vertexCountOutput);
+            boundary2D.vertexCapacityInput = vertices.size();
+            boundary2D.vertices = vertices.data();
+            if (XR_SUCCEEDED(functions.xrGetSpaceBoundary2DFB(replay.Session(), space, &boundary2D))) {
+                ovrPlane plane(space);
+                plane.Update(boundary2D, color);
+                scene.Planes.emplace_back(plane);
+                anchors.Track(space);
+            }
+        }
+    }
+    if (IsComponentEnabled(functions, space, XR_SPACE_COMPONENT_TYPE_BOUNDED_3D_FB)) {
+        XrRect3DfFB boundingBox3D;
+        if (XR_SUCCEEDED(functions.xrGetSpaceBoundingBox3DFB(replay.Session(), space, &boundingBox3D))) {
+            ovrVolume volume(space);
+            volume.Update(boundingBox3D, color);
+            scene.Volumes.emplace_back(volume);
+            anchors.Track(space);
+        }
+    }
+    if (IsComponentEnabled(functions, space, XR_SPACE_COMPONENT_TYPE_TRIANGLE_MESH_META)) {
+        XrUuidEXT uuid = {};
+        const bool hasUuid = XR_SUCCEEDED(functions.xrGetSpaceUuidFB(space, &uuid));
+        pipeline.Submit(space, settings, nullptr, hasUuid ? &uuid : nullptr);
+        scene.PendingMeshes++;
+    }
+}
+
+// HandleXrEvents of SceneSharingXr.cpp, for the events a scene load raises. Returns
+// whether the query completed.
+bool HandleEvents(
+    const ReplayFunctions& functions,
+    ReplayRuntime& replay,
+    const ovrMeshProcessingSettings& settings,
+    MeshPipeline& pipeline,
+    AnchorLocator& anchors,
+    ReplayScene& scene) {
+    bool queryComplete = false;
+    XrEventDataBuffer eventData = {XR_TYPE_EVENT_DATA_BUFFER};
+    while (xrPollEvent(replay.Instance(), &eventData) == XR_SUCCESS) {
+        const auto* header = reinterpret_cast<const XrEventDataBaseHeader*>(&eventData);
+        if (header->type == XR_TYPE_EVENT_DATA_SPACE_QUERY_RESULTS_AVAILABLE_FB) {
+            const auto* available =
+                reinterpret_cast<const XrEventDataSpaceQueryResultsAvailableFB*>(&eventData);
+            XrSpaceQueryResultsFB queryResults = {XR_TYPE_SPACE_QUERY_RESULTS_FB};
+            if (XR_FAILED(functions.xrRetrieveSpaceQueryResultsFB(
+                    replay.Session(), available->requestId, &queryResults))) {
+                continue;
+            }
+            std::vector<XrSpaceQueryResultFB> results(queryResults.resultCountOutput);
+            queryResults.resultCapacityInput = results.size();
+            queryResults.results = results.data();
+            if (XR_FAILED(functions.xrRetrieveSpaceQueryResultsFB(
+                    replay.Session(), available->requestId, &queryResults))) {
+                continue;
+            }
+            for (const XrSpaceQueryResultFB& result : results) {
+                // HandleReceivedSpace: spaces that are locatable already are added at once.
+                XrSpaceComponentStatusSetInfoFB request = {
+                    XR_TYPE_SPACE_COMPONENT_STATUS_SET_INFO_FB,
+                    nullptr,
+                    XR_SPACE_COMPONENT_TYPE_LOCATABLE_FB,
+                    XR_TRUE,
+                    0};
+                XrAsyncRequestIdFB requestId;
+                if (functions.xrSetSpaceComponentStatusFB(result.space, &request, &requestId) ==
+                    XR_ERROR_SPACE_COMPONENT_STATUS_ALREADY_SET_FB) {
+                    AddSpace(functions, replay, result.space, settings, pipeline, anchors, scene);
+                }
+            }
+        } else if (header->type == XR_TYPE_EVENT_DATA_SPACE_SET_STATUS_COMPLETE_FB) {
+            const auto* complete =
+                reinterpret_cast<const XrEventDataSpaceSetStatusCompleteFB*>(&eventData);
+            if (complete->result == XR_SUCCESS &&
+                complete->componentType == XR_SPACE_COMPONENT_TYPE_LOCATABLE_FB) {
+                AddSpace(functions, replay, complete->space, settings, pipeline, anchors, scene);
+            }
+        } else if (header->type == XR_TYPE_EVENT_DATA_SPACE_QUERY_COMPLETE_FB) {
+            queryComplete = true;
+        }
+        eventData = {XR_TYPE_EVENT_DATA_BUFFER};
+    }
+    return queryComplete;
+}
+
+// CommitSceneMeshes of SceneSharingXr.cpp. Returns the meshes committed. A space stops
+// pending with its first mesh, which may come from the cache and be followed by the
+// runtime's.
+size_t CommitMeshes(
+    MeshPipeline& pipeline,
+    size_t uploadBudget,
+    AnchorLocator& anchors,
+    ReplayScene& scene,
+    ReplayResult& result) {
+    std::vector<MeshPipeline::Result> results;
+    pipeline.TakeCompleted(uploadBudget, results);
+    for (MeshPipeline::Result& mesh : results) {
+        auto existing = std::find_if(scene.Meshes.begin(), scene.Meshes.end(), [&mesh](const ovrMesh& m) {
+            return m.Space == mesh.Space;
+        });
+        if (existing == scene.Meshes.end()) {
+            scene.Meshes.emplace_back(mesh.Space);
+            existing = scene.Meshes.end() - 1;
+            anchors.Track(mesh.Space);
+            scene.PendingMeshes--;
+        }
+        if (mesh.FromCache) {
+            result.CachedMeshes++;
+        }
+        existing->Commit(std::move(mesh.Mesh));
+    }
+    return results.size();
+}
+
+// The environment depth texture the occlusion shaders sample, as the runtime's swapchain
+// images: one two-layer array per image.
+struct DepthTextures {
+    GLuint Textures[ReplayRuntime::kDepthSwapchainLength] = {};
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+
+    void Upload(uint32_t index, const uint16_t* texels, uint32_t width, uint32_t height) {
+        if (width != Width || height != Height) {
+            Destroy();
+            glGenTextures(ReplayRuntime::kDepthSwapchainLength, Textures);
+            for (GLuint texture : Textures) {
+                glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+                glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT16, width, height, 2);
+            }
+            Width = width;
+            Height = height;
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, Textures[index]);
+        glTexSubImage3D(
+            GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, width, height, 2, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, texels);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    void Destroy() {
+        if (Width != 0) {
+            glDeleteTextures(ReplayRuntime::kDepthSwapchainLength, Textures);
+        }
+        Width = 0;
+        Height = 0;
+    }
+};
+
+ReplayRuntime::Counters Subtract(const ReplayRuntime::Counters& a, const ReplayRuntime::Counters& b) {
+    ReplayRuntime::Counters c;
+    c.QuerySpaces = a.QuerySpaces - b.QuerySpaces;
+    c.RetrieveQueryResults = a.RetrieveQueryResults - b.RetrieveQueryResults;
+    c.ComponentCalls = a.ComponentCalls - b.ComponentCalls;
+    c.GetTriangleMesh = a.GetTriangleMesh - b.GetTriangleMesh;
+    c.GetBoundary2D = a.GetBoundary2D - b.GetBoundary2D;
+    c.GetBoundingBox = a.GetBoundingBox - b.GetBoundingBox;
+    c.GetSemanticLabels = a.GetSemanticLabels - b.GetSemanticLabels;
+    c.LocateSpace = a.LocateSpace - b.LocateSpace;
+    c.LocateSpaces = a.LocateSpaces - b.LocateSpaces;
+    c.LocatedSpaces = a.LocatedSpaces - b.LocatedSpaces;
+    c.AcquireDepthImage = a.AcquireDepthImage - b.AcquireDepthImage;
+    c.PollEvent = a.PollEvent - b.PollEvent;
+    return c;
+}
+
+bool Replay(const Options& options, ReplayResult& result) {
+    ReplayRuntime replay;
+    if (!replay.Open(options.Trace)) {
+        std::fprintf(stderr, "Could not replay %s: %s\n", options.Trace.c_str(), replay.Error().c_str());
+        return false;
+    }
+    HeadlessGl gl;
+    if (!gl.Create()) {
+        std::fprintf(stderr, "No GL context: %s\n", gl.Error().c_str());
+        return false;
+    }
+    result.Renderer = gl.Renderer();
+
+    ReplayFunctions functions;
+    if (!LoadFunctions(replay.Instance(), functions)) {
+        std::fprintf(stderr, "The replay runtime is missing a function the sample loads\n");
+        return false;
+    }
+
+    // --threads 0 (the default) uses all hardware threads, like the app; 1 processes on
+    // the pipeline thread alone.
+    std::unique_ptr<ThreadPool> pool;
+    if (options.Threads != 1) {
+        pool.reset(new ThreadPool(options.Threads > 1 ? options.Threads - 1 : -1));
+    }
+    result.Threads = pool ? pool->ThreadCount() : 1;
+
+    // No scene programs here, so meshes draw from their own buffers.
+    ovrMeshProcessingSettings settings;
+    settings.MergeOccluders = false;
+
+    AnchorLocator anchors;
+#if defined(XR_KHR_locate_spaces)
+    anchors.SetLocateSpaces(functions.xrLocateSpacesKHR);
+#endif
+    ReplayScene scene;
+    std::unique_ptr<ProcessedMeshCache> cache;
+    if (!options.MeshCache.empty()) {
+        std::string directory = options.MeshCache;
+        if (directory.back() != '/') {
+            directory += '/';
+        }
+        cache.reset(new ProcessedMeshCache(directory));
+    }
+    {
+        MeshPipeline pipeline(
+            [&functions](XrSpace space, std::vector<XrVector3f>& vertices, std::vector<uint32_t>& indices) {
+                return FetchMesh(functions, space, vertices, indices);
+            },
+            pool.get(),
+            cache.get());
+
+        // Load: QueryAllAnchors, then a frame loop until every mesh is on the GPU.
+        const XrDuration framePeriod = static_cast<XrDuration>(1e9 / options.Fps);
+        const auto loadStart = Clock::now();
+        XrSpaceQueryInfoFB queryInfo = {
+            XR_TYPE_SPACE_QUERY_INFO_FB, nullptr, XR_SPACE_QUERY_ACTION_LOAD_FB, 1000, 0, nullptr, nullptr};
+        XrAsyncRequestIdFB requestId;
+        if (XR_FAILED(functions.xrQuerySpacesFB(
+                replay.Session(), reinterpret_cast<XrSpaceQueryInfoBaseHeaderFB*>(&queryInfo), &requestId))) {
+            std::fprintf(stderr, "xrQuerySpacesFB failed\n");
+            return false;
+        }
+        bool queryComplete = false;
+        while (!queryComplete || scene.PendingMeshes > 0) {
+            queryComplete |= HandleEvents(functions, replay, settings, pipeline, anchors, scene);
+            if (CommitMeshes(pipeline, options.UploadBudget, anchors, scene, result) > 0) {
+                glFinish();
+                if (result.FirstOcclusionMs < 0.0) {
+                    result.FirstOcclusionMs = MillisecondsSince(loadStart);
+                }
+            }
+            result.LoadFrames++;
+            if (scene.PendingMeshes > 0) {
+                // A frame at the replay's pace while the pipeline works.
+                std::this_thread::sleep_for(std::chrono::nanoseconds(framePeriod));
+            }
+        }
+        result.SceneLoadMs = MillisecondsSince(loadStart);
+    }
+    result.LoadCalls = replay.GetCounters();
+    result.Spaces = replay.Spaces().size();
+    result.Planes = scene.Planes.size();
+    result.Volumes = scene.Volumes.size();
+    result.Meshes = scene.Meshes.size();
+    for (const ovrMesh& mesh : scene.Meshes) {
+        for (const MeshletMesh::Meshlet& meshlet : mesh.Level(0).Meshlets.Meshlets()) {
+            result.MeshTriangles += meshlet.TriangleCount;
+        }
+    }
+
+    // Frames: the scene anchors, poses and levels of detail, and environment depth.
+    const XrDuration framePeriod = static_cast<XrDuration>(1e9 / options.Fps);
+    int frames = options.Frames;
+    if (frames <= 0) {
+        frames = 1 + static_cast<int>((replay.EndTime() - replay.StartTime()) / framePeriod);
+    }
+    DepthTextures depth;
+    std::vector<double> frameMs;
+    frameMs.reserve(frames);
+    const ReplayRuntime::Counters beforeFrames = replay.GetCounters();
+    for (int frame = 0; frame < frames; ++frame) {
+        const XrTime time = replay.StartTime() + frame * framePeriod;
+        replay.SetTime(time);
+        const auto frameStart = Clock::now();
+
+        anchors.Update(replay.Session(), replay.LocalSpace(), time);
+        for (auto& plane : scene.Planes) {
+            const AnchorLocator::Location* location = anchors.Find(plane.Space);
+            if (location != nullptr && location->IsValid) {
+                plane.SetPose(location->Pose);
+            }
+        }
+        for (auto& volume : scene.Volumes) {
+            const AnchorLocator::Location* location = anchors.Find(volume.Space);
+            if (location != nullptr && location->IsValid) {
+                volume.SetPose(location->Pose);
+            }
+        }
+        XrSpaceLocation head = {XR_TYPE_SPACE_LOCATION};
+        xrLocateSpace(replay.HeadSpace(), replay.LocalSpace(), time, &head);
+        const OVR::Vector3f viewPosition(head.pose.position.x, head.pose.position.y, head.pose.position.z);
+        for (auto& mesh : scene.Meshes) {
+            const AnchorLocator::Location* location = anchors.Find(mesh.Space);
+            if (location != nullptr && location->IsValid) {
+                mesh.SetPose(location->Pose);
+            }
+            mesh.SelectLod(viewPosition);
+        }
+
+#if defined(XR_META_environment_depth)
+        XrEnvironmentDepthImageAcquireInfoMETA acquireInfo = {
+            XR_TYPE_ENVIRONMENT_DEPTH_IMAGE_ACQUIRE_INFO_META};
+        acquireInfo.space = replay.LocalSpace();
+        acquireInfo.displayTime = time;
+        XrEnvironmentDepthImageMETA depthImage = {XR_TYPE_ENVIRONMENT_DEPTH_IMAGE_META};
+        depthImage.views[0].type = XR_TYPE_ENVIRONMENT_DEPTH_IMAGE_VIEW_META;
+        depthImage.views[1].type = XR_TYPE_ENVIRONMENT_DEPTH_IMAGE_VIEW_META;
+        if (functions.xrAcquireEnvironmentDepthImageMETA(
+                replay.DepthProvider(), &acquireInfo, &depthImage) == XR_SUCCESS) {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            const uint16_t* texels = replay.DepthImage(depthImage.swapchainIndex, width, height);
+            if (texels != nullptr) {
+                depth.Upload(depthImage.swapchainIndex, texels, width, height);
+                result.DepthImages++;
+            }
+        }
+#endif
+        glFinish();
+        frameMs.push_back(MillisecondsSince(frameStart));
+    }
+    result.FrameCalls = Subtract(replay.GetCounters(), beforeFrames);
+    result.Frames = frames;
+    if (!frameMs.empty()) {
+        std::sort(frameMs.begin(), frameMs.end());
+        result.FrameMedianMs = frameMs[frameMs.size() / 2];
+        result.FrameP95Ms = frameMs[std::min(frameMs.size() - 1, frameMs.size() * 95 / 100)];
+        result.FrameMaxMs = frameMs.back();
+    }
+
+    depth.Destroy();
+    scene.Destroy();
+    return true;
+}
+
+/*
+================================================================================
+
+Output
+
+================================================================================
+*/
+
+std::string JsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void WriteCalls(std::ostream& out, const ReplayRuntime::Counters& calls, int frames) {
+    const double perFrame = frames > 0 ? 1.0 / frames : 0.0;
+    char line[512];
+    std::snprintf(
+        line,
+        sizeof(line),
+        "{\"query_spaces\": %llu, \"retrieve_query_results\": %llu, \"component_calls\": %llu, "
+        "\"get_triangle_mesh\": %llu, \"get_boundary_2d\": %llu, \"get_bounding_box\": %llu, "
+        "\"get_semantic_labels\": %llu, \"locate_space\": %llu, \"locate_spaces\": %llu, "
+        "\"located_spaces\": %llu, \"located_spaces_per_frame\": %.2f, "
+        "\"acquire_depth_image\": %llu, \"poll_event\": %llu}",
+        static_cast<unsigned long long>(calls.QuerySpaces),
+        static_cast<unsigned long long>(calls.RetrieveQueryResults),
+        static_cast<unsigned long long>(calls.ComponentCalls),
+        static_cast<unsigned long long>(calls.GetTriangleMesh),
+        static_cast<unsigned long long>(calls.GetBoundary2D),
+        static_cast<unsigned long long>(calls.GetBoundingBox),
+        static_cast<unsigned long long>(calls.GetSemanticLabels),
+        static_cast<unsigned long long>(calls.LocateSpace),
+        static_cast<unsigned long long>(calls.LocateSpaces),
+        static_cast<unsigned long long>(calls.LocatedSpaces),
+        calls.LocatedSpaces * perFrame,
+        static_cast<unsigned long long>(calls.AcquireDepthImage),
+        static_cast<unsigned long long>(calls.PollEvent));
+    out << line;
+}
+
+void WriteJson(std::ostream& out, const Options& options, const ReplayResult& r) {
+    char number[64];
+    out << "{\n";
+    out << "  \"benchmark\": \"XrMeshOcclusion replay\",\n";
+    out << "  \"format_version\": 1,\n";
+    out << "  \"label\": " << JsonString(options.Label) << ",\n";
+    out << "  \"timestamp\": " << static_cast<long long>(std::time(nullptr)) << ",\n";
+    out << "  \"trace\": " << JsonString(options.Trace) << ",\n";
+    out << "  \"renderer\": " << JsonString(r.Renderer) << ",\n";
+    out << "  \"threads\": " << r.Threads << ",\n";
+    out << "  \"spaces\": " << r.Spaces << ",\n";
+    out << "  \"planes\": " << r.Planes << ",\n";
+    out << "  \"volumes\": " << r.Volumes << ",\n";
+    out << "  \"meshes\": " << r.Meshes << ",\n";
+    out << "  \"mesh_triangles\": " << r.MeshTriangles << ",\n";
+    out << "  \"cached_meshes\": " << r.CachedMeshes << ",\n";
+    std::snprintf(number, sizeof(number), "%.3f", r.FirstOcclusionMs);
+    out << "  \"first_occlusion_ms\": " << number << ",\n";
+    std::snprintf(number, sizeof(number), "%.3f", r.SceneLoadMs);
+    out << "  \"scene_load_ms\": " << number << ",\n";
+    out << "  \"load_frames\": " << r.LoadFrames << ",\n";
+    out << "  \"load_calls\": ";
+    WriteCalls(out, r.LoadCalls, r.LoadFrames);
+    out << ",\n";
+    out << "  \"frames\": " << r.Frames << ",\n";
+    std::snprintf(number, sizeof(number), "%.4f", r.FrameMedianMs);
+    out << "  \"frame_median_ms\": " << number << ",\n";
+    std::snprintf(number, sizeof(number), "%.4f", r.FrameP95Ms);
+    out << "  \"frame_p95_ms\": " << number << ",\n";
+    std::snprintf(number, sizeof(number), "%.4f", r.FrameMaxMs);
+    out << "  \"frame_max_ms\": " << number << ",\n";
+    out << "  \"depth_images\": " << r.DepthImages << ",\n";
+    out << "  \"frame_calls\": ";
+    WriteCalls(out, r.FrameCalls, r.Frames);
+    out << "\n}\n";
+}
+
+void WriteCsv(std::ostream& out, const Options& options, const ReplayResult& r) {
+    out << "label,trace,threads,spaces,planes,volumes,meshes,mesh_triangles,cached_meshes,first_occlusion_ms,"
+           "scene_load_ms,frames,frame_median_ms,frame_p95_ms,frame_max_ms,depth_images,"
+           "located_spaces_per_frame\n";
+    char line[1024];
+    std::snprintf(
+        line,
+        sizeof(line),
+        "%s,%s,%d,%zu,%zu,%zu,%zu,%zu,%zu,%.3f,%.3f,%d,%.4f,%.4f,%.4f,%llu,%.2f\n",
+        options.Label.c_str(),
+        options.Trace.c_str(),
+        r.Threads,
+        r.Spaces,
+        r.Planes,
+        r.Volumes,
+        r.Meshes,
+        r.MeshTriangles,
+        r.CachedMeshes,
+        r.FirstOcclusionMs,
+        r.SceneLoadMs,
+        r.Frames,
+        r.FrameMedianMs,
+        r.FrameP95Ms,
+        r.FrameMaxMs,
+        static_cast<unsigned long long>(r.DepthImages),
+        r.Frames > 0 ? static_cast<double>(r.FrameCalls.LocatedSpaces) / r.Frames : 0.0);
+    out << line;
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--trace") {
+            options.Trace = value;
+        } else if (arg == "--frames") {
+            options.Frames = std::max(0, std::atoi(value.c_str()));
+        } else if (arg == "--fps") {
+            options.Fps = std::max(1.0, std::atof(value.c_str()));
+        } else if (arg == "--threads") {
+            options.Threads = std::atoi(value.c_str());
+        } else if (arg == "--upload-budget") {
+            options.UploadBudget = static_cast<size_t>(std::strtoull(value.c_str(), nullptr, 10));
+        } else if (arg == "--mesh-cache") {
+            options.MeshCache = value;
+        } else if (arg == "--format") {
+            options.Format = value;
+        } else if (arg == "--label") {
+            options.Label = value;
+        } else if (arg == "--output") {
+            options.Output = value;
+        } else {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    if (options.Trace.empty()) {
+        std::fprintf(stderr, "--trace is required\n");
+        return false;
+    }
+    if (options.Format != "json" && options.Format != "csv") {
+        std::fprintf(stderr, "Unknown format %s\n", options.Format.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        return 2;
+    }
+
+    ReplayResult result;
+    if (!Replay(options, result)) {
+        return 1;
+    }
+    std::fprintf(
+        stderr,
+        "%s: %zu spaces, %zu meshes, first occlusion after %.1f ms, %d frames\n",
+        options.Trace.c_str(),
+        result.Spaces,
+        result.Meshes,
+        result.FirstOcclusionMs,
+        result.Frames);
+
+    std::ofstream file;
+    if (!options.Output.empty()) {
+        file.open(options.Output);
+        if (!file) {
+            std::fprintf(stderr, "Could not open %s\n", options.Output.c_str());
+            return 1;
+        }
+    }
+    std::ostream& out = options.Output.empty() ? std::cout : file;
+    if (options.Format == "csv") {
+        WriteCsv(out, options, result);
+    } else {
+        WriteJson(out, options, result);
+    }
+    return 0;
+}
@@ -0,0 +1,933 @@
+#include "ReplayRuntime.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+// Handle values of the replay. Recorded space handles are mapped to kFirstSpaceHandle on,
+// in trace order, so a replay's handles do not depend on what the device handed out.
+constexpr uint64_t kInstanceHandle = 0x1;
+constexpr uint64_t kSessionHandle = 0x2;
+constexpr uint64_t kLocalSpaceHandle = 0x10;
+constexpr uint64_t kHeadSpaceHandle = 0x11;
+constexpr uint64_t kControllerSpaceHandle = 0x12; // and 0x13
+constexpr uint64_t kDepthProviderHandle = 0x20;
+constexpr uint64_t kFirstSpaceHandle = 0x1000;
+
+constexpr XrSpaceLocationFlags kTrackedFlags = XR_SPACE_LOCATION_ORIENTATION_VALID_BIT |
+    XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_TRACKED_BIT |
+    XR_SPACE_LOCATION_POSITION_TRACKED_BIT;
+
+// The host builds are 64 bit, where OpenXR handles are pointers.
+template <typename Handle>
+Handle ToHandle(uint64_t value) {
+    return reinterpret_cast<Handle>(static_cast<uintptr_t>(value));
+}
+
+template <typename Handle>
+uint64_t FromHandle(Handle handle) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+}
+
+XrVector3f Rotate(const XrQuaternionf& q, const XrVector3f& v) {
+    // v + 2 * cross(q.xyz, cross(q.xyz, v) + q.w * v)
+    const XrVector3f t = {
+        q.y * v.z - q.z * v.y + q.w * v.x,
+        q.z * v.x - q.x * v.z + q.w * v.y,
+        q.x * v.y - q.y * v.x + q.w * v.z};
+    return {
+        v.x + 2.0f * (q.y * t.z - q.z * t.y),
+        v.y + 2.0f * (q.z * t.x - q.x * t.z),
+        v.z + 2.0f * (q.x * t.y - q.y * t.x)};
+}
+
+XrPosef Multiply(const XrPosef& a, const XrPosef& b) {
+    const XrQuaternionf& p = a.orientation;
+    const XrQuaternionf& q = b.orientation;
+    const XrVector3f t = Rotate(p, b.position);
+    return {
+        {p.w * q.x + p.x * q.w + p.y * q.z - p.z * q.y,
+         p.w * q.y - p.x * q.z + p.y * q.w + p.z * q.x,
+         p.w * q.z + p.x * q.y - p.y * q.x + p.z * q.w,
+         p.w * q.w - p.x * q.x - p.y * q.y - p.z * q.z},
+        {a.position.x + t.x, a.position.y + t.y, a.position.z + t.z}};
+}
+
+XrPosef Inverse(const XrPosef& pose) {
+    const XrQuaternionf q = {
+        -pose.orientation.x, -pose.orientation.y, -pose.orientation.z, pose.orientation.w};
+    const XrVector3f t = Rotate(q, pose.position);
+    return {q, {-t.x, -t.y, -t.z}};
+}
+
+// The two call idiom: reports count, and copies when capacity is not 0.
+template <typename T>
+XrResult CopyOut(const T* data, uint32_t count, uint32_t capacity, uint32_t* countOutput, T* output) {
+    *countOutput = count;
+    if (capacity == 0) {
+        return XR_SUCCESS;
+    }
+    if (capacity < count || output == nullptr) {
+        return XR_ERROR_SIZE_INSUFFICIENT;
+    }
+    std::copy(data, data + count, output);
+    return XR_SUCCESS;
+}
+
+bool SameUuid(const XrUuidEXT& a, const XrUuidEXT& b) {
+    return std::memcmp(a.data, b.data, XR_UUID_SIZE_EXT) == 0;
+}
+
+bool HasLabel(const std::string& labels, const char* label) {
+    size_t start = 0;
+    while (start <= labels.size()) {
+        size_t end = labels.find(',', start);
+        if (end == std::string::npos) {
+            end = labels.size();
+        }
+        if (labels.compare(start, end - start, label) == 0) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+const XrSpaceComponentTypeFB kComponentTypes[] = {
+    XR_SPACE_COMPONENT_TYPE_LOCATABLE_FB,
+    XR_SPACE_COMPONENT_TYPE_BOUNDED_2D_FB,
+    XR_SPACE_COMPONENT_TYPE_BOUNDED_3D_FB,
+    XR_SPACE_COMPONENT_TYPE_SEMANTIC_LABELS_FB,
+    XR_SPACE_COMPONENT_TYPE_ROOM_LAYOUT_FB,
+    XR_SPACE_COMPONENT_TYPE_SPACE_CONTAINER_FB,
+    XR_SPACE_COMPONENT_TYPE_TRIANGLE_MESH_META,
+};
+
+// The open replay, and the lock every entry point holds while answering for it.
+ReplayRuntime* gReplay = nullptr;
+std::mutex gMutex;
+
+} // namespace
+
+/*
+================================================================================
+
+ReplayRuntime
+
+================================================================================
+*/
+
+ReplayRuntime::ReplayRuntime() = default;
+
+ReplayRuntime::~ReplayRuntime() {
+    Close();
+}
+
+bool ReplayRuntime::Open(const std::string& path) {
+    Close();
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        if (gReplay != nullptr) {
+            Error_ = "another replay is open";
+            return false;
+        }
+    }
+    if (!Trace_.Open(path)) {
+        Error_ = Trace_.Error();
+        return false;
+    }
+
+    bool hasTime = false;
+    for (size_t i = 0; i < Trace_.RecordCount(); ++i) {
+        const SceneTraceReader::Record record = Trace_.GetRecord(i);
+        if (record.Time > 0) {
+            StartTime_ = hasTime ? std::min(StartTime_, record.Time) : record.Time;
+            EndTime_ = hasTime ? std::max(EndTime_, record.Time) : record.Time;
+            hasTime = true;
+        }
+
+        if (record.Type == SceneTraceRecordType::Space) {
+            Space space;
+            if (!SceneTraceReader::ReadSpace(record, space.Info) ||
+                SpacesByRecordedHandle_.count(record.Space) != 0) {
+                continue;
+            }
+            space.RecordedHandle = record.Space;
+            space.Enabled = space.Info.Components;
+            SpacesByRecordedHandle_[record.Space] = static_cast<uint32_t>(Spaces_.size());
+            SpaceHandles_.push_back(ToHandle<XrSpace>(kFirstSpaceHandle + Spaces_.size()));
+            Spaces_.push_back(space);
+            continue;
+        }
+
+        SceneTracePose pose;
+        switch (record.Type) {
+            case SceneTraceRecordType::HeadPose:
+                if (SceneTraceReader::ReadPose(record, pose)) {
+                    Head_.push_back({record.Time, pose.Pose, pose.LocationFlags});
+                }
+                continue;
+            case SceneTraceRecordType::ControllerPose:
+                if (record.Space < 2 && SceneTraceReader::ReadPose(record, pose)) {
+                    Controllers_[record.Space].push_back({record.Time, pose.Pose, pose.LocationFlags});
+                }
+                continue;
+            case SceneTraceRecordType::DepthFrame:
+                DepthFrames_.push_back(static_cast<uint32_t>(i));
+                continue;
+            default:
+                break;
+        }
+
+        // The rest belongs to a space recorded before it.
+        auto found = SpacesByRecordedHandle_.find(record.Space);
+        if (found == SpacesByRecordedHandle_.end()) {
+            continue;
+        }
+        Space& space = Spaces_[found->second];
+        switch (record.Type) {
+            case SceneTraceRecordType::TriangleMesh:
+                space.TriangleMesh = static_cast<int64_t>(i);
+                break;
+            case SceneTraceRecordType::Boundary2D:
+                space.Boundary2D = static_cast<int64_t>(i);
+                break;
+            case SceneTraceRecordType::BoundingBox2D:
+                space.BoundingBox2D = record.Size >= sizeof(XrRect2Df) ? static_cast<int64_t>(i) : -1;
+                break;
+            case SceneTraceRecordType::BoundingBox3D:
+                space.BoundingBox3D = record.Size >= sizeof(XrRect3DfFB) ? static_cast<int64_t>(i) : -1;
+                break;
+            case SceneTraceRecordType::SemanticLabels:
+                SceneTraceReader::ReadSemanticLabels(record, space.Labels);
+                break;
+            case SceneTraceRecordType::SpacePose:
+                if (SceneTraceReader::ReadPose(record, pose)) {
+                    space.Poses.push_back({record.Time, pose.Pose, pose.LocationFlags});
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Records are written as they come in, which is not quite in time order across
+    // threads.
+    auto byTime = [](const PoseSample& a, const PoseSample& b) { return a.Time < b.Time; };
+    std::stable_sort(Head_.begin(), Head_.end(), byTime);
+    for (auto& controller : Controllers_) {
+        std::stable_sort(controller.begin(), controller.end(), byTime);
+    }
+    for (Space& space : Spaces_) {
+        std::stable_sort(space.Poses.begin(), space.Poses.end(), byTime);
+    }
+    std::stable_sort(DepthFrames_.begin(), DepthFrames_.end(), [this](uint32_t a, uint32_t b) {
+        return Trace_.GetRecord(a).Time < Trace_.GetRecord(b).Time;
+    });
+
+    Time_ = StartTime_;
+    std::lock_guard<std::mutex> lock(gMutex);
+    gReplay = this;
+    return true;
+}
+
+void ReplayRuntime::Close() {
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        if (gReplay == this) {
+            gReplay = nullptr;
+        }
+    }
+    Trace_.Close();
+    Spaces_.clear();
+    SpaceHandles_.clear();
+    SpacesByRecordedHandle_.clear();
+    Head_.clear();
+    Controllers_[0].clear();
+    Controllers_[1].clear();
+    DepthFrames_.clear();
+    DepthAcquired_ = 0;
+    std::fill(std::begin(DepthSwapchain_), std::end(DepthSwapchain_), -1);
+    Events_.clear();
+    QueryResults_.clear();
+    NextRequestId_ = 1;
+    StartTime_ = 0;
+    EndTime_ = 0;
+    Time_ = 0;
+    Counters_ = Counters();
+}
+
+XrInstance ReplayRuntime::Instance() const {
+    return ToHandle<XrInstance>(kInstanceHandle);
+}
+
+XrSession ReplayRuntime::Session() const {
+    return ToHandle<XrSession>(kSessionHandle);
+}
+
+XrSpace ReplayRuntime::LocalSpace() const {
+    return ToHandle<XrSpace>(kLocalSpaceHandle);
+}
+
+XrSpace ReplayRuntime::HeadSpace() const {
+    return ToHandle<XrSpace>(kHeadSpaceHandle);
+}
+
+XrSpace ReplayRuntime::ControllerSpace(int hand) const {
+    return ToHandle<XrSpace>(kControllerSpaceHandle + (hand != 0 ? 1 : 0));
+}
+
+XrEnvironmentDepthProviderMETA ReplayRuntime::DepthProvider() const {
+    return ToHandle<XrEnvironmentDepthProviderMETA>(kDepthProviderHandle);
+}
+
+XrTime ReplayRuntime::Time() const {
+    std::lock_guard<std::mutex> lock(gMutex);
+    return Time_;
+}
+
+void ReplayRuntime::SetTime(XrTime time) {
+    std::lock_guard<std::mutex> lock(gMutex);
+    Time_ = time;
+}
+
+ReplayRuntime::Counters ReplayRuntime::GetCounters() const {
+    std::lock_guard<std::mutex> lock(gMutex);
+    return Counters_;
+}
+
+void ReplayRuntime::ResetCounters() {
+    std::lock_guard<std::mutex> lock(gMutex);
+    Counters_ = Counters();
+}
+
+const uint16_t* ReplayRuntime::DepthImage(uint32_t swapchainIndex, uint32_t& width, uint32_t& height)
+    const {
+    std::lock_guard<std::mutex> lock(gMutex);
+    if (swapchainIndex >= kDepthSwapchainLength || DepthSwapchain_[swapchainIndex] < 0) {
+        return nullptr;
+    }
+    SceneTraceReader::DepthFrame frame;
+    SceneTraceReader::ReadDepthFrame(
+        Trace_.GetRecord(static_cast<size_t>(DepthSwapchain_[swapchainIndex])), frame);
+    width = frame.Frame->Width;
+    height = frame.Frame->Height;
+    return frame.Texels;
+}
+
+ReplayRuntime::Space* ReplayRuntime::FindSpace(XrSpace space) {
+    const uint64_t handle = FromHandle(space);
+    if (handle < kFirstSpaceHandle || handle - kFirstSpaceHandle >= Spaces_.size()) {
+        return nullptr;
+    }
+    return &Spaces_[handle - kFirstSpaceHandle];
+}
+
+bool ReplayRuntime::PoseAt(XrSpace space, XrTime time, XrPosef& pose, XrSpaceLocationFlags& flags)
+    const {
+    const uint64_t handle = FromHandle(space);
+    const std::vector<PoseSample>* samples = nullptr;
+    if (handle == kLocalSpaceHandle) {
+        pose = {{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+        flags = kTrackedFlags;
+        return true;
+    } else if (handle == kHeadSpaceHandle) {
+        samples = &Head_;
+    } else if (handle == kControllerSpaceHandle || handle == kControllerSpaceHandle + 1) {
+        samples = &Controllers_[handle - kControllerSpaceHandle];
+    } else if (handle >= kFirstSpaceHandle && handle - kFirstSpaceHandle < Spaces_.size()) {
+        samples = &Spaces_[handle - kFirstSpaceHandle].Poses;
+    } else {
+        return false;
+    }
+
+    if (samples->empty()) {
+        pose = {{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+        flags = 0;
+        return true;
+    }
+    auto next = std::upper_bound(
+        samples->begin(), samples->end(), time, [](XrTime t, const PoseSample& sample) {
+            return t < sample.Time;
+        });
+    const PoseSample& sample = next == samples->begin() ? *next : *(next - 1);
+    pose = sample.Pose;
+    flags = sample.Flags;
+    return true;
+}
+
+void ReplayRuntime::PushEvent(const void* event, size_t size) {
+    XrEventDataBuffer buffer = {};
+    std::memcpy(&buffer, event, std::min(size, sizeof(buffer)));
+    Events_.push_back(buffer);
+}
+
+/*
+================================================================================
+
+Entry points
+
+================================================================================
+*/
+
+struct ReplayRuntime::EntryPoints {
+    static bool IsSession(XrSession session) {
+        return gReplay != nullptr && FromHandle(session) == kSessionHandle;
+    }
+
+    // The space, or null when there is no replay or it is not one of its spaces.
+    static Space* Find(XrSpace space) {
+        return gReplay != nullptr ? gReplay->FindSpace(space) : nullptr;
+    }
+
+    // Filters on what a trace does not record, like the storage location, match every
+    // space.
+    static bool Matches(const Space& space, const XrSpaceFilterInfoBaseHeaderFB* filter) {
+        for (auto header = reinterpret_cast<const XrEventDataBaseHeader*>(filter); header != nullptr;
+             header = static_cast<const XrEventDataBaseHeader*>(header->next)) {
+            if (header->type == XR_TYPE_SPACE_UUID_FILTER_INFO_FB) {
+                auto uuids = reinterpret_cast<const XrSpaceUuidFilterInfoFB*>(header);
+                const XrUuidEXT* begin = uuids->uuids;
+                const XrUuidEXT* end = begin + uuids->uuidCount;
+                if (std::none_of(begin, end, [&space](const XrUuidEXT& uuid) {
+                        return SameUuid(uuid, space.Info.Uuid);
+                    })) {
+                    return false;
+                }
+            } else if (header->type == XR_TYPE_SPACE_COMPONENT_FILTER_INFO_FB) {
+                auto component = reinterpret_cast<const XrSpaceComponentFilterInfoFB*>(header);
+                if ((space.Enabled & SceneTraceComponentBit(component->componentType)) == 0) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static XrResult XRAPI_CALL QuerySpaces(
+        XrSession session,
+        const XrSpaceQueryInfoBaseHeaderFB* info,
+        XrAsyncRequestIdFB* requestId) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        if (!IsSession(session)) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        if (info == nullptr || info->type != XR_TYPE_SPACE_QUERY_INFO_FB || requestId == nullptr) {
+            return XR_ERROR_VALIDATION_FAILURE;
+        }
+        ReplayRuntime& replay = *gReplay;
+        replay.Counters_.QuerySpaces++;
+
+        auto query = reinterpret_cast<const XrSpaceQueryInfoFB*>(info);
+        std::vector<XrSpaceQueryResultFB> results;
+        for (size_t i = 0; i < replay.Spaces_.size(); ++i) {
+            const Space& space = replay.Spaces_[i];
+            if (query->maxResultCount != 0 && results.size() >= query->maxResultCount) {
+                break;
+            }
+            if (Matches(space, query->filter) &&
+                (query->excludeFilter == nullptr || !Matches(space, query->excludeFilter))) {
+                results.push_back({replay.SpaceHandles_[i], space.Info.Uuid});
+            }
+        }
+
+        *requestId = replay.NextRequestId_++;
+        if (!results.empty()) {
+            replay.QueryResults_[*requestId] = std::move(results);
+            XrEventDataSpaceQueryResultsAvailableFB available = {
+                XR_TYPE_EVENT_DATA_SPACE_QUERY_RESULTS_AVAILABLE_FB};
+            available.requestId = *requestId;
+            replay.PushEvent(&available, sizeof(available));
+        }
+        XrEventDataSpaceQueryCompleteFB complete = {XR_TYPE_EVENT_DATA_SPACE_QUERY_COMPLETE_FB};
+        complete.requestId = *requestId;
+        complete.result = XR_SUCCESS;
+        replay.PushEvent(&complete, sizeof(complete));
+        return XR_SUCCESS;
+    }
+
+    static XrResult XRAPI_CALL RetrieveSpaceQueryResults(
+        XrSession session,
+        XrAsyncRequestIdFB requestId,
+        XrSpaceQueryResultsFB* results) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        if (!IsSession(session)) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        ReplayRuntime& replay = *gReplay;
+        replay.Counters_.RetrieveQueryResults++;
+        auto found = replay.QueryResults_.find(requestId);
+        if (found == replay.QueryResults_.end() || results == nullptr) {
+            return XR_ERROR_VALIDATION_FAILURE;
+        }
+        const auto& spaces = found->second;
+        const XrResult result = CopyOut(
+            spaces.data(),
+            static_cast<uint32_t>(spaces.size()),
+            results->resultCapacityInput,
+            &results->resultCountOutput,
+            results->results);
+        // Like the runtime, results can be retrieved once.
+        if (result == XR_SUCCESS && results->resultCapacityInput != 0) {
+            replay.QueryResults_.erase(found);
+        }
+        return result;
+    }
+
+    static XrResult XRAPI_CALL EnumerateSpaceSupportedComponents(
+        XrSpace spaceHandle,
+        uint32_t capacity,
+        uint32_t* countOutput,
+        XrSpaceComponentTypeFB* types) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.ComponentCalls++;
+        std::vector<XrSpaceComponentTypeFB> supported;
+        for (XrSpaceComponentTypeFB type : kComponentTypes) {
+            if ((space->Info.Components & SceneTraceComponentBit(type)) != 0) {
+                supported.push_back(type);
+            }
+        }
+        return CopyOut(
+            supported.data(), static_cast<uint32_t>(supported.size()), capacity, countOutput, types);
+    }
+
+    static XrResult XRAPI_CALL GetSpaceComponentStatus(
+        XrSpace spaceHandle,
+        XrSpaceComponentTypeFB type,
+        XrSpaceComponentStatusFB* status) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.ComponentCalls++;
+        const uint32_t bit = SceneTraceComponentBit(type);
+        if ((space->Info.Components & bit) == 0) {
+            return XR_ERROR_SPACE_COMPONENT_NOT_SUPPORTED_FB;
+        }
+        status->enabled = (space->Enabled & bit) != 0 ? XR_TRUE : XR_FALSE;
+        status->changePending = XR_FALSE;
+        return XR_SUCCESS;
+    }
+
+    // Completes at once, with its event queued for xrPollEvent.
+    static XrResult XRAPI_CALL SetSpaceComponentStatus(
+        XrSpace spaceHandle,
+        const XrSpaceComponentStatusSetInfoFB* info,
+        XrAsyncRequestIdFB* requestId) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        ReplayRuntime& replay = *gReplay;
+        replay.Counters_.ComponentCalls++;
+        const uint32_t bit = SceneTraceComponentBit(info->componentType);
+        if ((space->Info.Components & bit) == 0) {
+            return XR_ERROR_SPACE_COMPONENT_NOT_SUPPORTED_FB;
+        }
+        if (((space->Enabled & bit) != 0) == (info->enabled != XR_FALSE)) {
+            return XR_ERROR_SPACE_COMPONENT_STATUS_ALREADY_SET_FB;
+        }
+        space->Enabled ^= bit;
+
+        *requestId = replay.NextRequestId_++;
+        XrEventDataSpaceSetStatusCompleteFB complete = {
+            XR_TYPE_EVENT_DATA_SPACE_SET_STATUS_COMPLETE_FB};
+        complete.requestId = *requestId;
+        complete.result = XR_SUCCESS;
+        complete.space = spaceHandle;
+        complete.uuid = space->Info.Uuid;
+        complete.componentType = info->componentType;
+        complete.enabled = info->enabled;
+        replay.PushEvent(&complete, sizeof(complete));
+        return XR_SUCCESS;
+    }
+
+    static XrResult XRAPI_CALL GetSpaceUuid(XrSpace spaceHandle, XrUuidEXT* uuid) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.ComponentCalls++;
+        *uuid = space->Info.Uuid;
+        return XR_SUCCESS;
+    }
+
+    // Found from the semantic labels of the trace's spaces, which is what the runtime
+    // builds the layout from.
+    static XrResult XRAPI_CALL GetSpaceRoomLayout(
+        XrSession session,
+        XrSpace spaceHandle,
+        XrRoomLayoutFB* layout) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (!IsSession(session) || space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        ReplayRuntime& replay = *gReplay;
+        replay.Counters_.ComponentCalls++;
+        if ((space->Enabled & SCENE_TRACE_COMPONENT_ROOM_LAYOUT) == 0) {
+            return XR_ERROR_SPACE_COMPONENT_NOT_ENABLED_FB;
+        }
+        std::memset(&layout->floorUuid, 0, sizeof(layout->floorUuid));
+        std::memset(&layout->ceilingUuid, 0, sizeof(layout->ceilingUuid));
+        std::vector<XrUuidEXT> walls;
+        for (const Space& other : replay.Spaces_) {
+            if (HasLabel(other.Labels, "FLOOR")) {
+                layout->floorUuid = other.Info.Uuid;
+            } else if (HasLabel(other.Labels, "CEILING")) {
+                layout->ceilingUuid = other.Info.Uuid;
+            } else if (
+                HasLabel(other.Labels, "WALL_FACE") ||
+                HasLabel(other.Labels, "INVISIBLE_WALL_FACE")) {
+                walls.push_back(other.Info.Uuid);
+            }
+        }
+        return CopyOut(
+            walls.data(),
+            static_cast<uint32_t>(walls.size()),
+            layout->wallUuidCapacityInput,
+            &layout->wallUuidCountOutput,
+            layout->wallUuids);
+    }
+
+    // A trace holds one room, so a container holds every other space of it.
+    static XrResult XRAPI_CALL GetSpaceContainer(
+        XrSession session,
+        XrSpace spaceHandle,
+        XrSpaceContainerFB* container) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (!IsSession(session) || space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        ReplayRuntime& replay = *gReplay;
+        replay.Counters_.ComponentCalls++;
+        if ((space->Enabled & SCENE_TRACE_COMPONENT_SPACE_CONTAINER) == 0) {
+            return XR_ERROR_SPACE_COMPONENT_NOT_ENABLED_FB;
+        }
+        std::vector<XrUuidEXT> uuids;
+        for (const Space& other : replay.Spaces_) {
+            if (&other != space) {
+                uuids.push_back(other.Info.Uuid);
+            }
+        }
+        return CopyOut(
+            uuids.data(),
+            static_cast<uint32_t>(uuids.size()),
+            container->uuidCapacityInput,
+            &container->uuidCountOutput,
+            container->uuids);
+    }
+
+    static XrResult XRAPI_CALL GetSpaceBoundingBox2D(
+        XrSession session,
+        XrSpace spaceHandle,
+        XrRect2Df* boundingBox) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (!IsSession(session) || space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.GetBoundingBox++;
+        if ((space->Enabled & SCENE_TRACE_COMPONENT_BOUNDED_2D) == 0 || space->BoundingBox2D < 0) {
+            return XR_ERROR_SPACE_COMPONENT_NOT_ENABLED_FB;
+        }
+        const auto record = gReplay->Trace_.GetRecord(static_cast<size_t>(space->BoundingBox2D));
+        std::memcpy(boundingBox, record.Data, sizeof(*boundingBox));
+        return XR_SUCCESS;
+    }
+
+    static XrResult XRAPI_CALL GetSpaceBoundingBox3D(
+        XrSession session,
+        XrSpace spaceHandle,
+        XrRect3DfFB* boundingBox) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (!IsSession(session) || space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.GetBoundingBox++;
+        if ((space->Enabled & SCENE_TRACE_COMPONENT_BOUNDED_3D) == 0 || space->BoundingBox3D < 0) {
+            return XR_ERROR_SPACE_COMPONENT_NOT_ENABLED_FB;
+        }
+        const auto record = gReplay->Trace_.GetRecord(static_cast<size_t>(space->BoundingBox3D));
+        std::memcpy(boundingBox, record.Data, sizeof(*boundingBox));
+        return XR_SUCCESS;
+    }
+
+    static XrResult XRAPI_CALL GetSpaceBoundary2D(
+        XrSession session,
+        XrSpace spaceHandle,
+        XrBoundary2DFB* boundary) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (!IsSession(session) || space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.GetBoundary2D++;
+        SceneTraceReader::Boundary2D recorded;
+        if ((space->Enabled & SCENE_TRACE_COMPONENT_BOUNDED_2D) == 0 || space->Boundary2D < 0 ||
+            !SceneTraceReader::ReadBoundary2D(
+                gReplay->Trace_.GetRecord(static_cast<size_t>(space->Boundary2D)), recorded)) {
+            return XR_ERROR_SPACE_COMPONENT_NOT_ENABLED_FB;
+        }
+        return CopyOut(
+            recorded.Vertices,
+            recorded.VertexCount,
+            boundary->vertexCapacityInput,
+            &boundary->vertexCountOutput,
+            boundary->vertices);
+    }
+
+    static XrResult XRAPI_CALL GetSpaceSemanticLabels(
+        XrSession session,
+        XrSpace spaceHandle,
+        XrSemanticLabelsFB* labels) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (!IsSession(session) || space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.GetSemanticLabels++;
+        if ((space->Enabled & SCENE_TRACE_COMPONENT_SEMANTIC_LABELS) == 0) {
+            return XR_ERROR_SPACE_COMPONENT_NOT_ENABLED_FB;
+        }
+        return CopyOut(
+            space->Labels.data(),
+            static_cast<uint32_t>(space->Labels.size()),
+            labels->bufferCapacityInput,
+            &labels->bufferCountOutput,
+            labels->buffer);
+    }
+
+    static XrResult XRAPI_CALL GetSpaceTriangleMesh(
+        XrSpace spaceHandle,
+        const XrSpaceTriangleMeshGetInfoMETA* /* info */,
+        XrSpaceTriangleMeshMETA* mesh) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        Space* space = Find(spaceHandle);
+        if (space == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.GetTriangleMesh++;
+        SceneTraceReader::TriangleMesh recorded;
+        if ((space->Enabled & SCENE_TRACE_COMPONENT_TRIANGLE_MESH) == 0 || space->TriangleMesh < 0 ||
+            !SceneTraceReader::ReadTriangleMesh(
+                gReplay->Trace_.GetRecord(static_cast<size_t>(space->TriangleMesh)), recorded)) {
+            return XR_ERROR_SPACE_COMPONENT_NOT_ENABLED_FB;
+        }
+        mesh->vertexCountOutput = recorded.VertexCount;
+        mesh->indexCountOutput = recorded.IndexCount;
+        if (mesh->vertexCapacityInput == 0 && mesh->indexCapacityInput == 0) {
+            return XR_SUCCESS;
+        }
+        if (mesh->vertexCapacityInput < recorded.VertexCount ||
+            mesh->indexCapacityInput < recorded.IndexCount || mesh->vertices == nullptr ||
+            mesh->indices == nullptr) {
+            return XR_ERROR_SIZE_INSUFFICIENT;
+        }
+        std::copy(recorded.Vertices, recorded.Vertices + recorded.VertexCount, mesh->vertices);
+        std::copy(recorded.Indices, recorded.Indices + recorded.IndexCount, mesh->indices);
+        return XR_SUCCESS;
+    }
+
+    static XrResult Locate(
+        XrSpace space,
+        XrSpace baseSpace,
+        XrTime time,
+        XrPosef& pose,
+        XrSpaceLocationFlags& flags) {
+        if (time <= 0) {
+            return XR_ERROR_TIME_INVALID;
+        }
+        XrPosef spacePose;
+        XrPosef basePose;
+        XrSpaceLocationFlags spaceFlags;
+        XrSpaceLocationFlags baseFlags;
+        if (!gReplay->PoseAt(space, time, spacePose, spaceFlags) ||
+            !gReplay->PoseAt(baseSpace, time, basePose, baseFlags)) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        pose = Multiply(Inverse(basePose), spacePose);
+        flags = spaceFlags & baseFlags;
+        gReplay->Counters_.LocatedSpaces++;
+        return XR_SUCCESS;
+    }
+
+    static XrResult XRAPI_CALL LocateSpace(
+        XrSpace space,
+        XrSpace baseSpace,
+        XrTime time,
+        XrSpaceLocation* location) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        if (gReplay == nullptr) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.LocateSpace++;
+        return Locate(space, baseSpace, time, location->pose, location->locationFlags);
+    }
+
+#if defined(XR_KHR_locate_spaces)
+    static XrResult XRAPI_CALL LocateSpaces(
+        XrSession session,
+        const XrSpacesLocateInfoKHR* info,
+        XrSpaceLocationsKHR* locations) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        if (!IsSession(session)) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        gReplay->Counters_.LocateSpaces++;
+        if (locations->locationCount < info->spaceCount) {
+            return XR_ERROR_VALIDATION_FAILURE;
+        }
+        for (uint32_t i = 0; i < info->spaceCount; ++i) {
+            XrSpaceLocationDataKHR& location = locations->locations[i];
+            const XrResult result = Locate(
+                info->spaces[i], info->baseSpace, info->time, location.pose, location.locationFlags);
+            if (result != XR_SUCCESS) {
+                return result;
+            }
+        }
+        return XR_SUCCESS;
+    }
+#endif
+
+#if defined(XR_META_environment_depth)
+    // The newest recorded depth image at the replay's time, in the next swapchain image.
+    static XrResult XRAPI_CALL AcquireEnvironmentDepthImage(
+        XrEnvironmentDepthProviderMETA provider,
+        const XrEnvironmentDepthImageAcquireInfoMETA* info,
+        XrEnvironmentDepthImageMETA* image) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        if (gReplay == nullptr || FromHandle(provider) != kDepthProviderHandle) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        ReplayRuntime& replay = *gReplay;
+        replay.Counters_.AcquireDepthImage++;
+
+        auto next = std::upper_bound(
+            replay.DepthFrames_.begin(),
+            replay.DepthFrames_.end(),
+            replay.Time_,
+            [&replay](XrTime t, uint32_t record) {
+                return t < replay.Trace_.GetRecord(record).Time;
+            });
+        if (next == replay.DepthFrames_.begin()) {
+            return XR_ENVIRONMENT_DEPTH_NOT_AVAILABLE_META;
+        }
+        const uint32_t record = *(next - 1);
+        SceneTraceReader::DepthFrame frame;
+        if (!SceneTraceReader::ReadDepthFrame(replay.Trace_.GetRecord(record), frame)) {
+            return XR_ENVIRONMENT_DEPTH_NOT_AVAILABLE_META;
+        }
+
+        XrPosef basePose;
+        XrSpaceLocationFlags baseFlags;
+        if (!replay.PoseAt(info->space, info->displayTime, basePose, baseFlags)) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        const XrPosef fromBase = Inverse(basePose);
+
+        const uint32_t index = replay.DepthAcquired_++ % kDepthSwapchainLength;
+        replay.DepthSwapchain_[index] = record;
+        image->swapchainIndex = index;
+        image->nearZ = frame.Frame->NearZ;
+        image->farZ = frame.Frame->FarZ;
+        for (int view = 0; view < 2; ++view) {
+            image->views[view].fov = frame.Frame->ViewFovs[view];
+            image->views[view].pose = Multiply(fromBase, frame.Frame->ViewPoses[view]);
+        }
+        return XR_SUCCESS;
+    }
+#endif
+
+    static XrResult XRAPI_CALL PollEvent(XrInstance instance, XrEventDataBuffer* eventData) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        if (gReplay == nullptr || FromHandle(instance) != kInstanceHandle) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        ReplayRuntime& replay = *gReplay;
+        replay.Counters_.PollEvent++;
+        if (replay.Events_.empty()) {
+            return XR_EVENT_UNAVAILABLE;
+        }
+        *eventData = replay.Events_.front();
+        replay.Events_.pop_front();
+        return XR_SUCCESS;
+    }
+
+    static XrResult XRAPI_CALL GetInstanceProcAddr(
+        XrInstance instance,
+        const char* name,
+        PFN_xrVoidFunction* function) {
+        std::lock_guard<std::mutex> lock(gMutex);
+        struct NamedFunction {
+            const char* Name;
+            PFN_xrVoidFunction Function;
+        };
+#define REPLAY_FUNCTION(name, function) \
+    { name, reinterpret_cast<PFN_xrVoidFunction>(&EntryPoints::function) }
+        static const NamedFunction functions[] = {
+            REPLAY_FUNCTION("xrGetInstanceProcAddr", GetInstanceProcAddr),
+            REPLAY_FUNCTION("xrPollEvent", PollEvent),
+            REPLAY_FUNCTION("xrLocateSpace", LocateSpace),
+            REPLAY_FUNCTION("xrQuerySpacesFB", QuerySpaces),
+            REPLAY_FUNCTION("xrRetrieveSpaceQueryResultsFB", RetrieveSpaceQueryResults),
+            REPLAY_FUNCTION("xrEnumerateSpaceSupportedComponentsFB", EnumerateSpaceSupportedComponents),
+            REPLAY_FUNCTION("xrGetSpaceComponentStatusFB", GetSpaceComponentStatus),
+            REPLAY_FUNCTION("xrSetSpaceComponentStatusFB", SetSpaceComponentStatus),
+            REPLAY_FUNCTION("xrGetSpaceUuidFB", GetSpaceUuid),
+            REPLAY_FUNCTION("xrGetSpaceRoomLayoutFB", GetSpaceRoomLayout),
+            REPLAY_FUNCTION("xrGetSpaceContainerFB", GetSpaceContainer),
+            REPLAY_FUNCTION("xrGetSpaceBoundingBox2DFB", GetSpaceBoundingBox2D),
+            REPLAY_FUNCTION("xrGetSpaceBoundingBox3DFB", GetSpaceBoundingBox3D),
+            REPLAY_FUNCTION("xrGetSpaceBoundary2DFB", GetSpaceBoundary2D),
+            REPLAY_FUNCTION("xrGetSpaceSemanticLabelsFB", GetSpaceSemanticLabels),
+            REPLAY_FUNCTION("xrGetSpaceTriangleMeshMETA", GetSpaceTriangleMesh),
+#if defined(XR_KHR_locate_spaces)
+            REPLAY_FUNCTION("xrLocateSpacesKHR", LocateSpaces),
+#endif
+#if defined(XR_META_environment_depth)
+            REPLAY_FUNCTION("xrAcquireEnvironmentDepthImageMETA", AcquireEnvironmentDepthImage),
+#endif
+        };
+#undef REPLAY_FUNCTION
+
+        *function = nullptr;
+        if (gReplay == nullptr || FromHandle(instance) != kInstanceHandle) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        for (const NamedFunction& named : functions) {
+            if (std::strcmp(named.Name, name) == 0) {
+                *function = named.Function;
+                return XR_SUCCESS;
+            }
+        }
+        return XR_ERROR_FUNCTION_UNSUPPORTED;
+    }
+};
+
+// The loader's exports, which the sample calls directly.
+
+XRAPI_ATTR XrResult XRAPI_CALL
+xrGetInstanceProcAddr(XrInstance instance, const char* name, PFN_xrVoidFunction* function) {
+    return ReplayRuntime::EntryPoints::GetInstanceProcAddr(instance, name, function);
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL xrPollEvent(XrInstance instance, XrEventDataBuffer* eventData) {
+    return ReplayRuntime::EntryPoints::PollEvent(instance, eventData);
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL
+xrLocateSpace(XrSpace space, XrSpace baseSpace, XrTime time, XrSpaceLocation* location) {
+    return ReplayRuntime::EntryPoints::LocateSpace(space, baseSpace, time, location);
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <openxr/openxr.h>
+
+#include "SceneTrace.h"
+
+// Stand-in for the OpenXR runtime calls the sample's scene code makes, answered from a
+// recorded scene trace, so a room can be loaded, tracked and rendered on a Linux host
+// without a headset.
+//
+// Linking ReplayRuntime.cpp defines xrGetInstanceProcAddr, xrPollEvent and xrLocateSpace
+// in place of the OpenXR loader; xrGetInstanceProcAddr hands out the scene extension
+// functions (xrQuerySpacesFB, xrGetSpaceTriangleMeshMETA, xrGetSpaceBoundary2DFB and the
+// rest of what SceneSharingXr.cpp loads, xrLocateSpacesKHR and
+// xrAcquireEnvironmentDepthImageMETA) like a runtime would. They answer for the replay
+// that is open; there is one at a time per process.
+//
+// The replay is deterministic. Its clock only moves with SetTime. Queries return their
+// spaces in trace order, with their events queued for xrPollEvent at once. A space's
+// pose at a time is its last one recorded at or before that time, or its first one
+// before the recording starts; depth images likewise. Calls of other runtimes' handles
+// return XR_ERROR_HANDLE_INVALID. Like a runtime's, the functions can be called from any
+// thread, e.g. MeshPipeline's, as can the methods below other than Open and Close.
+class ReplayRuntime {
+public:
+    // Calls answered since Open or ResetCounters
+    struct Counters {
+        uint64_t QuerySpaces = 0;
+        uint64_t RetrieveQueryResults = 0;
+        uint64_t ComponentCalls = 0; // supported components, status, UUIDs, room layout, container
+        uint64_t GetTriangleMesh = 0;
+        uint64_t GetBoundary2D = 0;
+        uint64_t GetBoundingBox = 0; // 2D and 3D
+        uint64_t GetSemanticLabels = 0;
+        uint64_t LocateSpace = 0;
+        uint64_t LocateSpaces = 0; // xrLocateSpacesKHR calls
+        uint64_t LocatedSpaces = 0; // spaces located by both
+        uint64_t AcquireDepthImage = 0;
+        uint64_t PollEvent = 0;
+    };
+
+    // Depth images are handed out round robin over this many swapchain images, like the
+    // runtime's environment depth swapchain.
+    static constexpr uint32_t kDepthSwapchainLength = 3;
+
+    ReplayRuntime();
+    ~ReplayRuntime();
+
+    ReplayRuntime(const ReplayRuntime&) = delete;
+    ReplayRuntime& operator=(const ReplayRuntime&) = delete;
+
+    // Loads a trace and makes this the replay the entry points answer for, with the clock
+    // at the trace's first record. Returns false, with Error() set, when the trace cannot
+    // be read or another replay is open.
+    bool Open(const std::string& path);
+    void Close();
+
+    const std::string& Error() const {
+        return Error_;
+    }
+
+    // Handles to hand to the sample's code in place of the runtime's.
+    XrInstance Instance() const;
+    XrSession Session() const;
+    // The space the trace's poses are recorded in, like the app's LOCAL space.
+    XrSpace LocalSpace() const;
+    // The recorded head, like a VIEW space, and controllers (0 left, 1 right).
+    XrSpace HeadSpace() const;
+    XrSpace ControllerSpace(int hand) const;
+    XrEnvironmentDepthProviderMETA DepthProvider() const;
+
+    // Spaces in trace order, the results of a query without filters.
+    const std::vector<XrSpace>& Spaces() const {
+        return SpaceHandles_;
+    }
+
+    XrTime StartTime() const {
+        return StartTime_;
+    }
+    XrTime EndTime() const {
+        return EndTime_;
+    }
+    XrTime Time() const;
+    void SetTime(XrTime time);
+
+    // Texels of the depth image last acquired into swapchainIndex, view 0 then view 1,
+    // or null before one was. They stay valid until Close.
+    const uint16_t* DepthImage(uint32_t swapchainIndex, uint32_t& width, uint32_t& height) const;
+
+    Counters GetCounters() const;
+    void ResetCounters();
+
+    // The exported and handed out runtime functions, in ReplayRuntime.cpp
+    struct EntryPoints;
+
+private:
+    struct PoseSample {
+        XrTime Time;
+        XrPosef Pose;
+        XrSpaceLocationFlags Flags;
+    };
+
+    // A recorded space, with the index of its last record of each kind, or -1.
+    struct Space {
+        uint64_t RecordedHandle = 0;
+        SceneTraceSpace Info = {};
+        uint32_t Enabled = 0; // SceneTraceComponent bits, changed by xrSetSpaceComponentStatusFB
+        int64_t TriangleMesh = -1;
+        int64_t Boundary2D = -1;
+        int64_t BoundingBox2D = -1;
+        int64_t BoundingBox3D = -1;
+        std::string Labels;
+        std::vector<PoseSample> Poses;
+    };
+
+    // Space for a handle of this replay, or null.
+    Space* FindSpace(XrSpace space);
+    // Pose of a space of this replay in the local space at time; false for a handle that
+    // is not one.
+    bool PoseAt(XrSpace space, XrTime time, XrPosef& pose, XrSpaceLocationFlags& flags) const;
+    void PushEvent(const void* event, size_t size);
+
+    SceneTraceReader Trace_;
+    std::string Error_;
+    std::vector<Space> Spaces_;
+    std::vector<XrSpace> SpaceHandles_;
+    std::unordered_map<uint64_t, uint32_t> SpacesByRecordedHandle_;
+    std::vector<PoseSample> Head_;
+    std::vector<PoseSample> Controllers_[2];
+    std::vector<uint32_t> DepthFrames_; // record indices, in time order
+    uint32_t DepthAcquired_ = 0;
+    int64_t DepthSwapchain_[kDepthSwapchainLength] = {-1, -1, -1}; // record indices
+    std::deque<XrEventDataBuffer> Events_;
+    std::unordered_map<XrAsyncRequestIdFB, std::vector<XrSpaceQueryResultFB>> QueryResults_;
+    XrAsyncRequestIdFB NextRequestId_ = 1;
+    XrTime StartTime_ = 0;
+    XrTime EndTime_ = 0;
+    XrTime Time_ = 0;
+    Counters Counters_;
+};
@@ -0,0 +1,368 @@
+#include "AdaptiveSubdivision.h"
+#include "MeshSubdivision.h"
+#include "MeshTopology.h"
+#include "SubdivisionStencils.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+
+constexpr uint32_t kNoVertex = UINT32_MAX;
+constexpr uint32_t kNoEdge = UINT32_MAX;
+constexpr size_t kItemsPerTask = 4096;
+
+uint64_t EdgeKey(uint32_t a, uint32_t b) {
+    return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+}
+
+// Red-green marking of one level, reused across the budget search.
+struct Closure {
+    std::vector<uint8_t> Red;
+    std::vector<uint8_t> SplitEdgeCount;
+    std::vector<uint8_t> EdgeSplit;
+    std::vector<uint32_t> Stack;
+};
+
+// Marks the first markedCount candidates red and closes the marking: every edge of a
+// red triangle is split, a triangle left with two split edges becomes red too, and so
+// do the coarse triangles of a hanging edge when one of its halves is split (halvedEdges
+// maps each edge to the hanging edge it is half of, or kNoEdge). Neighbors thus stay at
+// most one level apart. Returns the triangle count of the conforming mesh this marking
+// produces.
+size_t CloseMarking(
+    const MeshTopology& topology,
+    const std::vector<uint8_t>& initialEdgeSplit,
+    const std::vector<uint8_t>& initialSplitEdgeCount,
+    const std::vector<uint32_t>& halvedEdges,
+    const std::vector<uint32_t>& candidates,
+    size_t markedCount,
+    Closure& closure) {
+    closure.EdgeSplit = initialEdgeSplit;
+    closure.SplitEdgeCount = initialSplitEdgeCount;
+    closure.Red.assign(topology.TriangleCount(), 0);
+    closure.Stack.clear();
+
+    auto markRed = [&closure](uint32_t triangle) {
+        if (!closure.Red[triangle]) {
+            closure.Red[triangle] = 1;
+            closure.Stack.push_back(triangle);
+        }
+    };
+    for (size_t i = 0; i < markedCount; ++i) {
+        markRed(candidates[i]);
+    }
+    while (!closure.Stack.empty()) {
+        const uint32_t triangle = closure.Stack.back();
+        closure.Stack.pop_back();
+        for (uint32_t corner = 0; corner < 3; ++corner) {
+            const uint32_t edge = topology.HalfEdgeEdge(triangle * 3 + corner);
+            if (closure.EdgeSplit[edge]) {
+                continue;
+            }
+            closure.EdgeSplit[edge] = 1;
+            for (const uint32_t* h = topology.EdgeHalfEdgesBegin(edge); h != topology.EdgeHalfEdgesEnd(edge); ++h) {
+                const uint32_t neighbor = *h / 3;
+                if (neighbor != triangle && ++closure.SplitEdgeCount[neighbor] >= 2) {
+                    markRed(neighbor);
+                }
+            }
+            // Only the coarse side still has the whole edge, and its green bisection could
+            // not reach the new vertex.
+            const uint32_t halved = halvedEdges[edge];
+            if (halved != kNoEdge) {
+                for (const uint32_t* h = topology.EdgeHalfEdgesBegin(halved); h != topology.EdgeHalfEdgesEnd(halved); ++h) {
+                    markRed(*h / 3);
+                }
+            }
+        }
+    }
+
+    size_t outputTriangles = 0;
+    for (size_t t = 0; t < topology.TriangleCount(); ++t) {
+        outputTriangles += closure.Red[t] ? 4 : (closure.SplitEdgeCount[t] > 0 ? 2 : 1);
+    }
+    return outputTriangles;
+}
+
+// How far a triangle exceeds the refinement thresholds; above 1 makes it a candidate.
+float RefinementScore(
+    const AdaptiveSubdivision::Settings& settings,
+    const MeshTopology& topology,
+    const std::vector<XrVector3f>& vertices,
+    const std::vector<uint32_t>& indices,
+    const std::vector<XrVector3f>& faceNormals,
+    uint32_t triangle) {
+    const XrVector3f& p0 = vertices[indices[triangle * 3]];
+    const XrVector3f& p1 = vertices[indices[triangle * 3 + 1]];
+    const XrVector3f& p2 = vertices[indices[triangle * 3 + 2]];
+    const float longestEdge = std::max({
+        VectorMath::magnitude(VectorMath::subtract(p1, p0)),
+        VectorMath::magnitude(VectorMath::subtract(p2, p1)),
+        VectorMath::magnitude(VectorMath::subtract(p0, p2))});
+    if (longestEdge <= settings.MinEdgeLength) {
+        return 0.0f;
+    }
+
+    float score = longestEdge / settings.MaxEdgeLength;
+
+    // Sharpest angle to a neighbor across a manifold edge.
+    float dihedral = 0.0f;
+    for (uint32_t corner = 0; corner < 3; ++corner) {
+        const uint32_t edge = topology.HalfEdgeEdge(triangle * 3 + corner);
+        if (topology.EdgeFaceCount(edge) != 2) {
+            continue;
+        }
+        const uint32_t* h = topology.EdgeHalfEdgesBegin(edge);
+        const uint32_t neighbor = (h[0] / 3 == triangle) ? h[1] / 3 : h[0] / 3;
+        const XrVector3f& n0 = faceNormals[triangle];
+        const XrVector3f& n1 = faceNormals[neighbor];
+        const float cosAngle = std::min(1.0f, std::max(-1.0f, n0.x * n1.x + n0.y * n1.y + n0.z * n1.z));
+        dihedral = std::max(dihedral, std::acos(cosAngle));
+    }
+    score = std::max(score, dihedral / settings.MaxDihedralAngle);
+
+    if (settings.HasViewer) {
+        const XrVector3f centroid = VectorMath::scalar_multiply(VectorMath::add(VectorMath::add(p0, p1), p2), 1.0f / 3.0f);
+        const float distance = std::max(
+            0.1f, VectorMath::magnitude(VectorMath::subtract(centroid, settings.ViewerPosition)));
+        score = std::max(score, (longestEdge / distance) / settings.MaxViewAngle);
+    }
+    return score;
+}
+
+// Loop odd rule for the vertex inserted on an edge, optionally recorded as a stencil row.
+XrVector3f EdgeVertexPosition(
+    const MeshTopology& topology,
+    const std::vector<XrVector3f>& vertices,
+    const std::vector<uint32_t>& indices,
+    uint32_t edge,
+    SubdivisionStencils* stencils) {
+    const MeshTopology::Edge& e = topology.GetEdge(edge);
+    const XrVector3f& v0_pos = vertices[e.v0];
+    const XrVector3f& v1_pos = vertices[e.v1];
+    if (topology.EdgeFaceCount(edge) == 2) {
+        const uint32_t* halfEdges = topology.EdgeHalfEdgesBegin(edge);
+        const uint32_t h0 = halfEdges[0];
+        const uint32_t h1 = halfEdges[1];
+        const uint32_t v2 = indices[h0 - h0 % 3 + (h0 + 2) % 3];
+        const uint32_t v3 = indices[h1 - h1 % 3 + (h1 + 2) % 3];
+        if (stencils != nullptr) {
+            const uint32_t rowVertices[4] = {e.v0, e.v1, v2, v3};
+            const float rowWeights[4] = {3.0f / 8.0f, 3.0f / 8.0f, 1.0f / 8.0f, 1.0f / 8.0f};
+            stencils->AddVertex(rowVertices, rowWeights, 4);
+        }
+        const XrVector3f& v2_pos = vertices[v2];
+        const XrVector3f& v3_pos = vertices[v3];
+        auto term1 = VectorMath::scalar_multiply(VectorMath::add(v0_pos, v1_pos), 3.0f / 8.0f);
+        auto term2 = VectorMath::scalar_multiply(VectorMath::add(v2_pos, v3_pos), 1.0f / 8.0f);
+        return VectorMath::add(term1, term2);
+    }
+    if (stencils != nullptr) {
+        const uint32_t rowVertices[2] = {e.v0, e.v1};
+        const float rowWeights[2] = {0.5f, 0.5f};
+        stencils->AddVertex(rowVertices, rowWeights, 2);
+    }
+    return VectorMath::scalar_multiply(VectorMath::add(v0_pos, v1_pos), 0.5f);
+}
+
+} // namespace
+
+std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> AdaptiveSubdivision::subdivide(
+    const std::vector<XrVector3f>& originalVertices,
+    const std::vector<uint32_t>& originalIndices,
+    const Settings& settings,
+    ThreadPool* pool,
+    SubdivisionStencils* stencils) {
+
+    std::vector<XrVector3f> vertices = originalVertices;
+    std::vector<uint32_t> indices = originalIndices;
+    std::vector<uint32_t> nextIndices;
+
+    // Vertex inserted on every edge split so far. An entry whose edge is still an edge
+    // of the current triangles is a hanging vertex: its other side was refined.
+    std::unordered_map<uint64_t, uint32_t> edgeVertices;
+
+    MeshTopology topology;
+    Closure closure;
+    std::vector<uint32_t> edgeVertex;
+    std::vector<uint8_t> initialEdgeSplit;
+    std::vector<uint8_t> initialSplitEdgeCount;
+    std::vector<uint32_t> hangingEdgeOfVertex;
+    std::vector<uint32_t> halvedEdges;
+    std::vector<XrVector3f> faceNormals;
+    std::vector<float> scores;
+    std::vector<uint32_t> candidates;
+
+    if (stencils != nullptr) {
+        stencils->Begin(vertices.size());
+    }
+
+    for (int level = 0; level < settings.MaxLevels; ++level) {
+        topology.Build(indices, vertices.size(), pool);
+        const size_t triangleCount = topology.TriangleCount();
+        const size_t edgeCount = topology.EdgeCount();
+
+        edgeVertex.assign(edgeCount, kNoVertex);
+        initialEdgeSplit.assign(edgeCount, 0);
+        for (uint32_t e = 0; e < edgeCount; ++e) {
+            const MeshTopology::Edge& edge = topology.GetEdge(e);
+            const auto it = edgeVertices.find(EdgeKey(edge.v0, edge.v1));
+            if (it != edgeVertices.end()) {
+                edgeVertex[e] = it->second;
+                initialEdgeSplit[e] = 1;
+            }
+        }
+        initialSplitEdgeCount.assign(triangleCount, 0);
+        for (size_t h = 0; h < topology.HalfEdgeCount(); ++h) {
+            initialSplitEdgeCount[h / 3] += initialEdgeSplit[topology.HalfEdgeEdge(h)];
+        }
+
+        // The halves of a hanging edge run from its vertex to one of its endpoints.
+        hangingEdgeOfVertex.assign(vertices.size(), kNoEdge);
+        for (uint32_t e = 0; e < edgeCount; ++e) {
+            if (initialEdgeSplit[e]) {
+                hangingEdgeOfVertex[edgeVertex[e]] = e;
+            }
+        }
+        halvedEdges.assign(edgeCount, kNoEdge);
+        for (uint32_t e = 0; e < edgeCount; ++e) {
+            const MeshTopology::Edge& edge = topology.GetEdge(e);
+            for (const auto& ends : {std::make_pair(edge.v0, edge.v1), std::make_pair(edge.v1, edge.v0)}) {
+                const uint32_t hanging = hangingEdgeOfVertex[ends.first];
+                if (hanging != kNoEdge &&
+                    (topology.GetEdge(hanging).v0 == ends.second || topology.GetEdge(hanging).v1 == ends.second)) {
+                    halvedEdges[e] = hanging;
+                }
+            }
+        }
+
+        faceNormals.resize(triangleCount);
+        scores.resize(triangleCount);
+        ParallelFor(pool, triangleCount, kItemsPerTask, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                const XrVector3f& v0 = vertices[indices[t * 3]];
+                const XrVector3f& v1 = vertices[indices[t * 3 + 1]];
+                const XrVector3f& v2 = vertices[indices[t * 3 + 2]];
+                faceNormals[t] = VectorMath::normalize(VectorMath::cross_product(
+                    VectorMath::subtract(v1, v0), VectorMath::subtract(v2, v0)));
+            }
+        });
+        ParallelFor(pool, triangleCount, kItemsPerTask, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                scores[t] = RefinementScore(
+                    settings, topology, vertices, indices, faceNormals, static_cast<uint32_t>(t));
+            }
+        });
+
+        // Worst offenders first; the triangle index keeps the order deterministic.
+        candidates.clear();
+        for (uint32_t t = 0; t < triangleCount; ++t) {
+            if (scores[t] > 1.0f) {
+                candidates.push_back(t);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [&scores](uint32_t a, uint32_t b) {
+            return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+        });
+
+        // Largest prefix of the candidates whose closed marking fits the budget. The
+        // output size only grows with the prefix, so a binary search finds it.
+        size_t accepted = candidates.size();
+        auto fits = [&](size_t markedCount) {
+            return CloseMarking(
+                       topology, initialEdgeSplit, initialSplitEdgeCount, halvedEdges, candidates, markedCount, closure) <=
+                settings.TriangleBudget;
+        };
+        if (!fits(accepted)) {
+            size_t low = 0;
+            size_t high = accepted;
+            while (low < high) {
+                const size_t mid = (low + high + 1) / 2;
+                if (fits(mid)) {
+                    low = mid;
+                } else {
+                    high = mid - 1;
+                }
+            }
+            accepted = low;
+            CloseMarking(topology, initialEdgeSplit, initialSplitEdgeCount, halvedEdges, candidates, accepted, closure);
+        }
+        if (accepted == 0) {
+            break;
+        }
+
+        // New edge vertices, numbered in edge order.
+        if (stencils != nullptr) {
+            const float one = 1.0f;
+            for (uint32_t i = 0; i < vertices.size(); ++i) {
+                stencils->AddVertex(&i, &one, 1);
+            }
+        }
+        for (uint32_t e = 0; e < edgeCount; ++e) {
+            if (closure.EdgeSplit[e] && edgeVertex[e] == kNoVertex) {
+                edgeVertex[e] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(EdgeVertexPosition(topology, vertices, indices, e, stencils));
+                const MeshTopology::Edge& edge = topology.GetEdge(e);
+                edgeVertices.emplace(EdgeKey(edge.v0, edge.v1), edgeVertex[e]);
+            }
+        }
+        if (stencils != nullptr) {
+            stencils->EndLevel();
+        }
+
+        // Red triangles are replaced by their four children, as in LoopSubdivision.
+        // Everything else is carried over unchanged; green splits are only emitted at the end.
+        nextIndices.clear();
+        nextIndices.reserve(indices.size() + candidates.size() * 9);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            const uint32_t v0_idx = indices[t * 3];
+            const uint32_t v1_idx = indices[t * 3 + 1];
+            const uint32_t v2_idx = indices[t * 3 + 2];
+            if (!closure.Red[t]) {
+                nextIndices.insert(nextIndices.end(), {v0_idx, v1_idx, v2_idx});
+                continue;
+            }
+            const uint32_t m0 = edgeVertex[topology.HalfEdgeEdge(t * 3)];
+            const uint32_t m1 = edgeVertex[topology.HalfEdgeEdge(t * 3 + 1)];
+            const uint32_t m2 = edgeVertex[topology.HalfEdgeEdge(t * 3 + 2)];
+            nextIndices.insert(nextIndices.end(), {
+                v0_idx, m0, m2,
+                v1_idx, m1, m0,
+                v2_idx, m2, m1,
+                m0, m1, m2});
+        }
+        std::swap(indices, nextIndices);
+    }
+
+    // Close the remaining hanging vertices with green bisections. The red closure leaves
+    // every triangle with at most one split edge, and the halves of that edge unsplit.
+    nextIndices.clear();
+    nextIndices.reserve(indices.size() * 2);
+    for (size_t t = 0; t < indices.size() / 3; ++t) {
+        const uint32_t* tri = &indices[t * 3];
+        uint32_t splitCorner = 3;
+        uint32_t edgeVertexIndex = kNoVertex;
+        if (!edgeVertices.empty()) {
+            for (uint32_t corner = 0; corner < 3; ++corner) {
+                const auto it = edgeVertices.find(EdgeKey(tri[corner], tri[(corner + 1) % 3]));
+                if (it != edgeVertices.end()) {
+                    splitCorner = corner;
+                    edgeVertexIndex = it->second;
+                    break;
+                }
+            }
+        }
+        if (splitCorner == 3) {
+            nextIndices.insert(nextIndices.end(), {tri[0], tri[1], tri[2]});
+            continue;
+        }
+        const uint32_t a = tri[splitCorner];
+        const uint32_t b = tri[(splitCorner + 1) % 3];
+        const uint32_t c = tri[(splitCorner + 2) % 3];
+        nextIndices.insert(nextIndices.end(), {a, edgeVertexIndex, c, edgeVertexIndex, b, c});
+    }
+
+    return {std::move(vertices), std::move(nextIndices)};
+}
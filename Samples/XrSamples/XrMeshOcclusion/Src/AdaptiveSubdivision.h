@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <openxr/openxr.h>
+
+class ThreadPool;
+class SubdivisionStencils;
+
+// Budgeted red-green refinement of a triangle mesh.
+//
+// Each level marks the triangles that are too coarse (long edges, sharp creases or
+// large as seen from the viewer) and splits them 1-to-4 ("red"). A triangle that ends
+// up with two or more split edges is made red as well, and so is the coarse side of an
+// edge when one of its halves on the other side is split, which keeps neighbors at most
+// one level apart. A triangle left with a single split edge is bisected ("green") in
+// the output only, so the result has no T-junctions at any depth. Green triangles are
+// never refined further: if one needs more detail, its parent is made red in the next
+// level instead.
+//
+// Original vertices keep their positions and new edge vertices use the Loop odd rule,
+// so flat walls and floors stay flat while creases get extra vertices for expansion.
+class AdaptiveSubdivision {
+public:
+    struct Settings {
+        // Refinement levels; each one at most quadruples a triangle.
+        int MaxLevels = 2;
+        // Upper bound for the output triangle count. Candidates are accepted in order of
+        // how far they exceed the thresholds below until the budget is used up.
+        size_t TriangleBudget = 100000;
+        // Triangles whose longest edge is below this are never split.
+        float MinEdgeLength = 0.05f;
+        // Triangles with a longer edge are always candidates (meters).
+        float MaxEdgeLength = 0.5f;
+        // Triangles meeting a neighbor at a sharper angle than this are candidates (radians).
+        float MaxDihedralAngle = 0.44f; // ~25 degrees
+        // Triangles whose longest edge subtends a larger angle than this as seen from
+        // ViewerPosition are candidates (radians, small angle approximation).
+        float MaxViewAngle = 0.1f;
+        // Viewer position in the mesh's space; ignored unless HasViewer is set.
+        bool HasViewer = false;
+        XrVector3f ViewerPosition = {0.0f, 0.0f, 0.0f};
+    };
+
+    // When stencils is given it receives the weights from the original to the output
+    // vertices, so refreshed positions can reuse this refinement without re-deciding it.
+    static std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> subdivide(
+        const std::vector<XrVector3f>& originalVertices,
+        const std::vector<uint32_t>& originalIndices,
+        const Settings& settings,
+        ThreadPool* pool = nullptr,
+        SubdivisionStencils* stencils = nullptr);
+};
@@ -0,0 +1,115 @@
+#include "AnchorLocator.h"
+
+#include <algorithm>
+#include <cmath>
+
+void AnchorLocator::Track(XrSpace space) {
+    auto inserted = Locations_.emplace(space, Location());
+    Location& location = inserted.first->second;
+    if (inserted.second) {
+        location.Phase = NextPhase_++ % std::max(Settings_.StaticInterval, 1u);
+    }
+    location.IsStatic = false;
+    location.StableFrames = 0;
+}
+
+void AnchorLocator::Untrack(XrSpace space) {
+    Locations_.erase(space);
+}
+
+void AnchorLocator::Clear() {
+    Locations_.clear();
+    DueSpaces_.clear();
+    DueLocations_.clear();
+}
+
+void AnchorLocator::Invalidate() {
+    for (auto& entry : Locations_) {
+        entry.second.IsStatic = false;
+        entry.second.StableFrames = 0;
+    }
+}
+
+const AnchorLocator::Location* AnchorLocator::Find(XrSpace space) const {
+    auto entry = Locations_.find(space);
+    return entry != Locations_.end() ? &entry->second : nullptr;
+}
+
+void AnchorLocator::Apply(Location& location, const XrPosef& pose, XrSpaceLocationFlags flags) const {
+    const XrSpaceLocationFlags validFlags =
+        XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT;
+    if ((flags & validFlags) != validFlags) {
+        location.IsStatic = false;
+        location.StableFrames = 0;
+        return;
+    }
+    // Measured from where the run began rather than from the last location, so that an
+    // anchor drifting by less than the tolerance per frame still ends its run.
+    bool stable = false;
+    if (location.StableFrames > 0) {
+        const XrVector3f& a = location.StablePose.position;
+        const XrQuaternionf& p = location.StablePose.orientation;
+        const XrQuaternionf& q = pose.orientation;
+        const float dx = pose.position.x - a.x;
+        const float dy = pose.position.y - a.y;
+        const float dz = pose.position.z - a.z;
+        const float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        // Angle of the rotation between the orientations
+        const float dot = std::min(std::fabs(p.x * q.x + p.y * q.y + p.z * q.z + p.w * q.w), 1.0f);
+        const float angle = 2.0f * std::acos(dot);
+        stable = distance <= Settings_.StableDistance && angle <= Settings_.StableAngle;
+    }
+    if (stable) {
+        ++location.StableFrames;
+    } else {
+        location.StablePose = pose;
+        location.StableFrames = 1;
+    }
+    location.IsStatic = location.StableFrames > Settings_.StableFrames;
+    location.Pose = pose;
+    location.IsValid = true;
+}
+
+void AnchorLocator::Update(XrSession session, XrSpace baseSpace, XrTime time) {
+    const uint32_t interval = std::max(Settings_.StaticInterval, 1u);
+    const uint32_t phase = static_cast<uint32_t>(Frame_++ % interval);
+    DueSpaces_.clear();
+    DueLocations_.clear();
+    for (auto& entry : Locations_) {
+        if (!entry.second.IsStatic || entry.second.Phase == phase) {
+            DueSpaces_.push_back(entry.first);
+            DueLocations_.push_back(&entry.second);
+        }
+    }
+    if (DueSpaces_.empty()) {
+        return;
+    }
+
+#if defined(XR_KHR_locate_spaces)
+    if (LocateSpaces_ != nullptr) {
+        LocationData_.resize(DueSpaces_.size());
+        XrSpacesLocateInfoKHR locateInfo = {XR_TYPE_SPACES_LOCATE_INFO_KHR};
+        locateInfo.baseSpace = baseSpace;
+        locateInfo.time = time;
+        locateInfo.spaceCount = static_cast<uint32_t>(DueSpaces_.size());
+        locateInfo.spaces = DueSpaces_.data();
+        XrSpaceLocationsKHR locations = {XR_TYPE_SPACE_LOCATIONS_KHR};
+        locations.locationCount = static_cast<uint32_t>(LocationData_.size());
+        locations.locations = LocationData_.data();
+        if (XR_SUCCEEDED(LocateSpaces_(session, &locateInfo, &locations))) {
+            for (size_t i = 0; i < DueSpaces_.size(); ++i) {
+                Apply(*DueLocations_[i], LocationData_[i].pose, LocationData_[i].locationFlags);
+            }
+            return;
+        }
+    }
+#endif
+    (void)session;
+    for (size_t i = 0; i < DueSpaces_.size(); ++i) {
+        XrSpaceLocation spaceLocation = {XR_TYPE_SPACE_LOCATION};
+        if (XR_FAILED(xrLocateSpace(DueSpaces_[i], baseSpace, time, &spaceLocation))) {
+            spaceLocation.locationFlags = 0;
+        }
+        Apply(*DueLocations_[i], spaceLocation.pose, spaceLocation.locationFlags);
+    }
+}
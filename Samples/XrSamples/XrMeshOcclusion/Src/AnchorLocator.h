@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <openxr/openxr.h>
+
+// Poses of the scene's anchors, located once per frame for all of them: with one
+// xrLocateSpacesKHR call when the runtime has XR_KHR_locate_spaces, with xrLocateSpace
+// per anchor otherwise.
+//
+// Room anchors hardly ever move, so an anchor whose pose stays within the tolerance of
+// where it was StableFrames locations ago, on every location since, is flagged static
+// and from then on only located every StaticInterval frames, the static anchors spread
+// evenly over those frames. One that is found to have moved away from that pose, also
+// by slow drift, is located every frame again until it settles. Invalidate makes every
+// anchor moving again, for when the base space is about to change
+// (XR_TYPE_EVENT_DATA_REFERENCE_SPACE_CHANGE_PENDING). The runtime calls per frame thus
+// follow the number of moving anchors rather than of all anchors.
+class AnchorLocator {
+public:
+    struct Settings {
+        // Largest change from the start of a run of locations that counts as not moving
+        float StableDistance = 0.001f; // metres
+        float StableAngle = 0.002f; // radians
+        uint32_t StableFrames = 30;
+        uint32_t StaticInterval = 90;
+    };
+
+    struct Location {
+        XrPosef Pose = {{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+        // Set once the anchor was located with a valid position and orientation; Pose is
+        // the last such location.
+        bool IsValid = false;
+        bool IsStatic = false;
+        // Locations in a row within the tolerance of StablePose, the first of them; 0 when
+        // the next one starts a new run.
+        uint32_t StableFrames = 0;
+        XrPosef StablePose = {{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+        uint32_t Phase = 0; // frame within StaticInterval on which a static anchor is located
+    };
+
+    AnchorLocator() = default;
+    explicit AnchorLocator(const Settings& settings) : Settings_(settings) {}
+
+#if defined(XR_KHR_locate_spaces)
+    // Batches the locations; null (the default) for one xrLocateSpace per anchor.
+    void SetLocateSpaces(PFN_xrLocateSpacesKHR locateSpaces) {
+        LocateSpaces_ = locateSpaces;
+    }
+#endif
+
+    // Starts locating space from the next Update. Tracking a space again only makes it
+    // moving again.
+    void Track(XrSpace space);
+    void Untrack(XrSpace space);
+    void Clear();
+
+    // Locates the anchors due this frame relative to baseSpace at time.
+    void Update(XrSession session, XrSpace baseSpace, XrTime time);
+
+    // Treats every anchor as moving again, so each is located on the next frames.
+    void Invalidate();
+
+    // The anchor's location, or null when space is not tracked.
+    const Location* Find(XrSpace space) const;
+
+    size_t TrackedCount() const {
+        return Locations_.size();
+    }
+    // Anchors located by the last Update
+    size_t LocatedCount() const {
+        return DueSpaces_.size();
+    }
+    const std::vector<XrSpace>& LocatedSpaces() const {
+        return DueSpaces_;
+    }
+
+private:
+    void Apply(Location& location, const XrPosef& pose, XrSpaceLocationFlags flags) const;
+
+    Settings Settings_;
+    std::unordered_map<XrSpace, Location> Locations_;
+    uint64_t Frame_ = 0;
+    uint32_t NextPhase_ = 0;
+#if defined(XR_KHR_locate_spaces)
+    PFN_xrLocateSpacesKHR LocateSpaces_ = nullptr;
+    std::vector<XrSpaceLocationDataKHR> LocationData_;
+#endif
+    // Anchors being located by Update
+    std::vector<XrSpace> DueSpaces_;
+    std::vector<Location*> DueLocations_;
+};
@@ -18,6 +18,8 @@
  */
 #pragma once
 
+#include <string>
+
 #include <openxr/openxr.h>
 
 class ExternalDataHandler {
@@ -27,4 +29,7 @@ class ExternalDataHandler {
     virtual bool LoadSharedGroupUuid(XrUuidEXT& groupUuid) = 0;
 
     virtual bool WriteSharedGroupUuid(const XrUuidEXT& groupUuid) = 0;
+
+    // Directory of the app's files, with the trailing separator, e.g. for scene traces.
+    virtual std::string GetDataDirectory() const = 0;
 };
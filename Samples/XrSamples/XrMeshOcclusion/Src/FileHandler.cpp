@@ -121,3 +121,7 @@ bool FileHandler::WriteSharedGroupUuid(
     fclose(file);
     return (res > 0);
 }
+
+std::string FileHandler::GetDataDirectory() const {
+    return dataDir;
+}
@@ -30,6 +30,8 @@ class FileHandler : public ExternalDataHandler {
 
     bool WriteSharedGroupUuid(const XrUuidEXT& groupUuid) override;
 
+    std::string GetDataDirectory() const override;
+
    private:
     std::string dataDir;
     const char* kSharedGroupUuidFilename = "sharedGroupUuid.txt";
@@ -0,0 +1,150 @@
+#include "FrustumCulling.h"
+#include "MeshletMesh.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+enum PlaneIndex { kLeft, kRight, kBottom, kTop, kNear, kFar };
+
+// Plane that is always satisfied, for planes at infinity.
+constexpr StereoFrustum::Plane kEverywhere = {0.0f, 0.0f, 0.0f, 1.0f};
+
+StereoFrustum::Plane Normalized(float x, float y, float z, float w) {
+    const float length = std::sqrt(x * x + y * y + z * z);
+    if (length < 1e-6f) {
+        return kEverywhere;
+    }
+    return {x / length, y / length, z / length, w / length};
+}
+
+// The six planes of one eye (Gribb & Hartmann), from the rows of projection * view.
+std::array<StereoFrustum::Plane, 6> EyePlanes(const OVR::Matrix4f& view, const OVR::Matrix4f& proj) {
+    // The matrices are stored transposed, so their product in reverse order is the
+    // transposed clip matrix.
+    const OVR::Matrix4f clip = (view * proj).Transposed();
+    const float(*m)[4] = clip.M;
+    std::array<StereoFrustum::Plane, 6> planes;
+    planes[kLeft] = Normalized(m[3][0] + m[0][0], m[3][1] + m[0][1], m[3][2] + m[0][2], m[3][3] + m[0][3]);
+    planes[kRight] = Normalized(m[3][0] - m[0][0], m[3][1] - m[0][1], m[3][2] - m[0][2], m[3][3] - m[0][3]);
+    planes[kBottom] = Normalized(m[3][0] + m[1][0], m[3][1] + m[1][1], m[3][2] + m[1][2], m[3][3] + m[1][3]);
+    planes[kTop] = Normalized(m[3][0] - m[1][0], m[3][1] - m[1][1], m[3][2] - m[1][2], m[3][3] - m[1][3]);
+    planes[kNear] = Normalized(m[3][0] + m[2][0], m[3][1] + m[2][1], m[3][2] + m[2][2], m[3][3] + m[2][3]);
+    planes[kFar] = Normalized(m[3][0] - m[2][0], m[3][1] - m[2][1], m[3][2] - m[2][2], m[3][3] - m[2][3]);
+    return planes;
+}
+
+// One plane with the average normal that passes through the closest point of whichever
+// input plane lies further out.
+StereoFrustum::Plane Merge(const StereoFrustum::Plane& a, const StereoFrustum::Plane& b) {
+    const bool aEverywhere = a.X == 0.0f && a.Y == 0.0f && a.Z == 0.0f;
+    const bool bEverywhere = b.X == 0.0f && b.Y == 0.0f && b.Z == 0.0f;
+    if (aEverywhere || bEverywhere) {
+        return kEverywhere;
+    }
+    const StereoFrustum::Plane n = Normalized(a.X + b.X, a.Y + b.Y, a.Z + b.Z, 0.0f);
+    const float wa = a.W * (n.X * a.X + n.Y * a.Y + n.Z * a.Z);
+    const float wb = b.W * (n.X * b.X + n.Y * b.Y + n.Z * b.Z);
+    return {n.X, n.Y, n.Z, std::max(wa, wb)};
+}
+
+} // namespace
+
+void StereoFrustum::Set(const OVR::Matrix4f view[2], const OVR::Matrix4f proj[2]) {
+    const std::array<Plane, 6> left = EyePlanes(view[0], proj[0]);
+    const std::array<Plane, 6> right = EyePlanes(view[1], proj[1]);
+    Planes_[kLeft] = left[kLeft];
+    Planes_[kRight] = right[kRight];
+    for (const int i : {kBottom, kTop, kNear, kFar}) {
+        Planes_[i] = Merge(left[i], right[i]);
+    }
+    // The stored views are transposed, so the eye is in the last row of the inverse.
+    for (int eye = 0; eye < 2; ++eye) {
+        const OVR::Matrix4f inverse = view[eye].Inverted();
+        Eyes_[eye] = OVR::Vector3f(inverse.M[3][0], inverse.M[3][1], inverse.M[3][2]);
+    }
+}
+
+size_t StereoFrustum::CullMeshlets(
+    const MeshletMesh& meshlets,
+    const OVR::Posef& pose,
+    float expansion,
+    float expansionPerMetre,
+    bool cullBackFacing,
+    std::vector<uint8_t>& visible) const {
+    // Everything in mesh space: the planes and eyes move instead of the meshlets.
+    std::array<Plane, 6> planes;
+    for (size_t i = 0; i < Planes_.size(); ++i) {
+        const Plane& p = Planes_[i];
+        const OVR::Vector3f n = pose.Rotation.InverseRotate(OVR::Vector3f(p.X, p.Y, p.Z));
+        planes[i] = {n.x, n.y, n.z, p.W + p.X * pose.Translation.x + p.Y * pose.Translation.y + p.Z * pose.Translation.z};
+    }
+    const OVR::Vector3f eyes[2] = {pose.InverseTransform(Eyes_[0]), pose.InverseTransform(Eyes_[1])};
+
+    const std::vector<MeshletMesh::Meshlet>& list = meshlets.Meshlets();
+    visible.resize(list.size());
+    size_t visibleCount = 0;
+    for (size_t m = 0; m < list.size(); ++m) {
+        const MeshletMesh::Meshlet& meshlet = list[m];
+        const OVR::Vector3f center(meshlet.Center.x, meshlet.Center.y, meshlet.Center.z);
+        const float distance = (center - eyes[0]).Length();
+        const float radius = meshlet.Radius + expansion + expansionPerMetre * (distance + meshlet.Radius);
+        bool inside = true;
+        for (const Plane& p : planes) {
+            if (p.X * center.x + p.Y * center.y + p.Z * center.z + p.W < -radius) {
+                inside = false;
+                break;
+            }
+        }
+        // Pushing the triangles out along their normals keeps them in front of the apex,
+        // so the cone still holds with the expansion.
+        if (inside && cullBackFacing && meshlet.ConeCutoff < 1.0f) {
+            const OVR::Vector3f apex(meshlet.ConeApex.x, meshlet.ConeApex.y, meshlet.ConeApex.z);
+            const OVR::Vector3f axis(meshlet.ConeAxis.x, meshlet.ConeAxis.y, meshlet.ConeAxis.z);
+            bool backFacing = true;
+            for (const OVR::Vector3f& eye : eyes) {
+                const OVR::Vector3f toApex = apex - eye;
+                const float length = toApex.Length();
+                if (length <= 0.0f || toApex.Dot(axis) < meshlet.ConeCutoff * length) {
+                    backFacing = false;
+                    break;
+                }
+            }
+            inside = !backFacing;
+        }
+        visible[m] = inside ? 1 : 0;
+        visibleCount += inside ? 1 : 0;
+    }
+    return visibleCount;
+}
+
+size_t StereoFrustum::AddBox(const OVR::Posef& pose, const OVR::Bounds3f& localBounds, float margin) {
+    const OVR::Vector3f localCenter = localBounds.GetCenter();
+    const OVR::Vector3f localExtent = localBounds.GetSize() * 0.5f;
+    const OVR::Vector3f center = pose.Transform(localCenter);
+    // Half extents of the rotated box: each world axis sums the absolute projections
+    // of the local ones.
+    const OVR::Matrix4f rotation(pose.Rotation);
+    float extent[3];
+    for (int i = 0; i < 3; ++i) {
+        extent[i] = std::fabs(rotation.M[i][0]) * localExtent.x + std::fabs(rotation.M[i][1]) * localExtent.y +
+            std::fabs(rotation.M[i][2]) * localExtent.z + margin;
+    }
+    Centers_.push_back({center.x, center.y, center.z});
+    Extents_.push_back({extent[0], extent[1], extent[2]});
+    return Centers_.size() - 1;
+}
+
+void StereoFrustum::ClearBoxes() {
+    Centers_.clear();
+    Extents_.clear();
+    Visible_.clear();
+}
+
+void StereoFrustum::Cull(ThreadPool* pool) {
+    VectorMathSimd::ToSoA(Centers_.data(), Centers_.size(), CentersSoA_);
+    VectorMathSimd::ToSoA(Extents_.data(), Extents_.size(), ExtentsSoA_);
+    Visible_.resize(Centers_.size());
+    VectorMathSimd::CullBoxes(CentersSoA_, ExtentsSoA_, &Planes_[0].X, Planes_.size(), Visible_.data(), pool);
+}
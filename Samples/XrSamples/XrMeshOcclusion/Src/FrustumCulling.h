@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <openxr/openxr.h>
+
+#include "OVR_Math.h"
+#include "VectorMathSimd.h"
+
+class MeshletMesh;
+class ThreadPool;
+
+// Culls boxes against one frustum enclosing both eyes' views, so every object is tested
+// once per frame rather than once per eye.
+//
+// The left and right planes are the left eye's left and the right eye's right plane.
+// The other four merge the two eyes' planes into one with their average normal, moved
+// out until it passes through both; for the nearly parallel views of a headset that
+// contains both frusta. An infinite far plane is left out.
+class StereoFrustum {
+public:
+    // Inside where X * x + Y * y + Z * z + W >= 0; (X, Y, Z) is unit length.
+    struct Plane {
+        float X;
+        float Y;
+        float Z;
+        float W;
+    };
+
+    // view and proj are the per-eye matrices stored column major, as in
+    // ovrAppRenderer::FrameIn; index 0 is the left eye.
+    void Set(const OVR::Matrix4f view[2], const OVR::Matrix4f proj[2]);
+
+    const std::array<Plane, 6>& Planes() const { return Planes_; }
+
+    // Eye positions in world space.
+    const OVR::Vector3f& EyePosition(int eye) const { return Eyes_[eye]; }
+
+    // Per-meshlet test of a mesh placed at pose: visible[m] is set to whether meshlet m's
+    // bounding sphere, grown by the vertex shader expansion at its distance, intersects
+    // the frustum and, with cullBackFacing, whether it faces at least one eye according
+    // to its normal cone. Returns the number of visible meshlets.
+    size_t CullMeshlets(
+        const MeshletMesh& meshlets,
+        const OVR::Posef& pose,
+        float expansion,
+        float expansionPerMetre,
+        bool cullBackFacing,
+        std::vector<uint8_t>& visible) const;
+
+    // Queues the world space box around localBounds placed at pose, grown by margin on
+    // every side, for the next Cull. Returns its index.
+    size_t AddBox(const OVR::Posef& pose, const OVR::Bounds3f& localBounds, float margin);
+    void ClearBoxes();
+
+    // Tests the queued boxes; IsVisible then tells which of them intersect the frustum.
+    void Cull(ThreadPool* pool = nullptr);
+
+    size_t BoxCount() const { return Centers_.size(); }
+    bool IsVisible(size_t box) const { return Visible_[box] != 0; }
+
+private:
+    std::array<Plane, 6> Planes_ = {};
+    OVR::Vector3f Eyes_[2];
+    std::vector<XrVector3f> Centers_;
+    std::vector<XrVector3f> Extents_;
+    std::vector<uint8_t> Visible_;
+    VectorMathSimd::Vector3SoA CentersSoA_;
+    VectorMathSimd::Vector3SoA ExtentsSoA_;
+};
@@ -0,0 +1,77 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+
+#if defined(_WIN32)
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        Error_ = "cannot open " + path;
+        return false;
+    }
+    FileData_.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(FileData_.data()), FileData_.size())) {
+        Error_ = "cannot read " + path;
+        FileData_.clear();
+        return false;
+    }
+    Data_ = FileData_.data();
+    Size_ = FileData_.size();
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        Error_ = "cannot open " + path;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        Error_ = "cannot open " + path;
+        return false;
+    }
+    if (info.st_size == 0) {
+        // mmap refuses empty ranges
+        close(fd);
+        return true;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        Error_ = "cannot map " + path;
+        return false;
+    }
+    Data_ = static_cast<const uint8_t*>(data);
+    Size_ = static_cast<size_t>(info.st_size);
+    Mapped_ = true;
+#endif
+    return true;
+}
+
+void MappedFile::Close() {
+#if defined(_WIN32)
+    FileData_.clear();
+    FileData_.shrink_to_fit();
+#else
+    if (Mapped_) {
+        munmap(const_cast<uint8_t*>(Data_), Size_);
+        Mapped_ = false;
+    }
+#endif
+    Data_ = nullptr;
+    Size_ = 0;
+    Error_.clear();
+}
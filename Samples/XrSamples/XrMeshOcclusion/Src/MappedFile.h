@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file: mapped into memory where the platform can, read into
+// memory on Windows. The data stays valid until Close or destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false, with Error() set, when the file cannot be opened or mapped. An empty
+    // file opens with no data.
+    bool Open(const std::string& path);
+    void Close();
+
+    const uint8_t* Data() const {
+        return Data_;
+    }
+    size_t Size() const {
+        return Size_;
+    }
+    const std::string& Error() const {
+        return Error_;
+    }
+
+private:
+    const uint8_t* Data_ = nullptr;
+    size_t Size_ = 0;
+#if defined(_WIN32)
+    std::vector<uint8_t> FileData_;
+#else
+    bool Mapped_ = false;
+#endif
+    std::string Error_;
+};
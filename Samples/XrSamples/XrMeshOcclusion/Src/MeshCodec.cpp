@@ -0,0 +1,610 @@
+#include "MeshCodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Encoding layout:
+//
+//   Header
+//   stream of triangle codes
+//   stream of explicit vertex deltas (varints)
+//   stream of position differences (varints, x y z per new vertex)
+//
+// Each stream is a mode byte and its decoded size (varint), then the bytes as they are
+// (kStoredStream) or a frequency table and rANS data (kRansStream). Values are little
+// endian.
+struct Header {
+    char Magic[4];
+    uint32_t Version;
+    uint32_t VertexCount;
+    uint32_t TriangleCount;
+    float Min[3]; // grid origin
+    float Step;
+};
+
+constexpr char kMagic[4] = {'X', 'R', 'M', 'C'};
+constexpr uint32_t kVersion = 1;
+
+// Largest grid coordinate; parallelogram predictions stay well within 32 bits.
+constexpr uint32_t kMaxGridValue = (1u << 24) - 1;
+
+// A triangle code byte is the edge FIFO entry in the high nibble, or kNoEdge followed by
+// a second byte, and vertex codes in the nibbles after that.
+constexpr uint32_t kFifoSize = 16;
+constexpr uint32_t kNoEdge = 15;
+constexpr uint32_t kNewVertex = 0;
+constexpr uint32_t kRecentVertices = 14; // vertex codes 1 to 14
+constexpr uint32_t kExplicitVertex = 15;
+
+constexpr uint32_t kNone = ~0u;
+
+constexpr uint8_t kStoredStream = 0;
+constexpr uint8_t kRansStream = 1;
+
+// rANS with 32-bit state and byte-wise renormalization, frequencies scaled to 2^12
+constexpr uint32_t kProbBits = 12;
+constexpr uint32_t kProbScale = 1u << kProbBits;
+constexpr uint32_t kRansLow = 1u << 23;
+
+// No symbol is given more than 31/32 of the range, so every decoded symbol takes at
+// least 1/23 of a bit of input (the state shrinks by at least log2(32/31) minus the
+// rounding of x >> kProbBits, about 0.045 bits). That bounds how much a stream can
+// claim to expand to before anything is allocated for it.
+constexpr uint32_t kMaxFrequency = kProbScale - kProbScale / 32;
+constexpr uint64_t kMaxSymbolsPerByte = 8 * 23;
+
+// Far beyond any room mesh, and small enough for the decoded sizes to fit in 32 bits
+constexpr uint32_t kMaxTriangleCount = 1u << 26;
+
+// Below this many bytes the frequency table costs more than entropy coding saves.
+constexpr size_t kMinRansStreamSize = 64;
+
+// An edge a later triangle would have as consecutive corners A, B, and the third vertex
+// of the triangle that left it, on the other side.
+struct Edge {
+    uint32_t A;
+    uint32_t B;
+    uint32_t Opposite;
+};
+
+// The last kFifoSize entries pushed; Get(0) is the most recent.
+template <typename T>
+class Fifo {
+public:
+    explicit Fifo(const T& empty) {
+        std::fill(Entries_, Entries_ + kFifoSize, empty);
+    }
+    void Push(const T& entry) {
+        Entries_[Offset_ & (kFifoSize - 1)] = entry;
+        ++Offset_;
+    }
+    const T& Get(uint32_t i) const {
+        return Entries_[(Offset_ - 1 - i) & (kFifoSize - 1)];
+    }
+
+private:
+    T Entries_[kFifoSize];
+    uint32_t Offset_ = 0;
+};
+
+uint32_t ZigZag(uint32_t value) {
+    return (value << 1) ^ (0u - (value >> 31));
+}
+
+uint32_t UnZigZag(uint32_t value) {
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+void WriteVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool ReadVarint(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        const uint8_t byte = *p++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Scales counts to frequencies summing to kProbScale, at least 1 for every symbol that
+// occurs and at most kMaxFrequency.
+void NormalizeFrequencies(const uint32_t counts[256], size_t total, uint32_t frequencies[256]) {
+    uint32_t sum = 0;
+    int largest = 0;
+    for (int s = 0; s < 256; ++s) {
+        frequencies[s] = 0;
+        if (counts[s] != 0) {
+            const uint64_t scaled = static_cast<uint64_t>(counts[s]) * kProbScale / total;
+            frequencies[s] = std::max<uint32_t>(static_cast<uint32_t>(scaled), 1);
+            sum += frequencies[s];
+            if (counts[s] > counts[largest]) {
+                largest = s;
+            }
+        }
+    }
+    if (sum < kProbScale) {
+        frequencies[largest] += kProbScale - sum;
+    }
+    // Over by the symbols rounded up to 1: taken from the most frequent ones.
+    while (sum > kProbScale) {
+        const int s = static_cast<int>(std::max_element(frequencies, frequencies + 256) - frequencies);
+        const uint32_t taken = std::min(sum - kProbScale, frequencies[s] - 1);
+        frequencies[s] -= taken;
+        sum -= taken;
+    }
+    // A stream of (almost) one symbol: the rest of the range goes to the next most
+    // frequent symbol, or to one that does not occur when there is none.
+    if (frequencies[largest] > kMaxFrequency) {
+        int other = largest ^ 1;
+        for (int s = 0; s < 256; ++s) {
+            if (s != largest && counts[s] > counts[other]) {
+                other = s;
+            }
+        }
+        frequencies[other] += frequencies[largest] - kMaxFrequency;
+        frequencies[largest] = kMaxFrequency;
+    }
+}
+
+void RansEncode(const std::vector<uint8_t>& data, const uint32_t frequencies[256], std::vector<uint8_t>& out) {
+    uint32_t starts[256];
+    uint32_t start = 0;
+    for (int s = 0; s < 256; ++s) {
+        starts[s] = start;
+        start += frequencies[s];
+    }
+    // rANS decodes in the reverse order of encoding; the bytes are written back to
+    // front and reversed at the end.
+    std::vector<uint8_t> reversed;
+    reversed.reserve(data.size() / 2 + 8);
+    uint32_t x = kRansLow;
+    for (size_t i = data.size(); i-- > 0;) {
+        const uint8_t s = data[i];
+        const uint32_t frequency = frequencies[s];
+        const uint32_t xMax = ((kRansLow >> kProbBits) << 8) * frequency;
+        while (x >= xMax) {
+            reversed.push_back(static_cast<uint8_t>(x));
+            x >>= 8;
+        }
+        x = ((x / frequency) << kProbBits) + (x % frequency) + starts[s];
+    }
+    for (int i = 0; i < 4; ++i) {
+        reversed.push_back(static_cast<uint8_t>(x));
+        x >>= 8;
+    }
+    out.insert(out.end(), reversed.rbegin(), reversed.rend());
+}
+
+bool RansDecode(const uint8_t* in, size_t inSize, const uint32_t frequencies[256], size_t count, uint8_t* out) {
+    struct Slot {
+        uint16_t Frequency;
+        uint16_t Bias; // slot - start of the symbol
+        uint8_t Symbol;
+    };
+    std::vector<Slot> slots(kProbScale);
+    uint32_t start = 0;
+    for (int s = 0; s < 256; ++s) {
+        for (uint32_t i = 0; i < frequencies[s]; ++i) {
+            slots[start + i] = {static_cast<uint16_t>(frequencies[s]), static_cast<uint16_t>(i), static_cast<uint8_t>(s)};
+        }
+        start += frequencies[s];
+    }
+
+    if (inSize < 4) {
+        return false;
+    }
+    const uint8_t* p = in;
+    const uint8_t* end = in + inSize;
+    uint32_t x = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+    p += 4;
+    for (size_t i = 0; i < count; ++i) {
+        const Slot& slot = slots[x & (kProbScale - 1)];
+        out[i] = slot.Symbol;
+        x = slot.Frequency * (x >> kProbBits) + slot.Bias;
+        while (x < kRansLow) {
+            if (p == end) {
+                return false;
+            }
+            x = (x << 8) | *p++;
+        }
+    }
+    // The encoder started from kRansLow; anything else is damage.
+    return x == kRansLow && p == end;
+}
+
+void WriteStream(std::vector<uint8_t>& out, const std::vector<uint8_t>& data) {
+    const size_t streamStart = out.size();
+    if (data.size() >= kMinRansStreamSize) {
+        uint32_t counts[256] = {};
+        for (const uint8_t byte : data) {
+            counts[byte]++;
+        }
+        uint32_t frequencies[256];
+        NormalizeFrequencies(counts, data.size(), frequencies);
+
+        out.push_back(kRansStream);
+        WriteVarint(out, static_cast<uint32_t>(data.size()));
+        uint8_t present[32] = {};
+        for (int s = 0; s < 256; ++s) {
+            if (frequencies[s] != 0) {
+                present[s >> 3] |= static_cast<uint8_t>(1 << (s & 7));
+            }
+        }
+        out.insert(out.end(), present, present + sizeof(present));
+        for (int s = 0; s < 256; ++s) {
+            if (frequencies[s] != 0) {
+                WriteVarint(out, frequencies[s] - 1);
+            }
+        }
+        std::vector<uint8_t> encoded;
+        RansEncode(data, frequencies, encoded);
+        WriteVarint(out, static_cast<uint32_t>(encoded.size()));
+        out.insert(out.end(), encoded.begin(), encoded.end());
+        if (out.size() - streamStart < data.size()) {
+            return;
+        }
+        // Did not pay off
+        out.resize(streamStart);
+    }
+    out.push_back(kStoredStream);
+    WriteVarint(out, static_cast<uint32_t>(data.size()));
+    out.insert(out.end(), data.begin(), data.end());
+}
+
+// Reads a stream of at most maxSize bytes.
+bool ReadStream(const uint8_t*& p, const uint8_t* end, uint64_t maxSize, std::vector<uint8_t>& data) {
+    if (p == end) {
+        return false;
+    }
+    const uint8_t mode = *p++;
+    uint32_t size;
+    if (!ReadVarint(p, end, size) || size > maxSize) {
+        return false;
+    }
+    if (mode == kStoredStream) {
+        if (static_cast<size_t>(end - p) < size) {
+            return false;
+        }
+        data.assign(p, p + size);
+        p += size;
+        return true;
+    }
+    if (mode != kRansStream || end - p < 32) {
+        return false;
+    }
+    const uint8_t* present = p;
+    p += 32;
+    uint32_t frequencies[256];
+    uint32_t sum = 0;
+    for (int s = 0; s < 256; ++s) {
+        frequencies[s] = 0;
+        if (present[s >> 3] & (1 << (s & 7))) {
+            uint32_t frequency;
+            if (!ReadVarint(p, end, frequency) || frequency >= kMaxFrequency) {
+                return false;
+            }
+            frequencies[s] = frequency + 1;
+            sum += frequencies[s];
+        }
+    }
+    uint32_t encodedSize;
+    if (sum != kProbScale || !ReadVarint(p, end, encodedSize) || static_cast<size_t>(end - p) < encodedSize ||
+        size > encodedSize * kMaxSymbolsPerByte) {
+        return false;
+    }
+    data.resize(size);
+    if (!RansDecode(p, encodedSize, frequencies, size, data.data())) {
+        return false;
+    }
+    p += encodedSize;
+    return true;
+}
+
+} // namespace
+
+bool MeshCodec::Encode(
+    const std::vector<XrVector3f>& vertices,
+    const std::vector<uint32_t>& indices,
+    const Settings& settings,
+    std::vector<uint8_t>& out) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount > kMaxTriangleCount) {
+        return false;
+    }
+
+    // Grid over the vertices the triangles use
+    float boxMin[3] = {0.0f, 0.0f, 0.0f};
+    float boxMax[3] = {0.0f, 0.0f, 0.0f};
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        if (indices[i] >= vertices.size()) {
+            return false;
+        }
+        const float* p = &vertices[indices[i]].x;
+        for (int k = 0; k < 3; ++k) {
+            boxMin[k] = i == 0 ? p[k] : std::min(boxMin[k], p[k]);
+            boxMax[k] = i == 0 ? p[k] : std::max(boxMax[k], p[k]);
+        }
+    }
+    const float extent = std::max({boxMax[0] - boxMin[0], boxMax[1] - boxMin[1], boxMax[2] - boxMin[2]});
+    float step = std::max(settings.Precision, extent / static_cast<float>(kMaxGridValue));
+    if (!(step > 0.0f)) {
+        step = 1.0f;
+    }
+    const float scale = 1.0f / step;
+
+    std::vector<uint8_t> codes;
+    std::vector<uint8_t> explicitDeltas;
+    std::vector<uint8_t> differences;
+    codes.reserve(triangleCount + triangleCount / 8);
+    differences.reserve(triangleCount * 2);
+
+    std::vector<uint32_t> remap(vertices.size(), kNone); // original -> encoded
+    std::vector<uint32_t> grid; // x y z per encoded vertex
+    grid.reserve(std::min(vertices.size(), triangleCount * 3) * 3);
+    Fifo<Edge> edges({kNone, kNone, kNone});
+    Fifo<uint32_t> recent(kNone);
+    uint32_t next = 0;
+    uint32_t lastExplicit = 0;
+    uint32_t last[3] = {0, 0, 0};
+
+    // Returns the code of an original vertex, numbering it and writing what the decoder
+    // needs to follow. Differences are modulo 2^32, which the decoder undoes exactly.
+    auto codeVertex = [&](uint32_t original, const uint32_t prediction[3]) -> uint32_t {
+        uint32_t& v = remap[original];
+        if (v == kNone) {
+            v = next++;
+            const float* p = &vertices[original].x;
+            for (int k = 0; k < 3; ++k) {
+                const float value = std::round((p[k] - boxMin[k]) * scale);
+                const uint32_t q = static_cast<uint32_t>(std::min(std::max(value, 0.0f), float(kMaxGridValue)));
+                grid.push_back(q);
+                last[k] = q;
+                WriteVarint(differences, ZigZag(q - prediction[k]));
+            }
+            recent.Push(v);
+            return kNewVertex;
+        }
+        for (uint32_t i = 0; i < kRecentVertices; ++i) {
+            if (recent.Get(i) == v) {
+                return 1 + i;
+            }
+        }
+        WriteVarint(explicitDeltas, ZigZag(v - lastExplicit));
+        lastExplicit = v;
+        recent.Push(v);
+        return kExplicitVertex;
+    };
+
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const uint32_t* corners = &indices[t * 3];
+
+        // The most recent edge any rotation of the triangle starts with
+        uint32_t edgeSlot = kNoEdge;
+        int rotation = 0;
+        for (int r = 0; r < 3; ++r) {
+            const uint32_t x = remap[corners[r]];
+            const uint32_t y = remap[corners[(r + 1) % 3]];
+            if (x == kNone || y == kNone) {
+                continue;
+            }
+            for (uint32_t i = 0; i < std::min(edgeSlot, kNoEdge); ++i) {
+                const Edge& edge = edges.Get(i);
+                if (edge.A == x && edge.B == y) {
+                    edgeSlot = i;
+                    rotation = r;
+                    break;
+                }
+            }
+        }
+
+        if (edgeSlot != kNoEdge) {
+            const Edge edge = edges.Get(edgeSlot);
+            const uint32_t x = edge.A;
+            const uint32_t y = edge.B;
+            const uint32_t w = edge.Opposite;
+            uint32_t prediction[3];
+            for (int k = 0; k < 3; ++k) {
+                prediction[k] = grid[x * 3 + k] + grid[y * 3 + k] - grid[w * 3 + k];
+            }
+            const uint32_t code = codeVertex(corners[(rotation + 2) % 3], prediction);
+            codes.push_back(static_cast<uint8_t>((edgeSlot << 4) | code));
+            const uint32_t z = remap[corners[(rotation + 2) % 3]];
+            edges.Push({z, y, x});
+            edges.Push({x, z, y});
+        } else {
+            uint32_t vertexCodes[3];
+            for (int c = 0; c < 3; ++c) {
+                const uint32_t prediction[3] = {last[0], last[1], last[2]};
+                vertexCodes[c] = codeVertex(corners[c], prediction);
+            }
+            codes.push_back(static_cast<uint8_t>((kNoEdge << 4) | vertexCodes[0]));
+            codes.push_back(static_cast<uint8_t>((vertexCodes[1] << 4) | vertexCodes[2]));
+            const uint32_t a = remap[corners[0]];
+            const uint32_t b = remap[corners[1]];
+            const uint32_t c = remap[corners[2]];
+            edges.Push({b, a, c});
+            edges.Push({c, b, a});
+            edges.Push({a, c, b});
+        }
+    }
+
+    Header header = {};
+    std::memcpy(header.Magic, kMagic, sizeof(header.Magic));
+    header.Version = kVersion;
+    header.VertexCount = next;
+    header.TriangleCount = static_cast<uint32_t>(triangleCount);
+    std::memcpy(header.Min, boxMin, sizeof(header.Min));
+    header.Step = step;
+    const size_t headerOffset = out.size();
+    out.resize(headerOffset + sizeof(header));
+    std::memcpy(out.data() + headerOffset, &header, sizeof(header));
+    WriteStream(out, codes);
+    WriteStream(out, explicitDeltas);
+    WriteStream(out, differences);
+    return true;
+}
+
+bool MeshCodec::Decode(
+    const uint8_t* data,
+    size_t size,
+    std::vector<XrVector3f>& vertices,
+    std::vector<uint32_t>& indices) {
+    vertices.clear();
+    indices.clear();
+    Header header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.Magic, kMagic, sizeof(header.Magic)) != 0 || header.Version != kVersion ||
+        header.TriangleCount > kMaxTriangleCount || header.VertexCount > uint64_t(header.TriangleCount) * 3) {
+        return false;
+    }
+    // A triangle takes at most two code bytes and three explicit deltas, and a vertex
+    // three differences, of at most 5 bytes each.
+    const uint8_t* p = data + sizeof(header);
+    const uint8_t* end = data + size;
+    std::vector<uint8_t> codes;
+    std::vector<uint8_t> explicitDeltas;
+    std::vector<uint8_t> differences;
+    if (!ReadStream(p, end, uint64_t(header.TriangleCount) * 2, codes) ||
+        !ReadStream(p, end, uint64_t(header.TriangleCount) * 15, explicitDeltas) ||
+        !ReadStream(p, end, uint64_t(header.VertexCount) * 15, differences) || p != end) {
+        return false;
+    }
+    // Every triangle takes at least one code byte and every vertex three differences,
+    // which bounds the sizes before anything is allocated for them.
+    if (header.TriangleCount > codes.size() || header.VertexCount > differences.size() / 3) {
+        return false;
+    }
+
+    std::vector<uint32_t> grid(static_cast<size_t>(header.VertexCount) * 3);
+    indices.resize(static_cast<size_t>(header.TriangleCount) * 3);
+    const uint8_t* code = codes.data();
+    const uint8_t* codesEnd = code + codes.size();
+    const uint8_t* explicitDelta = explicitDeltas.data();
+    const uint8_t* explicitEnd = explicitDelta + explicitDeltas.size();
+    const uint8_t* difference = differences.data();
+    const uint8_t* differencesEnd = difference + differences.size();
+    Fifo<Edge> edges({kNone, kNone, kNone});
+    Fifo<uint32_t> recent(kNone);
+    uint32_t next = 0;
+    uint32_t lastExplicit = 0;
+    uint32_t last[3] = {0, 0, 0};
+
+    // The vertex of a vertex code, or kNone when the streams do not add up.
+    auto decodeVertex = [&](uint32_t vertexCode, const uint32_t prediction[3]) -> uint32_t {
+        if (vertexCode == kNewVertex) {
+            if (next == header.VertexCount) {
+                return kNone;
+            }
+            const uint32_t v = next++;
+            for (int k = 0; k < 3; ++k) {
+                uint32_t value;
+                if (!ReadVarint(difference, differencesEnd, value)) {
+                    return kNone;
+                }
+                const uint32_t q = prediction[k] + UnZigZag(value);
+                grid[v * 3 + k] = q;
+                last[k] = q;
+            }
+            recent.Push(v);
+            return v;
+        }
+        if (vertexCode <= kRecentVertices) {
+            const uint32_t v = recent.Get(vertexCode - 1);
+            return v < next ? v : kNone;
+        }
+        uint32_t value;
+        if (!ReadVarint(explicitDelta, explicitEnd, value)) {
+            return kNone;
+        }
+        const uint32_t v = lastExplicit + UnZigZag(value);
+        if (v >= next) {
+            return kNone;
+        }
+        lastExplicit = v;
+        recent.Push(v);
+        return v;
+    };
+
+    for (uint32_t t = 0; t < header.TriangleCount; ++t) {
+        uint32_t* corners = &indices[t * 3];
+        if (code == codesEnd) {
+            indices.clear();
+            return false;
+        }
+        const uint32_t first = *code++;
+        const uint32_t edgeSlot = first >> 4;
+        if (edgeSlot != kNoEdge) {
+            const Edge edge = edges.Get(edgeSlot);
+            const uint32_t x = edge.A;
+            const uint32_t y = edge.B;
+            const uint32_t w = edge.Opposite;
+            if (x >= next || y >= next || w >= next) {
+                indices.clear();
+                return false;
+            }
+            uint32_t prediction[3];
+            for (int k = 0; k < 3; ++k) {
+                prediction[k] = grid[x * 3 + k] + grid[y * 3 + k] - grid[w * 3 + k];
+            }
+            const uint32_t z = decodeVertex(first & 15, prediction);
+            if (z == kNone) {
+                indices.clear();
+                return false;
+            }
+            corners[0] = x;
+            corners[1] = y;
+            corners[2] = z;
+            edges.Push({z, y, x});
+            edges.Push({x, z, y});
+        } else {
+            if (code == codesEnd) {
+                indices.clear();
+                return false;
+            }
+            const uint32_t second = *code++;
+            const uint32_t vertexCodes[3] = {first & 15, second >> 4, second & 15};
+            for (int c = 0; c < 3; ++c) {
+                const uint32_t prediction[3] = {last[0], last[1], last[2]};
+                corners[c] = decodeVertex(vertexCodes[c], prediction);
+                if (corners[c] == kNone) {
+                    indices.clear();
+                    return false;
+                }
+            }
+            edges.Push({corners[1], corners[0], corners[2]});
+            edges.Push({corners[2], corners[1], corners[0]});
+            edges.Push({corners[0], corners[2], corners[1]});
+        }
+    }
+    if (next != header.VertexCount || code != codesEnd || explicitDelta != explicitEnd ||
+        difference != differencesEnd) {
+        indices.clear();
+        return false;
+    }
+
+    vertices.resize(header.VertexCount);
+    for (uint32_t v = 0; v < header.VertexCount; ++v) {
+        float* position = &vertices[v].x;
+        for (int k = 0; k < 3; ++k) {
+            position[k] = header.Min[k] + static_cast<float>(static_cast<int32_t>(grid[v * 3 + k])) * header.Step;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <openxr/openxr.h>
+
+// Compact encoding of a runtime room mesh (the vertices and indices of an
+// XrSpaceTriangleMeshMETA), for storing or sending it to another device. At the default
+// precision room meshes take 2 to 8% of their 12-byte positions and 4-byte indices, and
+// decode at several hundred MB/s of those on one core (meshocclusion_benchmark's encode
+// and decode stages).
+//
+// Positions are quantized to a grid of Settings::Precision. Connectivity is coded per
+// triangle in the order given, in the style of meshoptimizer's index codec: a triangle
+// that shares an edge with one of the last 15 edges seen names that edge and its third
+// vertex, and vertices are the next new one, one of the last 14 seen, or an explicit
+// delta. A new vertex is predicted from the triangle across its edge with the
+// parallelogram rule, otherwise from the previous new vertex, and only the difference is
+// kept. The code bytes, explicit deltas and position differences then go through an
+// order-0 rANS entropy coder, stream by stream.
+//
+// The decoded mesh has the same triangles in the same order, with the same winding, but
+// each triangle may start at another corner. Its vertices are the ones the triangles
+// use, numbered in the order they are first used, within half a grid step of the
+// originals on every axis.
+class MeshCodec {
+public:
+    struct Settings {
+        // Grid step of the positions, in metres. Raised where a room is too large for
+        // 2^24 steps on an axis.
+        float Precision = 0.001f;
+    };
+
+    // Appends the encoding of the triangle list indices over vertices to out. A trailing
+    // partial triangle is left out. Returns false, appending nothing, when an index is out
+    // of range or there are more than 2^26 triangles.
+    static bool Encode(
+        const std::vector<XrVector3f>& vertices,
+        const std::vector<uint32_t>& indices,
+        const Settings& settings,
+        std::vector<uint8_t>& out);
+
+    // Replaces vertices and indices with the mesh encoded in data. Returns false, with
+    // both empty, when data is not a complete encoding. Damage that still decodes to a
+    // mesh is not noticed; files and messages carrying an encoding check it themselves.
+    static bool Decode(
+        const uint8_t* data,
+        size_t size,
+        std::vector<XrVector3f>& vertices,
+        std::vector<uint32_t>& indices);
+};
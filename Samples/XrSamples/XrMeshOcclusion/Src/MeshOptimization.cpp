@@ -0,0 +1,329 @@
+#include "MeshOptimization.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// FIFO post-transform cache model. A vertex is cached while fewer than cacheSize
+// misses happened since it was loaded; Flush moves the clock past every entry.
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount, size_t cacheSize)
+        : CacheSize_(cacheSize), Clock_(cacheSize), LoadTime_(vertexCount, 0) {}
+
+    // Returns true on a miss.
+    bool Access(uint32_t vertex) {
+        if (Clock_ - LoadTime_[vertex] < CacheSize_) {
+            return false;
+        }
+        LoadTime_[vertex] = Clock_++;
+        return true;
+    }
+
+    void Flush() {
+        Clock_ += CacheSize_;
+    }
+
+private:
+    size_t CacheSize_;
+    size_t Clock_;
+    std::vector<size_t> LoadTime_;
+};
+
+// Tipsify: fills order with a triangle permutation and boundaries with the positions in
+// order where the next fan starts with a cold cache.
+void Tipsify(
+    const std::vector<uint32_t>& indices,
+    size_t vertexCount,
+    size_t cacheSize,
+    std::vector<uint32_t>& order,
+    std::vector<size_t>& boundaries) {
+    const size_t triangleCount = indices.size() / 3;
+
+    // Triangles around each vertex (CSR). A vertex repeated in a degenerate triangle is
+    // listed once per corner, matching its live count.
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (const uint32_t v : indices) {
+        ++offsets[v + 1];
+    }
+    std::vector<uint32_t> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        live[v] = offsets[v + 1];
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    size_t timestamp = cacheSize + 1;
+    size_t cursor = 0;
+    auto inCache = [&](uint32_t v) { return timestamp - cacheTime[v] <= cacheSize; };
+
+    order.clear();
+    order.reserve(triangleCount);
+    boundaries.clear();
+
+    int64_t fan = -1;
+    while (cursor < vertexCount && live[cursor] == 0) {
+        ++cursor;
+    }
+    if (cursor < vertexCount) {
+        fan = static_cast<int64_t>(cursor);
+    }
+    while (fan >= 0) {
+        candidates.clear();
+        for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+            const uint32_t t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            emitted[t] = true;
+            order.push_back(t);
+            for (int c = 0; c < 3; ++c) {
+                const uint32_t v = indices[t * 3 + c];
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (!inCache(v)) {
+                    cacheTime[v] = timestamp++;
+                }
+            }
+        }
+
+        // Prefer the candidate that stays in the cache while its remaining triangles
+        // are fanned out and that entered the cache earliest.
+        int64_t next = -1;
+        int64_t bestPriority = -1;
+        for (const uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize) {
+                priority = static_cast<int64_t>(timestamp - cacheTime[v]);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        if (next < 0) {
+            // Dead end: back up through recently used vertices, then scan for any
+            // vertex with triangles left.
+            while (!deadEnds.empty() && next < 0) {
+                const uint32_t v = deadEnds.back();
+                deadEnds.pop_back();
+                if (live[v] > 0) {
+                    next = v;
+                }
+            }
+            while (next < 0 && cursor < vertexCount) {
+                if (live[cursor] > 0) {
+                    next = static_cast<int64_t>(cursor);
+                }
+                ++cursor;
+            }
+            if (next >= 0 && !inCache(static_cast<uint32_t>(next))) {
+                boundaries.push_back(order.size());
+            }
+        }
+        fan = next;
+    }
+}
+
+XrVector3f Sub(const XrVector3f& a, const XrVector3f& b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+XrVector3f Cross(const XrVector3f& a, const XrVector3f& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+// Cuts the Tipsify order into clusters and sorts them by occlusion potential: the
+// distance of the cluster centroid from the mesh centroid along the cluster normal.
+// Clusters far out and facing outwards tend to cover the rest of the mesh.
+void SortClustersForOverdraw(
+    const std::vector<uint32_t>& indices,
+    const std::vector<XrVector3f>& vertices,
+    const MeshOptimization::Settings& settings,
+    const std::vector<size_t>& hardBoundaries,
+    std::vector<uint32_t>& order) {
+    const size_t triangleCount = order.size();
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Soft boundaries: once a cluster's cache miss ratio has come down to the mesh
+    // average (times the threshold), starting a new one with a cold cache costs little.
+    FifoCache cache(vertices.size(), settings.VertexCacheSize);
+    size_t totalMisses = 0;
+    for (const uint32_t t : order) {
+        for (int c = 0; c < 3; ++c) {
+            totalMisses += cache.Access(indices[t * 3 + c]) ? 1 : 0;
+        }
+    }
+    const float threshold = settings.OverdrawThreshold * static_cast<float>(totalMisses) / triangleCount;
+
+    std::vector<size_t> clusterStarts;
+    cache.Flush();
+    size_t clusterMisses = 0;
+    size_t nextHard = 0;
+    for (size_t i = 0; i < triangleCount; ++i) {
+        while (nextHard < hardBoundaries.size() && hardBoundaries[nextHard] < i) {
+            ++nextHard;
+        }
+        const bool hard = nextHard < hardBoundaries.size() && hardBoundaries[nextHard] == i;
+        const bool soft = !clusterStarts.empty() &&
+            static_cast<float>(clusterMisses) < threshold * static_cast<float>(i - clusterStarts.back());
+        if (clusterStarts.empty() || hard || soft) {
+            clusterStarts.push_back(i);
+            clusterMisses = 0;
+            cache.Flush();
+        }
+        for (int c = 0; c < 3; ++c) {
+            clusterMisses += cache.Access(indices[order[i] * 3 + c]) ? 1 : 0;
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+
+    struct Cluster {
+        size_t Begin;
+        size_t End;
+        float Potential;
+    };
+    const size_t clusterCount = clusterStarts.size() - 1;
+    std::vector<Cluster> clusters(clusterCount);
+    std::vector<XrVector3f> centroids(clusterCount);
+    std::vector<XrVector3f> normals(clusterCount);
+    double meshArea = 0.0;
+    double meshCentroid[3] = {0.0, 0.0, 0.0};
+    for (size_t k = 0; k < clusterCount; ++k) {
+        double area = 0.0;
+        double centroid[3] = {0.0, 0.0, 0.0};
+        XrVector3f normal = {0.0f, 0.0f, 0.0f};
+        for (size_t i = clusterStarts[k]; i < clusterStarts[k + 1]; ++i) {
+            const uint32_t* tri = &indices[order[i] * 3];
+            const XrVector3f& p0 = vertices[tri[0]];
+            const XrVector3f& p1 = vertices[tri[1]];
+            const XrVector3f& p2 = vertices[tri[2]];
+            const XrVector3f n = Cross(Sub(p1, p0), Sub(p2, p0));
+            const double a = 0.5 * std::sqrt(static_cast<double>(n.x) * n.x + static_cast<double>(n.y) * n.y +
+                                             static_cast<double>(n.z) * n.z);
+            area += a;
+            centroid[0] += a * (p0.x + p1.x + p2.x) / 3.0;
+            centroid[1] += a * (p0.y + p1.y + p2.y) / 3.0;
+            centroid[2] += a * (p0.z + p1.z + p2.z) / 3.0;
+            normal = {normal.x + n.x, normal.y + n.y, normal.z + n.z};
+        }
+        meshArea += area;
+        for (int c = 0; c < 3; ++c) {
+            meshCentroid[c] += centroid[c];
+        }
+        const double scale = area > 0.0 ? 1.0 / area : 0.0;
+        centroids[k] = {
+            static_cast<float>(centroid[0] * scale),
+            static_cast<float>(centroid[1] * scale),
+            static_cast<float>(centroid[2] * scale)};
+        const float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+        normals[k] = length > 1e-12f ? XrVector3f{normal.x / length, normal.y / length, normal.z / length}
+                                     : XrVector3f{0.0f, 0.0f, 0.0f};
+        clusters[k] = {clusterStarts[k], clusterStarts[k + 1], 0.0f};
+    }
+    const double meshScale = meshArea > 0.0 ? 1.0 / meshArea : 0.0;
+    const XrVector3f center = {
+        static_cast<float>(meshCentroid[0] * meshScale),
+        static_cast<float>(meshCentroid[1] * meshScale),
+        static_cast<float>(meshCentroid[2] * meshScale)};
+    for (size_t k = 0; k < clusterCount; ++k) {
+        const XrVector3f d = Sub(centroids[k], center);
+        clusters[k].Potential = d.x * normals[k].x + d.y * normals[k].y + d.z * normals[k].z;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.Potential > b.Potential;
+    });
+    std::vector<uint32_t> sorted;
+    sorted.reserve(triangleCount);
+    for (const Cluster& cluster : clusters) {
+        sorted.insert(sorted.end(), order.begin() + cluster.Begin, order.begin() + cluster.End);
+    }
+    order.swap(sorted);
+}
+
+} // namespace
+
+void MeshOptimization::optimize_triangle_order(
+    std::vector<uint32_t>& indices,
+    const std::vector<XrVector3f>& vertices,
+    const Settings& settings) {
+    const size_t cacheSize = std::max<size_t>(settings.VertexCacheSize, 3);
+    std::vector<uint32_t> order;
+    std::vector<size_t> boundaries;
+    Tipsify(indices, vertices.size(), cacheSize, order, boundaries);
+
+    if (settings.OptimizeOverdraw) {
+        Settings clusterSettings = settings;
+        clusterSettings.VertexCacheSize = cacheSize;
+        SortClustersForOverdraw(indices, vertices, clusterSettings, boundaries, order);
+    }
+
+    std::vector<uint32_t> reordered(indices.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const uint32_t t = order[i];
+        reordered[i * 3 + 0] = indices[t * 3 + 0];
+        reordered[i * 3 + 1] = indices[t * 3 + 1];
+        reordered[i * 3 + 2] = indices[t * 3 + 2];
+    }
+    indices.swap(reordered);
+}
+
+size_t MeshOptimization::optimize_vertex_fetch(
+    std::vector<uint32_t>& indices,
+    size_t vertexCount,
+    std::vector<uint32_t>& remap) {
+    remap.assign(vertexCount, kUnusedVertex);
+    uint32_t next = 0;
+    for (uint32_t& index : indices) {
+        if (remap[index] == kUnusedVertex) {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+    return next;
+}
+
+void MeshOptimization::remap_vertices(
+    std::vector<XrVector3f>& vertices,
+    const std::vector<uint32_t>& remap,
+    size_t newVertexCount) {
+    std::vector<XrVector3f> remapped(newVertexCount);
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        if (remap[i] != kUnusedVertex) {
+            remapped[remap[i]] = vertices[i];
+        }
+    }
+    vertices.swap(remapped);
+}
+
+float MeshOptimization::average_cache_miss_ratio(
+    const std::vector<uint32_t>& indices,
+    size_t vertexCount,
+    size_t cacheSize) {
+    if (indices.size() < 3) {
+        return 0.0f;
+    }
+    FifoCache cache(vertexCount, std::max<size_t>(cacheSize, 1));
+    size_t misses = 0;
+    for (const uint32_t v : indices) {
+        misses += cache.Access(v) ? 1 : 0;
+    }
+    return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
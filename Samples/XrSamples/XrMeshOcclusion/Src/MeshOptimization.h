@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <openxr/openxr.h>
+
+// Reorders a triangle mesh for the GPU before upload, without changing its shape.
+//
+// Triangles are put in Tipsify order (Sander, Nehab & Barczak 2007), which fans around
+// vertices that are still in the post-transform cache so each vertex is shaded about
+// once. Optionally, the result is cut into clusters at points where that costs little
+// cache efficiency and the clusters are sorted so the ones most likely to hide others
+// draw first, which lets early depth testing reject more of the rest. Vertices are then
+// renumbered in first-use order so fetches walk the vertex buffer almost linearly.
+class MeshOptimization {
+public:
+    struct Settings {
+        // Entries in the post-transform cache being optimized for. Tipsify is not very
+        // sensitive to it; 16 is a reasonable value for mobile GPUs.
+        size_t VertexCacheSize = 16;
+        // Sort triangle clusters for less overdraw after the cache optimization.
+        bool OptimizeOverdraw = false;
+        // Clusters are cut where their cache miss ratio drops below this multiple of the
+        // whole mesh's; higher values give more, smaller clusters.
+        float OverdrawThreshold = 1.05f;
+    };
+
+    // Marks vertices that no triangle references in the remap of optimize_vertex_fetch.
+    static constexpr uint32_t kUnusedVertex = ~0u;
+
+    // Reorders the triangles of indices in place. Vertex positions are only read for
+    // the overdraw ordering.
+    static void optimize_triangle_order(
+        std::vector<uint32_t>& indices,
+        const std::vector<XrVector3f>& vertices,
+        const Settings& settings);
+
+    // Renumbers vertices in the order the triangles first use them and rewrites indices
+    // to match. remap[old] receives the new index, or kUnusedVertex for vertices no
+    // triangle uses. Returns the number of vertices kept.
+    static size_t optimize_vertex_fetch(
+        std::vector<uint32_t>& indices,
+        size_t vertexCount,
+        std::vector<uint32_t>& remap);
+
+    // Applies a remap from optimize_vertex_fetch to a vertex array.
+    static void remap_vertices(
+        std::vector<XrVector3f>& vertices,
+        const std::vector<uint32_t>& remap,
+        size_t newVertexCount);
+
+    // Vertex shader invocations per triangle for a FIFO cache of the given size
+    // (between 0.5 for a perfect order on large meshes and 3).
+    static float average_cache_miss_ratio(
+        const std::vector<uint32_t>& indices,
+        size_t vertexCount,
+        size_t cacheSize);
+};
@@ -0,0 +1,114 @@
+#include "MeshPipeline.h"
+#include <algorithm>
+
+MeshPipeline::MeshPipeline(FetchFunction fetch, ThreadPool* pool, ProcessedMeshCache* cache)
+    : Fetch_(std::move(fetch)), Pool_(pool), Cache_(cache), Thread_([this]() { ThreadMain(); }) {}
+
+MeshPipeline::~MeshPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        ShuttingDown_ = true;
+        Requests_.clear();
+    }
+    RequestAvailable_.notify_all();
+    Thread_.join();
+}
+
+void MeshPipeline::Submit(
+    XrSpace space,
+    const ovrMeshProcessingSettings& settings,
+    std::shared_ptr<const ovrProcessedMesh> previous,
+    const XrUuidEXT* uuid) {
+    {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        auto queued = std::find_if(Requests_.begin(), Requests_.end(), [space](const Request& request) {
+            return request.Space == space;
+        });
+        if (queued != Requests_.end()) {
+            queued->Settings = settings;
+            queued->Previous = std::move(previous);
+            queued->HasUuid = uuid != nullptr;
+            queued->Uuid = uuid != nullptr ? *uuid : XrUuidEXT{};
+            return;
+        }
+        Requests_.push_back(
+            {space, settings, std::move(previous), uuid != nullptr, uuid != nullptr ? *uuid : XrUuidEXT{}});
+    }
+    RequestAvailable_.notify_one();
+}
+
+void MeshPipeline::Cancel() {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    Requests_.clear();
+    Completed_.clear();
+    ++Generation_;
+}
+
+size_t MeshPipeline::TakeCompleted(size_t byteBudget, std::vector<Result>& results) {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    size_t bytes = 0;
+    while (!Completed_.empty()) {
+        const size_t meshBytes = Completed_.front().Mesh->UploadBytes();
+        if (bytes > 0 && bytes + meshBytes > byteBudget) {
+            break;
+        }
+        bytes += meshBytes;
+        results.push_back(std::move(Completed_.front()));
+        Completed_.pop_front();
+    }
+    return bytes;
+}
+
+void MeshPipeline::Complete(uint64_t generation, Result result) {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    if (generation == Generation_) {
+        Completed_.push_back(std::move(result));
+    }
+}
+
+void MeshPipeline::ThreadMain() {
+    std::vector<XrVector3f> vertices;
+    std::vector<uint32_t> indices;
+    for (;;) {
+        Request request;
+        uint64_t generation;
+        {
+            std::unique_lock<std::mutex> lock(Mutex_);
+            RequestAvailable_.wait(lock, [this]() { return ShuttingDown_ || !Requests_.empty(); });
+            if (ShuttingDown_) {
+                return;
+            }
+            request = std::move(Requests_.front());
+            Requests_.pop_front();
+            generation = Generation_;
+        }
+
+        // A cached mesh is only worth it for a space that is not drawn yet; a refresh
+        // has the mesh in the scene to show meanwhile.
+        ProcessedMeshCache* cache = request.HasUuid ? Cache_ : nullptr;
+        bool cached = false;
+        uint64_t cachedHash = 0;
+        if (cache != nullptr && request.Previous == nullptr) {
+            std::shared_ptr<ovrProcessedMesh> mesh = cache->Load(request.Uuid, request.Settings, cachedHash);
+            if (mesh != nullptr) {
+                cached = true;
+                Complete(generation, {request.Space, std::move(mesh), true});
+            }
+        }
+
+        if (!Fetch_(request.Space, vertices, indices)) {
+            continue;
+        }
+        const uint64_t contentHash = cache != nullptr ? ProcessedMeshCache::HashMesh(vertices, indices) : 0;
+        if (cached && contentHash == cachedHash) {
+            continue;
+        }
+        std::shared_ptr<ovrProcessedMesh> processed = std::make_shared<ovrProcessedMesh>();
+        processed->Process(vertices, indices, request.Settings, request.Previous.get(), Pool_);
+        // Before handing it out: the GL thread may free its upload data once committed.
+        if (cache != nullptr) {
+            cache->Store(request.Uuid, contentHash, *processed);
+        }
+        Complete(generation, {request.Space, std::move(processed)});
+    }
+}
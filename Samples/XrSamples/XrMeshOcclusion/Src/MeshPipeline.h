@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ProcessedMeshCache.h"
+#include "SceneSharingGl.h"
+
+// Fetches and processes scene meshes on a background thread, so that loading or
+// refreshing the room does not stall the frame loop, and hands the results back to the
+// GL thread a few at a time.
+//
+// Requests run one at a time in the order they were submitted; the processing stages
+// inside use the worker pool. Finished meshes wait until the GL thread takes them with
+// TakeCompleted, which stops at a per-frame upload budget, so meshes show up one after
+// the other as they finish instead of all in the same long frame.
+//
+// With a ProcessedMeshCache, the first request of a space (without a previous result)
+// that comes with its UUID is answered from the cache when there is an entry, before
+// the runtime's mesh is even fetched. The runtime's mesh is then fetched as usual and
+// only processed, handed out and stored when it is not the one the entry was made from.
+class MeshPipeline {
+public:
+    // Copies the runtime's triangle mesh of space, returning false on failure. Runs on
+    // the pipeline thread.
+    using FetchFunction = std::function<
+        bool(XrSpace space, std::vector<XrVector3f>& vertices, std::vector<uint32_t>& indices)>;
+
+    struct Result {
+        XrSpace Space;
+        std::shared_ptr<ovrProcessedMesh> Mesh;
+        bool FromCache = false;
+    };
+
+    // cache may be null; it must outlive the pipeline.
+    MeshPipeline(FetchFunction fetch, ThreadPool* pool, ProcessedMeshCache* cache = nullptr);
+    ~MeshPipeline();
+
+    MeshPipeline(const MeshPipeline&) = delete;
+    MeshPipeline& operator=(const MeshPipeline&) = delete;
+
+    // Queues space for fetching and processing. previous is its last committed result,
+    // whose subdivision is reused when only the vertices moved. Replaces a request for
+    // the same space that has not started yet. uuid, when given, is the space's UUID,
+    // under which the result is cached.
+    void Submit(
+        XrSpace space,
+        const ovrMeshProcessingSettings& settings,
+        std::shared_ptr<const ovrProcessedMesh> previous,
+        const XrUuidEXT* uuid = nullptr);
+
+    // Drops the queued requests, and the results of the running one and of those not
+    // taken yet, e.g. when the scene is cleared.
+    void Cancel();
+
+    // Moves finished meshes, oldest first, to results while their UploadBytes stay within
+    // byteBudget. The first one is always taken, so a mesh over the budget still goes
+    // through, in a frame of its own. Returns the bytes taken.
+    size_t TakeCompleted(size_t byteBudget, std::vector<Result>& results);
+
+private:
+    struct Request {
+        XrSpace Space;
+        ovrMeshProcessingSettings Settings;
+        std::shared_ptr<const ovrProcessedMesh> Previous;
+        bool HasUuid;
+        XrUuidEXT Uuid;
+    };
+
+    void ThreadMain();
+    // Hands result out unless Cancel was called since generation.
+    void Complete(uint64_t generation, Result result);
+
+    FetchFunction Fetch_;
+    ThreadPool* Pool_;
+    ProcessedMeshCache* Cache_;
+    std::mutex Mutex_;
+    std::condition_variable RequestAvailable_;
+    std::deque<Request> Requests_;
+    std::deque<Result> Completed_;
+    uint64_t Generation_ = 0; // bumped by Cancel
+    bool ShuttingDown_ = false;
+    std::thread Thread_; // last, so it starts after the members it uses
+};
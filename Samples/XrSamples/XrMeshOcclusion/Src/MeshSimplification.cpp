@@ -0,0 +1,405 @@
+#include "MeshSimplification.h"
+#include "MeshSubdivision.h"
+#include "MeshTopology.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace {
+
+// Weight of the boundary and feature penalty planes relative to a face plane.
+constexpr double kPenaltyWeight = 100.0;
+// A collapse may not turn any face by more than ~78 degrees.
+constexpr float kMinNormalDot = 0.2f;
+// Cost per squared metre of edge length, far below any error bound. It only orders
+// collapses of equal error: on a flat region every collapse is free, and taking the
+// shortest edges first spreads them over the region instead of piling one fan onto a
+// vertex, whose every collapse would then revisit all of its neighbors.
+constexpr double kEdgeLengthCost = 1e-6;
+
+// Symmetric 4x4 matrix summing squared distances to a set of planes, upper triangle
+// stored row by row: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33.
+struct Quadric {
+    double a[10] = {};
+
+    void AddPlane(double nx, double ny, double nz, double d, double weight) {
+        a[0] += weight * nx * nx; a[1] += weight * nx * ny; a[2] += weight * nx * nz; a[3] += weight * nx * d;
+        a[4] += weight * ny * ny; a[5] += weight * ny * nz; a[6] += weight * ny * d;
+        a[7] += weight * nz * nz; a[8] += weight * nz * d;
+        a[9] += weight * d * d;
+    }
+
+    void Add(const Quadric& q) {
+        for (int i = 0; i < 10; ++i) {
+            a[i] += q.a[i];
+        }
+    }
+
+    double Evaluate(const XrVector3f& p) const {
+        const double x = p.x, y = p.y, z = p.z;
+        return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x +
+            a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y +
+            a[7] * z * z + 2 * a[8] * z + a[9];
+    }
+
+    // Point of least error, if the planes pin one down.
+    bool Minimize(XrVector3f& p) const {
+        const double det = a[0] * (a[4] * a[7] - a[5] * a[5]) - a[1] * (a[1] * a[7] - a[5] * a[2]) +
+            a[2] * (a[1] * a[5] - a[4] * a[2]);
+        if (std::abs(det) < 1e-12) {
+            return false;
+        }
+        const double bx = -a[3], by = -a[6], bz = -a[8];
+        const double inv = 1.0 / det;
+        p.x = static_cast<float>(inv * (bx * (a[4] * a[7] - a[5] * a[5]) - a[1] * (by * a[7] - a[5] * bz) +
+            a[2] * (by * a[5] - a[4] * bz)));
+        p.y = static_cast<float>(inv * (a[0] * (by * a[7] - bz * a[5]) - bx * (a[1] * a[7] - a[5] * a[2]) +
+            a[2] * (a[1] * bz - by * a[2])));
+        p.z = static_cast<float>(inv * (a[0] * (a[4] * bz - a[5] * by) - a[1] * (a[1] * bz - by * a[2]) +
+            bx * (a[1] * a[5] - a[4] * a[2])));
+        return true;
+    }
+};
+
+struct Candidate {
+    float Cost;
+    uint32_t Keep;
+    uint32_t Remove;
+    uint32_t KeepVersion;
+    uint32_t RemoveVersion;
+    XrVector3f Target;
+
+    bool operator>(const Candidate& other) const {
+        return Cost > other.Cost;
+    }
+};
+
+// VectorMath::normalize returns zero for degenerate faces.
+bool IsNonZero(const XrVector3f& v) {
+    return v.x != 0.0f || v.y != 0.0f || v.z != 0.0f;
+}
+
+// Plane through p along the edge direction and perpendicular to the face normal, which
+// penalizes moving the edge sideways out of the face.
+void AddEdgeConstraint(
+    Quadric& quadric,
+    const XrVector3f& p0,
+    const XrVector3f& p1,
+    const XrVector3f& faceNormal) {
+    const XrVector3f normal =
+        VectorMath::normalize(VectorMath::cross_product(VectorMath::subtract(p1, p0), faceNormal));
+    const double d = -(normal.x * p0.x + normal.y * p0.y + normal.z * p0.z);
+    quadric.AddPlane(normal.x, normal.y, normal.z, d, kPenaltyWeight);
+}
+
+class Simplifier {
+public:
+    Simplifier(
+        const std::vector<XrVector3f>& vertices,
+        const std::vector<uint32_t>& indices,
+        const MeshSimplification::Settings& settings)
+        : Settings_(settings), Positions_(vertices), Faces_(indices) {}
+
+    void Run();
+    void Output(std::vector<XrVector3f>& vertices, std::vector<uint32_t>& indices) const;
+
+private:
+    XrVector3f FaceNormal(uint32_t face) const {
+        const uint32_t* f = &Faces_[face * 3];
+        return VectorMath::cross_product(
+            VectorMath::subtract(Positions_[f[1]], Positions_[f[0]]),
+            VectorMath::subtract(Positions_[f[2]], Positions_[f[0]]));
+    }
+
+    void BuildQuadrics(const MeshTopology& topology);
+    void PushCandidate(uint32_t a, uint32_t b);
+    bool CanCollapse(const Candidate& candidate);
+    void Collapse(const Candidate& candidate);
+    void CollectNeighbors(uint32_t vertex, std::vector<uint32_t>& neighbors) const;
+
+    const MeshSimplification::Settings& Settings_;
+    std::vector<XrVector3f> Positions_;
+    std::vector<uint32_t> Faces_;
+    std::vector<uint8_t> FaceRemoved_;
+    size_t LiveFaceCount_ = 0;
+
+    std::vector<Quadric> Quadrics_;
+    std::vector<uint32_t> Versions_;
+    std::vector<uint8_t> VertexRemoved_;
+    // Faces around each vertex; may hold removed faces until the vertex is touched.
+    std::vector<std::vector<uint32_t>> VertexFaces_;
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> Heap_;
+
+    // Scratch for CanCollapse.
+    std::vector<uint32_t> NeighborsA_;
+    std::vector<uint32_t> NeighborsB_;
+};
+
+void Simplifier::BuildQuadrics(const MeshTopology& topology) {
+    const size_t triangleCount = topology.TriangleCount();
+    std::vector<XrVector3f> unitNormals(triangleCount);
+    for (uint32_t face = 0; face < triangleCount; ++face) {
+        unitNormals[face] = VectorMath::normalize(FaceNormal(face));
+        const XrVector3f& n = unitNormals[face];
+        const XrVector3f& p = Positions_[Faces_[face * 3]];
+        const double d = -(n.x * p.x + n.y * p.y + n.z * p.z);
+        for (int corner = 0; corner < 3; ++corner) {
+            Quadrics_[Faces_[face * 3 + corner]].AddPlane(n.x, n.y, n.z, d, 1.0);
+        }
+    }
+
+    const float featureCos = Settings_.FeatureAngle >= 0.0f ? std::cos(Settings_.FeatureAngle) : -2.0f;
+    for (uint32_t e = 0; e < topology.EdgeCount(); ++e) {
+        const MeshTopology::Edge& edge = topology.GetEdge(e);
+        const uint32_t faceCount = topology.EdgeFaceCount(e);
+        const uint32_t* halfEdges = topology.EdgeHalfEdgesBegin(e);
+        bool constrained = false;
+        if (faceCount == 1) {
+            constrained = Settings_.PreserveBoundary;
+        } else if (faceCount == 2) {
+            // A degenerate face has a zero normal, which is not a crease.
+            const XrVector3f& n0 = unitNormals[halfEdges[0] / 3];
+            const XrVector3f& n1 = unitNormals[halfEdges[1] / 3];
+            const float dot = n0.x * n1.x + n0.y * n1.y + n0.z * n1.z;
+            constrained = dot < featureCos && IsNonZero(n0) && IsNonZero(n1);
+        }
+        if (!constrained) {
+            continue;
+        }
+        for (uint32_t i = 0; i < faceCount; ++i) {
+            const XrVector3f& n = unitNormals[halfEdges[i] / 3];
+            Quadric constraint;
+            AddEdgeConstraint(constraint, Positions_[edge.v0], Positions_[edge.v1], n);
+            Quadrics_[edge.v0].Add(constraint);
+            Quadrics_[edge.v1].Add(constraint);
+        }
+    }
+}
+
+void Simplifier::PushCandidate(uint32_t a, uint32_t b) {
+    Quadric q = Quadrics_[a];
+    q.Add(Quadrics_[b]);
+
+    // The optimal point when the planes define one, otherwise the best of the endpoints
+    // and the midpoint.
+    // Nearly parallel planes give a far away optimum with a deceptively low cost, so
+    // the optimum is only trusted near the edge.
+    const XrVector3f midpoint =
+        VectorMath::scalar_multiply(VectorMath::add(Positions_[a], Positions_[b]), 0.5f);
+    const float edgeLength = VectorMath::magnitude(VectorMath::subtract(Positions_[a], Positions_[b]));
+    XrVector3f target;
+    double cost;
+    if (q.Minimize(target) &&
+        VectorMath::magnitude(VectorMath::subtract(target, midpoint)) <= edgeLength) {
+        cost = q.Evaluate(target);
+    } else {
+        target = Positions_[a];
+        cost = q.Evaluate(target);
+        for (const XrVector3f& option : {Positions_[b], midpoint}) {
+            const double optionCost = q.Evaluate(option);
+            if (optionCost < cost) {
+                cost = optionCost;
+                target = option;
+            }
+        }
+    }
+    cost = std::max(cost, 0.0) + kEdgeLengthCost * edgeLength * edgeLength;
+    Heap_.push({static_cast<float>(cost), a, b, Versions_[a], Versions_[b], target});
+}
+
+void Simplifier::CollectNeighbors(uint32_t vertex, std::vector<uint32_t>& neighbors) const {
+    neighbors.clear();
+    for (const uint32_t face : VertexFaces_[vertex]) {
+        if (FaceRemoved_[face]) {
+            continue;
+        }
+        for (int corner = 0; corner < 3; ++corner) {
+            const uint32_t v = Faces_[face * 3 + corner];
+            if (v != vertex) {
+                neighbors.push_back(v);
+            }
+        }
+    }
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+}
+
+bool Simplifier::CanCollapse(const Candidate& candidate) {
+    const uint32_t a = candidate.Keep;
+    const uint32_t b = candidate.Remove;
+
+    // Link condition: the only vertices adjacent to both ends may be the apexes of the
+    // faces on the edge, otherwise the collapse pinches the surface.
+    CollectNeighbors(a, NeighborsA_);
+    CollectNeighbors(b, NeighborsB_);
+    size_t common = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < NeighborsA_.size() && j < NeighborsB_.size()) {
+        if (NeighborsA_[i] < NeighborsB_[j]) {
+            ++i;
+        } else if (NeighborsA_[i] > NeighborsB_[j]) {
+            ++j;
+        } else {
+            common++;
+            ++i;
+            ++j;
+        }
+    }
+    size_t sharedFaces = 0;
+    for (const uint32_t face : VertexFaces_[b]) {
+        const uint32_t* f = &Faces_[face * 3];
+        sharedFaces += !FaceRemoved_[face] && (f[0] == a || f[1] == a || f[2] == a);
+    }
+    if (sharedFaces == 0 || common > sharedFaces || sharedFaces >= LiveFaceCount_) {
+        return false;
+    }
+
+    // No face that survives may flip, turn sharply or become degenerate. A face that is
+    // already degenerate has no orientation to keep (normalize returns zero for it), so
+    // it would otherwise block every collapse around the slivers most worth removing.
+    for (const uint32_t moved : {a, b}) {
+        const uint32_t other = moved == a ? b : a;
+        for (const uint32_t face : VertexFaces_[moved]) {
+            const uint32_t* f = &Faces_[face * 3];
+            if (FaceRemoved_[face] || f[0] == other || f[1] == other || f[2] == other) {
+                continue;
+            }
+            XrVector3f p[3];
+            for (int corner = 0; corner < 3; ++corner) {
+                p[corner] = f[corner] == moved ? candidate.Target : Positions_[f[corner]];
+            }
+            const XrVector3f before = VectorMath::normalize(FaceNormal(face));
+            if (!IsNonZero(before)) {
+                continue;
+            }
+            const XrVector3f after = VectorMath::normalize(
+                VectorMath::cross_product(VectorMath::subtract(p[1], p[0]), VectorMath::subtract(p[2], p[0])));
+            if (before.x * after.x + before.y * after.y + before.z * after.z < kMinNormalDot) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Simplifier::Collapse(const Candidate& candidate) {
+    const uint32_t a = candidate.Keep;
+    const uint32_t b = candidate.Remove;
+
+    Positions_[a] = candidate.Target;
+    Quadrics_[a].Add(Quadrics_[b]);
+    VertexRemoved_[b] = 1;
+    Versions_[a]++;
+
+    std::vector<uint32_t>& facesA = VertexFaces_[a];
+    for (const uint32_t face : VertexFaces_[b]) {
+        if (FaceRemoved_[face]) {
+            continue;
+        }
+        uint32_t* f = &Faces_[face * 3];
+        if (f[0] == a || f[1] == a || f[2] == a) {
+            FaceRemoved_[face] = 1;
+            LiveFaceCount_--;
+            continue;
+        }
+        for (int corner = 0; corner < 3; ++corner) {
+            if (f[corner] == b) {
+                f[corner] = a;
+            }
+        }
+        facesA.push_back(face);
+    }
+    std::vector<uint32_t>().swap(VertexFaces_[b]);
+    facesA.erase(
+        std::remove_if(facesA.begin(), facesA.end(), [this](uint32_t face) { return FaceRemoved_[face] != 0; }),
+        facesA.end());
+
+    CollectNeighbors(a, NeighborsA_);
+    for (const uint32_t neighbor : NeighborsA_) {
+        PushCandidate(a, neighbor);
+    }
+}
+
+void Simplifier::Run() {
+    const size_t vertexCount = Positions_.size();
+    const size_t triangleCount = Faces_.size() / 3;
+    MeshTopology topology;
+    topology.Build(Faces_, vertexCount);
+
+    FaceRemoved_.assign(triangleCount, 0);
+    LiveFaceCount_ = triangleCount;
+    Quadrics_.assign(vertexCount, Quadric());
+    Versions_.assign(vertexCount, 0);
+    VertexRemoved_.assign(vertexCount, 0);
+    VertexFaces_.resize(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        VertexFaces_[v].assign(topology.VertexFacesBegin(v), topology.VertexFacesEnd(v));
+    }
+    BuildQuadrics(topology);
+
+    for (uint32_t e = 0; e < topology.EdgeCount(); ++e) {
+        const MeshTopology::Edge& edge = topology.GetEdge(e);
+        PushCandidate(edge.v0, edge.v1);
+    }
+
+    const double maxCost = double(Settings_.MaxError) * Settings_.MaxError;
+    while (!Heap_.empty() && LiveFaceCount_ > Settings_.TargetTriangleCount) {
+        const Candidate candidate = Heap_.top();
+        Heap_.pop();
+        if (candidate.Cost > maxCost) {
+            break;
+        }
+        // Stale entries: an end was removed or moved since the cost was computed.
+        if (VertexRemoved_[candidate.Keep] || VertexRemoved_[candidate.Remove] ||
+            Versions_[candidate.Keep] != candidate.KeepVersion ||
+            Versions_[candidate.Remove] != candidate.RemoveVersion) {
+            continue;
+        }
+        if (CanCollapse(candidate)) {
+            Collapse(candidate);
+        }
+    }
+}
+
+void Simplifier::Output(std::vector<XrVector3f>& vertices, std::vector<uint32_t>& indices) const {
+    // Keep the surviving faces and the vertices they use, both in input order.
+    std::vector<uint32_t> remap(Positions_.size(), UINT32_MAX);
+    vertices.clear();
+    indices.clear();
+    indices.reserve(LiveFaceCount_ * 3);
+    for (size_t face = 0; face < FaceRemoved_.size(); ++face) {
+        if (FaceRemoved_[face]) {
+            continue;
+        }
+        for (int corner = 0; corner < 3; ++corner) {
+            indices.push_back(Faces_[face * 3 + corner]);
+        }
+    }
+    for (const uint32_t v : indices) {
+        remap[v] = 0;
+    }
+    for (size_t v = 0; v < remap.size(); ++v) {
+        if (remap[v] == 0) {
+            remap[v] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(Positions_[v]);
+        }
+    }
+    for (uint32_t& v : indices) {
+        v = remap[v];
+    }
+}
+
+} // namespace
+
+std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> MeshSimplification::simplify(
+    const std::vector<XrVector3f>& originalVertices,
+    const std::vector<uint32_t>& originalIndices,
+    const Settings& settings) {
+    Simplifier simplifier(originalVertices, originalIndices, settings);
+    simplifier.Run();
+    std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> result;
+    simplifier.Output(result.first, result.second);
+    return result;
+}
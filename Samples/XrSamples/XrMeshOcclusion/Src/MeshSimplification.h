@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <openxr/openxr.h>
+
+// Quadric error metric edge-collapse simplification (Garland & Heckbert).
+//
+// Every vertex accumulates the planes of its faces; collapsing an edge moves the
+// surviving vertex to the point minimizing the summed squared plane distances. Edges
+// are processed cheapest first from a binary heap with lazy invalidation, which keeps
+// the cost at O(n log n) for inputs of several hundred thousand triangles. Collapses
+// that would fold a face over or make the surface non-manifold are skipped.
+class MeshSimplification {
+public:
+    struct Settings {
+        // Stop once the mesh has at most this many triangles; 0 relies on MaxError alone.
+        size_t TargetTriangleCount = 0;
+        // Largest allowed distance between the simplified and the input surface (meters).
+        float MaxError = 0.01f;
+        // Adds a penalty plane along open borders so holes and mesh edges stay in place.
+        bool PreserveBoundary = true;
+        // Edges where faces meet at a sharper angle than this (radians) get the same
+        // penalty, which keeps the silhouettes of furniture and wall corners. Negative
+        // disables it.
+        float FeatureAngle = 0.7f;
+    };
+
+    static std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> simplify(
+        const std::vector<XrVector3f>& originalVertices,
+        const std::vector<uint32_t>& originalIndices,
+        const Settings& settings);
+};
@@ -1,4 +1,7 @@
 #include "MeshSubdivision.h"
+#include "SubdivisionStencils.h"
+#include "ThreadPool.h"
+#include "VectorMathSimd.h"
 #include <algorithm> // for std::min/max
 #include <cmath>     // for cos
 
@@ -6,6 +9,14 @@
 #define M_PI 3.14159265358979323846
 #endif
 
+namespace {
+// Work items per pool task for the per-face, per-edge and per-vertex passes.
+constexpr size_t kItemsPerTask = 4096;
+// Half-edges per block when numbering midpoints. Fixed, so the numbering never
+// depends on how many threads the pool has.
+constexpr size_t kHalfEdgesPerBlock = 16384;
+} // namespace
+
 void LoopSubdivision::expand_mesh(
     std::vector<XrVector3f>& vertices,
     const std::vector<uint32_t>& indices,
@@ -53,131 +64,253 @@ void LoopSubdivision::expand_mesh(
     }
 }
 
+void LoopSubdivision::expand_mesh(
+    std::vector<XrVector3f>& vertices,
+    const MeshTopology& topology,
+    const std::vector<uint32_t>& indices,
+    float expansion_factor,
+    ThreadPool* pool) {
+
+    if (std::abs(expansion_factor) < 1e-6) {
+        return; // No expansion needed
+    }
+
+    // Face normals once per triangle, then gathered per vertex through the vertex-face
+    // lists instead of scattered into an accumulator, all on SoA copies so the kernels
+    // run four vertices or faces at a time. The result does not match the scalar version
+    // above exactly: compilers may fuse that version's multiply-adds (on arm64 they do
+    // by default), so the two can differ in the last bits.
+    VectorMathSimd::Vector3SoA positions;
+    VectorMathSimd::Vector3SoA faceNormals;
+    VectorMathSimd::Vector3SoA vertexNormals;
+    VectorMathSimd::ToSoA(vertices.data(), vertices.size(), positions);
+    VectorMathSimd::FaceNormals(positions, indices.data(), topology.TriangleCount(), faceNormals, pool);
+    VectorMathSimd::GatherVertexNormals(topology, faceNormals, vertexNormals, pool);
+    VectorMathSimd::NormalizeAndOffset(positions, vertexNormals, expansion_factor, pool);
+    VectorMathSimd::FromSoA(positions, vertices.data());
+}
+
+void LoopSubdivision::compute_vertex_normals(
+    const std::vector<XrVector3f>& vertices,
+    const MeshTopology& topology,
+    const std::vector<uint32_t>& indices,
+    std::vector<XrVector3f>& normals,
+    ThreadPool* pool) {
+    VectorMathSimd::Vector3SoA positions;
+    VectorMathSimd::Vector3SoA faceNormals;
+    VectorMathSimd::Vector3SoA vertexNormals;
+    VectorMathSimd::ToSoA(vertices.data(), vertices.size(), positions);
+    VectorMathSimd::FaceNormals(positions, indices.data(), topology.TriangleCount(), faceNormals, pool);
+    VectorMathSimd::GatherVertexNormals(topology, faceNormals, vertexNormals, pool);
+    VectorMathSimd::Normalize(vertexNormals, pool);
+    normals.resize(vertices.size());
+    VectorMathSimd::FromSoA(vertexNormals, normals.data());
+}
+
 std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> LoopSubdivision::subdivide(
     const std::vector<XrVector3f>& originalVertices,
     const std::vector<uint32_t>& originalIndices,
-    int iterations) {
+    int iterations,
+    ThreadPool* pool,
+    SubdivisionStencils* stencils) {
 
+    if (stencils != nullptr) {
+        stencils->Begin(originalVertices.size());
+    }
     if (iterations <= 0) {
         return {originalVertices, originalIndices};
     }
 
-    std::vector<XrVector3f> currentVertices = originalVertices;
-    std::vector<uint32_t> currentIndices = originalIndices;
+    // Ping-pong between two buffer pairs and one topology so that later iterations
+    // reuse the capacity of earlier ones.
+    MeshTopology topology;
+    std::vector<XrVector3f> currentVertices;
+    std::vector<uint32_t> currentIndices;
+    std::vector<XrVector3f> nextVertices;
+    std::vector<uint32_t> nextIndices;
 
     for (int i = 0; i < iterations; ++i) {
-        auto result = apply_subdivision(currentVertices, currentIndices);
-        currentVertices = result.first;
-        currentIndices = result.second;
+        const std::vector<XrVector3f>& vertices = (i == 0) ? originalVertices : currentVertices;
+        const std::vector<uint32_t>& indices = (i == 0) ? originalIndices : currentIndices;
+        topology.Build(indices, vertices.size(), pool);
+        apply_subdivision(topology, vertices, indices, nextVertices, nextIndices, pool, stencils);
+        std::swap(currentVertices, nextVertices);
+        std::swap(currentIndices, nextIndices);
     }
 
-    return {currentVertices, currentIndices};
+    return {std::move(currentVertices), std::move(currentIndices)};
 }
 
 
 // Internal method to apply one level of subdivision
-std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> LoopSubdivision::apply_subdivision(
+void LoopSubdivision::apply_subdivision(
+    const MeshTopology& topology,
     const std::vector<XrVector3f>& vertices,
-    const std::vector<uint32_t>& indices) {
-    
-    std::vector<XrVector3f> newVertices = vertices;
-    std::vector<uint32_t> newIndices;
-    
-    // Map from an edge to the index of the new vertex created at its midpoint
-    std::map<Edge, uint32_t> edgeToMidpointIndex;
-    
-    // Adjacency list to find neighboring vertices for updating original vertex positions
-    std::vector<std::vector<uint32_t>> adjacency(vertices.size());
-    // Map to find the "opposite" vertex for a given edge, needed for new vertex position rule
-    std::map<Edge, std::vector<uint32_t>> edgeToOppositeVertices;
-
-
-    // First pass: Build adjacency, find opposite vertices, and create new faces
-    for (size_t i = 0; i < indices.size(); i += 3) {
-        uint32_t v0_idx = indices[i];
-        uint32_t v1_idx = indices[i + 1];
-        uint32_t v2_idx = indices[i + 2];
-
-        uint32_t tri_indices[3] = {v0_idx, v1_idx, v2_idx};
-        uint32_t mid_indices[3];
-
-        for (int j = 0; j < 3; ++j) {
-            uint32_t p0_idx = tri_indices[j];
-            uint32_t p1_idx = tri_indices[(j + 1) % 3];
-            uint32_t opposite_idx = tri_indices[(j + 2) % 3];
-
-            // Build adjacency list
-            adjacency[p0_idx].push_back(p1_idx);
-            adjacency[p1_idx].push_back(p0_idx);
-            
-            // Create a canonical representation for the edge
-            Edge edge = std::make_pair(std::min(p0_idx, p1_idx), std::max(p0_idx, p1_idx));
-            edgeToOppositeVertices[edge].push_back(opposite_idx);
-
-            // If this edge hasn't been processed, create a new midpoint vertex
-            if (edgeToMidpointIndex.find(edge) == edgeToMidpointIndex.end()) {
-                edgeToMidpointIndex[edge] = newVertices.size();
-                newVertices.push_back({0,0,0}); // Placeholder, position calculated later
+    const std::vector<uint32_t>& indices,
+    std::vector<XrVector3f>& newVertices,
+    std::vector<uint32_t>& newIndices,
+    ThreadPool* pool,
+    SubdivisionStencils* stencils) {
+
+    const size_t edgeCount = topology.EdgeCount();
+    const size_t triangleCount = topology.TriangleCount();
+
+    // Midpoint vertices are numbered in the order their edge is first seen in the
+    // index buffer, after all the original vertices. Each block of half-edges counts the
+    // edges it sees first, a prefix sum over the blocks gives every block its first
+    // midpoint, and the blocks then number their edges independently.
+    const size_t halfEdgeCount = topology.HalfEdgeCount();
+    const size_t blockCount = (halfEdgeCount + kHalfEdgesPerBlock - 1) / kHalfEdgesPerBlock;
+    newVertices.resize(vertices.size() + edgeCount);
+    std::vector<uint32_t> edgeToMidpointIndex(edgeCount);
+    std::vector<uint32_t> blockFirstMidpoint(blockCount + 1, 0);
+    ParallelFor(pool, blockCount, 1, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; ++block) {
+            const uint32_t first = static_cast<uint32_t>(block * kHalfEdgesPerBlock);
+            const uint32_t last = static_cast<uint32_t>(std::min(halfEdgeCount, (block + 1) * kHalfEdgesPerBlock));
+            uint32_t count = 0;
+            for (uint32_t h = first; h < last; ++h) {
+                count += topology.EdgeFirstHalfEdge(topology.HalfEdgeEdge(h)) == h;
             }
-            mid_indices[j] = edgeToMidpointIndex[edge];
+            blockFirstMidpoint[block + 1] = count;
         }
-
-        // Create the 4 new triangles from the original triangle
-        newIndices.push_back(v0_idx); newIndices.push_back(mid_indices[0]); newIndices.push_back(mid_indices[2]);
-        newIndices.push_back(v1_idx); newIndices.push_back(mid_indices[1]); newIndices.push_back(mid_indices[0]);
-        newIndices.push_back(v2_idx); newIndices.push_back(mid_indices[2]); newIndices.push_back(mid_indices[1]);
-        newIndices.push_back(mid_indices[0]); newIndices.push_back(mid_indices[1]); newIndices.push_back(mid_indices[2]);
+    });
+    blockFirstMidpoint[0] = static_cast<uint32_t>(vertices.size());
+    for (size_t block = 0; block < blockCount; ++block) {
+        blockFirstMidpoint[block + 1] += blockFirstMidpoint[block];
     }
-    
+    ParallelFor(pool, blockCount, 1, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; ++block) {
+            const uint32_t first = static_cast<uint32_t>(block * kHalfEdgesPerBlock);
+            const uint32_t last = static_cast<uint32_t>(std::min(halfEdgeCount, (block + 1) * kHalfEdgesPerBlock));
+            uint32_t nextMidpoint = blockFirstMidpoint[block];
+            for (uint32_t h = first; h < last; ++h) {
+                const uint32_t edge = topology.HalfEdgeEdge(h);
+                if (topology.EdgeFirstHalfEdge(edge) == h) {
+                    edgeToMidpointIndex[edge] = nextMidpoint++;
+                }
+            }
+        }
+    });
+
+    // First pass: Create the 4 new faces for each original triangle
+    newIndices.resize(triangleCount * 12);
+    ParallelFor(pool, triangleCount, kItemsPerTask, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const uint32_t v0_idx = indices[i * 3];
+            const uint32_t v1_idx = indices[i * 3 + 1];
+            const uint32_t v2_idx = indices[i * 3 + 2];
+            const uint32_t m0 = edgeToMidpointIndex[topology.HalfEdgeEdge(i * 3)];
+            const uint32_t m1 = edgeToMidpointIndex[topology.HalfEdgeEdge(i * 3 + 1)];
+            const uint32_t m2 = edgeToMidpointIndex[topology.HalfEdgeEdge(i * 3 + 2)];
+
+            uint32_t* tri = &newIndices[i * 12];
+            tri[0] = v0_idx; tri[1] = m0; tri[2] = m2;
+            tri[3] = v1_idx; tri[4] = m1; tri[5] = m0;
+            tri[6] = v2_idx; tri[7] = m2; tri[8] = m1;
+            tri[9] = m0; tri[10] = m1; tri[11] = m2;
+        }
+    });
+
     // Second pass: Calculate the positions of the new edge vertices
-    for (auto const& [edge, midpoint_idx] : edgeToMidpointIndex) {
-        uint32_t v0_idx = edge.first;
-        uint32_t v1_idx = edge.second;
-        
-        const XrVector3f& v0_pos = vertices[v0_idx];
-        const XrVector3f& v1_pos = vertices[v1_idx];
-        
-        // Find the two opposite vertices (C and D in the formula)
-        const auto& opposites = edgeToOppositeVertices[edge];
-        if (opposites.size() == 2) { // Interior edge
-            const XrVector3f& v2_pos = vertices[opposites[0]];
-            const XrVector3f& v3_pos = vertices[opposites[1]];
-            
-            // New position = 3/8 * (v0 + v1) + 1/8 * (v2 + v3)
-            auto term1 = VectorMath::scalar_multiply(VectorMath::add(v0_pos, v1_pos), 3.0f / 8.0f);
-            auto term2 = VectorMath::scalar_multiply(VectorMath::add(v2_pos, v3_pos), 1.0f / 8.0f);
-            newVertices[midpoint_idx] = VectorMath::add(term1, term2);
-        } else { // Boundary edge
-            // New position = 1/2 * (v0 + v1)
-            newVertices[midpoint_idx] = VectorMath::scalar_multiply(VectorMath::add(v0_pos, v1_pos), 0.5f);
+    ParallelFor(pool, edgeCount, kItemsPerTask, [&](size_t begin, size_t end) {
+        for (uint32_t e = static_cast<uint32_t>(begin); e < end; ++e) {
+            const MeshTopology::Edge& edge = topology.GetEdge(e);
+            const XrVector3f& v0_pos = vertices[edge.v0];
+            const XrVector3f& v1_pos = vertices[edge.v1];
+            const uint32_t midpoint_idx = edgeToMidpointIndex[e];
+
+            if (topology.EdgeFaceCount(e) == 2) { // Interior edge
+                // The opposite vertex of half-edge (face, corner) is corner + 2 of the same face.
+                const uint32_t* halfEdges = topology.EdgeHalfEdgesBegin(e);
+                const uint32_t h0 = halfEdges[0];
+                const uint32_t h1 = halfEdges[1];
+                const XrVector3f& v2_pos = vertices[indices[h0 - h0 % 3 + (h0 + 2) % 3]];
+                const XrVector3f& v3_pos = vertices[indices[h1 - h1 % 3 + (h1 + 2) % 3]];
+
+                // New position = 3/8 * (v0 + v1) + 1/8 * (v2 + v3)
+                auto term1 = VectorMath::scalar_multiply(VectorMath::add(v0_pos, v1_pos), 3.0f / 8.0f);
+                auto term2 = VectorMath::scalar_multiply(VectorMath::add(v2_pos, v3_pos), 1.0f / 8.0f);
+                newVertices[midpoint_idx] = VectorMath::add(term1, term2);
+            } else { // Boundary edge
+                // New position = 1/2 * (v0 + v1)
+                newVertices[midpoint_idx] = VectorMath::scalar_multiply(VectorMath::add(v0_pos, v1_pos), 0.5f);
+            }
         }
-    }
-    
+    });
+
     // Third pass: Update the positions of the original vertices
-    for (size_t i = 0; i < vertices.size(); ++i) {
-        size_t k = adjacency[i].size();
-        if (k < 2) continue; // Should not happen in a closed mesh
-
-        // Beta calculation (Warren's formula, a common choice)
-        float beta;
-        if (k == 3) {
-            beta = 3.0f / 16.0f;
-        } else {
-            beta = (3.0f / (8.0f * k));
+    ParallelFor(pool, vertices.size(), kItemsPerTask, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            // The one-ring lists each neighbor once per incident half-edge, so interior
+            // neighbors appear twice and k is twice the valence.
+            size_t k = topology.VertexNeighborCount(i);
+            if (k < 2) { // Should not happen in a closed mesh
+                newVertices[i] = vertices[i];
+                continue;
+            }
+
+            // Beta calculation (Warren's formula, a common choice)
+            float beta;
+            if (k == 3) {
+                beta = 3.0f / 16.0f;
+            } else {
+                beta = (3.0f / (8.0f * k));
+            }
+
+            // Sum of neighbor positions
+            XrVector3f neighbor_sum = {0,0,0};
+            for (const uint32_t* n = topology.VertexNeighborsBegin(i); n != topology.VertexNeighborsEnd(i); ++n) {
+                neighbor_sum = VectorMath::add(neighbor_sum, vertices[*n]);
+            }
+
+            // New position = (1 - k*beta) * old_pos + beta * neighbor_sum
+            const XrVector3f& old_pos = vertices[i];
+            auto term1 = VectorMath::scalar_multiply(old_pos, 1.0f - (float)k * beta);
+            auto term2 = VectorMath::scalar_multiply(neighbor_sum, beta);
+            newVertices[i] = VectorMath::add(term1, term2);
         }
-        
-        // Sum of neighbor positions
-        XrVector3f neighbor_sum = {0,0,0};
-        for(uint32_t neighbor_idx : adjacency[i]) {
-            neighbor_sum = VectorMath::add(neighbor_sum, vertices[neighbor_idx]);
+    });
+
+    if (stencils != nullptr) {
+        // The same rules as above, as weights, in output vertex order.
+        std::vector<uint32_t> rowVertices;
+        std::vector<float> rowWeights;
+        for (uint32_t i = 0; i < vertices.size(); ++i) {
+            const uint32_t k = topology.VertexNeighborCount(i);
+            if (k < 2) {
+                const float one = 1.0f;
+                stencils->AddVertex(&i, &one, 1);
+                continue;
+            }
+            const float beta = (k == 3) ? 3.0f / 16.0f : 3.0f / (8.0f * k);
+            rowVertices.assign(1, i);
+            rowWeights.assign(1, 1.0f - (float)k * beta);
+            rowVertices.insert(rowVertices.end(), topology.VertexNeighborsBegin(i), topology.VertexNeighborsEnd(i));
+            rowWeights.resize(rowVertices.size(), beta);
+            stencils->AddVertex(rowVertices.data(), rowWeights.data(), rowVertices.size());
         }
-        
-        // New position = (1 - k*beta) * old_pos + beta * neighbor_sum
-        const XrVector3f& old_pos = vertices[i];
-        auto term1 = VectorMath::scalar_multiply(old_pos, 1.0f - (float)k * beta);
-        auto term2 = VectorMath::scalar_multiply(neighbor_sum, beta);
-        newVertices[i] = VectorMath::add(term1, term2);
-    }
 
-    return {newVertices, newIndices};
-}
\ No newline at end of file
+        std::vector<uint32_t> midpointEdges(edgeCount);
+        for (uint32_t e = 0; e < edgeCount; ++e) {
+            midpointEdges[edgeToMidpointIndex[e] - vertices.size()] = e;
+        }
+        for (const uint32_t e : midpointEdges) {
+            const MeshTopology::Edge& edge = topology.GetEdge(e);
+            if (topology.EdgeFaceCount(e) == 2) {
+                const uint32_t* halfEdges = topology.EdgeHalfEdgesBegin(e);
+                const uint32_t h0 = halfEdges[0];
+                const uint32_t h1 = halfEdges[1];
+                const uint32_t oddVertices[4] = {
+                    edge.v0, edge.v1, indices[h0 - h0 % 3 + (h0 + 2) % 3], indices[h1 - h1 % 3 + (h1 + 2) % 3]};
+                const float oddWeights[4] = {3.0f / 8.0f, 3.0f / 8.0f, 1.0f / 8.0f, 1.0f / 8.0f};
+                stencils->AddVertex(oddVertices, oddWeights, 4);
+            } else {
+                const uint32_t oddVertices[2] = {edge.v0, edge.v1};
+                const float oddWeights[2] = {0.5f, 0.5f};
+                stencils->AddVertex(oddVertices, oddWeights, 2);
+            }
+        }
+        stencils->EndLevel();
+    }
+}
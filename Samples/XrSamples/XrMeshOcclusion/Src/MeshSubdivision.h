@@ -1,10 +1,13 @@
 #pragma once
 
 #include <vector>
-#include <map>
 #include <utility>
 #include "OVR_Math.h"
 #include <openxr/openxr.h>
+#include "MeshTopology.h"
+
+class ThreadPool;
+class SubdivisionStencils;
 
 // Helper functions for XrVector3f math, as it doesn't have overloaded operators.
 namespace VectorMath {
@@ -44,22 +47,47 @@ namespace VectorMath {
 class LoopSubdivision {
 public:
     // Main function to call. It takes the original mesh data and the number of iterations.
+    // With a pool the work is split across its threads; the output is bit-identical to
+    // the single threaded one. When stencils is given it also receives the weights from
+    // the original to the output vertices, for re-running on refreshed positions.
     static std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> subdivide(
         const std::vector<XrVector3f>& originalVertices,
         const std::vector<uint32_t>& originalIndices,
-        int iterations);
+        int iterations,
+        ThreadPool* pool = nullptr,
+        SubdivisionStencils* stencils = nullptr);
 
     static void expand_mesh(
         std::vector<XrVector3f>& vertices,
         const std::vector<uint32_t>& indices,
         float expansion_factor);
 
-private:
-    // Represents an edge using the indices of its two endpoints. Sorted to be unique.
-    using Edge = std::pair<uint32_t, uint32_t>;
+    // Same as above, reusing connectivity the caller already built for this mesh.
+    static void expand_mesh(
+        std::vector<XrVector3f>& vertices,
+        const MeshTopology& topology,
+        const std::vector<uint32_t>& indices,
+        float expansion_factor,
+        ThreadPool* pool = nullptr);
 
-    // Performs a single iteration of the subdivision algorithm.
-    static std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> apply_subdivision(
+    // The unit normals expand_mesh offsets along (zero for isolated or degenerate
+    // vertices), for expanding on the GPU instead.
+    static void compute_vertex_normals(
         const std::vector<XrVector3f>& vertices,
-        const std::vector<uint32_t>& indices);
-};
\ No newline at end of file
+        const MeshTopology& topology,
+        const std::vector<uint32_t>& indices,
+        std::vector<XrVector3f>& normals,
+        ThreadPool* pool = nullptr);
+
+private:
+    // Performs a single iteration of the subdivision algorithm on a mesh whose
+    // topology has already been built. Results are written to the out vectors.
+    static void apply_subdivision(
+        const MeshTopology& topology,
+        const std::vector<XrVector3f>& vertices,
+        const std::vector<uint32_t>& indices,
+        std::vector<XrVector3f>& outVertices,
+        std::vector<uint32_t>& outIndices,
+        ThreadPool* pool,
+        SubdivisionStencils* stencils);
+};
@@ -0,0 +1,167 @@
+#include "MeshTopology.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+
+// Buckets per pool task; each bucket is only a handful of half-edges.
+constexpr size_t kVerticesPerTask = 4096;
+
+// Turns per-bucket counts stored at offsets[b + 1] into start offsets.
+void CountsToOffsets(std::vector<uint32_t>& offsets) {
+    offsets[0] = 0;
+    for (size_t i = 1; i < offsets.size(); ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+}
+
+// Filling a CSR array with offsets[b]++ as the write cursor leaves offsets[b] holding
+// the end of bucket b. Shift everything back by one bucket to restore the starts.
+void RestoreOffsets(std::vector<uint32_t>& offsets) {
+    for (size_t i = offsets.size() - 1; i > 0; --i) {
+        offsets[i] = offsets[i - 1];
+    }
+    offsets[0] = 0;
+}
+
+} // namespace
+
+void MeshTopology::SortBucket(HalfEdgeKey* first, HalfEdgeKey* last) {
+    // Stable, so equal V1 keep their ascending half-edge order. High valence fans get
+    // the library sort, everything else the insertion sort.
+    if (last - first > 32) {
+        std::stable_sort(first, last, [](const HalfEdgeKey& a, const HalfEdgeKey& b) {
+            return a.V1 < b.V1;
+        });
+        return;
+    }
+    if (first == last) {
+        return;
+    }
+    for (HalfEdgeKey* i = first + 1; i != last; ++i) {
+        const HalfEdgeKey key = *i;
+        HalfEdgeKey* j = i;
+        for (; j != first && j[-1].V1 > key.V1; --j) {
+            *j = j[-1];
+        }
+        *j = key;
+    }
+}
+
+void MeshTopology::Clear() {
+    VertexCount_ = 0;
+    TriangleCount_ = 0;
+    SortKeys_.clear();
+    BucketOffsets_.clear();
+    BucketEdgeOffsets_.clear();
+    Edges_.clear();
+    HalfEdgeToEdge_.clear();
+    EdgeOffsets_.clear();
+    EdgeHalfEdges_.clear();
+    VertexNeighborOffsets_.clear();
+    VertexNeighbors_.clear();
+    VertexFaceOffsets_.clear();
+    VertexFaces_.clear();
+}
+
+void MeshTopology::Build(
+    const uint32_t* indices,
+    size_t indexCount,
+    size_t vertexCount,
+    ThreadPool* pool) {
+    VertexCount_ = vertexCount;
+    TriangleCount_ = indexCount / 3;
+    const size_t halfEdgeCount = TriangleCount_ * 3;
+
+    // Edges: bucket the half-edges on their smaller vertex. Half-edges go in in index
+    // order, so a stable sort of each bucket on the larger vertex yields the half-edges
+    // ordered by (v0, v1, half-edge), i.e. every edge's half-edges in index buffer order.
+    BucketOffsets_.assign(vertexCount + 1, 0);
+    for (size_t h = 0; h < halfEdgeCount; ++h) {
+        const uint32_t a = indices[h];
+        const uint32_t b = indices[h - h % 3 + (h + 1) % 3];
+        BucketOffsets_[std::min(a, b) + 1]++;
+    }
+    CountsToOffsets(BucketOffsets_);
+    SortKeys_.resize(halfEdgeCount);
+    for (size_t h = 0; h < halfEdgeCount; ++h) {
+        const uint32_t a = indices[h];
+        const uint32_t b = indices[h - h % 3 + (h + 1) % 3];
+        SortKeys_[BucketOffsets_[std::min(a, b)]++] = {std::max(a, b), static_cast<uint32_t>(h)};
+    }
+    RestoreOffsets(BucketOffsets_);
+
+    // Buckets hold a vertex's edges, a dozen entries on a typical mesh. Sort them and
+    // count the distinct edges each one contributes.
+    BucketEdgeOffsets_.assign(vertexCount + 1, 0);
+    ParallelFor(pool, vertexCount, kVerticesPerTask, [this](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            HalfEdgeKey* first = SortKeys_.data() + BucketOffsets_[v];
+            HalfEdgeKey* last = SortKeys_.data() + BucketOffsets_[v + 1];
+            SortBucket(first, last);
+            uint32_t edgeCount = 0;
+            for (const HalfEdgeKey* key = first; key != last; ++key) {
+                if (key == first || key->V1 != key[-1].V1) {
+                    edgeCount++;
+                }
+            }
+            BucketEdgeOffsets_[v + 1] = edgeCount;
+        }
+    });
+    CountsToOffsets(BucketEdgeOffsets_);
+
+    const size_t edgeCount = BucketEdgeOffsets_[vertexCount];
+    Edges_.resize(edgeCount);
+    EdgeOffsets_.resize(edgeCount + 1);
+    HalfEdgeToEdge_.resize(halfEdgeCount);
+    EdgeHalfEdges_.resize(halfEdgeCount);
+    ParallelFor(pool, vertexCount, kVerticesPerTask, [this](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            uint32_t edge = BucketEdgeOffsets_[v];
+            for (uint32_t i = BucketOffsets_[v]; i < BucketOffsets_[v + 1]; ++i) {
+                const HalfEdgeKey& key = SortKeys_[i];
+                if (i == BucketOffsets_[v] || key.V1 != SortKeys_[i - 1].V1) {
+                    EdgeOffsets_[edge] = i;
+                    Edges_[edge] = {static_cast<uint32_t>(v), key.V1};
+                    edge++;
+                }
+                HalfEdgeToEdge_[key.HalfEdge] = edge - 1;
+                EdgeHalfEdges_[i] = key.HalfEdge;
+            }
+        }
+    });
+    EdgeOffsets_[edgeCount] = static_cast<uint32_t>(halfEdgeCount);
+
+    // Vertex one-rings and vertex faces: counting passes in index buffer order.
+    VertexNeighborOffsets_.assign(vertexCount + 1, 0);
+    VertexFaceOffsets_.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < halfEdgeCount; ++i) {
+        const uint32_t a = indices[i];
+        const uint32_t b = indices[i - i % 3 + (i + 1) % 3];
+        VertexNeighborOffsets_[a + 1]++;
+        VertexNeighborOffsets_[b + 1]++;
+        VertexFaceOffsets_[a + 1]++;
+    }
+    CountsToOffsets(VertexNeighborOffsets_);
+    CountsToOffsets(VertexFaceOffsets_);
+
+    VertexNeighbors_.resize(VertexNeighborOffsets_[vertexCount]);
+    VertexFaces_.resize(VertexFaceOffsets_[vertexCount]);
+    for (size_t i = 0; i < halfEdgeCount; ++i) {
+        const uint32_t a = indices[i];
+        const uint32_t b = indices[i - i % 3 + (i + 1) % 3];
+        VertexNeighbors_[VertexNeighborOffsets_[a]++] = b;
+        VertexNeighbors_[VertexNeighborOffsets_[b]++] = a;
+        VertexFaces_[VertexFaceOffsets_[a]++] = static_cast<uint32_t>(i / 3);
+    }
+    RestoreOffsets(VertexNeighborOffsets_);
+    RestoreOffsets(VertexFaceOffsets_);
+}
+
+void MeshTopology::GetEdgeLineIndices(std::vector<uint32_t>& lineIndices) const {
+    lineIndices.resize(Edges_.size() * 2);
+    for (size_t e = 0; e < Edges_.size(); ++e) {
+        lineIndices[e * 2] = Edges_[e].v0;
+        lineIndices[e * 2 + 1] = Edges_[e].v1;
+    }
+}
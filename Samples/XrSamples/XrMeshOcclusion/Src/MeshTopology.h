@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// Flat connectivity for an indexed triangle list, shared by subdivision, normal
+// expansion and wireframe generation.
+//
+// Half-edge h = 3 * face + corner runs from indices[h] to indices[face * 3 + (corner + 1) % 3].
+// Edges are the unique undirected (v0 < v1) pairs, found by bucketing the half-edges on
+// v0 and sorting each (small) bucket on v1; everything else is CSR arrays filled by
+// counting passes. Passing a ThreadPool to Build spreads the per-bucket work over its
+// threads without changing the result. All storage lives in a handful of std::vectors,
+// so rebuilding the same object for a mesh of similar size does not allocate.
+class MeshTopology {
+public:
+    struct Edge {
+        uint32_t v0; // smaller vertex index
+        uint32_t v1; // larger vertex index
+    };
+
+    void Build(
+        const uint32_t* indices,
+        size_t indexCount,
+        size_t vertexCount,
+        ThreadPool* pool = nullptr);
+    void Build(const std::vector<uint32_t>& indices, size_t vertexCount, ThreadPool* pool = nullptr) {
+        Build(indices.data(), indices.size(), vertexCount, pool);
+    }
+
+    void Clear();
+
+    size_t VertexCount() const { return VertexCount_; }
+    size_t TriangleCount() const { return TriangleCount_; }
+    size_t HalfEdgeCount() const { return TriangleCount_ * 3; }
+    size_t EdgeCount() const { return Edges_.size(); }
+
+    const std::vector<Edge>& Edges() const { return Edges_; }
+    const Edge& GetEdge(uint32_t edge) const { return Edges_[edge]; }
+
+    // Undirected edge a half-edge belongs to.
+    uint32_t HalfEdgeEdge(uint32_t halfEdge) const { return HalfEdgeToEdge_[halfEdge]; }
+
+    // Half-edges sharing an edge, in ascending (i.e. triangle) order.
+    // One entry for a boundary edge, two for an interior manifold edge.
+    const uint32_t* EdgeHalfEdgesBegin(uint32_t edge) const {
+        return EdgeHalfEdges_.data() + EdgeOffsets_[edge];
+    }
+    const uint32_t* EdgeHalfEdgesEnd(uint32_t edge) const {
+        return EdgeHalfEdges_.data() + EdgeOffsets_[edge + 1];
+    }
+    uint32_t EdgeFaceCount(uint32_t edge) const {
+        return EdgeOffsets_[edge + 1] - EdgeOffsets_[edge];
+    }
+    // The half-edge that first references this edge when walking the index buffer.
+    uint32_t EdgeFirstHalfEdge(uint32_t edge) const {
+        return EdgeHalfEdges_[EdgeOffsets_[edge]];
+    }
+
+    // One-ring of a vertex with multiplicity: every half-edge touching the vertex
+    // contributes its other endpoint, in index buffer order. An interior vertex of
+    // valence n therefore lists each neighbor twice (2n entries).
+    const uint32_t* VertexNeighborsBegin(uint32_t vertex) const {
+        return VertexNeighbors_.data() + VertexNeighborOffsets_[vertex];
+    }
+    const uint32_t* VertexNeighborsEnd(uint32_t vertex) const {
+        return VertexNeighbors_.data() + VertexNeighborOffsets_[vertex + 1];
+    }
+    uint32_t VertexNeighborCount(uint32_t vertex) const {
+        return VertexNeighborOffsets_[vertex + 1] - VertexNeighborOffsets_[vertex];
+    }
+
+    // Faces using a vertex, in ascending order.
+    const uint32_t* VertexFacesBegin(uint32_t vertex) const {
+        return VertexFaces_.data() + VertexFaceOffsets_[vertex];
+    }
+    const uint32_t* VertexFacesEnd(uint32_t vertex) const {
+        return VertexFaces_.data() + VertexFaceOffsets_[vertex + 1];
+    }
+
+    // Unique edges as a GL_LINES index list (two indices per edge).
+    void GetEdgeLineIndices(std::vector<uint32_t>& lineIndices) const;
+
+private:
+    // Entry of the v0 bucket of a half-edge.
+    struct HalfEdgeKey {
+        uint32_t V1; // larger vertex of the undirected edge
+        uint32_t HalfEdge;
+    };
+
+    static void SortBucket(HalfEdgeKey* first, HalfEdgeKey* last);
+
+    size_t VertexCount_ = 0;
+    size_t TriangleCount_ = 0;
+
+    std::vector<HalfEdgeKey> SortKeys_;
+    std::vector<uint32_t> BucketOffsets_; // SortKeys_ range per v0
+    std::vector<uint32_t> BucketEdgeOffsets_; // first edge per v0
+    std::vector<Edge> Edges_;
+    std::vector<uint32_t> HalfEdgeToEdge_;
+    std::vector<uint32_t> EdgeOffsets_;
+    std::vector<uint32_t> EdgeHalfEdges_;
+
+    std::vector<uint32_t> VertexNeighborOffsets_;
+    std::vector<uint32_t> VertexNeighbors_;
+    std::vector<uint32_t> VertexFaceOffsets_;
+    std::vector<uint32_t> VertexFaces_;
+};
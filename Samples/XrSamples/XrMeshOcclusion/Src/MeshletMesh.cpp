@@ -0,0 +1,324 @@
+#include "MeshletMesh.h"
+#include "MeshTopology.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Meshlets per pool task in UpdateBounds.
+constexpr size_t kMeshletsPerTask = 64;
+
+// Below this, the normals are too spread out for the cone to cull anything useful.
+constexpr float kMinConeDot = 0.1f;
+
+constexpr uint32_t kNone = ~0u;
+
+// The ways to label the three corners of a triangle.
+constexpr uint8_t kLabelOrders[6][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}, {0, 2, 1}, {2, 1, 0}, {1, 0, 2}};
+
+} // namespace
+
+void MeshletMesh::Assign(
+    std::vector<Meshlet> meshlets,
+    std::vector<Batch> batches,
+    std::vector<uint16_t> indices,
+    std::vector<uint16_t> lineIndices,
+    std::vector<uint8_t> cornerLabels,
+    std::vector<uint32_t> vertexRemap,
+    size_t gpuVertexCount) {
+    Meshlets_ = std::move(meshlets);
+    Batches_ = std::move(batches);
+    Indices_ = std::move(indices);
+    LineIndices_ = std::move(lineIndices);
+    CornerLabels_ = std::move(cornerLabels);
+    VertexRemap_ = std::move(vertexRemap);
+    GpuVertexCount_ = gpuVertexCount;
+}
+
+void MeshletMesh::Clear() {
+    Meshlets_.clear();
+    Batches_.clear();
+    Indices_.clear();
+    LineIndices_.clear();
+    CornerLabels_.clear();
+    VertexRemap_.clear();
+    GpuVertexCount_ = 0;
+}
+
+void MeshletMesh::ReleaseBuffers() {
+    std::vector<uint16_t>().swap(Indices_);
+    std::vector<uint16_t>().swap(LineIndices_);
+    std::vector<uint8_t>().swap(CornerLabels_);
+}
+
+void MeshletMesh::Build(
+    const std::vector<uint32_t>& indices,
+    size_t vertexCount,
+    const MeshTopology& topology,
+    const Settings& settings) {
+    Clear();
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    const uint32_t minTriangles = std::max<uint32_t>(settings.MinTriangles, 1);
+    const uint32_t maxTriangles = std::max(settings.MaxTriangles, minTriangles);
+
+    // Meshlets: runs of consecutive triangles. The input is in vertex cache order, so a
+    // run stays spatially compact until the order jumps to a new region.
+    std::vector<uint32_t> lastMeshlet(vertexCount, kNone);
+    Meshlet meshlet = {};
+    for (uint32_t t = 0; t < triangleCount; ++t) {
+        const uint32_t* tri = &indices[t * 3];
+        const uint32_t current = static_cast<uint32_t>(Meshlets_.size());
+        if (meshlet.TriangleCount > 0) {
+            const bool touches = lastMeshlet[tri[0]] == current || lastMeshlet[tri[1]] == current ||
+                lastMeshlet[tri[2]] == current;
+            if (meshlet.TriangleCount >= maxTriangles || (meshlet.TriangleCount >= minTriangles && !touches)) {
+                Meshlets_.push_back(meshlet);
+                meshlet = {};
+                meshlet.FirstTriangle = t;
+            }
+        }
+        const uint32_t id = static_cast<uint32_t>(Meshlets_.size());
+        lastMeshlet[tri[0]] = lastMeshlet[tri[1]] = lastMeshlet[tri[2]] = id;
+        ++meshlet.TriangleCount;
+    }
+    if (meshlet.TriangleCount > 0) {
+        Meshlets_.push_back(meshlet);
+    }
+
+    // Batches: consecutive meshlets while their vertices fit 16-bit indices. Vertices
+    // get batch-local numbers in first-use order. With corner labels, each vertex has
+    // up to three copies in a batch, one per label, numbered the same way.
+    const bool labels = settings.Wireframe == WireframeMode::Barycentric;
+    const size_t copiesPerVertex = labels ? 3 : 1;
+    std::vector<uint32_t> localIndex(vertexCount * copiesPerVertex);
+    std::vector<uint32_t> vertexBatch(vertexCount * copiesPerVertex, kNone);
+    std::vector<uint32_t>& seenInMeshlet = lastMeshlet;
+    std::fill(seenInMeshlet.begin(), seenInMeshlet.end(), kNone);
+    Indices_.reserve(indices.size());
+    VertexRemap_.reserve(vertexCount);
+
+    Batch batch = {};
+    auto closeBatch = [&](uint32_t endMeshlet) {
+        batch.MeshletCount = endMeshlet - batch.FirstMeshlet;
+        batch.IndexCount = static_cast<uint32_t>(Indices_.size()) - batch.IndexOffset;
+        // Each unique edge once, from the triangle holding its first half-edge. All
+        // three vertices of that triangle are in this batch.
+        batch.LineIndexOffset = static_cast<uint32_t>(LineIndices_.size());
+        for (uint32_t m = batch.FirstMeshlet; m < endMeshlet && !labels; ++m) {
+            Meshlet& lineMeshlet = Meshlets_[m];
+            lineMeshlet.LineIndexOffset = static_cast<uint32_t>(LineIndices_.size());
+            const uint32_t endTriangle = lineMeshlet.FirstTriangle + lineMeshlet.TriangleCount;
+            for (uint32_t t = lineMeshlet.FirstTriangle; t < endTriangle; ++t) {
+                for (uint32_t c = 0; c < 3; ++c) {
+                    const uint32_t halfEdge = t * 3 + c;
+                    if (topology.EdgeFirstHalfEdge(topology.HalfEdgeEdge(halfEdge)) != halfEdge) {
+                        continue;
+                    }
+                    LineIndices_.push_back(static_cast<uint16_t>(localIndex[indices[halfEdge]]));
+                    LineIndices_.push_back(static_cast<uint16_t>(localIndex[indices[t * 3 + (c + 1) % 3]]));
+                }
+            }
+            lineMeshlet.LineIndexCount = static_cast<uint32_t>(LineIndices_.size()) - lineMeshlet.LineIndexOffset;
+        }
+        batch.LineIndexCount = static_cast<uint32_t>(LineIndices_.size()) - batch.LineIndexOffset;
+        Batches_.push_back(batch);
+    };
+
+    for (uint32_t m = 0; m < Meshlets_.size(); ++m) {
+        Meshlet& current = Meshlets_[m];
+        const uint32_t batchId = static_cast<uint32_t>(Batches_.size());
+        uint32_t newVertices = 0;
+        for (uint32_t i = current.FirstTriangle * 3; i < (current.FirstTriangle + current.TriangleCount) * 3; ++i) {
+            const uint32_t v = indices[i];
+            if (seenInMeshlet[v] != m && (labels || vertexBatch[v] != batchId)) {
+                seenInMeshlet[v] = m;
+                ++newVertices;
+            }
+        }
+        if (labels) {
+            newVertices *= 3; // at most, for every vertex the meshlet uses
+        }
+        if (batch.VertexCount + newVertices > kMaxBatchVertices) {
+            closeBatch(m);
+            batch = {};
+            batch.FirstMeshlet = m;
+            batch.VertexOffset = static_cast<uint32_t>(VertexRemap_.size());
+            batch.IndexOffset = static_cast<uint32_t>(Indices_.size());
+        }
+
+        current.Batch = static_cast<uint32_t>(Batches_.size());
+        current.FirstVertex = static_cast<uint32_t>(VertexRemap_.size());
+        for (uint32_t t = current.FirstTriangle; t < current.FirstTriangle + current.TriangleCount; ++t) {
+            const uint32_t* tri = &indices[t * 3];
+            // Labels that reuse the most copies already in the batch. A copy is only
+            // added for a vertex that is in the batch with other labels.
+            int order = 0;
+            if (labels) {
+                uint32_t fewestCopies = kNone;
+                for (int o = 0; o < 6 && fewestCopies > 0; ++o) {
+                    uint32_t copies = 0;
+                    for (int c = 0; c < 3; ++c) {
+                        const uint32_t* batches = &vertexBatch[size_t(tri[c]) * 3];
+                        const bool inBatch = batches[0] == current.Batch || batches[1] == current.Batch ||
+                            batches[2] == current.Batch;
+                        copies += inBatch && batches[kLabelOrders[o][c]] != current.Batch;
+                    }
+                    if (copies < fewestCopies) {
+                        fewestCopies = copies;
+                        order = o;
+                    }
+                }
+            }
+            for (int c = 0; c < 3; ++c) {
+                const uint8_t label = kLabelOrders[order][c];
+                const size_t copy = size_t(tri[c]) * copiesPerVertex + (labels ? label : 0);
+                if (vertexBatch[copy] != current.Batch) {
+                    vertexBatch[copy] = current.Batch;
+                    localIndex[copy] = batch.VertexCount++;
+                    VertexRemap_.push_back(tri[c]);
+                    if (labels) {
+                        CornerLabels_.push_back(label);
+                    }
+                }
+                Indices_.push_back(static_cast<uint16_t>(localIndex[copy]));
+            }
+        }
+        current.VertexCount = static_cast<uint32_t>(VertexRemap_.size()) - current.FirstVertex;
+    }
+    if (!Meshlets_.empty()) {
+        closeBatch(static_cast<uint32_t>(Meshlets_.size()));
+    }
+
+    GpuVertexCount_ = VertexRemap_.size();
+    bool identity = Batches_.size() <= 1 && GpuVertexCount_ == vertexCount;
+    for (size_t i = 0; identity && i < VertexRemap_.size(); ++i) {
+        identity = VertexRemap_[i] == i;
+    }
+    if (identity) {
+        VertexRemap_.clear();
+        VertexRemap_.shrink_to_fit();
+    }
+}
+
+void MeshletMesh::AppendVisibleRanges(
+    const std::vector<Meshlet>& meshlets,
+    const Batch& batch,
+    const uint8_t* visible,
+    bool lines,
+    int64_t indexBase,
+    std::vector<IndexRange>& ranges) {
+    for (uint32_t m = batch.FirstMeshlet; m < batch.FirstMeshlet + batch.MeshletCount; ++m) {
+        const Meshlet& meshlet = meshlets[m];
+        const uint32_t count = lines ? meshlet.LineIndexCount : meshlet.TriangleCount * 3;
+        if ((visible != nullptr && !visible[m]) || count == 0) {
+            continue;
+        }
+        const uint32_t first =
+            static_cast<uint32_t>((lines ? meshlet.LineIndexOffset : meshlet.FirstTriangle * 3) + indexBase);
+        if (!ranges.empty() && ranges.back().First + ranges.back().Count == first) {
+            ranges.back().Count += count;
+        } else {
+            ranges.push_back({first, count});
+        }
+    }
+}
+
+void MeshletMesh::UpdateBounds(
+    const std::vector<XrVector3f>& vertices,
+    const std::vector<uint32_t>& indices,
+    ThreadPool* pool) {
+    ParallelFor(pool, Meshlets_.size(), kMeshletsPerTask, [&](size_t begin, size_t end) {
+        for (size_t m = begin; m < end; ++m) {
+            Meshlet& meshlet = Meshlets_[m];
+            const uint32_t* first = &indices[meshlet.FirstTriangle * 3];
+            const uint32_t indexCount = meshlet.TriangleCount * 3;
+
+            // Sphere around the box center; within a few percent of the optimal sphere for
+            // the flat, compact patches that meshlets of a room mesh are.
+            XrVector3f lo = vertices[first[0]];
+            XrVector3f hi = lo;
+            for (uint32_t i = 1; i < indexCount; ++i) {
+                const XrVector3f& p = vertices[first[i]];
+                lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+                hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+            }
+            const XrVector3f center = {(lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f};
+            float radiusSquared = 0.0f;
+            for (uint32_t i = 0; i < indexCount; ++i) {
+                const XrVector3f& p = vertices[first[i]];
+                const float dx = p.x - center.x;
+                const float dy = p.y - center.y;
+                const float dz = p.z - center.z;
+                radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+            }
+            meshlet.Center = center;
+            meshlet.Radius = std::sqrt(radiusSquared);
+
+            // Cone around the average unit normal, with its apex moved back far enough
+            // that every triangle's plane is in front of it.
+            XrVector3f axis = {0.0f, 0.0f, 0.0f};
+            auto unitNormal = [&](uint32_t t, XrVector3f& n) {
+                const XrVector3f& p0 = vertices[first[t * 3]];
+                const XrVector3f& p1 = vertices[first[t * 3 + 1]];
+                const XrVector3f& p2 = vertices[first[t * 3 + 2]];
+                const XrVector3f e1 = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+                const XrVector3f e2 = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+                n = {e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x};
+                const float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+                if (length <= 1e-12f) {
+                    return false;
+                }
+                n = {n.x / length, n.y / length, n.z / length};
+                return true;
+            };
+            XrVector3f n;
+            for (uint32_t t = 0; t < meshlet.TriangleCount; ++t) {
+                if (unitNormal(t, n)) {
+                    axis = {axis.x + n.x, axis.y + n.y, axis.z + n.z};
+                }
+            }
+            const float axisLength = std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+            meshlet.ConeApex = center;
+            meshlet.ConeAxis = {0.0f, 0.0f, 0.0f};
+            meshlet.ConeCutoff = 1.0f;
+            if (axisLength <= 1e-12f) {
+                continue;
+            }
+            axis = {axis.x / axisLength, axis.y / axisLength, axis.z / axisLength};
+            float minDot = 1.0f;
+            for (uint32_t t = 0; t < meshlet.TriangleCount; ++t) {
+                if (unitNormal(t, n)) {
+                    minDot = std::min(minDot, axis.x * n.x + axis.y * n.y + axis.z * n.z);
+                }
+            }
+            meshlet.ConeAxis = axis;
+            if (minDot <= kMinConeDot) {
+                continue;
+            }
+            float maxT = 0.0f;
+            for (uint32_t t = 0; t < meshlet.TriangleCount; ++t) {
+                if (!unitNormal(t, n)) {
+                    continue;
+                }
+                const XrVector3f& p0 = vertices[first[t * 3]];
+                const float dc = (center.x - p0.x) * n.x + (center.y - p0.y) * n.y + (center.z - p0.z) * n.z;
+                const float dn = axis.x * n.x + axis.y * n.y + axis.z * n.z;
+                maxT = std::max(maxT, dc / dn);
+            }
+            meshlet.ConeApex = {center.x - axis.x * maxT, center.y - axis.y * maxT, center.z - axis.z * maxT};
+            meshlet.ConeCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+    });
+}
+
+void MeshletMesh::GatherVertices(const std::vector<XrVector3f>& vertices, std::vector<XrVector3f>& gpuVertices) const {
+    if (VertexRemap_.empty()) {
+        gpuVertices.assign(vertices.begin(), vertices.end());
+        return;
+    }
+    gpuVertices.resize(VertexRemap_.size());
+    for (size_t i = 0; i < VertexRemap_.size(); ++i) {
+        gpuVertices[i] = vertices[VertexRemap_[i]];
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <openxr/openxr.h>
+
+class MeshTopology;
+class ThreadPool;
+
+// A triangle mesh split into meshlets of ~128-256 consecutive triangles, each with a
+// bounding sphere and a normal cone for culling, for upload with 16-bit indices.
+//
+// Meshlets are grouped into batches of at most 65536 vertices. The GPU vertex buffer
+// holds each batch's vertices contiguously and indices are relative to the batch's
+// first vertex, so one batch is one draw with GL_UNSIGNED_SHORT indices. Vertices used
+// by more than one batch are duplicated; meshes with up to 65536 vertices are a single
+// batch and, without corner labels, keep the vertex order unchanged.
+//
+// The wireframe is either a line index buffer or, for a barycentric wireframe drawn
+// with the triangle indices, a corner label per GPU vertex. Labels are 0, 1 and 2 on
+// the three corners of every triangle, which takes extra copies of some vertices.
+class MeshletMesh {
+public:
+    enum class WireframeMode {
+        Lines, // LineIndices()
+        Barycentric, // CornerLabels()
+    };
+
+    struct Settings {
+        // A meshlet is closed once it has MinTriangles and the next triangle does not
+        // touch it (the triangle order jumps elsewhere), or when it has MaxTriangles.
+        uint32_t MinTriangles = 128;
+        uint32_t MaxTriangles = 256;
+        WireframeMode Wireframe = WireframeMode::Barycentric;
+    };
+
+    struct Meshlet {
+        uint32_t FirstTriangle; // in the source index buffer and in Indices() / 3
+        uint32_t TriangleCount;
+        uint32_t Batch;
+        // GPU vertices first used by this meshlet; the meshlets of a batch own
+        // consecutive ranges that together cover the batch.
+        uint32_t FirstVertex;
+        uint32_t VertexCount;
+        // Wireframe lines of the edges whose first half-edge is in this meshlet, in
+        // WireframeMode::Lines
+        uint32_t LineIndexOffset; // into LineIndices()
+        uint32_t LineIndexCount;
+        // Bounding sphere
+        XrVector3f Center;
+        float Radius;
+        // Normal cone: every front face normal n satisfies dot(n, ConeAxis) >= sqrt(1 -
+        // ConeCutoff^2), so the meshlet is back facing for an eye at e when
+        // dot(normalize(ConeApex - e), ConeAxis) >= ConeCutoff. ConeCutoff is 1 when the
+        // normals spread too much for that test.
+        XrVector3f ConeApex;
+        XrVector3f ConeAxis;
+        float ConeCutoff;
+    };
+
+    struct Batch {
+        uint32_t FirstMeshlet;
+        uint32_t MeshletCount;
+        uint32_t VertexOffset; // first GPU vertex
+        uint32_t VertexCount;
+        uint32_t IndexOffset; // into Indices()
+        uint32_t IndexCount;
+        uint32_t LineIndexOffset; // into LineIndices()
+        uint32_t LineIndexCount;
+    };
+
+    struct IndexRange {
+        uint32_t First;
+        uint32_t Count;
+    };
+
+    static constexpr uint32_t kMaxBatchVertices = 65536;
+
+    // Appends the Indices() ranges (LineIndices() with lines) of the meshlets of batch
+    // whose visible entry is nonzero, or of all of them when visible is null, moved by
+    // indexBase. Ranges that continue the previous one, including ranges.back(), are
+    // merged into it.
+    static void AppendVisibleRanges(
+        const std::vector<Meshlet>& meshlets,
+        const Batch& batch,
+        const uint8_t* visible,
+        bool lines,
+        int64_t indexBase,
+        std::vector<IndexRange>& ranges);
+
+    // Partitions indices (a triangle list over vertexCount vertices, in draw order) and
+    // builds the 16-bit triangle and wireframe line indices. topology must be built from
+    // the same indices; it provides the unique edges for the lines.
+    void Build(
+        const std::vector<uint32_t>& indices,
+        size_t vertexCount,
+        const MeshTopology& topology,
+        const Settings& settings);
+
+    // Recomputes the meshlet spheres and cones for the positions of the mesh Build was
+    // given. Cheap enough to run on every vertex refresh.
+    void UpdateBounds(
+        const std::vector<XrVector3f>& vertices,
+        const std::vector<uint32_t>& indices,
+        ThreadPool* pool = nullptr);
+
+    // Takes the buffers of a mesh built before, e.g. read back from ProcessedMeshCache,
+    // as they were. vertexRemap is empty for the identity order.
+    void Assign(
+        std::vector<Meshlet> meshlets,
+        std::vector<Batch> batches,
+        std::vector<uint16_t> indices,
+        std::vector<uint16_t> lineIndices,
+        std::vector<uint8_t> cornerLabels,
+        std::vector<uint32_t> vertexRemap,
+        size_t gpuVertexCount);
+
+    void Clear();
+    // Frees the triangle and line indices and the corner labels, e.g. once uploaded. The
+    // meshlets, batches and GPU vertex order stay.
+    void ReleaseBuffers();
+
+    const std::vector<Meshlet>& Meshlets() const { return Meshlets_; }
+    const std::vector<Batch>& Batches() const { return Batches_; }
+    const std::vector<uint16_t>& Indices() const { return Indices_; }
+    const std::vector<uint16_t>& LineIndices() const { return LineIndices_; }
+    // Corner label of every GPU vertex, in WireframeMode::Barycentric.
+    const std::vector<uint8_t>& CornerLabels() const { return CornerLabels_; }
+
+    size_t GpuVertexCount() const { return GpuVertexCount_; }
+
+    // GPU vertex buffer contents for the mesh's vertices.
+    void GatherVertices(const std::vector<XrVector3f>& vertices, std::vector<XrVector3f>& gpuVertices) const;
+
+    // True when the GPU vertex buffer is the mesh's vertex array as is.
+    bool IsIdentityVertexOrder() const { return VertexRemap_.empty(); }
+    // Mesh vertex of every GPU vertex; empty for the identity.
+    const std::vector<uint32_t>& VertexRemap() const { return VertexRemap_; }
+
+private:
+    std::vector<Meshlet> Meshlets_;
+    std::vector<Batch> Batches_;
+    std::vector<uint16_t> Indices_;
+    std::vector<uint16_t> LineIndices_;
+    std::vector<uint8_t> CornerLabels_;
+    // GPU vertex -> mesh vertex; empty for the identity.
+    std::vector<uint32_t> VertexRemap_;
+    size_t GpuVertexCount_ = 0;
+};
@@ -0,0 +1,419 @@
+#include "ProcessedMeshCache.h"
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+// xxHash64's primes and rounds
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t Read64(const uint8_t* bytes) {
+    uint64_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+uint64_t HashRound(uint64_t accumulator, uint64_t input) {
+    return RotateLeft(accumulator + input * kPrime2, 31) * kPrime1;
+}
+
+uint64_t MergeRound(uint64_t hash, uint64_t accumulator) {
+    return (hash ^ HashRound(0, accumulator)) * kPrime1 + kPrime4;
+}
+
+size_t PaddedSize(size_t size) {
+    return (size + kProcessedMeshCacheAlignment - 1) & ~(kProcessedMeshCacheAlignment - 1);
+}
+
+template <typename T>
+void AppendValue(std::vector<uint8_t>& out, const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "written as raw bytes");
+    const size_t offset = out.size();
+    out.resize(offset + sizeof(T));
+    std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+// Appends values padded to the alignment with zeros.
+template <typename T>
+void AppendArray(std::vector<uint8_t>& out, const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value, "written as raw bytes");
+    const size_t offset = out.size();
+    const size_t bytes = values.size() * sizeof(T);
+    out.resize(offset + PaddedSize(bytes), 0);
+    if (bytes > 0) {
+        std::memcpy(out.data() + offset, values.data(), bytes);
+    }
+}
+
+// Reads the payload back in the order it was appended, failing past its end.
+class PayloadReader {
+public:
+    PayloadReader(const uint8_t* data, size_t size) : Data_(data), Size_(size) {}
+
+    template <typename T>
+    bool Read(T& value) {
+        if (Size_ - Offset_ < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, Data_ + Offset_, sizeof(T));
+        Offset_ += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool ReadArray(uint32_t count, std::vector<T>& values) {
+        const uint64_t bytes = static_cast<uint64_t>(count) * sizeof(T);
+        if (Size_ - Offset_ < PaddedSize(bytes)) {
+            return false;
+        }
+        values.resize(count);
+        if (bytes > 0) {
+            std::memcpy(values.data(), Data_ + Offset_, bytes);
+        }
+        Offset_ += PaddedSize(bytes);
+        return true;
+    }
+
+    bool AtEnd() const {
+        return Offset_ == Size_;
+    }
+
+private:
+    const uint8_t* Data_;
+    size_t Size_;
+    size_t Offset_ = 0;
+};
+
+void AppendLevel(std::vector<uint8_t>& out, const ovrProcessedMesh& level) {
+    const MeshletMesh& meshlets = level.Meshlets;
+    ProcessedMeshCacheLevel header = {};
+    header.VertexCount = static_cast<uint32_t>(level.Vertices.size());
+    header.NormalCount = static_cast<uint32_t>(level.Normals.size());
+    header.GpuVertexCount = static_cast<uint32_t>(level.GpuVertices.size());
+    header.GpuNormalCount = static_cast<uint32_t>(level.GpuNormals.size());
+    header.MeshletCount = static_cast<uint32_t>(meshlets.Meshlets().size());
+    header.BatchCount = static_cast<uint32_t>(meshlets.Batches().size());
+    header.IndexCount = static_cast<uint32_t>(meshlets.Indices().size());
+    header.LineIndexCount = static_cast<uint32_t>(meshlets.LineIndices().size());
+    header.CornerLabelCount = static_cast<uint32_t>(meshlets.CornerLabels().size());
+    header.VertexRemapCount = static_cast<uint32_t>(meshlets.VertexRemap().size());
+    header.MeshletVertexCount = static_cast<uint32_t>(meshlets.GpuVertexCount());
+    const OVR::Bounds3f& bounds = level.LocalBounds;
+    header.BoundsMin = {bounds.b[0].x, bounds.b[0].y, bounds.b[0].z};
+    header.BoundsMax = {bounds.b[1].x, bounds.b[1].y, bounds.b[1].z};
+    AppendValue(out, header);
+    AppendArray(out, level.Vertices);
+    AppendArray(out, level.Normals);
+    AppendArray(out, level.GpuVertices);
+    AppendArray(out, level.GpuNormals);
+    AppendArray(out, meshlets.Meshlets());
+    AppendArray(out, meshlets.Batches());
+    AppendArray(out, meshlets.Indices());
+    AppendArray(out, meshlets.LineIndices());
+    AppendArray(out, meshlets.CornerLabels());
+    AppendArray(out, meshlets.VertexRemap());
+}
+
+// Whether the arrays of a level read back fit together, so that uploading and drawing
+// it stays within its buffers. The checksum only shows the file is as it was written; a
+// file from a build that laid the meshlets out differently can still pass it.
+bool IsConsistent(const ovrProcessedMesh& level) {
+    const MeshletMesh& meshlets = level.Meshlets;
+    const uint64_t vertexCount = level.UploadVertices().size();
+    if (meshlets.GpuVertexCount() != vertexCount ||
+        (!level.Normals.empty() && level.Normals.size() != level.Vertices.size()) ||
+        (!level.GpuNormals.empty() && level.GpuNormals.size() != level.GpuVertices.size()) ||
+        (!meshlets.CornerLabels().empty() && meshlets.CornerLabels().size() != vertexCount)) {
+        return false;
+    }
+    for (const uint32_t vertex : meshlets.VertexRemap()) {
+        if (vertex >= level.Vertices.size()) {
+            return false;
+        }
+    }
+    const uint64_t indexCount = meshlets.Indices().size();
+    const uint64_t lineIndexCount = meshlets.LineIndices().size();
+    for (const MeshletMesh::Batch& batch : meshlets.Batches()) {
+        if (uint64_t(batch.IndexOffset) + batch.IndexCount > indexCount ||
+            uint64_t(batch.LineIndexOffset) + batch.LineIndexCount > lineIndexCount ||
+            uint64_t(batch.VertexOffset) + batch.VertexCount > vertexCount ||
+            uint64_t(batch.FirstMeshlet) + batch.MeshletCount > meshlets.Meshlets().size()) {
+            return false;
+        }
+        // Batch indices are relative to the batch's first vertex.
+        for (uint32_t i = 0; i < batch.IndexCount; ++i) {
+            if (meshlets.Indices()[batch.IndexOffset + i] >= batch.VertexCount) {
+                return false;
+            }
+        }
+        for (uint32_t i = 0; i < batch.LineIndexCount; ++i) {
+            if (meshlets.LineIndices()[batch.LineIndexOffset + i] >= batch.VertexCount) {
+                return false;
+            }
+        }
+    }
+    for (const MeshletMesh::Meshlet& meshlet : meshlets.Meshlets()) {
+        if (meshlet.Batch >= meshlets.Batches().size()) {
+            return false;
+        }
+        const MeshletMesh::Batch& batch = meshlets.Batches()[meshlet.Batch];
+        const uint64_t firstIndex = uint64_t(meshlet.FirstTriangle) * 3;
+        if (firstIndex < batch.IndexOffset ||
+            firstIndex + uint64_t(meshlet.TriangleCount) * 3 > uint64_t(batch.IndexOffset) + batch.IndexCount ||
+            meshlet.LineIndexOffset < batch.LineIndexOffset ||
+            uint64_t(meshlet.LineIndexOffset) + meshlet.LineIndexCount >
+                uint64_t(batch.LineIndexOffset) + batch.LineIndexCount ||
+            uint64_t(meshlet.FirstVertex) + meshlet.VertexCount > vertexCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReadLevel(PayloadReader& in, ovrProcessedMesh& level) {
+    ProcessedMeshCacheLevel header;
+    std::vector<MeshletMesh::Meshlet> meshlets;
+    std::vector<MeshletMesh::Batch> batches;
+    std::vector<uint16_t> indices;
+    std::vector<uint16_t> lineIndices;
+    std::vector<uint8_t> cornerLabels;
+    std::vector<uint32_t> vertexRemap;
+    if (!in.Read(header) || !in.ReadArray(header.VertexCount, level.Vertices) ||
+        !in.ReadArray(header.NormalCount, level.Normals) ||
+        !in.ReadArray(header.GpuVertexCount, level.GpuVertices) ||
+        !in.ReadArray(header.GpuNormalCount, level.GpuNormals) || !in.ReadArray(header.MeshletCount, meshlets) ||
+        !in.ReadArray(header.BatchCount, batches) || !in.ReadArray(header.IndexCount, indices) ||
+        !in.ReadArray(header.LineIndexCount, lineIndices) ||
+        !in.ReadArray(header.CornerLabelCount, cornerLabels) ||
+        !in.ReadArray(header.VertexRemapCount, vertexRemap)) {
+        return false;
+    }
+    // The GPU copies exist exactly when the upload order is not the identity.
+    if (vertexRemap.empty() != level.GpuVertices.empty()) {
+        return false;
+    }
+    level.Meshlets.Assign(
+        std::move(meshlets),
+        std::move(batches),
+        std::move(indices),
+        std::move(lineIndices),
+        std::move(cornerLabels),
+        std::move(vertexRemap),
+        header.MeshletVertexCount);
+    level.LocalBounds = OVR::Bounds3f(
+        OVR::Vector3f(header.BoundsMin.x, header.BoundsMin.y, header.BoundsMin.z),
+        OVR::Vector3f(header.BoundsMax.x, header.BoundsMax.y, header.BoundsMax.z));
+    return IsConsistent(level);
+}
+
+} // namespace
+
+ProcessedMeshCache::ProcessedMeshCache(std::string directory) : Directory_(std::move(directory)) {
+#if defined(_WIN32)
+    _mkdir(Directory_.c_str());
+#else
+    mkdir(Directory_.c_str(), 0770);
+#endif
+}
+
+uint64_t ProcessedMeshCache::Hash(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    const uint8_t* end = bytes + size;
+    uint64_t hash;
+    if (size >= 32) {
+        // Four independent lanes, so the multiplies overlap.
+        uint64_t lanes[4] = {seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1};
+        for (; end - bytes >= 32; bytes += 32) {
+            lanes[0] = HashRound(lanes[0], Read64(bytes));
+            lanes[1] = HashRound(lanes[1], Read64(bytes + 8));
+            lanes[2] = HashRound(lanes[2], Read64(bytes + 16));
+            lanes[3] = HashRound(lanes[3], Read64(bytes + 24));
+        }
+        hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) +
+            RotateLeft(lanes[3], 18);
+        for (const uint64_t lane : lanes) {
+            hash = MergeRound(hash, lane);
+        }
+    } else {
+        hash = seed + kPrime5;
+    }
+    hash += static_cast<uint64_t>(size);
+    for (; end - bytes >= 8; bytes += 8) {
+        hash = RotateLeft(hash ^ HashRound(0, Read64(bytes)), 27) * kPrime1 + kPrime4;
+    }
+    if (end - bytes >= 4) {
+        uint32_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        hash = RotateLeft(hash ^ (word * kPrime1), 23) * kPrime2 + kPrime3;
+        bytes += 4;
+    }
+    for (; bytes < end; ++bytes) {
+        hash = RotateLeft(hash ^ (*bytes * kPrime5), 11) * kPrime1;
+    }
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t ProcessedMeshCache::HashMesh(
+    const std::vector<XrVector3f>& vertices,
+    const std::vector<uint32_t>& indices) {
+    const uint64_t vertexHash = Hash(vertices.data(), vertices.size() * sizeof(XrVector3f));
+    return Hash(indices.data(), indices.size() * sizeof(uint32_t), vertexHash);
+}
+
+uint64_t ProcessedMeshCache::HashSettings(const ovrMeshProcessingSettings& settings) {
+    // Widened to one type, so that no padding is hashed. The expansion is baked into the
+    // positions without GPU expansion, a uniform with it.
+    const double fields[] = {
+        static_cast<double>(settings.Simplify),
+        static_cast<double>(settings.Simplification.TargetTriangleCount),
+        static_cast<double>(settings.Simplification.MaxError),
+        static_cast<double>(settings.Simplification.PreserveBoundary),
+        static_cast<double>(settings.Simplification.FeatureAngle),
+        static_cast<double>(static_cast<int>(settings.Subdivision)),
+        static_cast<double>(settings.UniformIterations),
+        static_cast<double>(settings.Adaptive.MaxLevels),
+        static_cast<double>(settings.Adaptive.TriangleBudget),
+        static_cast<double>(settings.Adaptive.MinEdgeLength),
+        static_cast<double>(settings.Adaptive.MaxEdgeLength),
+        static_cast<double>(settings.Adaptive.MaxDihedralAngle),
+        static_cast<double>(settings.Adaptive.MaxViewAngle),
+        static_cast<double>(settings.OptimizeVertexOrder),
+        static_cast<double>(settings.Optimization.VertexCacheSize),
+        static_cast<double>(settings.Optimization.OptimizeOverdraw),
+        static_cast<double>(settings.Optimization.OverdrawThreshold),
+        static_cast<double>(settings.Meshlets.MinTriangles),
+        static_cast<double>(settings.Meshlets.MaxTriangles),
+        static_cast<double>(static_cast<int>(settings.Meshlets.Wireframe)),
+        static_cast<double>(settings.GpuExpansion),
+        settings.GpuExpansion ? 0.0 : settings.ExpansionFactor,
+        static_cast<double>(settings.LodCount),
+        static_cast<double>(settings.LodMaxError),
+    };
+    return Hash(fields, sizeof(fields), kProcessedMeshCacheVersion);
+}
+
+std::string ProcessedMeshCache::PathOf(const XrUuidEXT& uuid) const {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string path = Directory_;
+    for (const uint8_t byte : uuid.data) {
+        path += kDigits[byte >> 4];
+        path += kDigits[byte & 15];
+    }
+    path += ".xrmesh";
+    return path;
+}
+
+std::shared_ptr<ovrProcessedMesh> ProcessedMeshCache::Load(
+    const XrUuidEXT& uuid,
+    const ovrMeshProcessingSettings& settings,
+    uint64_t& contentHash) {
+    const std::string path = PathOf(uuid);
+    MappedFile file;
+    if (!file.Open(path)) {
+        return nullptr;
+    }
+
+    ProcessedMeshCacheHeader header = {};
+    const uint8_t* payload = nullptr;
+    bool valid = file.Size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, file.Data(), sizeof(header));
+        payload = file.Data() + sizeof(header);
+        valid = std::memcmp(header.Magic, kProcessedMeshCacheMagic, sizeof(header.Magic)) == 0 &&
+            header.Version == kProcessedMeshCacheVersion &&
+            std::memcmp(header.Uuid, uuid.data, sizeof(header.Uuid)) == 0 && header.LevelCount > 0 &&
+            header.SettingsHash == HashSettings(settings) &&
+            header.PayloadSize == file.Size() - sizeof(header) &&
+            Hash(payload, header.PayloadSize) == header.PayloadChecksum;
+    }
+
+    // Level 0 gets the caller's settings, so those only read at upload and draw time
+    // apply; the levels of detail get them with LodCount 1, like Process gives them.
+    std::shared_ptr<ovrProcessedMesh> mesh = std::make_shared<ovrProcessedMesh>();
+    ovrMeshProcessingSettings lodSettings = settings;
+    lodSettings.LodCount = 1;
+    PayloadReader in(payload, valid ? static_cast<size_t>(header.PayloadSize) : 0);
+    for (uint32_t l = 0; valid && l < header.LevelCount; ++l) {
+        ovrProcessedMesh* level = mesh.get();
+        if (l > 0) {
+            mesh->Lods.push_back(std::make_shared<ovrProcessedMesh>());
+            level = mesh->Lods.back().get();
+        }
+        level->Settings = l == 0 ? settings : lodSettings;
+        valid = ReadLevel(in, *level);
+    }
+    if (!valid || !in.AtEnd()) {
+        file.Close();
+        std::remove(path.c_str());
+        return nullptr;
+    }
+    contentHash = header.ContentHash;
+    return mesh;
+}
+
+bool ProcessedMeshCache::Store(const XrUuidEXT& uuid, uint64_t contentHash, const ovrProcessedMesh& mesh) {
+    std::vector<uint8_t> data(sizeof(ProcessedMeshCacheHeader));
+    AppendLevel(data, mesh);
+    for (const std::shared_ptr<ovrProcessedMesh>& lod : mesh.Lods) {
+        AppendLevel(data, *lod);
+    }
+
+    ProcessedMeshCacheHeader header = {};
+    std::memcpy(header.Magic, kProcessedMeshCacheMagic, sizeof(header.Magic));
+    header.Version = kProcessedMeshCacheVersion;
+    header.LevelCount = static_cast<uint32_t>(1 + mesh.Lods.size());
+    std::memcpy(header.Uuid, uuid.data, sizeof(header.Uuid));
+    header.ContentHash = contentHash;
+    header.SettingsHash = HashSettings(mesh.Settings);
+    header.PayloadSize = data.size() - sizeof(header);
+    header.PayloadChecksum = Hash(data.data() + sizeof(header), header.PayloadSize);
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    // Written next to the entry and renamed over it, so readers never see half a file.
+    const std::string path = PathOf(uuid);
+    const std::string partialPath = path + ".partial";
+    FILE* file = std::fopen(partialPath.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (std::fclose(file) != 0 || !written) {
+        std::remove(partialPath.c_str());
+        return false;
+    }
+#if defined(_WIN32)
+    // rename does not replace existing files there.
+    std::remove(path.c_str());
+#endif
+    if (std::rename(partialPath.c_str(), path.c_str()) != 0) {
+        std::remove(partialPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ProcessedMeshCache::Remove(const XrUuidEXT& uuid) {
+    std::remove(PathOf(uuid).c_str());
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <openxr/openxr.h>
+
+#include "SceneSharingGl.h"
+
+// A processed mesh file: the occluder geometry ovrProcessedMesh::Process made from a
+// space's runtime mesh, so the next session can draw it before the runtime mesh is
+// fetched and processed again.
+//
+// The file is read in place from a memory mapping:
+//
+//   ProcessedMeshCacheHeader
+//   ProcessedMeshCacheLevel, then its arrays, each padded to 8 bytes    (per level)
+//
+// Level 0 comes first, then the levels of detail. A level's arrays are, in order:
+// XrVector3f Vertices[VertexCount], Normals[NormalCount], GpuVertices[GpuVertexCount]
+// and GpuNormals[GpuNormalCount], MeshletMesh::Meshlet[MeshletCount],
+// MeshletMesh::Batch[BatchCount], uint16_t Indices[IndexCount] and
+// LineIndices[LineIndexCount], uint8_t CornerLabels[CornerLabelCount] and uint32_t
+// VertexRemap[VertexRemapCount]. PayloadChecksum is ProcessedMeshCache::Hash of
+// everything after the header. Values are little endian, like scene traces.
+struct ProcessedMeshCacheHeader {
+    char Magic[8]; // kProcessedMeshCacheMagic
+    uint32_t Version;
+    uint32_t LevelCount;
+    uint8_t Uuid[XR_UUID_SIZE_EXT];
+    uint64_t ContentHash; // ProcessedMeshCache::HashMesh of the runtime mesh
+    uint64_t SettingsHash; // ProcessedMeshCache::HashSettings of the settings used
+    uint64_t PayloadSize;
+    uint64_t PayloadChecksum;
+};
+
+struct ProcessedMeshCacheLevel {
+    uint32_t VertexCount;
+    uint32_t NormalCount;
+    uint32_t GpuVertexCount;
+    uint32_t GpuNormalCount;
+    uint32_t MeshletCount;
+    uint32_t BatchCount;
+    uint32_t IndexCount;
+    uint32_t LineIndexCount;
+    uint32_t CornerLabelCount;
+    uint32_t VertexRemapCount;
+    uint32_t MeshletVertexCount; // MeshletMesh::GpuVertexCount
+    uint32_t Reserved;
+    XrVector3f BoundsMin; // LocalBounds
+    XrVector3f BoundsMax;
+};
+
+constexpr char kProcessedMeshCacheMagic[8] = {'X', 'R', 'O', 'C', 'C', 'M', 'S', 'H'};
+constexpr uint32_t kProcessedMeshCacheVersion = 1;
+constexpr size_t kProcessedMeshCacheAlignment = 8;
+
+// Processed meshes of the scene's spaces kept on disk between sessions, one file per
+// space named by its UUID, in a directory under the app's data directory.
+//
+// A file is keyed by a hash of the runtime mesh it was made from and a hash of the
+// settings Process reads, and is only checked when its space is loaded: Load compares
+// the settings, verifies the checksum and that the meshlet and batch ranges fit the
+// arrays they index then, and the caller compares the content hash with the runtime mesh
+// once it has that. Files that do not pass are removed. Nothing is read at startup, so a
+// cache of many rooms costs nothing until they are entered.
+//
+// The methods may be called from any thread, one call per file at a time; MeshPipeline
+// makes all of them on its thread.
+class ProcessedMeshCache {
+public:
+    // Creates directory, which ends in a path separator, when it does not exist.
+    explicit ProcessedMeshCache(std::string directory);
+
+    // 64-bit hash of size bytes, for noticing changed or damaged data, not for security.
+    static uint64_t Hash(const void* data, size_t size, uint64_t seed = 0);
+    // Hash of a runtime mesh, its vertices and indices.
+    static uint64_t HashMesh(const std::vector<XrVector3f>& vertices, const std::vector<uint32_t>& indices);
+    // Hash of the settings the processed geometry depends on. The viewer position of
+    // adaptive subdivision is left out: it differs in every session, and a mesh refined
+    // for another viewpoint still occludes. So are the settings only read when the mesh
+    // is uploaded or drawn, which Load takes from its caller.
+    static uint64_t HashSettings(const ovrMeshProcessingSettings& settings);
+
+    // The cached mesh of uuid, processed with settings like these, or null. contentHash
+    // receives the HashMesh of the runtime mesh it was made from. The mesh has no
+    // SharedLayout, so the next Process from it builds its layouts anew.
+    std::shared_ptr<ovrProcessedMesh> Load(
+        const XrUuidEXT& uuid,
+        const ovrMeshProcessingSettings& settings,
+        uint64_t& contentHash);
+
+    // Writes mesh, processed from a runtime mesh with HashMesh contentHash, as the entry
+    // of uuid. mesh must still have its upload data. The file is replaced at once, so an
+    // interrupted write leaves the previous entry or none. Returns false on failure.
+    bool Store(const XrUuidEXT& uuid, uint64_t contentHash, const ovrProcessedMesh& mesh);
+
+    void Remove(const XrUuidEXT& uuid);
+
+    const std::string& Directory() const {
+        return Directory_;
+    }
+
+private:
+    std::string PathOf(const XrUuidEXT& uuid) const;
+
+    std::string Directory_;
+};
@@ -0,0 +1,64 @@
+#include "QuantizedPositions.h"
+#include <algorithm>
+#include <cmath>
+
+void QuantizedPositions::Clear() {
+    Values_.clear();
+    BoxMin_ = {0.0f, 0.0f, 0.0f};
+    BoxExtent_ = {0.0f, 0.0f, 0.0f};
+}
+
+void QuantizedPositions::Quantize(const XrVector3f* positions, size_t count) {
+    Clear();
+    if (count == 0) {
+        return;
+    }
+    XrVector3f lo = positions[0];
+    XrVector3f hi = lo;
+    for (size_t i = 1; i < count; ++i) {
+        const XrVector3f& p = positions[i];
+        lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+        hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+    }
+    // Flat axes (a single wall) still get a small extent, so the dequantization stays
+    // invertible and offsets along that axis remain representable in the shader.
+    const XrVector3f extent = {
+        std::max(hi.x - lo.x, kMinExtent), std::max(hi.y - lo.y, kMinExtent), std::max(hi.z - lo.z, kMinExtent)};
+    Quantize(positions, count, lo, extent);
+}
+
+void QuantizedPositions::Quantize(
+    const XrVector3f* positions,
+    size_t count,
+    const XrVector3f& boxMin,
+    const XrVector3f& boxExtent) {
+    BoxMin_ = boxMin;
+    BoxExtent_ = boxExtent;
+    const XrVector3f& lo = BoxMin_;
+
+    const float sx = float(kMaxValue) / BoxExtent_.x;
+    const float sy = float(kMaxValue) / BoxExtent_.y;
+    const float sz = float(kMaxValue) / BoxExtent_.z;
+    auto quantize = [](float value) {
+        return static_cast<uint16_t>(std::min(std::max(value + 0.5f, 0.0f), float(kMaxValue)));
+    };
+
+    Values_.resize(count * 3);
+    uint16_t* out = Values_.data();
+    for (size_t i = 0; i < count; ++i) {
+        const XrVector3f& p = positions[i];
+        out[i * 3 + 0] = quantize((p.x - lo.x) * sx);
+        out[i * 3 + 1] = quantize((p.y - lo.y) * sy);
+        out[i * 3 + 2] = quantize((p.z - lo.z) * sz);
+    }
+}
+
+OVR::Matrix4f QuantizedPositions::Dequantization() const {
+    return OVR::Matrix4f::Translation(BoxMin_.x, BoxMin_.y, BoxMin_.z) *
+        OVR::Matrix4f::Scaling(BoxExtent_.x, BoxExtent_.y, BoxExtent_.z);
+}
+
+float QuantizedPositions::MaxError() const {
+    const float extent = std::max(BoxExtent_.x, std::max(BoxExtent_.y, BoxExtent_.z));
+    return 0.5f * extent / float(kMaxValue);
+}
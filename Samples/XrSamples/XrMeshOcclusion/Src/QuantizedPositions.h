@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <openxr/openxr.h>
+
+#include "OVR_Math.h"
+
+// Vertex positions as 16-bit unsigned normalized integers relative to their bounding
+// box, for upload as a GL_UNSIGNED_SHORT normalized attribute (6 bytes per vertex
+// instead of 12). The shader reads each coordinate in [0, 1]; Dequantization() maps
+// that back to the original positions and is meant to be folded into the model matrix.
+//
+// The step is the box extent / 65535 on each axis, about 0.15 mm for a 10 m room.
+class QuantizedPositions {
+public:
+    static constexpr uint32_t kMaxValue = 65535;
+    // Smallest box extent on any axis, in metres.
+    static constexpr float kMinExtent = 1e-3f;
+
+    // Replaces the contents with positions quantized to their own bounding box.
+    void Quantize(const XrVector3f* positions, size_t count);
+    // Replaces the contents with positions quantized to the given box, such as the box
+    // of an earlier Quantize so that unchanged positions keep their values. Positions
+    // outside the box are clamped to it.
+    void Quantize(const XrVector3f* positions, size_t count, const XrVector3f& boxMin, const XrVector3f& boxExtent);
+
+    void Clear();
+
+    // x, y, z per vertex.
+    const std::vector<uint16_t>& Values() const { return Values_; }
+    size_t VertexCount() const { return Values_.size() / 3; }
+
+    // Bounding box the values are relative to.
+    const XrVector3f& BoxMin() const { return BoxMin_; }
+    const XrVector3f& BoxExtent() const { return BoxExtent_; }
+
+    // Maps the normalized attribute in [0, 1]^3 to the original positions.
+    OVR::Matrix4f Dequantization() const;
+
+    // Largest distance along any axis between a position and its quantized value.
+    float MaxError() const;
+
+private:
+    std::vector<uint16_t> Values_;
+    XrVector3f BoxMin_ = {0.0f, 0.0f, 0.0f};
+    XrVector3f BoxExtent_ = {0.0f, 0.0f, 0.0f};
+};
@@ -43,12 +43,18 @@ Copyright   :   Copyright (c) Facebook Technologies, LLC and its affiliates. All
 #include <android/input.h>
 #endif
 
+#include <algorithm>
 #include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <iterator>
 #include <thread>
 
 #if defined(ANDROID)
 #include <sys/system_properties.h>
+#endif
 
+#if defined(ANDROID) || defined(__linux__)
 #include <EGL/egl.h>
 #include <GLES3/gl3.h>
 #include <GLES3/gl3ext.h>
@@ -159,6 +165,7 @@ struct OpenGLExtensions_t {
     bool multi_view; // GL_OVR_multiview, GL_OVR_multiview2
     bool EXT_texture_border_clamp; // GL_EXT_texture_border_clamp, GL_OES_texture_border_clamp
     bool EXT_sRGB_write_control;
+    bool EXT_color_buffer_float; // float color attachments, used by ovrDepthPyramid
 };
 
 OpenGLExtensions_t glExtensions;
@@ -182,6 +189,7 @@ static void EglInitExtensions() {
             strstr(allExtensions, "GL_EXT_texture_border_clamp") ||
             strstr(allExtensions, "GL_OES_texture_border_clamp");
         glExtensions.EXT_sRGB_write_control = strstr(allExtensions, "GL_EXT_sRGB_write_control");
+        glExtensions.EXT_color_buffer_float = strstr(allExtensions, "GL_EXT_color_buffer_float");
     }
 }
 
@@ -246,6 +254,284 @@ static void GLCheckErrors(int line) {
 /*
 ================================================================================
 
+ovrGlStateCache
+
+================================================================================
+*/
+
+void ovrGlStateCache::BeginFrame() {
+    Counters_ = Counters();
+    Invalidate();
+}
+
+void ovrGlStateCache::Invalidate() {
+    Program_ = kUnknown;
+    VertexArray_ = kUnknown;
+    for (GLuint& buffer : Buffers_) {
+        buffer = kUnknown;
+    }
+    for (UniformBinding& binding : UniformBuffers_) {
+        binding = {kUnknown, 0, 0};
+    }
+    ActiveTexture_ = kUnknown;
+    for (TextureBinding& binding : Textures_) {
+        binding = {0, kUnknown};
+    }
+}
+
+int ovrGlStateCache::BufferTargetIndex(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return 0;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return 1;
+        case GL_UNIFORM_BUFFER:
+            return 2;
+        case GL_COPY_WRITE_BUFFER:
+            return 3;
+        case GL_PIXEL_PACK_BUFFER:
+            return 4;
+        default:
+            assert(false);
+            return -1;
+    }
+}
+
+void ovrGlStateCache::UseProgram(GLuint program) {
+    if (program == Program_) {
+        ++Counters_.SkippedBinds;
+        return;
+    }
+    GL(glUseProgram(program));
+    Program_ = program;
+    ++Counters_.ProgramBinds;
+}
+
+void ovrGlStateCache::BindVertexArray(GLuint vertexArray) {
+    if (vertexArray == VertexArray_) {
+        ++Counters_.SkippedBinds;
+        return;
+    }
+    GL(glBindVertexArray(vertexArray));
+    VertexArray_ = vertexArray;
+    // The element buffer binding is part of the vertex array.
+    Buffers_[BufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = kUnknown;
+    ++Counters_.VertexArrayBinds;
+}
+
+void ovrGlStateCache::BindBuffer(GLenum target, GLuint buffer) {
+    const int index = BufferTargetIndex(target);
+    if (index < 0) {
+        GL(glBindBuffer(target, buffer));
+        ++Counters_.BufferBinds;
+        return;
+    }
+    if (buffer == Buffers_[index]) {
+        ++Counters_.SkippedBinds;
+        return;
+    }
+    GL(glBindBuffer(target, buffer));
+    Buffers_[index] = buffer;
+    ++Counters_.BufferBinds;
+}
+
+void ovrGlStateCache::BindUniformBuffer(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    if (index < kUniformBindings) {
+        UniformBinding& binding = UniformBuffers_[index];
+        if (binding.Buffer == buffer && binding.Offset == offset && binding.Size == size) {
+            ++Counters_.SkippedBinds;
+            return;
+        }
+        binding = {buffer, offset, size};
+    }
+    if (size == 0) {
+        GL(glBindBufferBase(GL_UNIFORM_BUFFER, index, buffer));
+    } else {
+        GL(glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size));
+    }
+    // Indexed binds also bind the generic binding point.
+    Buffers_[BufferTargetIndex(GL_UNIFORM_BUFFER)] = buffer;
+    ++Counters_.BufferBinds;
+}
+
+void ovrGlStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if (unit < kTextureUnits && Textures_[unit].Target == target && Textures_[unit].Texture == texture) {
+        ++Counters_.SkippedBinds;
+        return;
+    }
+    if (unit != ActiveTexture_) {
+        GL(glActiveTexture(GL_TEXTURE0 + unit));
+        ActiveTexture_ = unit;
+    }
+    GL(glBindTexture(target, texture));
+    if (unit < kTextureUnits) {
+        Textures_[unit] = {target, texture};
+    }
+    ++Counters_.TextureBinds;
+}
+
+void ovrGlStateCache::Uniform1i(GLint location, GLint value) {
+    GL(glUniform1i(location, value));
+    ++Counters_.UniformUpdates;
+}
+
+void ovrGlStateCache::Uniform4f(GLint location, float x, float y, float z, float w) {
+    GL(glUniform4f(location, x, y, z, w));
+    ++Counters_.UniformUpdates;
+}
+
+void ovrGlStateCache::UniformMatrix4(GLint location, const Matrix4f& matrix) {
+    GL(glUniformMatrix4fv(location, 1, GL_TRUE, &matrix.M[0][0]));
+    ++Counters_.UniformUpdates;
+}
+
+void ovrGlStateCache::DrawElements(GLenum mode, GLsizei count, GLenum type, size_t offset) {
+    GL(glDrawElements(mode, count, type, (const GLvoid*)offset));
+    ++Counters_.Draws;
+    Counters_.Elements += count;
+}
+
+void ovrGlStateCache::DrawArrays(GLenum mode, GLint first, GLsizei count) {
+    GL(glDrawArrays(mode, first, count));
+    ++Counters_.Draws;
+    Counters_.Elements += count;
+}
+
+/*
+================================================================================
+
+ovrBufferPool
+
+================================================================================
+*/
+
+ovrBufferPool::Allocation ovrBufferPool::Allocate(size_t size, size_t alignment) {
+    Allocation allocation;
+    if (size == 0) {
+        return allocation;
+    }
+    alignment = std::max<size_t>(alignment, 1);
+    auto place = [&](Arena& arena) {
+        for (auto range = arena.FreeRanges.begin(); range != arena.FreeRanges.end(); ++range) {
+            const size_t rangeBegin = range->first;
+            const size_t rangeEnd = range->first + range->second;
+            const size_t begin = (rangeBegin + alignment - 1) / alignment * alignment;
+            if (begin + size > rangeEnd) {
+                continue;
+            }
+            // The padding before the allocation and the rest after it stay free.
+            arena.FreeRanges.erase(range);
+            if (begin > rangeBegin) {
+                arena.FreeRanges[rangeBegin] = begin - rangeBegin;
+            }
+            if (begin + size < rangeEnd) {
+                arena.FreeRanges[begin + size] = rangeEnd - (begin + size);
+            }
+            arena.Allocated += size;
+            ++arena.AllocationCount;
+            allocation = {arena.Buffer, begin, size};
+            return true;
+        }
+        return false;
+    };
+    for (Arena& arena : Arenas_) {
+        if (arena.Size - arena.Allocated >= size && place(arena)) {
+            return allocation;
+        }
+    }
+
+    Arena arena = {0, std::max(size, ArenaSize_), 0, 0, {}};
+    arena.FreeRanges[0] = arena.Size;
+    GL(glGenBuffers(1, &arena.Buffer));
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, arena.Buffer));
+    GL(glBufferData(GL_COPY_WRITE_BUFFER, arena.Size, nullptr, GL_STATIC_DRAW));
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    Arenas_.push_back(std::move(arena));
+    place(Arenas_.back());
+    return allocation;
+}
+
+void ovrBufferPool::Free(Allocation& allocation) {
+    if (allocation.Buffer == 0) {
+        return;
+    }
+    auto arena = std::find_if(Arenas_.begin(), Arenas_.end(), [&allocation](const Arena& candidate) {
+        return candidate.Buffer == allocation.Buffer;
+    });
+    assert(arena != Arenas_.end());
+    size_t begin = allocation.Offset;
+    size_t end = allocation.Offset + allocation.Size;
+    allocation = Allocation();
+    if (arena == Arenas_.end()) {
+        return;
+    }
+    arena->Allocated -= end - begin;
+    --arena->AllocationCount;
+
+    if (arena->AllocationCount == 0) {
+        const bool otherEmpty = std::any_of(Arenas_.begin(), Arenas_.end(), [&arena](const Arena& other) {
+            return &other != &*arena && other.AllocationCount == 0;
+        });
+        if (arena->Size > ArenaSize_ || otherEmpty) {
+            GL(glDeleteBuffers(1, &arena->Buffer));
+            Arenas_.erase(arena);
+            return;
+        }
+        arena->FreeRanges.clear();
+        arena->FreeRanges[0] = arena->Size;
+        return;
+    }
+
+    // Merge with the free neighbours
+    auto next = arena->FreeRanges.lower_bound(begin);
+    if (next != arena->FreeRanges.end() && next->first == end) {
+        end += next->second;
+        next = arena->FreeRanges.erase(next);
+    }
+    if (next != arena->FreeRanges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == begin) {
+            begin = previous->first;
+            arena->FreeRanges.erase(previous);
+        }
+    }
+    arena->FreeRanges[begin] = end - begin;
+}
+
+void ovrBufferPool::Write(Allocation& allocation, const void* data, size_t size, size_t alignment) {
+    if (allocation.Size != size || allocation.Offset % std::max<size_t>(alignment, 1) != 0) {
+        Free(allocation);
+        allocation = Allocate(size, alignment);
+    }
+    if (allocation.Buffer == 0 || data == nullptr) {
+        return;
+    }
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.Buffer));
+    GL(glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.Offset, size, data));
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+}
+
+void ovrBufferPool::Destroy() {
+    for (Arena& arena : Arenas_) {
+        GL(glDeleteBuffers(1, &arena.Buffer));
+    }
+    Arenas_.clear();
+}
+
+ovrBufferPool::Stats ovrBufferPool::GetStats() const {
+    Stats stats;
+    for (const Arena& arena : Arenas_) {
+        ++stats.Arenas;
+        stats.Allocations += arena.AllocationCount;
+        stats.AllocatedBytes += arena.Allocated;
+        stats.ArenaBytes += arena.Size;
+    }
+    return stats;
+}
+
+/*
+================================================================================
+
 ovrGeometry
 
 ================================================================================
@@ -254,7 +540,10 @@ ovrGeometry
 enum VertexAttributeLocation {
     VERTEX_ATTRIBUTE_LOCATION_POSITION,
     VERTEX_ATTRIBUTE_LOCATION_COLOR,
-    VERTEX_ATTRIBUTE_LOCATION_UV
+    VERTEX_ATTRIBUTE_LOCATION_UV,
+    VERTEX_ATTRIBUTE_LOCATION_NORMAL,
+    VERTEX_ATTRIBUTE_LOCATION_MESH_SLOT,
+    VERTEX_ATTRIBUTE_LOCATION_CORNER
 };
 
 struct ovrVertexAttribute {
@@ -265,12 +554,33 @@ struct ovrVertexAttribute {
 static ovrVertexAttribute ProgramVertexAttributes[] = {
     {VERTEX_ATTRIBUTE_LOCATION_POSITION, "vertexPosition"},
     {VERTEX_ATTRIBUTE_LOCATION_COLOR, "vertexColor"},
-    {VERTEX_ATTRIBUTE_LOCATION_UV, "vertexUv"}};
+    {VERTEX_ATTRIBUTE_LOCATION_UV, "vertexUv"},
+    {VERTEX_ATTRIBUTE_LOCATION_NORMAL, "vertexNormal"},
+    {VERTEX_ATTRIBUTE_LOCATION_MESH_SLOT, "vertexMeshSlot"},
+    {VERTEX_ATTRIBUTE_LOCATION_CORNER, "vertexCorner"}};
+
+static Bounds3f PositionBounds(const XrVector3f* vertices, size_t vertexCount) {
+    Bounds3f bounds(Bounds3f::Init);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        bounds.AddPoint(Vector3f(vertices[i].x, vertices[i].y, vertices[i].z));
+    }
+    return bounds;
+}
+
+ovrBufferPool& ovrGeometry::VertexBuffers() {
+    static ovrBufferPool pool;
+    return pool;
+}
+
+ovrBufferPool& ovrGeometry::IndexBuffers() {
+    static ovrBufferPool pool;
+    return pool;
+}
 
 void ovrGeometry::Clear() {
-    VertexBuffer_ = 0;
-    IndexBuffer_ = 0;
-    WireframeIndexBuffer_ = 0;
+    VertexBuffer_ = {};
+    IndexBuffer_ = {};
+    WireframeIndexBuffer_ = {};
 
     VertexArrayObject_ = 0;
     for (int i = 0; i < MAX_VERTEX_ATTRIB_POINTERS; i++) {
@@ -281,6 +591,14 @@ void ovrGeometry::Clear() {
     WireframeIndexCount_ = 0;
     VertexCount_ = 0;
     IndexCount_ = 0;
+    MeshBatches_.clear();
+    Meshlets_.clear();
+    VertexData_.clear();
+    QuantizedPositions_ = false;
+    HasNormals_ = false;
+    CornerLabels_.clear();
+    PositionTransform_ = OVR::Matrix4f::Identity();
+    LocalBounds_.Clear();
     
     IsRenderable_ = false;
 }
@@ -290,19 +608,14 @@ void ovrGeometry::BindVAO() const {
 }
 
 void ovrGeometry::CreateIndexBuffer(const std::vector<unsigned short>& indices) {
-    if (IndexBuffer_ == 0) {
-        GL(glGenBuffers(1, &IndexBuffer_));
-    }
-    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexBuffer_));
-    GL(glBufferData(
-        GL_ELEMENT_ARRAY_BUFFER,
-        indices.size() * sizeof(unsigned short),
-        indices.data(),
-        GL_STATIC_DRAW));
-    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+    IndexBuffers().Write(IndexBuffer_, indices.data(), indices.size() * sizeof(unsigned short), sizeof(unsigned short));
     IndexCount_ = indices.size();
 }
 
+void ovrGeometry::CreateVertexBuffer(const void* data, size_t size, size_t alignment) {
+    VertexBuffers().Write(VertexBuffer_, data, size, alignment);
+}
+
 void ovrGeometry::CreateAxes() {
     struct AxesVertices {
         float positions[6][3];
@@ -335,10 +648,7 @@ void ovrGeometry::CreateAxes() {
     VertexAttribs_[1].Stride = sizeof(kAxesVertices.colors[0]);
     VertexAttribs_[1].Pointer = (const GLvoid*)offsetof(AxesVertices, colors);
 
-    GL(glGenBuffers(1, &VertexBuffer_));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer_));
-    GL(glBufferData(GL_ARRAY_BUFFER, sizeof(kAxesVertices), &kAxesVertices, GL_STATIC_DRAW));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    CreateVertexBuffer(&kAxesVertices, sizeof(kAxesVertices), sizeof(float));
 
     static const std::vector<unsigned short> indices = {
         0,
@@ -364,10 +674,7 @@ void ovrGeometry::CreateStage() {
     VertexAttribs_[0].Stride = 3 * sizeof(float);
     VertexAttribs_[0].Pointer = (const GLvoid*)0;
 
-    GL(glGenBuffers(1, &VertexBuffer_));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer_));
-    GL(glBufferData(GL_ARRAY_BUFFER, sizeof(stageVertices), stageVertices, GL_STATIC_DRAW));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    CreateVertexBuffer(stageVertices, sizeof(stageVertices), sizeof(float));
 
     static const std::vector<unsigned short> indices = {0, 1, 2, 2, 1, 3};
     CreateIndexBuffer(indices);
@@ -392,6 +699,7 @@ void ovrGeometry::CreatePlane(const std::vector<XrVector3f>& vertices, const XrC
         planeVertices.emplace_back(PlaneVertex{vertex, color});
     }
     VertexCount_ = vertices.size();
+    LocalBounds_ = PositionBounds(vertices.data(), vertices.size());
     VertexAttribs_[0].Index = VERTEX_ATTRIBUTE_LOCATION_POSITION;
     VertexAttribs_[0].Size = 3;
     VertexAttribs_[0].Type = GL_FLOAT;
@@ -406,16 +714,7 @@ void ovrGeometry::CreatePlane(const std::vector<XrVector3f>& vertices, const XrC
     VertexAttribs_[1].Stride = sizeof(PlaneVertex);
     VertexAttribs_[1].Pointer = (const GLvoid*)offsetof(PlaneVertex, color);
 
-    if (VertexBuffer_ == 0) {
-        GL(glGenBuffers(1, &VertexBuffer_));
-    }
-    GL(glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer_));
-    GL(glBufferData(
-        GL_ARRAY_BUFFER,
-        sizeof(PlaneVertex) * planeVertices.size(),
-        planeVertices.data(),
-        GL_STATIC_DRAW));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    CreateVertexBuffer(planeVertices.data(), sizeof(PlaneVertex) * planeVertices.size(), sizeof(float));
     // Render only front side of the plane to make sure plane direction is correct.
     std::vector<unsigned short> indices;
     const int numTriangles = vertices.size() - 2;
@@ -449,6 +748,7 @@ void ovrGeometry::CreateVolume(const std::array<XrVector3f, 8>& vertices, const
          vertices[7]},
         {color, color, color, color, color, color, color, color}};
     VertexCount_ = 8;
+    LocalBounds_ = PositionBounds(vertices.data(), vertices.size());
     VertexAttribs_[0].Index = VERTEX_ATTRIBUTE_LOCATION_POSITION;
     VertexAttribs_[0].Size = 3;
     VertexAttribs_[0].Type = GL_FLOAT;
@@ -463,10 +763,7 @@ void ovrGeometry::CreateVolume(const std::array<XrVector3f, 8>& vertices, const
     VertexAttribs_[1].Stride = sizeof(volumeVertices.colors[0]);
     VertexAttribs_[1].Pointer = (const GLvoid*)offsetof(VolumeVertices, colors);
 
-    GL(glGenBuffers(1, &VertexBuffer_));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer_));
-    GL(glBufferData(GL_ARRAY_BUFFER, sizeof(VolumeVertices), &volumeVertices, GL_STATIC_DRAW));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    CreateVertexBuffer(&volumeVertices, sizeof(VolumeVertices), sizeof(float));
     const std::vector<unsigned short> indices = {
         0, 2, 1, 2, 0, 3, // bottom
         4, 6, 5, 6, 4, 7, // top
@@ -481,81 +778,283 @@ void ovrGeometry::CreateVolume(const std::array<XrVector3f, 8>& vertices, const
     IsRenderable_ = true;
 }
 
-void ovrGeometry::CreateMesh(const XrSpaceTriangleMeshMETA& mesh) {
-    VertexCount_ = mesh.vertexCountOutput;
+void ovrGeometry::CreateMesh(
+    const std::vector<XrVector3f>& vertices,
+    const std::vector<XrVector3f>& normals,
+    const MeshletMesh& meshlets,
+    bool quantizePositions) {
+    VertexCount_ = vertices.size();
+    QuantizedPositions_ = quantizePositions;
+    HasNormals_ = !normals.empty();
+    assert(!HasNormals_ || normals.size() == vertices.size());
+    CornerLabels_ = meshlets.CornerLabels();
+
+    // Interleaved: the position, then the normal as three signed normalized bytes
+    // starting on a 4 byte boundary, followed by the corner label.
+    const GLsizei positionSize = quantizePositions ? 3 * sizeof(uint16_t) : sizeof(XrVector3f);
+    const GLsizei normalOffset = (positionSize + 3) & ~3;
+    const GLsizei stride = HasNormals_ || HasCornerLabels() ? normalOffset + 4 * sizeof(int8_t) : positionSize;
+
     VertexAttribs_[0].Index = VERTEX_ATTRIBUTE_LOCATION_POSITION;
     VertexAttribs_[0].Size = 3;
-    VertexAttribs_[0].Type = GL_FLOAT;
-    VertexAttribs_[0].Normalized = false;
-    VertexAttribs_[0].Stride = sizeof(XrVector3f);
+    VertexAttribs_[0].Type = quantizePositions ? GL_UNSIGNED_SHORT : GL_FLOAT;
+    VertexAttribs_[0].Normalized = quantizePositions;
+    VertexAttribs_[0].Stride = stride;
     VertexAttribs_[0].Pointer = (const GLvoid*)0;
 
-    GL(glGenBuffers(1, &VertexBuffer_));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer_));
-    GL(glBufferData(
-        GL_ARRAY_BUFFER,
-        mesh.vertexCountOutput * sizeof(XrVector3f),
-        mesh.vertices,
-        GL_STATIC_DRAW));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    if (HasNormals_) {
+        VertexAttribs_[1].Index = VERTEX_ATTRIBUTE_LOCATION_NORMAL;
+        VertexAttribs_[1].Size = 3;
+        VertexAttribs_[1].Type = GL_BYTE;
+        VertexAttribs_[1].Normalized = true;
+        VertexAttribs_[1].Stride = stride;
+        VertexAttribs_[1].Pointer = (const GLvoid*)(size_t)normalOffset;
+    }
+    if (HasCornerLabels()) {
+        VertexAttribs_[2].Index = VERTEX_ATTRIBUTE_LOCATION_CORNER;
+        VertexAttribs_[2].Size = 1;
+        VertexAttribs_[2].Type = GL_UNSIGNED_BYTE;
+        VertexAttribs_[2].Normalized = false;
+        VertexAttribs_[2].Stride = stride;
+        VertexAttribs_[2].Pointer = (const GLvoid*)(size_t)(normalOffset + 3);
+    }
 
-    // Buffer 1: Indici dei triangoli (per occlusione)
-    GL(glGenBuffers(1, &IndexBuffer_));
-    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexBuffer_));
-    GL(glBufferData(
-        GL_ELEMENT_ARRAY_BUFFER,
-        mesh.indexCountOutput * sizeof(uint32_t),
-        mesh.indices,
-        GL_STATIC_DRAW));
-    IndexCount_ = mesh.indexCountOutput;
-
-    // Buffer 2: Indici delle linee (per il wireframe)
-    std::vector<uint32_t> wireframeIndices;
-    wireframeIndices.reserve(mesh.indexCountOutput * 2);
-    for (uint32_t i = 0; i < mesh.indexCountOutput; i += 3) {
-        uint32_t i0 = mesh.indices[i];
-        uint32_t i1 = mesh.indices[i + 1];
-        uint32_t i2 = mesh.indices[i + 2];
-        wireframeIndices.push_back(i0);
-        wireframeIndices.push_back(i1);
-        wireframeIndices.push_back(i1);
-        wireframeIndices.push_back(i2);
-        wireframeIndices.push_back(i2);
-        wireframeIndices.push_back(i0);
-    }
-
-    GL(glGenBuffers(1, &WireframeIndexBuffer_));
-    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, WireframeIndexBuffer_));
-    GL(glBufferData(
-        GL_ELEMENT_ARRAY_BUFFER,
-        wireframeIndices.size() * sizeof(uint32_t),
-        wireframeIndices.data(),
-        GL_STATIC_DRAW));
-    WireframeIndexCount_ = wireframeIndices.size();
-    
-    // Annulla il binding 
-    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+    MeshBatches_ = meshlets.Batches();
+    Meshlets_ = meshlets.Meshlets();
+    VertexData_.clear();
+
+    // Aligned to the stride, so that the batches can be addressed in whole vertices.
+    CreateVertexBuffer(nullptr, vertices.size() * stride, stride);
+    UpdateMeshVertices(vertices.data(), HasNormals_ ? normals.data() : nullptr, vertices.size());
+
+    // Buffer 1: Indici dei triangoli (per occlusione), 16 bit relativi al batch
+    CreateIndexBuffer(meshlets.Indices());
+
+    // Buffer 2: Indici delle linee (per il wireframe), uno per ogni spigolo unico.
+    // Not needed for a barycentric wireframe, which is drawn with buffer 1.
+    if (!HasCornerLabels()) {
+        IndexBuffers().Write(
+            WireframeIndexBuffer_,
+            meshlets.LineIndices().data(),
+            meshlets.LineIndices().size() * sizeof(uint16_t),
+            sizeof(uint16_t));
+        WireframeIndexCount_ = meshlets.LineIndices().size();
+    }
 
-    // Crea il VAO. Poiché nessun index buffer è correntemente associato,
-    // il VAO non catturerà uno stato di binding errato.
     CreateVAO();
 
     IsRenderable_ = true;
 }
 
+// Interleaved occluder vertices of the given stride: the position at offset 0, as three
+// 16-bit normalized values when quantized is not null and as floats otherwise, the
+// normal as three signed normalized bytes at normalOffset when normals is not null, and
+// the corner label byte at cornerOffset when cornerLabels is not null.
+static void WriteOccluderVertices(
+    const XrVector3f* vertices,
+    const uint16_t* quantized,
+    const XrVector3f* normals,
+    const uint8_t* cornerLabels,
+    size_t vertexCount,
+    size_t stride,
+    size_t normalOffset,
+    size_t cornerOffset,
+    uint8_t* out) {
+    for (size_t i = 0; i < vertexCount; ++i) {
+        uint8_t* vertex = out + i * stride;
+        if (quantized != nullptr) {
+            memcpy(vertex, &quantized[i * 3], 3 * sizeof(uint16_t));
+        } else {
+            memcpy(vertex, &vertices[i], sizeof(XrVector3f));
+        }
+        if (normals != nullptr) {
+            const int8_t normal[3] = {
+                static_cast<int8_t>(std::lround(normals[i].x * 127.0f)),
+                static_cast<int8_t>(std::lround(normals[i].y * 127.0f)),
+                static_cast<int8_t>(std::lround(normals[i].z * 127.0f))};
+            memcpy(vertex + normalOffset, normal, sizeof(normal));
+        }
+        if (cornerLabels != nullptr) {
+            vertex[cornerOffset] = cornerLabels[i];
+        }
+    }
+}
 
-void ovrGeometry::Destroy() {
-    if (IndexBuffer_ != 0) {
-        GL(glDeleteBuffers(1, &IndexBuffer_));
+// Quantizes the positions of a vertex update. previous is the Dequantization() of the
+// last upload, or null for the first one. Its box is kept while the new positions fit
+// in it and span at least half of it on every axis, so unchanged positions keep their
+// values and only the meshlets that moved need uploading.
+static void RequantizePositions(
+    const XrVector3f* vertices,
+    size_t vertexCount,
+    const Bounds3f& bounds,
+    const Matrix4f* previous,
+    QuantizedPositions& quantized) {
+    if (previous != nullptr) {
+        const Vector3f boxMin(previous->M[0][3], previous->M[1][3], previous->M[2][3]);
+        const Vector3f boxExtent(previous->M[0][0], previous->M[1][1], previous->M[2][2]);
+        const Vector3f size = bounds.GetSize();
+        bool keep = true;
+        for (int i = 0; i < 3 && keep; ++i) {
+            keep = bounds.b[0][i] >= boxMin[i] && bounds.b[1][i] <= boxMin[i] + boxExtent[i] &&
+                std::max(size[i], QuantizedPositions::kMinExtent) >= 0.5f * boxExtent[i];
+        }
+        if (keep) {
+            quantized.Quantize(
+                vertices, vertexCount, {boxMin.x, boxMin.y, boxMin.z}, {boxExtent.x, boxExtent.y, boxExtent.z});
+            return;
+        }
     }
-    
-    if (WireframeIndexBuffer_ != 0) {
-        GL(glDeleteBuffers(1, &WireframeIndexBuffer_));
+    quantized.Quantize(vertices, vertexCount);
+}
+
+// Uploads the vertices of the meshlets of batch that differ between data and previous,
+// or all of them when previous is empty, to the buffer bound to target, in which the
+// batch starts at firstVertex. Both hold a mesh's GPU vertices, stride bytes each.
+// Neighbouring meshlets go up as one range.
+static void UploadChangedMeshlets(
+    GLenum target,
+    const std::vector<MeshletMesh::Meshlet>& meshlets,
+    const MeshletMesh::Batch& batch,
+    const std::vector<uint8_t>& data,
+    const std::vector<uint8_t>& previous,
+    size_t stride,
+    size_t firstVertex) {
+    // Changed vertices relative to the batch, not yet uploaded
+    size_t runBegin = 0;
+    size_t runEnd = 0;
+    auto flush = [&]() {
+        if (runEnd > runBegin) {
+            GL(glBufferSubData(
+                target,
+                (firstVertex + runBegin) * stride,
+                (runEnd - runBegin) * stride,
+                &data[(batch.VertexOffset + runBegin) * stride]));
+        }
+        runBegin = runEnd = 0;
+    };
+    for (uint32_t m = batch.FirstMeshlet; m < batch.FirstMeshlet + batch.MeshletCount; ++m) {
+        const MeshletMesh::Meshlet& meshlet = meshlets[m];
+        const size_t offset = size_t(meshlet.FirstVertex) * stride;
+        const size_t size = size_t(meshlet.VertexCount) * stride;
+        if (size == 0 || (!previous.empty() && memcmp(&data[offset], &previous[offset], size) == 0)) {
+            continue;
+        }
+        const size_t begin = meshlet.FirstVertex - batch.VertexOffset;
+        if (runEnd == runBegin || runEnd != begin) {
+            flush();
+            runBegin = begin;
+        }
+        runEnd = begin + meshlet.VertexCount;
+    }
+    flush();
+}
+
+void ovrGeometry::UpdateMeshVertices(const XrVector3f* vertices, const XrVector3f* normals, size_t vertexCount) {
+    assert(static_cast<int>(vertexCount) == VertexCount_);
+    assert((normals != nullptr) == HasNormals_);
+    LocalBounds_ = PositionBounds(vertices, vertexCount);
+    const bool refresh = !VertexData_.empty();
+    QuantizedPositions quantized;
+    if (QuantizedPositions_) {
+        // The model matrix picks up a new box next frame.
+        RequantizePositions(vertices, vertexCount, LocalBounds_, refresh ? &PositionTransform_ : nullptr, quantized);
+        PositionTransform_ = quantized.Dequantization();
+    }
+
+    const size_t stride = VertexAttribs_[0].Stride;
+    std::vector<uint8_t> data(vertexCount * stride, 0);
+    WriteOccluderVertices(
+        vertices,
+        QuantizedPositions_ ? quantized.Values().data() : nullptr,
+        normals,
+        HasCornerLabels() ? CornerLabels_.data() : nullptr,
+        vertexCount,
+        stride,
+        HasNormals_ ? (size_t)VertexAttribs_[1].Pointer : 0,
+        HasCornerLabels() ? (size_t)VertexAttribs_[2].Pointer : 0,
+        data.data());
+
+    const size_t firstVertex = VertexBuffer_.Offset / stride;
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, VertexBuffer_.Buffer));
+    for (const MeshletMesh::Batch& batch : MeshBatches_) {
+        UploadChangedMeshlets(
+            GL_COPY_WRITE_BUFFER, Meshlets_, batch, data, VertexData_, stride, firstVertex + batch.VertexOffset);
+    }
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    VertexData_ = std::move(data);
+}
+
+void ovrGeometry::ReleaseVertexData() {
+    std::vector<uint8_t>().swap(VertexData_);
+}
+
+void ovrGeometry::DrawMesh(ovrGlStateCache& state, const std::vector<uint8_t>& visibleMeshlets) const {
+    DrawMeshBatches(state, GL_TRIANGLES, IndexBuffer_, visibleMeshlets);
+}
+
+void ovrGeometry::DrawMeshWireframe(ovrGlStateCache& state, const std::vector<uint8_t>& visibleMeshlets) const {
+    if (HasCornerLabels()) {
+        DrawMeshBatches(state, GL_TRIANGLES, IndexBuffer_, visibleMeshlets);
+    } else {
+        DrawMeshBatches(state, GL_LINES, WireframeIndexBuffer_, visibleMeshlets);
     }
+}
 
-    if (VertexBuffer_ != 0) {
-        GL(glDeleteBuffers(1, &VertexBuffer_));
+void ovrGeometry::DrawMeshBatches(
+    ovrGlStateCache& state,
+    GLenum mode,
+    const ovrBufferPool::Allocation& indexBuffer,
+    const std::vector<uint8_t>& visibleMeshlets) const {
+    // Associa esplicitamente il buffer richiesto: il VAO ricorda solo quello dei triangoli.
+    state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.Buffer);
+    const bool lines = mode == GL_LINES;
+    const bool rebase = MeshBatches_.size() > 1;
+    const size_t firstVertex = VertexBuffer_.Offset / VertexAttribs_[0].Stride;
+    // GLES 3.0 has no base vertex draws: point the vertex streams at the batch's first
+    // vertex instead, so its 16-bit indices start from zero.
+    auto pointAttribs = [this](size_t batchVertex) {
+        for (int i = 0; i < MAX_VERTEX_ATTRIB_POINTERS; i++) {
+            if (VertexAttribs_[i].Index == -1) {
+                continue;
+            }
+            GL(glVertexAttribPointer(
+                VertexAttribs_[i].Index,
+                VertexAttribs_[i].Size,
+                VertexAttribs_[i].Type,
+                VertexAttribs_[i].Normalized,
+                VertexAttribs_[i].Stride,
+                (const GLvoid*)((size_t)VertexAttribs_[i].Pointer + batchVertex * VertexAttribs_[i].Stride)));
+        }
+    };
+    if (rebase) {
+        state.BindBuffer(GL_ARRAY_BUFFER, VertexBuffer_.Buffer);
+    }
+    std::vector<MeshletMesh::IndexRange> ranges;
+    for (const MeshletMesh::Batch& batch : MeshBatches_) {
+        ranges.clear();
+        MeshletMesh::AppendVisibleRanges(
+            Meshlets_, batch, visibleMeshlets.empty() ? nullptr : visibleMeshlets.data(), lines, 0, ranges);
+        if (ranges.empty()) {
+            continue;
+        }
+        if (rebase) {
+            pointAttribs(firstVertex + batch.VertexOffset);
+        }
+        for (const MeshletMesh::IndexRange& range : ranges) {
+            state.DrawElements(
+                mode, range.Count, GL_UNSIGNED_SHORT, indexBuffer.Offset + size_t(range.First) * sizeof(uint16_t));
+        }
+    }
+    if (rebase) {
+        pointAttribs(firstVertex);
     }
+}
+
+void ovrGeometry::Destroy() {
+    IndexBuffers().Free(IndexBuffer_);
+    IndexBuffers().Free(WireframeIndexBuffer_);
+    VertexBuffers().Free(VertexBuffer_);
     Clear();
 }
 
@@ -565,8 +1064,9 @@ void ovrGeometry::CreateVAO() {
     }
     GL(glBindVertexArray(VertexArrayObject_));
 
-    GL(glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer_));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer_.Buffer));
 
+    // The attribute pointers include where the geometry starts in its pool buffer.
     for (int i = 0; i < MAX_VERTEX_ATTRIB_POINTERS; i++) {
         if (VertexAttribs_[i].Index != -1) {
             GL(glEnableVertexAttribArray(VertexAttribs_[i].Index));
@@ -576,12 +1076,12 @@ void ovrGeometry::CreateVAO() {
                 VertexAttribs_[i].Type,
                 VertexAttribs_[i].Normalized,
                 VertexAttribs_[i].Stride,
-                VertexAttribs_[i].Pointer));
+                (const GLvoid*)((size_t)VertexAttribs_[i].Pointer + VertexBuffer_.Offset)));
         }
     }
     
     // Associa il buffer di indici predefinito (per triangoli) allo stato del VAO.
-    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexBuffer_));
+    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexBuffer_.Buffer));
 
     GL(glBindVertexArray(0));
     GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
@@ -605,7 +1105,15 @@ ovrProgram
 */
 
 struct ovrUniform {
-    enum Index { MODEL_MATRIX, VIEW_ID, SCENE_MATRICES, CUBE_COLOR };
+    enum Index {
+        MODEL_MATRIX,
+        VIEW_ID,
+        SCENE_MATRICES,
+        CUBE_COLOR,
+        EXPANSION,
+        EXPANSION_SCALE,
+        OCCLUDER_MESHES
+    };
     enum Type {
         VECTOR4,
         MATRIX4X4,
@@ -622,7 +1130,10 @@ static ovrUniform ProgramUniforms[] = {
     {ovrUniform::Index::MODEL_MATRIX, ovrUniform::Type::MATRIX4X4, "ModelMatrix"},
     {ovrUniform::Index::VIEW_ID, ovrUniform::Type::INTEGER, "ViewID"},
     {ovrUniform::Index::SCENE_MATRICES, ovrUniform::Type::BUFFER, "SceneMatrices"},
-    {ovrUniform::Index::CUBE_COLOR, ovrUniform::Type::VECTOR4, "CubeColor"}};
+    {ovrUniform::Index::CUBE_COLOR, ovrUniform::Type::VECTOR4, "CubeColor"},
+    {ovrUniform::Index::EXPANSION, ovrUniform::Type::VECTOR4, "Expansion"},
+    {ovrUniform::Index::EXPANSION_SCALE, ovrUniform::Type::VECTOR4, "ExpansionScale"},
+    {ovrUniform::Index::OCCLUDER_MESHES, ovrUniform::Type::BUFFER, "OccluderMeshes"}};
 
 void ovrProgram::Clear() {
     Program = 0;
@@ -694,8 +1205,11 @@ bool ovrProgram::Create(const char* vertexSource, const char* fragmentSource) {
             GL(UniformLocation[uniformIndex] =
                    glGetUniformBlockIndex(Program, ProgramUniforms[i].name));
             UniformBinding[uniformIndex] = numBufferBindings++;
-            GL(glUniformBlockBinding(
-                Program, UniformLocation[uniformIndex], UniformBinding[uniformIndex]));
+            // Blocks the program does not declare have no index to bind.
+            if (UniformLocation[uniformIndex] >= 0) {
+                GL(glUniformBlockBinding(
+                    Program, UniformLocation[uniformIndex], UniformBinding[uniformIndex]));
+            }
         } else {
             GL(UniformLocation[uniformIndex] =
                    glGetUniformLocation(Program, ProgramUniforms[i].name));
@@ -752,7 +1266,7 @@ void ovrFramebuffer::Clear() {
 }
 
 static void* GlGetExtensionProc(const char* functionName) {
-#if defined(ANDROID)
+#if defined(ANDROID) || defined(__linux__)
     return (void*)eglGetProcAddress(functionName);
 #elif defined(WIN32)
     return (void*)wglGetProcAddress(functionName);
@@ -800,6 +1314,9 @@ bool ovrFramebuffer::Create(
         GL(glGenTextures(1, &el.DepthTexture));
         GL(glBindTexture(GL_TEXTURE_2D_ARRAY, el.DepthTexture));
         GL(glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, width, height, 2));
+        // Read with texelFetch by ovrDepthPyramid.
+        GL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        GL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
         GL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
 
         // Create the frame buffer.
@@ -957,45 +1474,1293 @@ ovrMesh
 ================================================================================
 */
 
-ovrMesh::ovrMesh(const XrSpace space) : Space(space) {}
+// Whether two settings produce the same subdivided topology, vertex order and meshlets
+// for the same input. The viewer position is left out: a refresh keeps the refinement chosen
+// when it was built.
+static bool SameSubdivision(const ovrMeshProcessingSettings& a, const ovrMeshProcessingSettings& b) {
+    if (a.Subdivision != b.Subdivision || a.OptimizeVertexOrder != b.OptimizeVertexOrder ||
+        a.Meshlets.MinTriangles != b.Meshlets.MinTriangles || a.Meshlets.MaxTriangles != b.Meshlets.MaxTriangles ||
+        a.Meshlets.Wireframe != b.Meshlets.Wireframe) {
+        return false;
+    }
+    if (a.OptimizeVertexOrder &&
+        (a.Optimization.VertexCacheSize != b.Optimization.VertexCacheSize ||
+         a.Optimization.OptimizeOverdraw != b.Optimization.OptimizeOverdraw ||
+         a.Optimization.OverdrawThreshold != b.Optimization.OverdrawThreshold)) {
+        return false;
+    }
+    if (a.Subdivision == ovrMeshProcessingSettings::SubdivisionMode::Uniform) {
+        return a.UniformIterations == b.UniformIterations;
+    }
+    const AdaptiveSubdivision::Settings& x = a.Adaptive;
+    const AdaptiveSubdivision::Settings& y = b.Adaptive;
+    return x.MaxLevels == y.MaxLevels && x.TriangleBudget == y.TriangleBudget &&
+        x.MinEdgeLength == y.MinEdgeLength && x.MaxEdgeLength == y.MaxEdgeLength &&
+        x.MaxDihedralAngle == y.MaxDihedralAngle && x.MaxViewAngle == y.MaxViewAngle;
+}
+
+void ovrProcessedMesh::Process(
+    std::vector<XrVector3f> vertices,
+    std::vector<uint32_t> indices,
+    const ovrMeshProcessingSettings& settings,
+    const ovrProcessedMesh* previous,
+    ThreadPool* pool) {
+    // --- PERFORM SIMPLIFICATION ---
+    // Everything below works on the simplified mesh, including the layout reuse.
+    if (settings.Simplify) {
+        auto simplifiedResult = MeshSimplification::simplify(vertices, indices, settings.Simplification);
+        vertices = std::move(simplifiedResult.first);
+        indices = std::move(simplifiedResult.second);
+    }
+
+    ProcessLevel(vertices, indices, settings, previous, pool);
+
+    // --- LEVELS OF DETAIL ---
+    // Each level aims at half the triangles of the one before. While the runtime mesh
+    // has fewer than that, it is subdivided less; after that it is simplified, each level
+    // from the one before, with an error bound that doubles along with the distance the
+    // level is drawn from.
+    Lods.clear();
+    const size_t sourceTriangles = indices.size() / 3;
+    const size_t fullTriangles = SharedLayout->Indices.size() / 3;
+    size_t coarsestTriangles = fullTriangles;
+    for (int level = 1; level < settings.LodCount; ++level) {
+        const size_t targetTriangles = fullTriangles >> level;
+        ovrMeshProcessingSettings lodSettings = settings;
+        lodSettings.LodCount = 1;
+        if (sourceTriangles < targetTriangles &&
+            settings.Subdivision != ovrMeshProcessingSettings::SubdivisionMode::None) {
+            if (settings.Subdivision == ovrMeshProcessingSettings::SubdivisionMode::Adaptive) {
+                lodSettings.Adaptive.TriangleBudget = targetTriangles;
+            } else {
+                int iterations = 0;
+                while (iterations + 1 < settings.UniformIterations &&
+                       (sourceTriangles << (2 * (iterations + 1))) <= targetTriangles) {
+                    ++iterations;
+                }
+                lodSettings.UniformIterations = iterations;
+                if (iterations == 0) {
+                    lodSettings.Subdivision = ovrMeshProcessingSettings::SubdivisionMode::None;
+                }
+            }
+        } else {
+            lodSettings.Subdivision = ovrMeshProcessingSettings::SubdivisionMode::None;
+            MeshSimplification::Settings simplification = settings.Simplification;
+            simplification.TargetTriangleCount = targetTriangles;
+            simplification.MaxError = settings.LodMaxError * static_cast<float>(1 << (level - 1));
+            auto simplifiedResult = MeshSimplification::simplify(vertices, indices, simplification);
+            vertices = std::move(simplifiedResult.first);
+            indices = std::move(simplifiedResult.second);
+        }
+
+        const ovrProcessedMesh* previousLod = nullptr;
+        if (previous != nullptr && level <= static_cast<int>(previous->Lods.size())) {
+            previousLod = previous->Lods[level - 1].get();
+        }
+        std::shared_ptr<ovrProcessedMesh> lod = std::make_shared<ovrProcessedMesh>();
+        lod->ProcessLevel(vertices, indices, lodSettings, previousLod, pool);
+        // A level within a tenth of the one before saves too little to be worth its
+        // buffers, and the ones after it would not get much smaller either.
+        const size_t lodTriangles = lod->SharedLayout->Indices.size() / 3;
+        if (lodTriangles * 10 > coarsestTriangles * 9) {
+            break;
+        }
+        coarsestTriangles = lodTriangles;
+        Lods.push_back(std::move(lod));
+    }
+}
 
-void ovrMesh::Update(const XrSpaceTriangleMeshMETA& mesh) {
-// Convert the raw C-style arrays from the OpenXR struct to std::vectors
- std::vector<XrVector3f> originalVertices(mesh.vertices, mesh.vertices + mesh.vertexCountOutput);
- std::vector<uint32_t> originalIndices(mesh.indices, mesh.indices + mesh.indexCountOutput);
+void ovrProcessedMesh::ProcessLevel(
+    std::vector<XrVector3f> vertices,
+    std::vector<uint32_t> indices,
+    const ovrMeshProcessingSettings& settings,
+    const ovrProcessedMesh* previous,
+    ThreadPool* pool) {
+    Settings = settings;
+
+    // --- PERFORM SUBDIVISION ---
+    // Same topology as last time: only the positions need subdividing, and the
+    // subdivided indices, topology and meshlets are still valid.
+    const Layout* reused = previous != nullptr ? previous->SharedLayout.get() : nullptr;
+    const bool reuseLayout = reused != nullptr &&
+        settings.Subdivision != ovrMeshProcessingSettings::SubdivisionMode::None && !reused->Stencils.IsEmpty() &&
+        reused->Stencils.SourceVertexCount() == vertices.size() && indices == reused->SourceIndices &&
+        SameSubdivision(settings, reused->SourceSettings);
+    if (reuseLayout) {
+        SharedLayout = previous->SharedLayout;
+        reused->Stencils.Apply(vertices.data(), Vertices, pool);
+    } else {
+        std::shared_ptr<Layout> layout = std::make_shared<Layout>();
+        std::pair<std::vector<XrVector3f>, std::vector<uint32_t>> subdividedResult;
+        switch (settings.Subdivision) {
+            case ovrMeshProcessingSettings::SubdivisionMode::None:
+                subdividedResult = {vertices, indices};
+                break;
+            case ovrMeshProcessingSettings::SubdivisionMode::Uniform:
+                subdividedResult = LoopSubdivision::subdivide(
+                    vertices, indices, settings.UniformIterations, pool, &layout->Stencils);
+                break;
+            case ovrMeshProcessingSettings::SubdivisionMode::Adaptive:
+                subdividedResult = AdaptiveSubdivision::subdivide(
+                    vertices, indices, settings.Adaptive, pool, &layout->Stencils);
+                break;
+        }
+        layout->SourceIndices = std::move(indices);
+        layout->SourceSettings = settings;
+        Vertices = std::move(subdividedResult.first);
+        layout->Indices = std::move(subdividedResult.second);
+
+        // --- OPTIMIZE FOR THE GPU ---
+        // Cache friendly triangle order, then vertices renumbered in first-use order. The
+        // stencil rows are renumbered too, so refreshes come out in the same order.
+        if (settings.OptimizeVertexOrder) {
+            MeshOptimization::optimize_triangle_order(layout->Indices, Vertices, settings.Optimization);
+            std::vector<uint32_t> vertexRemap;
+            const size_t vertexCount =
+                MeshOptimization::optimize_vertex_fetch(layout->Indices, Vertices.size(), vertexRemap);
+            MeshOptimization::remap_vertices(Vertices, vertexRemap, vertexCount);
+            if (!layout->Stencils.IsEmpty()) {
+                layout->Stencils.RemapOutputs(vertexRemap, vertexCount);
+            }
+        }
+
+        // Connectivity of the subdivided mesh, shared by expansion and the wireframe
+        layout->Topology.Build(layout->Indices, Vertices.size(), pool);
 
- // --- PERFORM SUBDIVISION ---
- int subdivisionIterations = 1; 
- auto subdividedResult = LoopSubdivision::subdivide(originalVertices, originalIndices, subdivisionIterations);
+        // Upload layout: meshlets in batches addressed with 16-bit indices
+        layout->Meshlets.Build(layout->Indices, Vertices.size(), layout->Topology, settings.Meshlets);
+        SharedLayout = std::move(layout);
+    }
+    const Layout& layout = *SharedLayout;
+
+    // --- PERFORM EXPANSION ---
+    // On the GPU only the normals are uploaded and the offset stays a uniform, so it can
+    // change without touching the buffers.
+    if (settings.GpuExpansion) {
+        LoopSubdivision::compute_vertex_normals(Vertices, layout.Topology, layout.Indices, Normals, pool);
+    } else {
+        Normals.clear();
+        LoopSubdivision::expand_mesh(Vertices, layout.Topology, layout.Indices, settings.ExpansionFactor, pool);
+    }
 
- // Store the results in the member variables to manage their lifetime
- this->subdividedVertices = subdividedResult.first;
- this->subdividedIndices = subdividedResult.second;
+    // Meshlet bounds follow the positions, also on refreshes. With GPU expansion they do
+    // not include the expansion offset.
+    Meshlets = layout.Meshlets;
+    Meshlets.UpdateBounds(Vertices, layout.Indices, pool);
+
+    // Vertices in upload order; only meshes split into several batches need a copy
+    GpuVertices.clear();
+    GpuNormals.clear();
+    if (!Meshlets.IsIdentityVertexOrder()) {
+        Meshlets.GatherVertices(Vertices, GpuVertices);
+        if (!Normals.empty()) {
+            Meshlets.GatherVertices(Normals, GpuNormals);
+        }
+    }
+    const std::vector<XrVector3f>& uploadVertices = UploadVertices();
+    LocalBounds = PositionBounds(uploadVertices.data(), uploadVertices.size());
+}
 
- // --- PERFORM EXPANSION ---
- const float expansionFactor = 0.015f; 
- LoopSubdivision::expand_mesh(this->subdividedVertices, this->subdividedIndices, expansionFactor);
+size_t ovrProcessedMesh::UploadBytes() const {
+    const size_t positionSize = Settings.QuantizePositions ? 3 * sizeof(uint16_t) : sizeof(XrVector3f);
+    const bool hasNormalSlot = !UploadNormals().empty() || !Meshlets.CornerLabels().empty();
+    const size_t vertexSize = hasNormalSlot ? ((positionSize + 3) & ~size_t(3)) + 4 : positionSize;
+    size_t bytes = UploadVertices().size() * vertexSize +
+        (Meshlets.Indices().size() + Meshlets.LineIndices().size()) * sizeof(uint16_t);
+    for (const std::shared_ptr<ovrProcessedMesh>& lod : Lods) {
+        bytes += lod->UploadBytes();
+    }
+    return bytes;
+}
 
- // Create a temporary mesh struct that points to our new subdivided and expanded data
- XrSpaceTriangleMeshMETA finalMeshForGL = {XR_TYPE_SPACE_TRIANGLE_MESH_META};
- finalMeshForGL.vertexCountOutput = static_cast<uint32_t>(this->subdividedVertices.size());
- finalMeshForGL.vertices = this->subdividedVertices.data();
- finalMeshForGL.indexCountOutput = static_cast<uint32_t>(this->subdividedIndices.size());
- finalMeshForGL.indices = this->subdividedIndices.data();
+void ovrProcessedMesh::ReleaseUploadData() {
+    ReleaseVertices();
+    Meshlets.ReleaseBuffers();
+    for (const std::shared_ptr<ovrProcessedMesh>& lod : Lods) {
+        lod->Meshlets.ReleaseBuffers();
+    }
+}
 
- // Pass the new, refined mesh to the geometry creator
- Geometry.CreateMesh(finalMeshForGL);
+void ovrProcessedMesh::ReleaseVertices() {
+    std::vector<XrVector3f>().swap(Vertices);
+    std::vector<XrVector3f>().swap(Normals);
+    std::vector<XrVector3f>().swap(GpuVertices);
+    std::vector<XrVector3f>().swap(GpuNormals);
+    for (const std::shared_ptr<ovrProcessedMesh>& lod : Lods) {
+        lod->ReleaseVertices();
+    }
+}
 
+ovrMesh::ovrMesh(const XrSpace space)
+    : Space(space), Processed_(std::make_shared<const ovrProcessedMesh>()) {}
+
+void ovrMesh::Update(
+    const XrSpaceTriangleMeshMETA& mesh,
+    const ovrMeshProcessingSettings& settings,
+    ThreadPool* pool) {
+    std::shared_ptr<ovrProcessedMesh> processed = std::make_shared<ovrProcessedMesh>();
+    processed->Process(
+        std::vector<XrVector3f>(mesh.vertices, mesh.vertices + mesh.vertexCountOutput),
+        std::vector<uint32_t>(mesh.indices, mesh.indices + mesh.indexCountOutput),
+        settings,
+        Processed_.get(),
+        pool);
+    Commit(std::move(processed));
+}
+
+// Creates or refreshes geometry from one level of a processed mesh. A refresh with
+// unchanged topology and vertex format only needs the new vertices; anything else
+// rebuilds the buffers.
+static void UploadLevel(ovrGeometry& geometry, const ovrProcessedMesh& level, bool newLayout) {
+    const ovrMeshProcessingSettings& settings = level.Settings;
+    const std::vector<XrVector3f>& uploadVertices = level.UploadVertices();
+    const std::vector<XrVector3f>& uploadNormals = level.UploadNormals();
+    if (!newLayout && geometry.IsRenderable() && geometry.HasQuantizedPositions() == settings.QuantizePositions &&
+        geometry.HasNormals() == settings.GpuExpansion) {
+        geometry.UpdateMeshVertices(
+            uploadVertices.data(), uploadNormals.empty() ? nullptr : uploadNormals.data(), uploadVertices.size());
+        return;
+    }
+    if (geometry.IsRenderable()) {
+        geometry.DestroyVAO();
+        geometry.Destroy();
+    }
+    geometry.CreateMesh(uploadVertices, uploadNormals, level.Meshlets, settings.QuantizePositions);
+}
+
+void ovrMesh::Commit(std::shared_ptr<ovrProcessedMesh> processed) {
+    // Compared with the committed result rather than the one processing started from,
+    // which is older when results were processed while others waited to be committed.
+    // Results without layouts, read from ProcessedMeshCache, are always new.
+    const size_t levelCount = processed->Lods.size() + 1;
+    std::vector<bool> newLayouts(levelCount, true);
+    if (processed->Lods.size() == Processed_->Lods.size()) {
+        auto isNew = [](const ovrProcessedMesh& level, const ovrProcessedMesh& committed) {
+            return level.SharedLayout == nullptr || level.SharedLayout != committed.SharedLayout;
+        };
+        newLayouts[0] = isNew(*processed, *Processed_);
+        for (size_t l = 1; l < levelCount; ++l) {
+            newLayouts[l] = isNew(*processed->Lods[l - 1], *Processed_->Lods[l - 1]);
+        }
+    }
+    Processed_ = processed;
+    const ovrMeshProcessingSettings& settings = Processed_->Settings;
+
+    ++VertexVersion_;
+    if (std::find(newLayouts.begin(), newLayouts.end(), true) != newLayouts.end()) {
+        ++LayoutVersion_;
+    }
+    Expansion = settings.GpuExpansion ? settings.ExpansionFactor : 0.0f;
+    ExpansionPerMetre = settings.GpuExpansion ? settings.ExpansionPerMetre : 0.0f;
+    Lod_ = std::min(Lod_, LodCount() - 1);
+
+    // Merged meshes are uploaded by the scene's ovrMergedOccluders, which notices the new
+    // versions on its next Update and then releases their vertices.
+    Merged_ = settings.MergeOccluders;
+    VerticesReleased_ = false;
+    PendingVertices_ = Merged_ && !settings.KeepCpuCopies ? processed : nullptr;
+    if (Merged_) {
+        DestroyGeometry();
+        return;
+    }
+    for (size_t l = levelCount; l < LodGeometry_.size() + 1; ++l) {
+        LodGeometry_[l - 1].DestroyVAO();
+        LodGeometry_[l - 1].Destroy();
+    }
+    LodGeometry_.resize(levelCount - 1);
+    UploadLevel(Geometry, *Processed_, newLayouts[0]);
+    for (size_t l = 1; l < levelCount; ++l) {
+        UploadLevel(LodGeometry_[l - 1], *Processed_->Lods[l - 1], newLayouts[l]);
+    }
+    if (!settings.KeepCpuCopies) {
+        processed->ReleaseUploadData();
+        Geometry.ReleaseVertexData();
+        for (ovrGeometry& geometry : LodGeometry_) {
+            geometry.ReleaseVertexData();
+        }
+    }
+}
+
+void ovrMesh::ReleaseMergedVertices() {
+    if (PendingVertices_ != nullptr) {
+        PendingVertices_->ReleaseVertices();
+        PendingVertices_.reset();
+        VerticesReleased_ = true;
+    }
+}
+
+void ovrMesh::DestroyGeometry() {
+    if (Geometry.IsRenderable()) {
+        Geometry.DestroyVAO();
+        Geometry.Destroy();
+    }
+    for (ovrGeometry& geometry : LodGeometry_) {
+        geometry.DestroyVAO();
+        geometry.Destroy();
+    }
+    LodGeometry_.clear();
+}
+
+void ovrMesh::SelectLod(const Vector3f& viewPosition) {
+    const int levelCount = LodCount();
+    const ovrMeshProcessingSettings& settings = Processed_->Settings;
+    // Distance from the viewer to the box; zero inside it, e.g. in the room shell.
+    const Bounds3f& bounds = Processed_->LocalBounds;
+    const Vector3f local = T_World_Mesh.InverseTransform(viewPosition);
+    const Vector3f nearest(
+        std::min(std::max(local.x, bounds.b[0].x), bounds.b[1].x),
+        std::min(std::max(local.y, bounds.b[0].y), bounds.b[1].y),
+        std::min(std::max(local.z, bounds.b[0].z), bounds.b[1].z));
+    const float distance = (nearest - local).Length();
+
+    auto levelStart = [&settings](int level) {
+        return settings.LodDistance * static_cast<float>(1 << (level - 1));
+    };
+    int level = std::min(Lod_, levelCount - 1);
+    while (level + 1 < levelCount && distance > levelStart(level + 1) * (1.0f + settings.LodHysteresis)) {
+        ++level;
+    }
+    while (level > 0 && distance < levelStart(level) * (1.0f - settings.LodHysteresis)) {
+        --level;
+    }
+    Lod_ = level;
 }
 
 void ovrMesh::SetPose(const XrPosef& T_World_Mesh_Xr) {
-    T_World_Mesh = FromXrPosef(T_World_Mesh_Xr);
+    const Posef pose = FromXrPosef(T_World_Mesh_Xr);
+    if (IsPoseSet_ && pose.Rotation == T_World_Mesh.Rotation && pose.Translation == T_World_Mesh.Translation) {
+        return;
+    }
+    T_World_Mesh = pose;
+    ModelMatrix = Matrix4f(T_World_Mesh);
     IsPoseSet_ = true;
 }
 
 /*
 ================================================================================
 
+ovrMergedOccluders
+
+================================================================================
+*/
+
+// The OccluderMeshes block of MERGED_OCCLUDER_VERTEX_SHADER (std140): model matrices,
+// then Expansion, then ExpansionScale.
+static constexpr size_t kOccluderMeshesSize =
+    ovrMergedOccluders::kMaxPageMeshes * (sizeof(Matrix4f) + 2 * 4 * sizeof(float));
+
+// Makes allocation, from pool, hold count elements of elementSize bytes, keeping its
+// first used ones. It at least doubles when it grows, up to maxCount elements. Returns
+// the bytes copied to the grown range.
+static size_t ReserveRange(
+    ovrBufferPool& pool,
+    ovrBufferPool::Allocation& allocation,
+    uint32_t used,
+    uint32_t count,
+    size_t elementSize,
+    uint32_t maxCount) {
+    const size_t capacity = allocation.Size / elementSize;
+    if (count <= capacity) {
+        return 0;
+    }
+    const size_t grownCount = std::max<size_t>(count, std::min<size_t>(capacity * 2, maxCount));
+    ovrBufferPool::Allocation grown = pool.Allocate(grownCount * elementSize, elementSize);
+    if (used > 0) {
+        GL(glBindBuffer(GL_COPY_READ_BUFFER, allocation.Buffer));
+        GL(glBindBuffer(GL_COPY_WRITE_BUFFER, grown.Buffer));
+        GL(glCopyBufferSubData(
+            GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.Offset, grown.Offset, size_t(used) * elementSize));
+        GL(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+        GL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    }
+    pool.Free(allocation);
+    allocation = grown;
+    return size_t(used) * elementSize;
+}
+
+void ovrMergedOccluders::Clear() {
+    Records_.clear();
+    MeshRecords_.clear();
+    Items_.clear();
+    FreeItems_.clear();
+    Pages_.clear();
+    PageOrder_.clear();
+    UniformData_.clear();
+    PageUniformStride_ = 0;
+    Stride_ = 0;
+    NormalOffset_ = 0;
+    UniformBuffer_ = 0;
+    CornerLabels_ = false;
+    CornerOffset_ = 0;
+}
+
+void ovrMergedOccluders::Destroy() {
+    for (Page& page : Pages_) {
+        DestroyPage(page);
+    }
+    if (UniformBuffer_ != 0) {
+        GL(glDeleteBuffers(1, &UniformBuffer_));
+    }
+    Clear();
+}
+
+void ovrMergedOccluders::DestroyPage(Page& page) {
+    if (page.VertexArrayObject != 0) {
+        GL(glDeleteVertexArrays(1, &page.VertexArrayObject));
+    }
+    ovrGeometry::VertexBuffers().Free(page.Vertices);
+    ovrGeometry::IndexBuffers().Free(page.Indices);
+    ovrGeometry::IndexBuffers().Free(page.LineIndices);
+}
+
+size_t ovrMergedOccluders::Update(std::vector<ovrMesh>& meshes, size_t byteBudget) {
+    // The scene's meshes are only appended to, or cleared all at once, and merged meshes
+    // share one vertex format; anything else starts over.
+    bool reset = MeshRecords_.size() > meshes.size();
+    for (size_t m = 0; m < meshes.size() && !reset; ++m) {
+        const ovrMesh& mesh = meshes[m];
+        reset = (m < MeshRecords_.size() && !MeshRecords_[m].empty() &&
+                 Records_[MeshRecords_[m].front()].Space != mesh.Space) ||
+            (mesh.IsMerged() && !Pages_.empty() &&
+             (mesh.QuantizesPositions() != QuantizedPositions_ || mesh.HasCornerLabels() != CornerLabels_));
+    }
+    if (reset) {
+        Destroy();
+    }
+    MeshRecords_.resize(meshes.size());
+
+    // Levels that are gone or were rebuilt come off their pages first, so that the pages
+    // they leave empty are dropped rather than appended to.
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        const ovrMesh& mesh = meshes[m];
+        const int levelCount = mesh.IsMerged() ? mesh.LodCount() : 0;
+        for (const uint32_t recordId : MeshRecords_[m]) {
+            const MeshRecord& record = Records_[recordId];
+            if (record.LayoutVersion != 0 &&
+                (record.Level >= levelCount || record.LayoutVersion != mesh.LayoutVersion())) {
+                RemoveRecord(recordId);
+            }
+        }
+    }
+    bool pagesChanged = DropEmptyPages();
+    const size_t pageCount = Pages_.size();
+
+    // A mesh that released its vertices is only missing after a reset; it is placed
+    // again when it is next committed.
+    size_t bytes = 0;
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        ovrMesh& mesh = meshes[m];
+        if (!mesh.IsMerged() || !mesh.HasVertices()) {
+            continue;
+        }
+        std::vector<uint32_t>& levels = MeshRecords_[m];
+        for (int level = 0; level < mesh.LodCount(); ++level) {
+            if (level == static_cast<int>(levels.size())) {
+                levels.push_back(static_cast<uint32_t>(Records_.size()));
+                Records_.emplace_back();
+                MeshRecord& record = Records_.back();
+                record.Mesh = m;
+                record.Level = level;
+                record.Space = mesh.Space;
+                record.LayoutVersion = 0;
+                record.VertexVersion = 0;
+                record.Distance = 0.0f;
+            }
+            MeshRecord& record = Records_[levels[level]];
+            if (record.LayoutVersion != mesh.LayoutVersion()) {
+                bytes += PlaceRecord(mesh, levels[level]);
+                record.LayoutVersion = mesh.LayoutVersion();
+            }
+            if (record.VertexVersion != mesh.VertexVersion()) {
+                WriteMeshVertices(mesh, record);
+                record.VertexVersion = mesh.VertexVersion();
+            }
+        }
+        mesh.ReleaseMergedVertices();
+    }
+    pagesChanged = pagesChanged || Pages_.size() != pageCount;
+
+    // Gaps are only unused space, so pages are repacked as the budget allows.
+    for (Page& page : Pages_) {
+        const size_t repackBytes =
+            size_t(page.VertexCount) * Stride_ + (size_t(page.IndexCount) + page.LineIndexCount) * sizeof(uint16_t);
+        if (page.HasGaps && bytes + repackBytes <= byteBudget) {
+            bytes += RepackPage(meshes, page);
+        }
+    }
+
+    if (pagesChanged) {
+        PageOrder_.clear();
+        for (size_t p = 0; p < Pages_.size(); ++p) {
+            PageOrder_.push_back(static_cast<uint32_t>(p));
+        }
+        if (UniformBuffer_ == 0) {
+            // One block per page, each starting on the required offset alignment.
+            GLint alignment = 256;
+            GL(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+            alignment = std::max(alignment, 1);
+            PageUniformStride_ = (kOccluderMeshesSize + alignment - 1) / alignment * alignment;
+            GL(glGenBuffers(1, &UniformBuffer_));
+        }
+        UniformData_.assign(Pages_.size() * PageUniformStride_, 0);
+    }
+    return bytes;
+}
+
+void ovrMergedOccluders::RemoveRecord(uint32_t recordId) {
+    MeshRecord& record = Records_[recordId];
+    for (const uint32_t itemId : record.Items) {
+        const Item& item = Items_[itemId];
+        Page& page = Pages_[item.Page];
+        page.Items.erase(std::find(page.Items.begin(), page.Items.end(), itemId));
+        page.SlotRecords[item.Slot] = kNoRecord;
+        page.HasGaps = true;
+        FreeItems_.push_back(itemId);
+    }
+    record.Items.clear();
+    record.LayoutVersion = 0;
+    record.VertexVersion = 0;
+}
+
+uint32_t ovrMergedOccluders::FindSlot(const Page& page, uint32_t recordId) {
+    auto slot = std::find(page.SlotRecords.begin(), page.SlotRecords.end(), recordId);
+    if (slot == page.SlotRecords.end()) {
+        slot = std::find(page.SlotRecords.begin(), page.SlotRecords.end(), kNoRecord);
+    }
+    return static_cast<uint32_t>(std::min<size_t>(slot - page.SlotRecords.begin(), kMaxPageMeshes));
+}
+
+bool ovrMergedOccluders::DropEmptyPages() {
+    size_t kept = 0;
+    for (size_t p = 0; p < Pages_.size(); ++p) {
+        if (Pages_[p].Items.empty()) {
+            DestroyPage(Pages_[p]);
+            continue;
+        }
+        if (kept != p) {
+            for (const uint32_t itemId : Pages_[p].Items) {
+                Items_[itemId].Page = static_cast<uint32_t>(kept);
+            }
+            Pages_[kept] = std::move(Pages_[p]);
+        }
+        ++kept;
+    }
+    const bool dropped = kept != Pages_.size();
+    Pages_.resize(kept);
+    return dropped;
+}
+
+size_t ovrMergedOccluders::PlaceRecord(const ovrMesh& mesh, uint32_t recordId) {
+    MeshRecord& record = Records_[recordId];
+    const MeshletMesh& meshlets = mesh.Level(record.Level).Meshlets;
+    const std::vector<MeshletMesh::Batch>& batches = meshlets.Batches();
+    if (Pages_.empty() && !batches.empty()) {
+        // Vertex: position, corner label (in the padding after quantized positions),
+        // normal as three signed bytes on a 4 byte boundary, mesh slot.
+        QuantizedPositions_ = mesh.QuantizesPositions();
+        CornerLabels_ = mesh.HasCornerLabels();
+        const GLsizei positionSize = QuantizedPositions_ ? 3 * sizeof(uint16_t) : sizeof(XrVector3f);
+        CornerOffset_ = positionSize;
+        NormalOffset_ = (positionSize + (CornerLabels_ ? 1 : 0) + 3) & ~3;
+        Stride_ = NormalOffset_ + 4;
+    }
+
+    size_t bytes = 0;
+    for (uint32_t b = 0; b < batches.size(); ++b) {
+        const MeshletMesh::Batch& batch = batches[b];
+        uint32_t pageId = 0;
+        uint32_t slot = 0;
+        for (; pageId < Pages_.size(); ++pageId) {
+            if (Pages_[pageId].VertexCount + batch.VertexCount <= MeshletMesh::kMaxBatchVertices) {
+                slot = FindSlot(Pages_[pageId], recordId);
+                if (slot < kMaxPageMeshes) {
+                    break;
+                }
+            }
+        }
+        if (pageId == Pages_.size()) {
+            Pages_.emplace_back();
+            slot = 0;
+        }
+        Page* page = &Pages_[pageId];
+        if (slot == page->SlotRecords.size()) {
+            page->SlotRecords.push_back(recordId);
+        } else {
+            page->SlotRecords[slot] = recordId;
+        }
+
+        const ovrBufferPool::Allocation vertices = page->Vertices;
+        const GLuint indexBuffer = page->Indices.Buffer;
+        bytes += ReserveRange(
+            ovrGeometry::VertexBuffers(),
+            page->Vertices,
+            page->VertexCount,
+            page->VertexCount + batch.VertexCount,
+            Stride_,
+            MeshletMesh::kMaxBatchVertices);
+        bytes += ReserveRange(
+            ovrGeometry::IndexBuffers(),
+            page->Indices,
+            page->IndexCount,
+            page->IndexCount + batch.IndexCount,
+            sizeof(uint16_t),
+            UINT32_MAX);
+        if (!CornerLabels_) {
+            bytes += ReserveRange(
+                ovrGeometry::IndexBuffers(),
+                page->LineIndices,
+                page->LineIndexCount,
+                page->LineIndexCount + batch.LineIndexCount,
+                sizeof(uint16_t),
+                UINT32_MAX);
+        }
+        if (page->Vertices.Buffer != vertices.Buffer || page->Vertices.Offset != vertices.Offset ||
+            page->Indices.Buffer != indexBuffer) {
+            CreatePageVAO(*page);
+        }
+
+        uint32_t itemId = static_cast<uint32_t>(Items_.size());
+        if (FreeItems_.empty()) {
+            Items_.emplace_back();
+        } else {
+            itemId = FreeItems_.back();
+            FreeItems_.pop_back();
+        }
+        Item& item = Items_[itemId];
+        item.Record = recordId;
+        item.Batch = b;
+        item.Page = pageId;
+        item.Slot = slot;
+        item.FirstVertex = page->VertexCount;
+        item.FirstIndex = page->IndexCount;
+        item.FirstLineIndex = page->LineIndexCount;
+        page->Items.push_back(itemId);
+        record.Items.push_back(itemId);
+
+        page->VertexCount += batch.VertexCount;
+        page->IndexCount += batch.IndexCount;
+        page->LineIndexCount += batch.LineIndexCount;
+        WriteItemIndices(meshlets, item, false);
+        if (!CornerLabels_) {
+            WriteItemIndices(meshlets, item, true);
+        }
+    }
+    return bytes;
+}
+
+size_t ovrMergedOccluders::RepackPage(const std::vector<ovrMesh>& meshes, Page& page) {
+    // The batches move, in draw order, to a new vertex range; their slots stay.
+    ovrBufferPool& pool = ovrGeometry::VertexBuffers();
+    ovrBufferPool::Allocation vertices = pool.Allocate(page.Vertices.Size, Stride_);
+    GL(glBindBuffer(GL_COPY_READ_BUFFER, page.Vertices.Buffer));
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, vertices.Buffer));
+    uint32_t vertexCount = 0;
+    for (const uint32_t itemId : page.Items) {
+        Item& item = Items_[itemId];
+        const MeshRecord& record = Records_[item.Record];
+        const MeshletMesh::Batch& batch = meshes[record.Mesh].Level(record.Level).Meshlets.Batches()[item.Batch];
+        GL(glCopyBufferSubData(
+            GL_COPY_READ_BUFFER,
+            GL_COPY_WRITE_BUFFER,
+            page.Vertices.Offset + size_t(item.FirstVertex) * Stride_,
+            vertices.Offset + size_t(vertexCount) * Stride_,
+            size_t(batch.VertexCount) * Stride_));
+        item.FirstVertex = vertexCount;
+        vertexCount += batch.VertexCount;
+    }
+    GL(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    pool.Free(page.Vertices);
+    page.Vertices = vertices;
+    page.VertexCount = vertexCount;
+    page.HasGaps = false;
+
+    WritePageIndices(meshes, page, false);
+    if (!CornerLabels_) {
+        WritePageIndices(meshes, page, true);
+    }
+    CreatePageVAO(page);
+    return size_t(vertexCount) * Stride_ + (size_t(page.IndexCount) + page.LineIndexCount) * sizeof(uint16_t);
+}
+
+void ovrMergedOccluders::WriteMeshVertices(const ovrMesh& mesh, MeshRecord& record) {
+    const ovrProcessedMesh& level = mesh.Level(record.Level);
+    const std::vector<XrVector3f>& vertices = level.UploadVertices();
+    const std::vector<XrVector3f>& normals = level.UploadNormals();
+
+    // Quantized against the whole mesh's box, so one matrix per mesh dequantizes it.
+    QuantizedPositions quantized;
+    if (QuantizedPositions_) {
+        quantized.Quantize(vertices.data(), vertices.size());
+        record.PositionTransform = quantized.Dequantization();
+    } else {
+        record.PositionTransform = Matrix4f::Identity();
+    }
+    // The draw order is computed from the box.
+    record.BoxMin = level.LocalBounds.b[0];
+    record.BoxMax = level.LocalBounds.b[1];
+
+    std::vector<uint8_t> data(vertices.size() * Stride_, 0);
+    WriteOccluderVertices(
+        vertices.data(),
+        QuantizedPositions_ ? quantized.Values().data() : nullptr,
+        normals.empty() ? nullptr : normals.data(),
+        CornerLabels_ ? level.Meshlets.CornerLabels().data() : nullptr,
+        vertices.size(),
+        Stride_,
+        NormalOffset_,
+        CornerOffset_,
+        data.data());
+    for (const uint32_t itemId : record.Items) {
+        const Item& item = Items_[itemId];
+        const MeshletMesh::Batch& batch = level.Meshlets.Batches()[item.Batch];
+        for (uint32_t v = batch.VertexOffset; v < batch.VertexOffset + batch.VertexCount; ++v) {
+            data[size_t(v) * Stride_ + NormalOffset_ + 3] = static_cast<uint8_t>(item.Slot);
+        }
+        const ovrBufferPool::Allocation& pageVertices = Pages_[item.Page].Vertices;
+        GL(glBindBuffer(GL_COPY_WRITE_BUFFER, pageVertices.Buffer));
+        GL(glBufferSubData(
+            GL_COPY_WRITE_BUFFER,
+            pageVertices.Offset + size_t(item.FirstVertex) * Stride_,
+            size_t(batch.VertexCount) * Stride_,
+            &data[size_t(batch.VertexOffset) * Stride_]));
+    }
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+}
+
+void ovrMergedOccluders::WriteItemIndices(const MeshletMesh& meshlets, const Item& item, bool lines) {
+    const MeshletMesh::Batch& batch = meshlets.Batches()[item.Batch];
+    const std::vector<uint16_t>& source = lines ? meshlets.LineIndices() : meshlets.Indices();
+    const uint32_t first = lines ? batch.LineIndexOffset : batch.IndexOffset;
+    const uint32_t count = lines ? batch.LineIndexCount : batch.IndexCount;
+    if (count == 0) {
+        return;
+    }
+    // Batch-relative indices, offset to the batch's place in the page.
+    std::vector<uint16_t> indices(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        indices[i] = static_cast<uint16_t>(source[first + i] + item.FirstVertex);
+    }
+    const ovrBufferPool::Allocation& range = lines ? Pages_[item.Page].LineIndices : Pages_[item.Page].Indices;
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, range.Buffer));
+    GL(glBufferSubData(
+        GL_COPY_WRITE_BUFFER,
+        range.Offset + size_t(lines ? item.FirstLineIndex : item.FirstIndex) * sizeof(uint16_t),
+        indices.size() * sizeof(uint16_t),
+        indices.data()));
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+}
+
+void ovrMergedOccluders::WritePageIndices(const std::vector<ovrMesh>& meshes, Page& page, bool lines) {
+    // Batch-relative indices, offset to the batch's place in the page.
+    std::vector<uint16_t> indices;
+    indices.reserve(lines ? page.LineIndexCount : page.IndexCount);
+    for (const uint32_t itemId : page.Items) {
+        Item& item = Items_[itemId];
+        (lines ? item.FirstLineIndex : item.FirstIndex) = static_cast<uint32_t>(indices.size());
+        const MeshRecord& record = Records_[item.Record];
+        const MeshletMesh& meshlets = meshes[record.Mesh].Level(record.Level).Meshlets;
+        const MeshletMesh::Batch& batch = meshlets.Batches()[item.Batch];
+        const std::vector<uint16_t>& source = lines ? meshlets.LineIndices() : meshlets.Indices();
+        const uint32_t first = lines ? batch.LineIndexOffset : batch.IndexOffset;
+        const uint32_t count = lines ? batch.LineIndexCount : batch.IndexCount;
+        for (uint32_t i = 0; i < count; ++i) {
+            indices.push_back(static_cast<uint16_t>(source[first + i] + item.FirstVertex));
+        }
+    }
+    (lines ? page.LineIndexCount : page.IndexCount) = static_cast<uint32_t>(indices.size());
+    if (indices.empty()) {
+        return;
+    }
+    const ovrBufferPool::Allocation& range = lines ? page.LineIndices : page.Indices;
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, range.Buffer));
+    GL(glBufferSubData(GL_COPY_WRITE_BUFFER, range.Offset, indices.size() * sizeof(uint16_t), indices.data()));
+    GL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+}
+
+void ovrMergedOccluders::CreatePageVAO(Page& page) {
+    if (page.VertexArrayObject != 0) {
+        GL(glDeleteVertexArrays(1, &page.VertexArrayObject));
+    }
+    // The page's first vertex is the attribute base, so its indices start from zero.
+    const size_t base = page.Vertices.Offset;
+    GL(glGenVertexArrays(1, &page.VertexArrayObject));
+    GL(glBindVertexArray(page.VertexArrayObject));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, page.Vertices.Buffer));
+    GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_POSITION));
+    GL(glVertexAttribPointer(
+        VERTEX_ATTRIBUTE_LOCATION_POSITION,
+        3,
+        QuantizedPositions_ ? GL_UNSIGNED_SHORT : GL_FLOAT,
+        QuantizedPositions_ ? GL_TRUE : GL_FALSE,
+        Stride_,
+        (const GLvoid*)base));
+    GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_NORMAL));
+    GL(glVertexAttribPointer(
+        VERTEX_ATTRIBUTE_LOCATION_NORMAL, 3, GL_BYTE, GL_TRUE, Stride_, (const GLvoid*)(base + NormalOffset_)));
+    GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_MESH_SLOT));
+    GL(glVertexAttribPointer(
+        VERTEX_ATTRIBUTE_LOCATION_MESH_SLOT,
+        1,
+        GL_UNSIGNED_BYTE,
+        GL_FALSE,
+        Stride_,
+        (const GLvoid*)(base + NormalOffset_ + 3)));
+    if (CornerLabels_) {
+        GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_CORNER));
+        GL(glVertexAttribPointer(
+            VERTEX_ATTRIBUTE_LOCATION_CORNER, 1, GL_UNSIGNED_BYTE, GL_FALSE, Stride_, (const GLvoid*)(base + CornerOffset_)));
+    }
+    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.Indices.Buffer));
+    GL(glBindVertexArray(0));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+}
+
+void ovrMergedOccluders::PrepareFrame(
+    const std::vector<ovrMesh>& meshes,
+    const std::vector<uint8_t>& meshVisible,
+    const Vector3f& viewPosition) {
+    if (Pages_.empty()) {
+        return;
+    }
+
+    for (MeshRecord& record : Records_) {
+        const ovrMesh& mesh = meshes[record.Mesh];
+        if (record.Items.empty() || !mesh.IsRenderable() || !meshVisible[record.Mesh] ||
+            record.Level != mesh.Lod()) {
+            // An all-zero matrix puts every vertex at w = 0, where it is clipped.
+            record.ModelMatrix = Matrix4f::Scaling(0.0f, 0.0f, 0.0f, 0.0f);
+            record.Distance = FLT_MAX;
+            continue;
+        }
+        record.ModelMatrix = mesh.ModelMatrix * record.PositionTransform;
+        // Distance from the viewer to the mesh's box. A box around the viewer is the
+        // room shell, which everything else in the room is in front of.
+        const Vector3f local = mesh.T_World_Mesh.InverseTransform(viewPosition);
+        const Vector3f nearest(
+            std::min(std::max(local.x, record.BoxMin.x), record.BoxMax.x),
+            std::min(std::max(local.y, record.BoxMin.y), record.BoxMax.y),
+            std::min(std::max(local.z, record.BoxMin.z), record.BoxMax.z));
+        const float distance = (nearest - local).Length();
+        record.Distance = distance > 0.0f ? distance : FLT_MAX / 2.0f;
+    }
+
+    auto closerItem = [this](uint32_t a, uint32_t b) {
+        return Records_[Items_[a].Record].Distance < Records_[Items_[b].Record].Distance;
+    };
+    for (Page& page : Pages_) {
+        if (!std::is_sorted(page.Items.begin(), page.Items.end(), closerItem)) {
+            std::stable_sort(page.Items.begin(), page.Items.end(), closerItem);
+            WritePageIndices(meshes, page, false);
+        }
+        page.Distance = Records_[Items_[page.Items.front()].Record].Distance;
+    }
+    std::stable_sort(PageOrder_.begin(), PageOrder_.end(), [this](uint32_t a, uint32_t b) {
+        return Pages_[a].Distance < Pages_[b].Distance;
+    });
+
+    // Draw ranges: the visible meshlets of the drawn meshes, merged where they follow
+    // each other in the page's index buffer.
+    for (Page& page : Pages_) {
+        page.Draws.clear();
+        page.LineDraws.clear();
+        for (const uint32_t itemId : page.Items) {
+            const Item& item = Items_[itemId];
+            const MeshRecord& record = Records_[item.Record];
+            if (record.Distance == FLT_MAX) {
+                continue;
+            }
+            // The drawn level, the one VisibleMeshlets refers to
+            const ovrMesh& mesh = meshes[record.Mesh];
+            const MeshletMesh& meshlets = mesh.Meshlets();
+            const MeshletMesh::Batch& batch = meshlets.Batches()[item.Batch];
+            const uint8_t* visible = mesh.VisibleMeshlets.empty() ? nullptr : mesh.VisibleMeshlets.data();
+            MeshletMesh::AppendVisibleRanges(
+                meshlets.Meshlets(),
+                batch,
+                visible,
+                false,
+                int64_t(item.FirstIndex) - batch.IndexOffset,
+                page.Draws);
+            if (!CornerLabels_) {
+                MeshletMesh::AppendVisibleRanges(
+                    meshlets.Meshlets(),
+                    batch,
+                    visible,
+                    true,
+                    int64_t(item.FirstLineIndex) - batch.LineIndexOffset,
+                    page.LineDraws);
+            }
+        }
+    }
+
+    for (size_t p = 0; p < Pages_.size(); ++p) {
+        const Page& page = Pages_[p];
+        float* matrices = reinterpret_cast<float*>(&UniformData_[p * PageUniformStride_]);
+        float* expansion = matrices + kMaxPageMeshes * 16;
+        float* expansionScale = expansion + kMaxPageMeshes * 4;
+        for (size_t slot = 0; slot < page.SlotRecords.size(); ++slot) {
+            if (page.SlotRecords[slot] == kNoRecord) {
+                continue;
+            }
+            const MeshRecord& record = Records_[page.SlotRecords[slot]];
+            const ovrMesh& mesh = meshes[record.Mesh];
+            // Column major, like the scene matrices.
+            const Matrix4f modelMatrix = record.ModelMatrix.Transposed();
+            memcpy(&matrices[slot * 16], &modelMatrix.M[0][0], 16 * sizeof(float));
+            expansion[slot * 4 + 0] = mesh.Expansion;
+            expansion[slot * 4 + 1] = mesh.ExpansionPerMetre;
+            expansionScale[slot * 4 + 0] = 1.0f / record.PositionTransform.M[0][0];
+            expansionScale[slot * 4 + 1] = 1.0f / record.PositionTransform.M[1][1];
+            expansionScale[slot * 4 + 2] = 1.0f / record.PositionTransform.M[2][2];
+        }
+    }
+    GL(glBindBuffer(GL_UNIFORM_BUFFER, UniformBuffer_));
+    GL(glBufferData(GL_UNIFORM_BUFFER, UniformData_.size(), UniformData_.data(), GL_DYNAMIC_DRAW));
+    GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+}
+
+void ovrMergedOccluders::Draw(ovrGlStateCache& state, const ovrProgram& program) const {
+    DrawPages(state, program, GL_TRIANGLES);
+}
+
+void ovrMergedOccluders::DrawWireframe(ovrGlStateCache& state, const ovrProgram& program) const {
+    DrawPages(state, program, CornerLabels_ ? GL_TRIANGLES : GL_LINES);
+}
+
+void ovrMergedOccluders::DrawPages(ovrGlStateCache& state, const ovrProgram& program, GLenum mode) const {
+    const bool lines = mode == GL_LINES;
+    for (const uint32_t p : PageOrder_) {
+        const Page& page = Pages_[p];
+        // Pages are sorted nearest mesh first, so a page with no mesh to draw means
+        // the remaining pages have none either.
+        if (page.Distance == FLT_MAX) {
+            break;
+        }
+        const std::vector<MeshletMesh::IndexRange>& draws = lines ? page.LineDraws : page.Draws;
+        const ovrBufferPool::Allocation& indices = lines ? page.LineIndices : page.Indices;
+        if (draws.empty()) {
+            continue;
+        }
+        state.BindUniformBuffer(
+            program.UniformBinding[ovrUniform::Index::OCCLUDER_MESHES],
+            UniformBuffer_,
+            p * PageUniformStride_,
+            kOccluderMeshesSize);
+        state.BindVertexArray(page.VertexArrayObject);
+        // Il VAO ricorda solo il buffer dei triangoli: associa esplicitamente quello richiesto.
+        state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.Buffer);
+        for (const MeshletMesh::IndexRange& range : draws) {
+            state.DrawElements(
+                mode, range.Count, GL_UNSIGNED_SHORT, indices.Offset + size_t(range.First) * sizeof(uint16_t));
+        }
+    }
+}
+
+/*
+================================================================================
+
+ovrDepthPyramid
+
+================================================================================
+*/
+
+// Size of the level below one of the given size; its texel i covers texels 2i and
+// 2i + 1, and also 2i + 2 when that is the last one.
+static int HalvedSize(int size) {
+    return std::max(size / 2, 1);
+}
+
+void ovrDepthPyramid::Clear() {
+    Texture_ = 0;
+    DrawFramebuffer_ = 0;
+    ReadFramebuffer_ = 0;
+    ReduceProgram_.Clear();
+    Levels_.clear();
+    GpuLevelCount_ = 0;
+    for (Readback& readback : Readbacks_) {
+        readback.PixelBuffer = 0;
+        readback.Fence = 0;
+    }
+    NextReadback_ = 0;
+    Depth_[0].clear();
+    Depth_[1].clear();
+    LevelOffsets_.clear();
+    HasDepth_ = false;
+}
+
+bool ovrDepthPyramid::Create(int width, int height) {
+    if (!glExtensions.EXT_color_buffer_float || !glExtensions.multi_view) {
+        ALOGV("ovrDepthPyramid: float color buffers or multiview not supported, disabled");
+        return false;
+    }
+    if (!ReduceProgram_.Create(DEPTH_REDUCE_VERTEX_SHADER, DEPTH_REDUCE_FRAGMENT_SHADER)) {
+        ALOGE("Failed to create the depth reduction program");
+        return false;
+    }
+
+    // GPU levels from half the attachment size down to the readback size, then CPU
+    // levels down to a single texel.
+    Levels_.push_back({width, height});
+    do {
+        const Level& previous = Levels_.back();
+        Levels_.push_back({HalvedSize(previous.Width), HalvedSize(previous.Height)});
+    } while (std::max(Levels_.back().Width, Levels_.back().Height) > kReadbackSize);
+    GpuLevelCount_ = static_cast<int>(Levels_.size()) - 1;
+    size_t cpuTexels = 0;
+    for (;;) {
+        const Level& level = Levels_.back();
+        LevelOffsets_.push_back(cpuTexels);
+        cpuTexels += size_t(level.Width) * level.Height;
+        if (level.Width == 1 && level.Height == 1) {
+            break;
+        }
+        Levels_.push_back({HalvedSize(level.Width), HalvedSize(level.Height)});
+    }
+    Depth_[0].assign(cpuTexels, 1.0f);
+    Depth_[1].assign(cpuTexels, 1.0f);
+
+    GL(glGenTextures(1, &Texture_));
+    GL(glBindTexture(GL_TEXTURE_2D_ARRAY, Texture_));
+    GL(glTexStorage3D(GL_TEXTURE_2D_ARRAY, GpuLevelCount_, GL_R32F, Levels_[1].Width, Levels_[1].Height, 2));
+    GL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+    GL(glGenFramebuffers(1, &DrawFramebuffer_));
+    GL(glGenFramebuffers(1, &ReadFramebuffer_));
+
+    // Float framebuffers are always readable as RGBA floats.
+    const Level& readLevel = Levels_[GpuLevelCount_];
+    for (Readback& readback : Readbacks_) {
+        GL(glGenBuffers(1, &readback.PixelBuffer));
+        GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PixelBuffer));
+        GL(glBufferData(
+            GL_PIXEL_PACK_BUFFER,
+            2 * size_t(readLevel.Width) * readLevel.Height * 4 * sizeof(float),
+            nullptr,
+            GL_STREAM_READ));
+    }
+    GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    return true;
+}
+
+void ovrDepthPyramid::Destroy() {
+    for (Readback& readback : Readbacks_) {
+        if (readback.Fence != 0) {
+            GL(glDeleteSync(readback.Fence));
+        }
+        if (readback.PixelBuffer != 0) {
+            GL(glDeleteBuffers(1, &readback.PixelBuffer));
+        }
+    }
+    if (DrawFramebuffer_ != 0) {
+        GL(glDeleteFramebuffers(1, &DrawFramebuffer_));
+    }
+    if (ReadFramebuffer_ != 0) {
+        GL(glDeleteFramebuffers(1, &ReadFramebuffer_));
+    }
+    if (Texture_ != 0) {
+        GL(glDeleteTextures(1, &Texture_));
+    }
+    ReduceProgram_.Destroy();
+    Clear();
+}
+
+void ovrDepthPyramid::Build(GLuint depthTexture, const Matrix4f view[2], const Matrix4f proj[2]) {
+    if (!IsEnabled()) {
+        return;
+    }
+    for (int eye = 0; eye < 2; ++eye) {
+        // The matrices are stored transposed: the eye is the last row of the inverse.
+        const Matrix4f inverse = view[eye].Inverted();
+        CurrentEyes_[eye] = Vector3f(inverse.M[3][0], inverse.M[3][1], inverse.M[3][2]);
+    }
+    ReadCompleted();
+
+    static PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC glFramebufferTextureMultiviewOVR =
+        (PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC)GlGetExtensionProc("glFramebufferTextureMultiviewOVR");
+
+    GL(glDisable(GL_DEPTH_TEST));
+    GL(glDisable(GL_SCISSOR_TEST));
+    GL(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+    GL(glUseProgram(ReduceProgram_.Program));
+    GL(glBindVertexArray(0));
+    GL(glActiveTexture(GL_TEXTURE0));
+    GL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, DrawFramebuffer_));
+    for (int level = 1; level <= GpuLevelCount_; ++level) {
+        // Level n of the pyramid texture is Levels_[n + 1]. The source level is made the
+        // only one visible to the shader, which also keeps the written level from being
+        // sampled.
+        if (level == 1) {
+            GL(glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture));
+        } else {
+            GL(glBindTexture(GL_TEXTURE_2D_ARRAY, Texture_));
+            GL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, level - 2));
+            GL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level - 2));
+        }
+        GL(glFramebufferTextureMultiviewOVR(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, Texture_, level - 1, 0, 2));
+        GL(glViewport(0, 0, Levels_[level].Width, Levels_[level].Height));
+        GL(glDrawArrays(GL_TRIANGLES, 0, 3));
+    }
+    GL(glBindTexture(GL_TEXTURE_2D_ARRAY, Texture_));
+    GL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0));
+    GL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, GpuLevelCount_ - 1));
+    GL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+
+    // Read the last level of both eyes into the next slot. A slot whose readback has not
+    // completed yet is overwritten.
+    Readback& readback = Readbacks_[NextReadback_];
+    NextReadback_ = (NextReadback_ + 1) % kReadbackSlots;
+    if (readback.Fence != 0) {
+        GL(glDeleteSync(readback.Fence));
+    }
+    const Level& readLevel = Levels_[GpuLevelCount_];
+    const size_t layerSize = size_t(readLevel.Width) * readLevel.Height * 4 * sizeof(float);
+    GL(glBindFramebuffer(GL_READ_FRAMEBUFFER, ReadFramebuffer_));
+    GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PixelBuffer));
+    for (int eye = 0; eye < 2; ++eye) {
+        GL(glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, Texture_, GpuLevelCount_ - 1, eye));
+        GL(glReadPixels(
+            0, 0, readLevel.Width, readLevel.Height, GL_RGBA, GL_FLOAT, (GLvoid*)(eye * layerSize)));
+    }
+    GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    GL(glBindFramebuffer(GL_READ_FRAMEBUFFER, 0));
+    GL(readback.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    for (int eye = 0; eye < 2; ++eye) {
+        // Clip space from world space, as ordinary row major matrices
+        readback.ViewProjection[eye] = (view[eye] * proj[eye]).Transposed();
+        readback.Eyes[eye] = CurrentEyes_[eye];
+    }
+}
+
+void ovrDepthPyramid::ReadCompleted() {
+    // Oldest first, so the newest completed readback ends up in Depth_.
+    for (int i = 0; i < kReadbackSlots; ++i) {
+        Readback& readback = Readbacks_[(NextReadback_ + i) % kReadbackSlots];
+        if (readback.Fence == 0) {
+            continue;
+        }
+        GL(const GLenum status = glClientWaitSync(readback.Fence, 0, 0));
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            continue;
+        }
+        GL(glDeleteSync(readback.Fence));
+        readback.Fence = 0;
+
+        const Level& readLevel = Levels_[GpuLevelCount_];
+        const size_t texels = size_t(readLevel.Width) * readLevel.Height;
+        GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PixelBuffer));
+        GL(const float* pixels = (const float*)glMapBufferRange(
+               GL_PIXEL_PACK_BUFFER, 0, 2 * texels * 4 * sizeof(float), GL_MAP_READ_BIT));
+        if (pixels != nullptr) {
+            for (int eye = 0; eye < 2; ++eye) {
+                float* depth = Depth_[eye].data();
+                for (size_t t = 0; t < texels; ++t) {
+                    depth[t] = pixels[(eye * texels + t) * 4];
+                }
+                // Coarser levels, with the same footprint as the shader
+                for (size_t l = GpuLevelCount_ + 1; l < Levels_.size(); ++l) {
+                    const Level& source = Levels_[l - 1];
+                    const Level& target = Levels_[l];
+                    const float* in = depth + LevelOffsets_[l - 1 - GpuLevelCount_];
+                    float* out = depth + LevelOffsets_[l - GpuLevelCount_];
+                    for (int y = 0; y < target.Height; ++y) {
+                        const int y1 = std::min(y * 2 + (y * 2 + 2 == source.Height - 1 ? 2 : 1), source.Height - 1);
+                        for (int x = 0; x < target.Width; ++x) {
+                            const int x1 = std::min(x * 2 + (x * 2 + 2 == source.Width - 1 ? 2 : 1), source.Width - 1);
+                            float farthest = 0.0f;
+                            for (int sy = y * 2; sy <= y1; ++sy) {
+                                for (int sx = x * 2; sx <= x1; ++sx) {
+                                    farthest = std::max(farthest, in[sy * source.Width + sx]);
+                                }
+                            }
+                            out[y * target.Width + x] = farthest;
+                        }
+                    }
+                }
+                ViewProjection_[eye] = readback.ViewProjection[eye];
+                Eyes_[eye] = readback.Eyes[eye];
+            }
+            HasDepth_ = true;
+        }
+        GL(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+        GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    }
+}
+
+bool ovrDepthPyramid::IsOccluded(const Posef& pose, const Bounds3f& localBounds) const {
+    if (!HasDepth_) {
+        return false;
+    }
+    // Anything the eyes could newly see around since the readback was taken
+    const float moved = std::max((CurrentEyes_[0] - Eyes_[0]).Length(), (CurrentEyes_[1] - Eyes_[1]).Length());
+    const Vector3f lo = localBounds.b[0] - Vector3f(moved);
+    const Vector3f hi = localBounds.b[1] + Vector3f(moved);
+    Vector3f corners[8];
+    for (int i = 0; i < 8; ++i) {
+        corners[i] = pose.Transform(Vector3f(i & 1 ? hi.x : lo.x, i & 2 ? hi.y : lo.y, i & 4 ? hi.z : lo.z));
+    }
+    return IsOccludedInEye(corners, 0) && IsOccludedInEye(corners, 1);
+}
+
+bool ovrDepthPyramid::IsOccludedInEye(const Vector3f corners[8], int eye) const {
+    // Screen rectangle and nearest depth of the box, in [0, 1]
+    float minX = FLT_MAX;
+    float minY = FLT_MAX;
+    float maxX = -FLT_MAX;
+    float maxY = -FLT_MAX;
+    float nearest = FLT_MAX;
+    for (int i = 0; i < 8; ++i) {
+        const Vector4f clip = ViewProjection_[eye].Transform(Vector4f(corners[i], 1.0f));
+        if (clip.w <= 1e-4f) {
+            return false; // reaches behind the eye
+        }
+        const float invW = 1.0f / clip.w;
+        minX = std::min(minX, clip.x * invW);
+        maxX = std::max(maxX, clip.x * invW);
+        minY = std::min(minY, clip.y * invW);
+        maxY = std::max(maxY, clip.y * invW);
+        nearest = std::min(nearest, clip.z * invW);
+    }
+    if (minX < -1.0f || maxX > 1.0f || minY < -1.0f || maxY > 1.0f) {
+        return false; // partly outside the view the depth was taken from
+    }
+    nearest = nearest * 0.5f + 0.5f;
+
+    // Pixel rectangle in the depth attachment, followed down the levels until it
+    // covers at most 2x2 texels.
+    const Level& full = Levels_[0];
+    int x0 = std::min(int((minX * 0.5f + 0.5f) * full.Width), full.Width - 1);
+    int x1 = std::min(int((maxX * 0.5f + 0.5f) * full.Width), full.Width - 1);
+    int y0 = std::min(int((minY * 0.5f + 0.5f) * full.Height), full.Height - 1);
+    int y1 = std::min(int((maxY * 0.5f + 0.5f) * full.Height), full.Height - 1);
+    size_t l = 1;
+    for (;; ++l) {
+        const Level& level = Levels_[l];
+        x0 = std::min(x0 / 2, level.Width - 1);
+        x1 = std::min(x1 / 2, level.Width - 1);
+        y0 = std::min(y0 / 2, level.Height - 1);
+        y1 = std::min(y1 / 2, level.Height - 1);
+        if (l >= size_t(GpuLevelCount_) && ((x1 - x0 <= 1 && y1 - y0 <= 1) || l + 1 == Levels_.size())) {
+            break;
+        }
+    }
+    const Level& level = Levels_[l];
+    const float* depth = Depth_[eye].data() + LevelOffsets_[l - GpuLevelCount_];
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            if (depth[y * level.Width + x] >= nearest) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+================================================================================
+
 ovrScene
 
 ================================================================================
@@ -1031,10 +2796,15 @@ void ovrScene::Clear() {
 
     WireframeProgram.Clear();
     MeshProgram.Clear();
+    MergedWireframeProgram.Clear();
+    BarycentricWireframeProgram.Clear();
+    MergedBarycentricWireframeProgram.Clear();
+    MergedMeshProgram.Clear();
     for (auto& mesh : Meshes) {
         mesh.Geometry.Clear();
     }
     Meshes.clear();
+    MergedOccluders.Clear();
 
     ControllerProgram.Clear();
     ControllerCube.Clear();
@@ -1097,15 +2867,30 @@ void ovrScene::Create() {
     }
 
     // Meshes (for occlusion)
-    if (!MeshProgram.Create(VERTEX_SHADER, MESH_FRAGMENT_SHADER)) {
+    if (!MeshProgram.Create(OCCLUDER_VERTEX_SHADER, MESH_FRAGMENT_SHADER)) {
         ALOGE("Failed to compile mesh program!");
     }
     
     // Wireframe (for visualization)
-    if (!WireframeProgram.Create(VERTEX_SHADER, WIREFRAME_FRAGMENT_SHADER)) {
+    if (!WireframeProgram.Create(OCCLUDER_VERTEX_SHADER, WIREFRAME_FRAGMENT_SHADER)) {
         ALOGE("Failed to compile wireframe program!");
     }
 
+    // Meshes merged into shared buffers, occlusion and wireframe
+    if (!MergedMeshProgram.Create(MERGED_OCCLUDER_VERTEX_SHADER, MESH_FRAGMENT_SHADER)) {
+        ALOGE("Failed to compile merged mesh program!");
+    }
+    if (!MergedWireframeProgram.Create(MERGED_OCCLUDER_VERTEX_SHADER, WIREFRAME_FRAGMENT_SHADER)) {
+        ALOGE("Failed to compile merged wireframe program!");
+    }
+    if (!BarycentricWireframeProgram.Create(OCCLUDER_VERTEX_SHADER, BARYCENTRIC_WIREFRAME_FRAGMENT_SHADER)) {
+        ALOGE("Failed to compile barycentric wireframe program!");
+    }
+    if (!MergedBarycentricWireframeProgram.Create(
+            MERGED_OCCLUDER_VERTEX_SHADER, BARYCENTRIC_WIREFRAME_FRAGMENT_SHADER)) {
+        ALOGE("Failed to compile merged barycentric wireframe program!");
+    }
+
     // Controller
     if (!ControllerProgram.Create(CUBE_VERTEX_SHADER, CUBE_FRAGMENT_SHADER)) {
         ALOGE("Failed to compile controller program!");
@@ -1144,14 +2929,22 @@ void ovrScene::Destroy() {
 
     WireframeProgram.Destroy();
     MeshProgram.Destroy();
+    MergedWireframeProgram.Destroy();
+    BarycentricWireframeProgram.Destroy();
+    MergedBarycentricWireframeProgram.Destroy();
+    MergedMeshProgram.Destroy();
     for (auto& mesh : Meshes) {
-        mesh.Geometry.DestroyVAO();
-        mesh.Geometry.Destroy();
+        mesh.DestroyGeometry();
     }
     Meshes.clear();
+    MergedOccluders.Destroy();
 
     ControllerProgram.Destroy();
     ControllerCube.Destroy();
+
+    // Last, once every geometry has returned its ranges
+    ovrGeometry::VertexBuffers().Destroy();
+    ovrGeometry::IndexBuffers().Destroy();
 }
 
 /*
@@ -1172,6 +2965,7 @@ void ovrGeometry::CreateCube(
     }
 
     VertexCount_ = vertices.size();
+    LocalBounds_ = PositionBounds(vertices.data(), vertices.size());
     VertexAttribs_[0].Index = VERTEX_ATTRIBUTE_LOCATION_POSITION;
     VertexAttribs_[0].Size = 3;
     VertexAttribs_[0].Type = GL_FLOAT;
@@ -1181,13 +2975,7 @@ void ovrGeometry::CreateCube(
 
     VertexAttribs_[1].Index = -1;
 
-    if (VertexBuffer_ == 0) {
-        GL(glGenBuffers(1, &VertexBuffer_));
-    }
-    GL(glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer_));
-    GL(glBufferData(
-        GL_ARRAY_BUFFER, sizeof(XrVector3f) * vertices.size(), vertices.data(), GL_STATIC_DRAW));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    CreateVertexBuffer(vertices.data(), sizeof(XrVector3f) * vertices.size(), sizeof(float));
 
     CreateIndexBuffer(indices);
     CreateVAO();
@@ -1222,6 +3010,10 @@ uint32_t ovrControllerCube::IndexCount() const {
     return Geometry.IndexCount();
 }
 
+size_t ovrControllerCube::IndexOffset() const {
+    return Geometry.IndexOffset();
+}
+
 void ovrControllerCube::Clear() {
     Geometry.Clear();
 }
@@ -1241,6 +3033,11 @@ ovrAppRenderer
 void ovrAppRenderer::Clear() {
     Framebuffer.Clear();
     Scene.Clear();
+    MeshVisible_.clear();
+    VisibleMeshes_.clear();
+    CullingStats_ = CullingStats();
+    DepthPyramid.Clear();
+    GlState_.BeginFrame();
 }
 
 void ovrAppRenderer::Create(
@@ -1255,12 +3052,105 @@ void ovrAppRenderer::Create(
     if (glExtensions.EXT_sRGB_write_control) {
         GL(glDisable(GL_FRAMEBUFFER_SRGB_EXT));
     }
+    DepthPyramid.Create(width, height);
 }
 
 void ovrAppRenderer::Destroy() {
+    DepthPyramid.Destroy();
     Framebuffer.Destroy();
 }
 
+// Expansion of an occluder mesh for OCCLUDER_VERTEX_SHADER. The normal offset is scaled
+// back through the dequantization in the model matrix.
+static void SetExpansionUniforms(ovrGlStateCache& state, const ovrProgram& program, const ovrMesh& mesh) {
+    if (program.UniformLocation[ovrUniform::Index::EXPANSION] >= 0) {
+        state.Uniform4f(
+            program.UniformLocation[ovrUniform::Index::EXPANSION], mesh.Expansion, mesh.ExpansionPerMetre, 0.0f, 0.0f);
+    }
+    if (program.UniformLocation[ovrUniform::Index::EXPANSION_SCALE] >= 0) {
+        const Matrix4f& dequantization = mesh.LodGeometry().PositionTransform();
+        state.Uniform4f(
+            program.UniformLocation[ovrUniform::Index::EXPANSION_SCALE],
+            1.0f / dequantization.M[0][0],
+            1.0f / dequantization.M[1][1],
+            1.0f / dequantization.M[2][2],
+            0.0f);
+    }
+}
+
+// Makes program current with the scene matrices bound to it.
+static void UseSceneProgram(ovrGlStateCache& state, const ovrProgram& program, GLuint sceneMatrices) {
+    state.UseProgram(program.Program);
+    state.BindUniformBuffer(program.UniformBinding[ovrUniform::Index::SCENE_MATRICES], sceneMatrices);
+    if (program.UniformLocation[ovrUniform::Index::VIEW_ID] >= 0) {
+        state.Uniform1i(program.UniformLocation[ovrUniform::Index::VIEW_ID], 0);
+    }
+}
+
+void ovrAppRenderer::CullMeshes(const FrameIn& frameIn, const Vector3f& viewPosition) {
+    Frustum_.Set(frameIn.View, frameIn.Proj);
+    Frustum_.ClearBoxes();
+    MeshVisible_.assign(Scene.Meshes.size(), 0);
+    VisibleMeshes_.clear();
+
+    TestedMeshes_.clear();
+    for (size_t i = 0; i < Scene.Meshes.size(); ++i) {
+        ovrMesh& mesh = Scene.Meshes[i];
+        if (!mesh.IsRenderable()) {
+            continue;
+        }
+        // The level of detail comes first: the tests below use its bounds and meshlets.
+        mesh.SelectLod(viewPosition);
+        // The vertex shader pushes vertices out by up to the expansion at the box's far
+        // side.
+        const Bounds3f& bounds = mesh.LocalBounds();
+        const float radius = bounds.GetSize().Length() * 0.5f;
+        const float distance = (mesh.T_World_Mesh.Transform(bounds.GetCenter()) - viewPosition).Length();
+        const float margin = mesh.Expansion + mesh.ExpansionPerMetre * (distance + radius);
+        Frustum_.AddBox(mesh.T_World_Mesh, bounds, margin);
+        TestedMeshes_.push_back(static_cast<uint32_t>(i));
+    }
+    Frustum_.Cull();
+
+    CullingStats_ = CullingStats();
+    CullingStats_.MeshesTested = static_cast<uint32_t>(TestedMeshes_.size());
+    for (size_t box = 0; box < TestedMeshes_.size(); ++box) {
+        if (!Frustum_.IsVisible(box)) {
+            ++CullingStats_.MeshesCulled;
+            continue;
+        }
+        // Then its meshlets; a large room mesh is mostly out of view.
+        const uint32_t meshIndex = TestedMeshes_[box];
+        ovrMesh& mesh = Scene.Meshes[meshIndex];
+        const size_t meshletCount = mesh.Meshlets().Meshlets().size();
+        const size_t visibleMeshlets = Frustum_.CullMeshlets(
+            mesh.Meshlets(),
+            mesh.T_World_Mesh,
+            mesh.Expansion,
+            mesh.ExpansionPerMetre,
+            CullBackFacingMeshlets,
+            mesh.VisibleMeshlets);
+        CullingStats_.MeshletsTested += static_cast<uint32_t>(meshletCount);
+        CullingStats_.MeshletsCulled += static_cast<uint32_t>(meshletCount - visibleMeshlets);
+        CullingStats_.MeshletsDrawn += static_cast<uint32_t>(visibleMeshlets);
+        if (visibleMeshlets == 0) {
+            ++CullingStats_.MeshesCulled;
+            continue;
+        }
+        if (visibleMeshlets == meshletCount) {
+            mesh.VisibleMeshlets.clear();
+        }
+        MeshVisible_[meshIndex] = 1;
+        if (!mesh.IsMerged()) {
+            VisibleMeshes_.push_back(meshIndex);
+        }
+        ++CullingStats_.MeshesDrawn;
+        if (mesh.Lod() > 0) {
+            ++CullingStats_.MeshesCoarse;
+        }
+    }
+}
+
 void ovrAppRenderer::RenderFrame(const FrameIn& frameIn) {
     // Update scene matrices
     GL(glBindBuffer(GL_UNIFORM_BUFFER, Scene.SceneMatrices));
@@ -1291,73 +3181,88 @@ void ovrAppRenderer::RenderFrame(const FrameIn& frameIn) {
     // ====================================================================
     // PASS 1: Occluders (Depth-only pass)
     // ====================================================================
-    GL(glUseProgram(Scene.MeshProgram.Program));
-    GL(glBindBufferBase(
-        GL_UNIFORM_BUFFER,
-        Scene.MeshProgram.UniformBinding[ovrUniform::Index::SCENE_MATRICES],
-        Scene.SceneMatrices));
-    if (Scene.MeshProgram.UniformLocation[ovrUniform::Index::VIEW_ID] >= 0) {
-        GL(glUniform1i(Scene.MeshProgram.UniformLocation[ovrUniform::Index::VIEW_ID], 0));
-    }
+    // Only meshes in view of either eye are drawn, here and in the wireframe pass.
+    // FrameIn matrices are stored column major, so the eye position is the last row of
+    // the inverse.
+    const Matrix4f viewInverse = frameIn.View[0].Inverted();
+    const Vector3f viewPosition(viewInverse.M[3][0], viewInverse.M[3][1], viewInverse.M[3][2]);
+    CullMeshes(frameIn, viewPosition);
+
+    // Merged meshes, uploaded as they are committed: one draw per page, front to back.
+    Scene.MergedOccluders.PrepareFrame(Scene.Meshes, MeshVisible_, viewPosition);
 
     GL(glDepthMask(GL_TRUE));
     GL(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+    // Back faces go triangle by triangle too, so that what occludes does not depend on
+    // how the triangles were grouped into meshlets.
+    if (CullBackFacingMeshlets) {
+        GL(glEnable(GL_CULL_FACE));
+        GL(glCullFace(GL_BACK));
+    }
+
+    // Draws below go through GlState_, which skips rebinding what is already bound.
+    GlState_.BeginFrame();
+
+    if (!Scene.MergedOccluders.IsEmpty()) {
+        UseSceneProgram(GlState_, Scene.MergedMeshProgram, Scene.SceneMatrices);
+        Scene.MergedOccluders.Draw(GlState_, Scene.MergedMeshProgram);
+    }
+
+    // Meshes with their own buffers
+    UseSceneProgram(GlState_, Scene.MeshProgram, Scene.SceneMatrices);
+    for (const uint32_t meshIndex : VisibleMeshes_) {
+        const ovrMesh& mesh = Scene.Meshes[meshIndex];
 
-    for (const auto& mesh : Scene.Meshes) {
-        if (!mesh.IsRenderable()) continue;
-        
         if (Scene.MeshProgram.UniformLocation[ovrUniform::Index::MODEL_MATRIX] >= 0) {
-            const Matrix4f transform = Matrix4f(mesh.T_World_Mesh);
-            GL(glUniformMatrix4fv(
-                Scene.MeshProgram.UniformLocation[ovrUniform::Index::MODEL_MATRIX], 1, GL_TRUE, &transform.M[0][0]));
+            // Quantized positions are dequantized by the same matrix
+            const Matrix4f transform = mesh.ModelMatrix * mesh.LodGeometry().PositionTransform();
+            GlState_.UniformMatrix4(Scene.MeshProgram.UniformLocation[ovrUniform::Index::MODEL_MATRIX], transform);
         }
-        
-        mesh.Geometry.BindVAO();
+        SetExpansionUniforms(GlState_, Scene.MeshProgram, mesh);
+
+        GlState_.BindVertexArray(mesh.LodGeometry().VertexArrayObject());
         // ** CORREZIONE CRITICA **
-        // Associa esplicitamente il buffer dei TRIANGOLI. Questo previene
+        // DrawMesh associa esplicitamente il buffer dei TRIANGOLI. Questo previene
         // che il binding del wireframe del frame precedente rimanga attivo.
-        GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.Geometry.IndexBuffer()));
-        GL(glDrawElements(GL_TRIANGLES, mesh.Geometry.IndexCount(), GL_UNSIGNED_INT, nullptr));
+        mesh.LodGeometry().DrawMesh(GlState_, mesh.VisibleMeshlets);
     }
 
     // ====================================================================
     // PASS 2: Scene Objects
     // ====================================================================
+    GL(glDisable(GL_CULL_FACE));
     GL(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
 
     // Render Controllers
-    GL(glUseProgram(Scene.ControllerProgram.Program));
-    GL(glBindBufferBase(
-        GL_UNIFORM_BUFFER,
-        Scene.ControllerProgram.UniformBinding[ovrUniform::Index::SCENE_MATRICES],
-        Scene.SceneMatrices));
-    if (Scene.ControllerProgram.UniformLocation[ovrUniform::Index::VIEW_ID] >= 0) {
-        GL(glUniform1i(Scene.ControllerProgram.UniformLocation[ovrUniform::Index::VIEW_ID], 0));
-    }
+    UseSceneProgram(GlState_, Scene.ControllerProgram, Scene.SceneMatrices);
 
     GLint cubeColorLocation =
         Scene.ControllerProgram.UniformLocation[ovrUniform::Index::CUBE_COLOR];
 
+    bool controllerDrawn[2] = {false, false};
     for (int i = 0; i < 2; ++i) {
         if (frameIn.RenderController[i]) {
+            // Skip objects entirely behind the occluders of earlier frames
+            ++CullingStats_.ObjectsTested;
+            if (DepthPyramid.IsOccluded(frameIn.ControllerPoses[i], Scene.ControllerCube.GetGeometry().LocalBounds())) {
+                ++CullingStats_.ObjectsOccluded;
+                continue;
+            }
             const Matrix4f transform = Matrix4f(frameIn.ControllerPoses[i]);
-            GL(glUniformMatrix4fv(
-                Scene.ControllerProgram.UniformLocation[ovrUniform::Index::MODEL_MATRIX],
-                1,
-                GL_TRUE,
-                &transform.M[0][0]));
+            GlState_.UniformMatrix4(Scene.ControllerProgram.UniformLocation[ovrUniform::Index::MODEL_MATRIX], transform);
 
             if (cubeColorLocation >= 0) {
                 if (i == 0) {
-                    GL(glUniform4f(cubeColorLocation, 1.0f, 0.2f, 0.2f, 1.0f)); // Red
+                    GlState_.Uniform4f(cubeColorLocation, 1.0f, 0.2f, 0.2f, 1.0f); // Red
                 } else {
-                    GL(glUniform4f(cubeColorLocation, 0.2f, 0.2f, 1.0f, 1.0f)); // Blue
+                    GlState_.Uniform4f(cubeColorLocation, 0.2f, 0.2f, 1.0f, 1.0f); // Blue
                 }
             }
             // Il VAO del cubo è auto-contenuto e funziona correttamente.
-            Scene.ControllerCube.BindVAO();
-            GL(glDrawElements(
-                GL_TRIANGLES, Scene.ControllerCube.IndexCount(), GL_UNSIGNED_SHORT, nullptr));
+            GlState_.BindVertexArray(Scene.ControllerCube.GetGeometry().VertexArrayObject());
+            GlState_.DrawElements(
+                GL_TRIANGLES, Scene.ControllerCube.IndexCount(), GL_UNSIGNED_SHORT, Scene.ControllerCube.IndexOffset());
+            controllerDrawn[i] = true;
         }
     }
     
@@ -1365,39 +3270,73 @@ void ovrAppRenderer::RenderFrame(const FrameIn& frameIn) {
     // PASS 3: Wireframe (Visible overlay)
     // ====================================================================
     if (frameIn.RenderWireframe) {
-        GL(glUseProgram(Scene.WireframeProgram.Program));
-        GL(glBindBufferBase(
-            GL_UNIFORM_BUFFER,
-            Scene.WireframeProgram.UniformBinding[ovrUniform::Index::SCENE_MATRICES],
-            Scene.SceneMatrices));
-        if (Scene.WireframeProgram.UniformLocation[ovrUniform::Index::VIEW_ID] >= 0) {
-            GL(glUniform1i(Scene.WireframeProgram.UniformLocation[ovrUniform::Index::VIEW_ID], 0));
-        }
-
         GL(glDepthMask(GL_FALSE));
         GL(glLineWidth(2.0f));
 
-        for (const auto& mesh : Scene.Meshes) {
-            if (!mesh.IsRenderable())
-                continue;
+        // Meshes with corner labels draw their triangles again with a fragment shader
+        // that keeps only the edges; the others draw lines.
+        if (!Scene.MergedOccluders.IsEmpty()) {
+            const ovrProgram& program = Scene.MergedOccluders.HasCornerLabels()
+                ? Scene.MergedBarycentricWireframeProgram
+                : Scene.MergedWireframeProgram;
+            UseSceneProgram(GlState_, program, Scene.SceneMatrices);
+            Scene.MergedOccluders.DrawWireframe(GlState_, program);
+        }
 
-            if (Scene.WireframeProgram.UniformLocation[ovrUniform::Index::MODEL_MATRIX] >= 0) {
-                const Matrix4f transform = Matrix4f(mesh.T_World_Mesh);
-                GL(glUniformMatrix4fv(
-                    Scene.WireframeProgram.UniformLocation[ovrUniform::Index::MODEL_MATRIX],
-                    1,
-                    GL_TRUE,
-                    &transform.M[0][0]));
+        for (const uint32_t meshIndex : VisibleMeshes_) {
+            const ovrMesh& mesh = Scene.Meshes[meshIndex];
+            const ovrProgram& program =
+                mesh.LodGeometry().HasCornerLabels() ? Scene.BarycentricWireframeProgram : Scene.WireframeProgram;
+            UseSceneProgram(GlState_, program, Scene.SceneMatrices);
+
+            if (program.UniformLocation[ovrUniform::Index::MODEL_MATRIX] >= 0) {
+                const Matrix4f transform = mesh.ModelMatrix * mesh.LodGeometry().PositionTransform();
+                GlState_.UniformMatrix4(program.UniformLocation[ovrUniform::Index::MODEL_MATRIX], transform);
             }
+            SetExpansionUniforms(GlState_, program, mesh);
 
-            mesh.Geometry.BindVAO();
+            GlState_.BindVertexArray(mesh.LodGeometry().VertexArrayObject());
 
-            // Associa esplicitamente il buffer delle LINEE per il wireframe.
-            GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.Geometry.WireframeIndexBuffer()));
-            GL(glDrawElements(
-                GL_LINES, mesh.Geometry.WireframeIndexCount(), GL_UNSIGNED_INT, nullptr));
+            // DrawMeshWireframe associa esplicitamente il buffer delle LINEE (o dei triangoli).
+            mesh.LodGeometry().DrawMeshWireframe(GlState_, mesh.VisibleMeshlets);
         }
     }
+    // Max depth pyramid of the occluders, for the object tests of the next frames. It is
+    // built once the eye buffer is complete: binding its framebuffers between the passes
+    // made a tiled GPU store the multisampled eye buffer and load it back every frame.
+    // Here the eye buffer is stored once, as at the end of any frame, and what the
+    // pyramid adds is storing the depth attachment, which is discarded without it, and
+    // the reduction passes. The objects drawn are first drawn again at the far plane, so
+    // that the pyramid holds the room alone: an object that moves must not hide another
+    // from an old readback.
+    if (DepthPyramid.IsEnabled()) {
+        GL(glDepthMask(GL_TRUE));
+        GL(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+        GL(glDepthFunc(GL_ALWAYS));
+        GL(glDepthRangef(1.0f, 1.0f));
+        UseSceneProgram(GlState_, Scene.ControllerProgram, Scene.SceneMatrices);
+        for (int i = 0; i < 2; ++i) {
+            if (controllerDrawn[i]) {
+                GlState_.UniformMatrix4(
+                    Scene.ControllerProgram.UniformLocation[ovrUniform::Index::MODEL_MATRIX],
+                    Matrix4f(frameIn.ControllerPoses[i]));
+                GlState_.BindVertexArray(Scene.ControllerCube.GetGeometry().VertexArrayObject());
+                GlState_.DrawElements(
+                    GL_TRIANGLES,
+                    Scene.ControllerCube.IndexCount(),
+                    GL_UNSIGNED_SHORT,
+                    Scene.ControllerCube.IndexOffset());
+            }
+        }
+        GL(glDepthRangef(0.0f, 1.0f));
+        GL(glDepthFunc(GL_LEQUAL));
+        DepthPyramid.Build(Framebuffer.Elements[frameIn.SwapChainIndex].DepthTexture, frameIn.View, frameIn.Proj);
+        GlState_.Invalidate();
+    } else {
+        // Nothing reads the depth after the frame, so the tiler need not store it.
+        Framebuffer.Resolve();
+    }
+
     // Restore GL state for the next frame
     GL(glDepthMask(GL_TRUE));
     GL(glBindVertexArray(0));
@@ -19,6 +19,8 @@
 #pragma once
 
 #include <array>
+#include <map>
+#include <memory>
 #include <vector>
 
 #if defined(ANDROID)
@@ -34,6 +36,12 @@
 #include <unknwn.h>
 #define XR_USE_GRAPHICS_API_OPENGL 1
 #define XR_USE_PLATFORM_WIN32 1
+#elif defined(__linux__)
+// Host builds, e.g. the benchmark's scene replay: GLES 3 through EGL on Mesa's drivers.
+#include <GLES3/gl3.h>
+#include <EGL/egl.h>
+
+#define XR_USE_GRAPHICS_API_OPENGL_ES 1
 #endif
 
 #include <openxr/openxr.h>
@@ -41,9 +49,136 @@
 #include <openxr/openxr_platform.h>
 
 #include "OVR_Math.h"
+#include "FrustumCulling.h"
+#include "MeshTopology.h"
+#include "AdaptiveSubdivision.h"
+#include "MeshSimplification.h"
+#include "MeshOptimization.h"
+#include "MeshletMesh.h"
+#include "QuantizedPositions.h"
+#include "SubdivisionStencils.h"
+
+class ThreadPool;
 
 #define NUM_EYES 2
 
+// The GL bindings last made through it, so that binding the same program, vertex array,
+// buffer or texture again is skipped, and counts of the GL calls made through it since
+// BeginFrame (like the framework's ovrDrawCounters). Bindings made directly must be
+// followed by Invalidate.
+struct ovrGlStateCache {
+    struct Counters {
+        uint32_t Draws = 0;
+        uint32_t Elements = 0; // indices or vertices drawn
+        uint32_t ProgramBinds = 0;
+        uint32_t VertexArrayBinds = 0;
+        uint32_t BufferBinds = 0; // including indexed uniform buffer bindings
+        uint32_t TextureBinds = 0;
+        uint32_t UniformUpdates = 0;
+        uint32_t SkippedBinds = 0; // redundant binds not issued
+    };
+
+    // Resets the counters and forgets the bindings.
+    void BeginFrame();
+    void Invalidate();
+
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vertexArray);
+    // GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER (which belongs to the bound vertex
+    // array), GL_UNIFORM_BUFFER, GL_COPY_WRITE_BUFFER or GL_PIXEL_PACK_BUFFER.
+    void BindBuffer(GLenum target, GLuint buffer);
+    // glBindBufferBase, or glBindBufferRange when size is not zero.
+    void BindUniformBuffer(GLuint index, GLuint buffer, GLintptr offset = 0, GLsizeiptr size = 0);
+    void BindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    void Uniform1i(GLint location, GLint value);
+    void Uniform4f(GLint location, float x, float y, float z, float w);
+    // Row major, like OVR::Matrix4f.
+    void UniformMatrix4(GLint location, const OVR::Matrix4f& matrix);
+    void DrawElements(GLenum mode, GLsizei count, GLenum type, size_t offset);
+    void DrawArrays(GLenum mode, GLint first, GLsizei count);
+
+    const Counters& FrameCounters() const {
+        return Counters_;
+    }
+
+   private:
+    static constexpr GLuint kUnknown = ~0u;
+    static constexpr int kBufferTargets = 5;
+    static constexpr GLuint kUniformBindings = 16;
+    static constexpr GLuint kTextureUnits = 8;
+
+    struct UniformBinding {
+        GLuint Buffer;
+        GLintptr Offset;
+        GLsizeiptr Size;
+    };
+
+    struct TextureBinding {
+        GLenum Target;
+        GLuint Texture;
+    };
+
+    static int BufferTargetIndex(GLenum target);
+
+    GLuint Program_ = kUnknown;
+    GLuint VertexArray_ = kUnknown;
+    GLuint Buffers_[kBufferTargets];
+    UniformBinding UniformBuffers_[kUniformBindings];
+    GLuint ActiveTexture_ = kUnknown;
+    TextureBinding Textures_[kTextureUnits];
+    Counters Counters_;
+};
+
+// Ranges of a few large GL buffers (arenas) handed out to many geometries, so that a
+// scene of hundreds of planes, volumes and mesh levels needs a handful of buffer objects
+// rather than two or three each. Ranges are placed first fit and merged with their free
+// neighbours when freed. A request larger than an arena gets an arena of its own, which
+// is deleted with it, as is an empty arena while another one is empty too.
+struct ovrBufferPool {
+    struct Allocation {
+        GLuint Buffer = 0; // 0 when nothing is allocated
+        size_t Offset = 0; // in bytes
+        size_t Size = 0;
+    };
+
+    struct Stats {
+        size_t Arenas = 0;
+        size_t Allocations = 0;
+        size_t AllocatedBytes = 0;
+        size_t ArenaBytes = 0;
+    };
+
+    static constexpr size_t kDefaultArenaSize = 4 << 20;
+
+    explicit ovrBufferPool(size_t arenaSize = kDefaultArenaSize) : ArenaSize_(arenaSize) {}
+
+    // A range of size bytes starting at a multiple of alignment, which need not be a
+    // power of two (a vertex stride, say). Empty for size 0.
+    Allocation Allocate(size_t size, size_t alignment);
+    // Returns the range to its arena and resets allocation.
+    void Free(Allocation& allocation);
+    // Writes allocation again: reallocates it unless it already has size bytes at a
+    // multiple of alignment, then uploads data through GL_COPY_WRITE_BUFFER.
+    void Write(Allocation& allocation, const void* data, size_t size, size_t alignment);
+    // Deletes every arena. Allocations still held are invalid afterwards.
+    void Destroy();
+
+    Stats GetStats() const;
+
+   private:
+    struct Arena {
+        GLuint Buffer;
+        size_t Size;
+        size_t Allocated;
+        size_t AllocationCount;
+        std::map<size_t, size_t> FreeRanges; // offset -> size
+    };
+
+    size_t ArenaSize_;
+    std::vector<Arena> Arenas_;
+};
+
 struct ovrGeometry {
     void Clear();
     void CreateAxes();
@@ -54,13 +189,48 @@ struct ovrGeometry {
         const XrColor4f& color);
     void CreatePlane(const std::vector<XrVector3f>& vertices, const XrColor4f& color);
     void CreateVolume(const std::array<XrVector3f, 8>& vertices, const XrColor4f& color);
-    void CreateMesh(const XrSpaceTriangleMeshMETA& mesh);
+    // Uploads a mesh as meshlet batches with 16-bit indices. vertices is the GPU vertex
+    // order of meshlets (see MeshletMesh::GatherVertices), and so are normals, which may
+    // be empty for a mesh without a normal stream. With quantizePositions the positions
+    // are stored as 16-bit normalized values in the mesh's bounding box and
+    // PositionTransform() must be applied after the model matrix.
+    void CreateMesh(
+        const std::vector<XrVector3f>& vertices,
+        const std::vector<XrVector3f>& normals,
+        const MeshletMesh& meshlets,
+        bool quantizePositions);
+    // Replaces the vertices of a mesh created by CreateMesh, keeping its indices and
+    // vertex format. normals must be null exactly when the mesh has no normal stream.
+    // Only meshlets whose vertex data changed are uploaded; quantized positions keep
+    // their bounding box while the new positions fit it well, so that unchanged
+    // vertices stay unchanged.
+    void UpdateMeshVertices(const XrVector3f* vertices, const XrVector3f* normals, size_t vertexCount);
+    // Frees the CPU copy of a mesh's vertex buffer that UpdateMeshVertices compares
+    // against; the next update then uploads every vertex.
+    void ReleaseVertexData();
+    // Draws a mesh created by CreateMesh, one draw per batch, or per run of visible
+    // meshlets when visibleMeshlets (by meshlet) is not empty. The VAO must be bound
+    // through state.
+    void DrawMesh(ovrGlStateCache& state, const std::vector<uint8_t>& visibleMeshlets) const;
+    // Lines, or with corner labels the triangles again, for a program whose fragment
+    // shader draws only their edges.
+    void DrawMeshWireframe(ovrGlStateCache& state, const std::vector<uint8_t>& visibleMeshlets) const;
     void Destroy();
     void CreateVAO();
     void DestroyVAO();
-    
-    GLuint IndexBuffer() const { 
-        return IndexBuffer_; 
+
+    // The pools every geometry's vertex and index buffers are allocated from. Destroyed
+    // with the scene.
+    static ovrBufferPool& VertexBuffers();
+    static ovrBufferPool& IndexBuffers();
+
+    GLuint IndexBuffer() const {
+        return IndexBuffer_.Buffer;
+    }
+
+    // Byte offset of the geometry's indices in IndexBuffer(), for glDrawElements.
+    size_t IndexOffset() const {
+        return IndexBuffer_.Offset;
     }
 
     int IndexCount() const {
@@ -71,15 +241,44 @@ struct ovrGeometry {
         return WireframeIndexCount_;
     }
     GLuint WireframeIndexBuffer() const {
-        return WireframeIndexBuffer_;
+        return WireframeIndexBuffer_.Buffer;
     }
 
     void BindVAO() const;
+    GLuint VertexArrayObject() const {
+        return VertexArrayObject_;
+    }
 
     bool IsRenderable() const {
         return IsRenderable_;
     }
 
+    bool HasQuantizedPositions() const {
+        return QuantizedPositions_;
+    }
+
+    bool HasNormals() const {
+        return HasNormals_;
+    }
+
+    // Set when the meshlets given to CreateMesh have corner labels (a barycentric
+    // wireframe).
+    bool HasCornerLabels() const {
+        return !CornerLabels_.empty();
+    }
+
+    // Vertex attribute space to mesh space: the dequantization of quantized positions,
+    // identity otherwise.
+    const OVR::Matrix4f& PositionTransform() const {
+        return PositionTransform_;
+    }
+
+    // Box around the vertex positions given to CreatePlane, CreateVolume, CreateMesh or
+    // UpdateMeshVertices, before PositionTransform().
+    const OVR::Bounds3f& LocalBounds() const {
+        return LocalBounds_;
+    }
+
    private:
     static constexpr int MAX_VERTEX_ATTRIB_POINTERS = 3;
 
@@ -93,16 +292,31 @@ struct ovrGeometry {
     };
 
     void CreateIndexBuffer(const std::vector<unsigned short>& indices);
+    void CreateVertexBuffer(const void* data, size_t size, size_t alignment);
+    void DrawMeshBatches(
+        ovrGlStateCache& state,
+        GLenum mode,
+        const ovrBufferPool::Allocation& indexBuffer,
+        const std::vector<uint8_t>& visibleMeshlets) const;
 
     int VertexCount_ = 0;
     int IndexCount_ = 0;
     int WireframeIndexCount_ = 0;
 
     VertexAttribPointer VertexAttribs_[MAX_VERTEX_ATTRIB_POINTERS];
-    GLuint VertexBuffer_ = 0;
-    GLuint IndexBuffer_ = 0;
+    ovrBufferPool::Allocation VertexBuffer_;
+    ovrBufferPool::Allocation IndexBuffer_;
     GLuint VertexArrayObject_ = 0;
-    GLuint WireframeIndexBuffer_ = 0;
+    ovrBufferPool::Allocation WireframeIndexBuffer_;
+    std::vector<MeshletMesh::Batch> MeshBatches_;
+    std::vector<MeshletMesh::Meshlet> Meshlets_;
+    // Copy of the vertex buffer, to find the meshlets a vertex update changes.
+    std::vector<uint8_t> VertexData_;
+    bool QuantizedPositions_ = false;
+    bool HasNormals_ = false;
+    std::vector<uint8_t> CornerLabels_;
+    OVR::Matrix4f PositionTransform_;
+    OVR::Bounds3f LocalBounds_;
 
     bool IsRenderable_ = false;
 };
@@ -201,30 +415,449 @@ struct ovrVolume {
     bool IsPoseSet_ = false;
 };
 
+// How ovrMesh::Update turns a runtime mesh into occluder geometry: optional
+// simplification, then optional subdivision, reordering for the GPU, then expansion.
+struct ovrMeshProcessingSettings {
+    bool Simplify = false;
+    MeshSimplification::Settings Simplification;
+
+    enum class SubdivisionMode {
+        None,
+        Uniform, // Loop subdivision of every triangle
+        Adaptive, // red-green refinement within a triangle budget
+    };
+    SubdivisionMode Subdivision = SubdivisionMode::Adaptive;
+    int UniformIterations = 1;
+    AdaptiveSubdivision::Settings Adaptive;
+    // Reorder triangles and vertices of the subdivided mesh for the GPU caches.
+    bool OptimizeVertexOrder = true;
+    MeshOptimization::Settings Optimization;
+    MeshletMesh::Settings Meshlets;
+    // Upload positions as 16-bit normalized values in the mesh's bounding box.
+    bool QuantizePositions = true;
+    // Offset along the vertex normals, in metres. With GpuExpansion the vertex shader
+    // applies it from a normal stream, plus ExpansionPerMetre for every metre between
+    // the eye and the vertex; otherwise it is baked into the positions on the CPU.
+    float ExpansionFactor = 0.015f;
+    bool GpuExpansion = true;
+    float ExpansionPerMetre = 0.0f;
+    // Draw the mesh from the scene's shared occluder buffers (ovrMergedOccluders)
+    // instead of its own.
+    bool MergeOccluders = true;
+    // Levels of detail for meshes seen from afar. Level l has about 1/2^l of the
+    // triangles of level 0, from less subdivision where the runtime mesh is coarser
+    // than that and from simplifying it otherwise; levels that would not be smaller are
+    // left out. Level l is drawn from LodDistance * 2^(l - 1) metres of the mesh's box;
+    // the drawn level only changes once the viewer is LodHysteresis times that distance
+    // past it, either way.
+    int LodCount = 3;
+    float LodDistance = 4.0f;
+    float LodHysteresis = 0.2f;
+    // Largest simplification error of level 1, in metres; doubles with every level.
+    float LodMaxError = 0.02f;
+    // Keep the processed vertices and the geometry's copy of its vertex buffer on the
+    // CPU once uploaded. Without them a refresh uploads every vertex, not only the
+    // meshlets that changed. Merged meshes free their vertices once the shared buffers
+    // hold them, and keep their meshlets' indices, which pages are repacked from.
+    bool KeepCpuCopies = true;
+};
+
+// CPU side of an ovrMesh: the runtime mesh simplified, subdivided, reordered, split
+// into meshlets and expanded, ready for upload. Process makes no GL calls, so it can run
+// on a worker thread; results are not changed after that and may be shared.
+struct ovrProcessedMesh {
+    // Subdivision of a runtime index buffer, reused while the runtime only moves
+    // vertices: the stencils as weights, and the subdivided indices and connectivity.
+    struct Layout {
+        SubdivisionStencils Stencils;
+        std::vector<uint32_t> SourceIndices;
+        ovrMeshProcessingSettings SourceSettings;
+        std::vector<uint32_t> Indices;
+        MeshTopology Topology;
+        MeshletMesh Meshlets; // without bounds
+    };
+
+    // Builds from the runtime's vertices and indices, with the coarser levels of detail.
+    // previous is the last result for the same mesh, or null; its layouts are shared
+    // when they still apply.
+    void Process(
+        std::vector<XrVector3f> vertices,
+        std::vector<uint32_t> indices,
+        const ovrMeshProcessingSettings& settings,
+        const ovrProcessedMesh* previous,
+        ThreadPool* pool = nullptr);
+
+    // Vertices in the GPU order of Meshlets, and their normals (empty when the
+    // expansion was applied on the CPU).
+    const std::vector<XrVector3f>& UploadVertices() const {
+        return Meshlets.IsIdentityVertexOrder() ? Vertices : GpuVertices;
+    }
+    const std::vector<XrVector3f>& UploadNormals() const {
+        return Meshlets.IsIdentityVertexOrder() ? Normals : GpuNormals;
+    }
+
+    // Size of the vertex and index data the upload writes to GL buffers, with Lods.
+    size_t UploadBytes() const;
+
+    // Frees the vertices, normals and index buffers of this level and its Lods once they
+    // are uploaded. The layout, meshlet bounds and LocalBounds stay, and still serve as
+    // the previous result of the next Process.
+    void ReleaseUploadData();
+    // Frees only the vertices and normals of this level and its Lods.
+    void ReleaseVertices();
+
+    ovrMeshProcessingSettings Settings;
+    // Shared with the previous result when only the vertices changed. Null in a mesh
+    // read from ProcessedMeshCache.
+    std::shared_ptr<const Layout> SharedLayout;
+    std::vector<XrVector3f> Vertices;
+    std::vector<XrVector3f> Normals; // empty unless expanding on the GPU
+    // Upload layout with the bounds of Vertices, and the vertices in that layout when
+    // that is not simply Vertices.
+    MeshletMesh Meshlets;
+    std::vector<XrVector3f> GpuVertices;
+    std::vector<XrVector3f> GpuNormals;
+    // Box around the processed vertices in mesh space, without the GPU expansion.
+    OVR::Bounds3f LocalBounds;
+    // Levels of detail 1 and up, coarsest last. Their own Lods are empty.
+    std::vector<std::shared_ptr<ovrProcessedMesh>> Lods;
+
+   private:
+    void ProcessLevel(
+        std::vector<XrVector3f> vertices,
+        std::vector<uint32_t> indices,
+        const ovrMeshProcessingSettings& settings,
+        const ovrProcessedMesh* previous,
+        ThreadPool* pool);
+};
+
 struct ovrMesh {
     explicit ovrMesh(const XrSpace space);
 
-    void Update(const XrSpaceTriangleMeshMETA& mesh);
+    // Subdivides, expands and uploads the mesh. The CPU stages run on pool when given.
+    void Update(
+        const XrSpaceTriangleMeshMETA& mesh,
+        const ovrMeshProcessingSettings& settings,
+        ThreadPool* pool = nullptr);
+
+    // The upload half of Update, for a mesh processed elsewhere (see MeshPipeline).
+    // Must be called on the GL thread. Releases the upload data of processed unless
+    // its settings keep CPU copies; a merged mesh's vertices wait for
+    // ReleaseMergedVertices.
+    void Commit(std::shared_ptr<ovrProcessedMesh> processed);
+
+    // Frees the vertices of a merged mesh once ovrMergedOccluders has uploaded them,
+    // unless its settings keep CPU copies. Until the next Commit, the mesh cannot be
+    // placed again.
+    void ReleaseMergedVertices();
+    bool HasVertices() const {
+        return !VerticesReleased_;
+    }
+
+    // The last committed result; an empty one before the first commit.
+    const std::shared_ptr<const ovrProcessedMesh>& Processed() const {
+        return Processed_;
+    }
 
     void SetPose(const XrPosef& T_World_Mesh);
 
+    // Level of detail 0 is Processed(), level l > 0 is Processed()->Lods[l - 1].
+    int LodCount() const {
+        return 1 + static_cast<int>(Processed_->Lods.size());
+    }
+    const ovrProcessedMesh& Level(int level) const {
+        return level == 0 ? *Processed_ : *Processed_->Lods[level - 1];
+    }
+
+    // Picks the level to draw for the viewer at viewPosition (world space) from its
+    // distance to the mesh's box. Set by the renderer before culling.
+    void SelectLod(const OVR::Vector3f& viewPosition);
+
+    // The selected level, which the accessors below and LodGeometry() refer to.
+    int Lod() const {
+        return Lod_;
+    }
+
+    // Geometry of the selected level.
+    const ovrGeometry& LodGeometry() const {
+        return Lod_ == 0 ? Geometry : LodGeometry_[Lod_ - 1];
+    }
+
+    // Destroys the geometry of every level.
+    void DestroyGeometry();
+
     void SetVisible(const bool isVisible) {
         IsVisible_ = isVisible;
     }
 
     bool IsRenderable() const {
-        return IsVisible_ && IsPoseSet_ && Geometry.IsRenderable();
+        return IsVisible_ && IsPoseSet_ && (Merged_ || Geometry.IsRenderable());
+    }
+
+    // Drawn by ovrMergedOccluders rather than from Geometry.
+    bool IsMerged() const {
+        return Merged_;
+    }
+
+    // Bumped by Commit when the meshlets (and so the indices) of any level were rebuilt,
+    // and on every Commit, respectively.
+    uint64_t LayoutVersion() const {
+        return LayoutVersion_;
+    }
+    uint64_t VertexVersion() const {
+        return VertexVersion_;
+    }
+
+    bool QuantizesPositions() const {
+        return Processed_->Settings.QuantizePositions;
+    }
+
+    // A corner label per GPU vertex for the barycentric wireframe, rather than lines.
+    bool HasCornerLabels() const {
+        return Processed_->Settings.Meshlets.Wireframe == MeshletMesh::WireframeMode::Barycentric;
+    }
+
+    // Box around the processed vertices in mesh space, without the GPU expansion.
+    const OVR::Bounds3f& LocalBounds() const {
+        return Level(Lod_).LocalBounds;
+    }
+
+    const MeshletMesh& Meshlets() const {
+        return Level(Lod_).Meshlets;
     }
 
     XrSpace Space;
     OVR::Posef T_World_Mesh;
+    // T_World_Mesh as a matrix, rebuilt by SetPose when the pose changes.
+    OVR::Matrix4f ModelMatrix;
+    // Level 0; the others are in LodGeometry_.
     ovrGeometry Geometry;
+    // Meshlets that passed this frame's culling, by meshlet, or empty when all of them
+    // are drawn. Set by the renderer.
+    std::vector<uint8_t> VisibleMeshlets;
+    // Vertex shader expansion, in metres plus metres per metre of eye distance. Set
+    // from the settings by Commit; may be changed at any time for meshes with normals.
+    float Expansion = 0.0f;
+    float ExpansionPerMetre = 0.0f;
 
    private:
     bool IsVisible_ = true;
     bool IsPoseSet_ = false;
-    std::vector<XrVector3f> subdividedVertices;
-    std::vector<uint32_t> subdividedIndices;
+    bool Merged_ = false;
+    bool VerticesReleased_ = false;
+    // Processed_ while its vertices wait for ReleaseMergedVertices
+    std::shared_ptr<ovrProcessedMesh> PendingVertices_;
+    uint64_t LayoutVersion_ = 0;
+    uint64_t VertexVersion_ = 0;
+    std::shared_ptr<const ovrProcessedMesh> Processed_;
+    int Lod_ = 0;
+    std::vector<ovrGeometry> LodGeometry_;
+};
+
+// All merged occluder meshes in pages of at most 65536 vertices (16-bit indices), each
+// with its own vertex and index ranges of the geometry buffer pools, drawn with one
+// glDrawElements per page instead of one draw per mesh batch. Every vertex carries the slot of its mesh in the page,
+// which indexes the page's block of model matrices and expansion values in a uniform
+// buffer (GLES 3.0 has neither draw IDs nor indirect draws).
+//
+// Batches are placed as their meshes arrive, each on the first page with room for it
+// and a free slot, else on a new page. A mesh whose meshlets were rebuilt leaves its old
+// batches' space unused and is placed again; pages with such gaps are repacked within
+// the upload budget, and pages left empty are dropped.
+//
+// Meshes are drawn front to back for early depth rejection: pages by their nearest
+// mesh, and the meshes of a page by rewriting its triangle indices whenever their order
+// changes. Meshes whose bounds contain the viewer (the room around them) go last.
+struct ovrMergedOccluders {
+    // Must match MAX_MESHES in MERGED_OCCLUDER_VERTEX_SHADER.
+    static constexpr uint32_t kMaxPageMeshes = 128;
+
+    void Clear();
+    void Destroy();
+    // Brings the buffers up to date with the merged meshes, before PrepareFrame: places
+    // new and rebuilt meshes and re-uploads all the vertices of refreshed ones, then asks
+    // each merged mesh to release its vertices. Those uploads were charged to the frame's
+    // budget when the meshes were committed; growing page ranges and repacking pages take
+    // byteBudget, and repacks past it wait for a later frame. Returns the bytes copied
+    // and uploaded for them.
+    size_t Update(std::vector<ovrMesh>& meshes, size_t byteBudget);
+    // Per-mesh transforms, draw order and draw ranges for this frame. Meshes whose
+    // meshVisible entry is zero (frustum culled) are skipped like hidden ones, and only
+    // the VisibleMeshlets of the others are drawn.
+    void PrepareFrame(
+        const std::vector<ovrMesh>& meshes,
+        const std::vector<uint8_t>& meshVisible,
+        const OVR::Vector3f& viewPosition);
+    // The program must be in use through state, with its SceneMatrices bound.
+    void Draw(ovrGlStateCache& state, const ovrProgram& program) const;
+    // Lines, or with corner labels the triangles again (see ovrGeometry).
+    void DrawWireframe(ovrGlStateCache& state, const ovrProgram& program) const;
+
+    bool IsEmpty() const {
+        return Pages_.empty();
+    }
+
+    bool HasCornerLabels() const {
+        return CornerLabels_;
+    }
+
+   private:
+    // One per level of detail of each mesh; only the selected level is drawn.
+    struct MeshRecord {
+        size_t Mesh; // index in the scene's meshes
+        int Level;
+        XrSpace Space;
+        // Versions of the mesh as placed and uploaded; zero while the record has no
+        // batches on any page.
+        uint64_t LayoutVersion;
+        uint64_t VertexVersion;
+        OVR::Matrix4f PositionTransform;
+        OVR::Vector3f BoxMin; // mesh space
+        OVR::Vector3f BoxMax;
+        OVR::Matrix4f ModelMatrix;
+        float Distance;
+        std::vector<uint32_t> Items;
+    };
+
+    struct Item {
+        uint32_t Record;
+        uint32_t Batch; // in the mesh's meshlets
+        uint32_t Page;
+        uint32_t Slot;
+        uint32_t FirstVertex; // in the page
+        uint32_t FirstIndex; // in the page, for the current draw order
+        uint32_t FirstLineIndex;
+    };
+
+    struct Page {
+        GLuint VertexArrayObject = 0;
+        // From ovrGeometry::VertexBuffers() and IndexBuffers()
+        ovrBufferPool::Allocation Vertices;
+        ovrBufferPool::Allocation Indices;
+        ovrBufferPool::Allocation LineIndices;
+        // Elements used in the ranges. Removed batches keep their space used until the
+        // page is repacked.
+        uint32_t VertexCount = 0;
+        uint32_t IndexCount = 0;
+        uint32_t LineIndexCount = 0;
+        bool HasGaps = false;
+        std::vector<uint32_t> Items; // in draw order
+        // Records of the meshes with a slot here; kNoRecord for a free slot
+        std::vector<uint32_t> SlotRecords;
+        float Distance = 0.0f;
+        // This frame's draws: index ranges of the visible meshlets
+        std::vector<MeshletMesh::IndexRange> Draws;
+        std::vector<MeshletMesh::IndexRange> LineDraws;
+    };
+
+    static constexpr uint32_t kNoRecord = UINT32_MAX;
+
+    static void DestroyPage(Page& page);
+    // The record's slot on the page, else a free one; kMaxPageMeshes when it is full.
+    static uint32_t FindSlot(const Page& page, uint32_t recordId);
+    // Takes the record's batches off their pages, leaving gaps, and frees its slots.
+    void RemoveRecord(uint32_t recordId);
+    // Returns whether any page was dropped.
+    bool DropEmptyPages();
+    // Places the batches of the record's level and uploads their indices. Returns the
+    // bytes copied to grow page ranges.
+    size_t PlaceRecord(const ovrMesh& mesh, uint32_t recordId);
+    // Moves the page's batches together. Returns the bytes copied and uploaded.
+    size_t RepackPage(const std::vector<ovrMesh>& meshes, Page& page);
+    // Uploads every vertex of the record's batches from its mesh's level.
+    void WriteMeshVertices(const ovrMesh& mesh, MeshRecord& record);
+    void WriteItemIndices(const MeshletMesh& meshlets, const Item& item, bool lines);
+    // Rewrites the page's indices in draw order from its start, closing any gaps.
+    void WritePageIndices(const std::vector<ovrMesh>& meshes, Page& page, bool lines);
+    void CreatePageVAO(Page& page);
+    void DrawPages(ovrGlStateCache& state, const ovrProgram& program, GLenum mode) const;
+
+    std::vector<MeshRecord> Records_;
+    // By scene mesh, its records by level
+    std::vector<std::vector<uint32_t>> MeshRecords_;
+    std::vector<Item> Items_;
+    std::vector<uint32_t> FreeItems_; // of removed batches, for reuse
+    std::vector<Page> Pages_;
+    std::vector<uint32_t> PageOrder_;
+    std::vector<uint8_t> UniformData_;
+    GLsizeiptr PageUniformStride_ = 0;
+    bool QuantizedPositions_ = true;
+    // Barycentric wireframe: a corner label per vertex and no line indices
+    bool CornerLabels_ = false;
+    GLsizei Stride_ = 0;
+    GLsizei NormalOffset_ = 0;
+    GLsizei CornerOffset_ = 0;
+    GLuint UniformBuffer_ = 0;
+};
+
+// Conservative occluder depth at low resolution, for skipping virtual objects that are
+// entirely behind the room.
+//
+// Build reduces the depth attachment of a finished frame, with the objects drawn in it
+// put back at the far plane, to a chain of max-depth levels (each texel the farthest
+// depth under it), one multiview fragment pass per level, down to at most
+// kReadbackSize texels across. That level is read back through a pixel pack buffer and
+// picked up by a later Build once its fence has signalled, so the CPU never waits on
+// the GPU; the coarser levels are then reduced on the CPU.
+//
+// IsOccluded tests against the newest readback, two or three frames old. Boxes are grown
+// by how far the eyes have moved since, and boxes reaching outside the old view are
+// never occluded; that keeps the test conservative for a moving head and static room.
+struct ovrDepthPyramid {
+    static constexpr int kReadbackSize = 64;
+    static constexpr int kReadbackSlots = 3;
+
+    void Clear();
+    // width and height of the depth attachment. Without float color buffers the
+    // pyramid stays disabled and Create returns false.
+    bool Create(int width, int height);
+    void Destroy();
+    // Reduces depthTexture, a two layer (left, right eye) array rendered with view and
+    // proj. Call it after the frame's last draw to the eye buffer: it binds other
+    // framebuffers, which makes a tiled GPU store the eye buffer. Leaves another
+    // framebuffer bound and changes the viewport, program and depth, scissor and color
+    // mask state.
+    void Build(GLuint depthTexture, const OVR::Matrix4f view[2], const OVR::Matrix4f proj[2]);
+    // True when the box around localBounds placed at pose is behind the occluders in
+    // both eyes.
+    bool IsOccluded(const OVR::Posef& pose, const OVR::Bounds3f& localBounds) const;
+
+    bool IsEnabled() const {
+        return Texture_ != 0;
+    }
+
+   private:
+    struct Readback {
+        GLuint PixelBuffer;
+        GLsync Fence;
+        OVR::Matrix4f ViewProjection[2];
+        OVR::Vector3f Eyes[2];
+    };
+
+    struct Level {
+        int Width;
+        int Height;
+    };
+
+    void ReadCompleted();
+    bool IsOccludedInEye(const OVR::Vector3f corners[8], int eye) const;
+
+    GLuint Texture_ = 0;
+    GLuint DrawFramebuffer_ = 0;
+    GLuint ReadFramebuffer_ = 0;
+    ovrProgram ReduceProgram_;
+    // The depth attachment, the GPU levels (the last one read back), then the CPU ones
+    std::vector<Level> Levels_;
+    int GpuLevelCount_ = 0;
+    Readback Readbacks_[kReadbackSlots];
+    int NextReadback_ = 0;
+    // Depth of every CPU level, left eye then right eye, from the newest readback
+    std::vector<float> Depth_[2];
+    std::vector<size_t> LevelOffsets_;
+    bool HasDepth_ = false;
+    OVR::Matrix4f ViewProjection_[2];
+    OVR::Vector3f Eyes_[2];
+    OVR::Vector3f CurrentEyes_[2];
 };
 
 class ovrControllerCube {
@@ -234,6 +867,7 @@ class ovrControllerCube {
     void CreateCube(float size = 0.05f, const XrColor4f& color = {0.8f, 0.8f, 0.8f, 1.0f});
     void BindVAO() const;
     uint32_t IndexCount() const;
+    size_t IndexOffset() const;
     void Clear();
     void Destroy();
 
@@ -288,6 +922,11 @@ struct ovrScene {
     ovrProgram VolumeProgram;
     ovrProgram MeshProgram;
     ovrProgram WireframeProgram;
+    ovrProgram MergedMeshProgram;
+    ovrProgram MergedWireframeProgram;
+    // Wireframe of meshes with corner labels, from their triangles
+    ovrProgram BarycentricWireframeProgram;
+    ovrProgram MergedBarycentricWireframeProgram;
     float ClearColor[4];
     ovrProgram ControllerProgram;
     ovrControllerCube ControllerCube;
@@ -295,6 +934,7 @@ struct ovrScene {
     std::vector<ovrPlane> Planes;
     std::vector<ovrVolume> Volumes;
     std::vector<ovrMesh> Meshes;
+    ovrMergedOccluders MergedOccluders;
 };
 
 struct ovrAppRenderer {
@@ -322,6 +962,49 @@ struct ovrAppRenderer {
 
     void RenderFrame(const FrameIn& frameIn);
 
+    // Occluder meshes of the last RenderFrame: renderable ones tested against the view
+    // frustum, how many of them were culled and drawn, and how many of those were drawn
+    // at a coarser level of detail; then the same for the meshlets of the meshes that
+    // were not culled.
+    struct CullingStats {
+        uint32_t MeshesTested = 0;
+        uint32_t MeshesCulled = 0;
+        uint32_t MeshesDrawn = 0;
+        uint32_t MeshesCoarse = 0;
+        uint32_t MeshletsTested = 0;
+        uint32_t MeshletsCulled = 0;
+        uint32_t MeshletsDrawn = 0;
+        // Virtual objects tested against DepthPyramid, and those skipped as occluded
+        uint32_t ObjectsTested = 0;
+        uint32_t ObjectsOccluded = 0;
+    };
+
+    const CullingStats& LastCullingStats() const {
+        return CullingStats_;
+    }
+
+    // GL calls of the last RenderFrame's draws, and the redundant binds it skipped.
+    const ovrGlStateCache::Counters& LastDrawCounters() const {
+        return GlState_.FrameCounters();
+    }
+
     ovrFramebuffer Framebuffer;
     ovrScene Scene;
+    ovrDepthPyramid DepthPyramid;
+    // Also skip meshlets that face away from both eyes, and cull back faces in the
+    // occluder pass. A surface seen from behind, like a table top from below, then
+    // occludes nothing, whichever meshlets its triangles are in.
+    bool CullBackFacingMeshlets = true;
+
+   private:
+    // Tests the renderable meshes, then the meshlets of those in view, against both
+    // eyes' frusta. Fills MeshVisible_, VisibleMeshes_ and each mesh's VisibleMeshlets.
+    void CullMeshes(const FrameIn& frameIn, const OVR::Vector3f& viewPosition);
+
+    StereoFrustum Frustum_;
+    std::vector<uint8_t> MeshVisible_; // per scene mesh
+    std::vector<uint32_t> VisibleMeshes_; // unmerged ones, drawn from their own buffers
+    std::vector<uint32_t> TestedMeshes_; // Frustum_ box -> scene mesh
+    CullingStats CullingStats_;
+    ovrGlStateCache GlState_;
 };
\ No newline at end of file
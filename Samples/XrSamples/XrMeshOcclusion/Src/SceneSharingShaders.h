@@ -37,6 +37,72 @@ static const char VERTEX_SHADER[] = R"(
   }
 )";
 
+// Occluder meshes: positions are pushed out along vertexNormal by Expansion.x metres
+// plus Expansion.y metres per metre of distance from the eye. ExpansionScale.xyz maps
+// mesh space lengths to vertexPosition units (the inverse of the dequantization scale
+// in ModelMatrix). Meshes expanded on the CPU have no normal stream and get zero.
+// vertexCorner is the corner label of meshes with a barycentric wireframe.
+static const char OCCLUDER_VERTEX_SHADER[] = R"(
+  #define NUM_VIEWS 2
+  #define VIEW_ID gl_ViewID_OVR
+  #extension GL_OVR_multiview2 : require
+  layout(num_views=NUM_VIEWS) in;
+  in vec3 vertexPosition;
+  in vec3 vertexNormal;
+  in float vertexCorner;
+  uniform mat4 ModelMatrix;
+  uniform vec4 Expansion;
+  uniform vec4 ExpansionScale;
+  uniform SceneMatrices {
+  	uniform mat4 ViewMatrix[NUM_VIEWS];
+  	uniform mat4 ProjectionMatrix[NUM_VIEWS];
+  } sm;
+  out mediump vec3 fragmentBarycentric;
+  void main() {
+  	mat4 modelView = sm.ViewMatrix[VIEW_ID] * ModelMatrix;
+  	vec4 viewPosition = modelView * vec4(vertexPosition, 1.0);
+  	vec3 viewNormal = mat3(modelView) * (ExpansionScale.xyz * vertexNormal);
+  	viewPosition.xyz += viewNormal * (Expansion.x + Expansion.y * length(viewPosition.xyz));
+  	gl_Position = sm.ProjectionMatrix[VIEW_ID] * viewPosition;
+  	fragmentBarycentric = vec3(equal(vec3(vertexCorner), vec3(0.0, 1.0, 2.0)));
+  }
+)";
+
+// Occluder meshes merged into shared buffers (ovrMergedOccluders): the same as
+// OCCLUDER_VERTEX_SHADER, with the per-mesh values in a uniform block indexed by the
+// vertex's mesh slot. MAX_MESHES must match ovrMergedOccluders::kMaxPageMeshes.
+static const char MERGED_OCCLUDER_VERTEX_SHADER[] = R"(
+  #define NUM_VIEWS 2
+  #define VIEW_ID gl_ViewID_OVR
+  #define MAX_MESHES 128
+  #extension GL_OVR_multiview2 : require
+  layout(num_views=NUM_VIEWS) in;
+  in vec3 vertexPosition;
+  in vec3 vertexNormal;
+  in float vertexMeshSlot;
+  in float vertexCorner;
+  uniform SceneMatrices {
+  	uniform mat4 ViewMatrix[NUM_VIEWS];
+  	uniform mat4 ProjectionMatrix[NUM_VIEWS];
+  } sm;
+  uniform OccluderMeshes {
+  	uniform mat4 ModelMatrix[MAX_MESHES];
+  	uniform vec4 Expansion[MAX_MESHES];
+  	uniform vec4 ExpansionScale[MAX_MESHES];
+  } om;
+  out mediump vec3 fragmentBarycentric;
+  void main() {
+  	int slot = int(vertexMeshSlot);
+  	mat4 modelView = sm.ViewMatrix[VIEW_ID] * om.ModelMatrix[slot];
+  	vec4 viewPosition = modelView * vec4(vertexPosition, 1.0);
+  	vec3 viewNormal = mat3(modelView) * (om.ExpansionScale[slot].xyz * vertexNormal);
+  	vec4 expansion = om.Expansion[slot];
+  	viewPosition.xyz += viewNormal * (expansion.x + expansion.y * length(viewPosition.xyz));
+  	gl_Position = sm.ProjectionMatrix[VIEW_ID] * viewPosition;
+  	fragmentBarycentric = vec3(equal(vec3(vertexCorner), vec3(0.0, 1.0, 2.0)));
+  }
+)";
+
 static const char FRAGMENT_SHADER[] = R"(
   in lowp vec4 fragmentColor;
   out lowp vec4 outColor;
@@ -76,6 +142,20 @@ static const char WIREFRAME_FRAGMENT_SHADER[] = R"(
   }
 )";
 
+// Wireframe from the triangles of a mesh with corner labels: keeps the fragments within
+// about a pixel of an edge, where one of the barycentric coordinates is near zero.
+static const char BARYCENTRIC_WIREFRAME_FRAGMENT_SHADER[] = R"(
+  in mediump vec3 fragmentBarycentric;
+  out lowp vec4 outColor;
+  void main() {
+    mediump vec3 pixels = fragmentBarycentric / fwidth(fragmentBarycentric);
+    if (min(min(pixels.x, pixels.y), pixels.z) > 1.0) {
+      discard;
+    }
+    outColor = vec4(0.0, 1.0, 0.0, 0.5);
+  }
+)";
+
 static const char MESH_FRAGMENT_SHADER[] = R"(
   out lowp vec4 outColor;
   void main() {
@@ -109,4 +189,38 @@ static const char CUBE_FRAGMENT_SHADER[] = R"(
   void main() {
     outColor = CubeColor;
   }
-)";
\ No newline at end of file
+)";
+
+// Max-depth reduction for ovrDepthPyramid, drawn as one triangle covering the level
+// being written. Each texel is the farthest of the 2x2 texels under it in the source
+// level (base level of Texture0), or 3 wide on the last row or column of an odd size.
+static const char DEPTH_REDUCE_VERTEX_SHADER[] = R"(
+  #define NUM_VIEWS 2
+  #define VIEW_ID gl_ViewID_OVR
+  #extension GL_OVR_multiview2 : require
+  layout(num_views=NUM_VIEWS) in;
+  flat out int fragmentLayer;
+  void main() {
+    vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+    fragmentLayer = int(VIEW_ID);
+  }
+)";
+
+static const char DEPTH_REDUCE_FRAGMENT_SHADER[] = R"(
+  uniform highp sampler2DArray Texture0;
+  flat in int fragmentLayer;
+  out highp float outDepth;
+  void main() {
+    ivec2 last = textureSize(Texture0, 0).xy - 1;
+    ivec2 first = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 end = min(first + 1 + ivec2(equal(first + 2, last)), last);
+    highp float depth = 0.0;
+    for (int y = first.y; y <= end.y; ++y) {
+      for (int x = first.x; x <= end.x; ++x) {
+        depth = max(depth, texelFetch(Texture0, ivec3(x, y, fragmentLayer), 0).r);
+      }
+    }
+    outDepth = depth;
+  }
+)";
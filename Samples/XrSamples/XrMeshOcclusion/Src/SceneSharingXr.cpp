@@ -37,6 +37,7 @@ Authors   :
 #include <assert.h>
 #include <unordered_set>
 #include <optional>
+#include <algorithm>
 #if defined(ANDROID)
 #include <unistd.h>
 #include <pthread.h>
@@ -48,12 +49,17 @@ Authors   :
 #include <thread>
 #endif
 
+#include "AnchorLocator.h"
 #include "AnchorUtilities.h"
 #include "FileHandler.h"
+#include "MeshPipeline.h"
+#include "ProcessedMeshCache.h"
 #include "SceneSharingHelpers.h"
 #include "SceneSharingGl.h"
 #include "SceneSharingXr.h"
+#include "SceneTrace.h"
 #include "SimpleXrInput.h"
+#include "ThreadPool.h"
 
 #if defined(_WIN32)
 // Favor the high performance NVIDIA or AMD GPUs
@@ -446,6 +452,10 @@ struct ovrExtensionFunctionPointers {
     PFN_xrGetSpaceRoomLayoutFB xrGetSpaceRoomLayoutFB = nullptr;
     PFN_xrGetSpaceContainerFB xrGetSpaceContainerFB = nullptr;
     PFN_xrGetSpaceTriangleMeshMETA xrGetSpaceTriangleMeshMETA = nullptr;
+#if defined(XR_KHR_locate_spaces)
+    // Null unless the runtime has XR_KHR_locate_spaces
+    PFN_xrLocateSpacesKHR xrLocateSpacesKHR = nullptr;
+#endif
 #if defined(XR_USE_PLATFORM_ANDROID)
     PFN_xrRequestSceneCaptureFB xrRequestSceneCaptureFB = nullptr;
 #endif
@@ -499,6 +509,28 @@ struct ovrApp {
 
     std::unique_ptr<ExternalDataHandler> ExternalDataHandler = std::make_unique<FileHandler>();
 
+    // Worker threads for subdividing and expanding scene meshes.
+    std::unique_ptr<ThreadPool> MeshWorkers = std::make_unique<ThreadPool>();
+    ovrMeshProcessingSettings MeshProcessing;
+    // Processed meshes from earlier sessions, in the data directory, so the room's
+    // occluders show up before its meshes are fetched and processed again.
+    std::unique_ptr<ProcessedMeshCache> MeshCache;
+    // Fetches and processes scene meshes off the frame loop. Created once the extension
+    // functions are loaded.
+    std::unique_ptr<MeshPipeline> MeshLoader;
+    // Bytes of processed meshes uploaded per frame; a larger mesh takes a frame alone.
+    size_t MeshUploadBudget = 4 << 20;
+    // Poses of the planes, volumes and meshes in LocalSpace, located once per frame.
+    AnchorLocator Anchors;
+    // Display time of the most recent frame, used to locate the user when meshes are
+    // (re)built outside the frame loop. Zero before the first frame.
+    XrTime LastPredictedDisplayTime = 0;
+    // Records what the runtime reports about the room, and the user's poses, into a
+    // scene trace while open. Button Y starts and stops it.
+    SceneTraceWriter Recorder;
+    // Spaces whose record is in the trace
+    std::unordered_set<XrSpace> RecordedSpaces;
+
     enum class QueryType {
         None,
         QueryAll,
@@ -791,7 +823,11 @@ std::string GetSemanticLabels(ovrApp& app, const XrSpace space) {
     labels.buffer = labelData.data();
     OXR(app.FunPtrs.xrGetSpaceSemanticLabelsFB(app.Session, space, &labels));
 
-    return std::string(labels.buffer, labels.bufferCountOutput);
+    std::string result(labels.buffer, labels.bufferCountOutput);
+    if (app.Recorder.IsOpen()) {
+        app.Recorder.WriteSemanticLabels(app.LastPredictedDisplayTime, space, result);
+    }
+    return result;
 }
 
 bool UpdateOvrPlane(ovrApp& app, ovrPlane& plane) {
@@ -815,6 +851,9 @@ bool UpdateOvrPlane(ovrApp& app, ovrPlane& plane) {
             ALOGE("Failed getting bounding box 2D!");
             return false;
         }
+        if (app.Recorder.IsOpen()) {
+            app.Recorder.WriteBoundingBox2D(app.LastPredictedDisplayTime, plane.Space, boundingBox2D);
+        }
         plane.Update(boundingBox2D, color);
         return true;
     } else if (app.CurrentPlaneVisualizationMode == ovrApp::PlaneVisualizationMode::Boundary) {
@@ -837,6 +876,10 @@ bool UpdateOvrPlane(ovrApp& app, ovrPlane& plane) {
             ALOGE("Failed getting boundary 2D!");
             return false;
         }
+        if (app.Recorder.IsOpen()) {
+            app.Recorder.WriteBoundary2D(
+                app.LastPredictedDisplayTime, plane.Space, vertices.data(), boundary2D.vertexCountOutput);
+        }
         plane.Update(boundary2D, color);
         return true;
     }
@@ -852,57 +895,133 @@ bool UpdateOvrVolume(ovrApp& app, ovrVolume& volume) {
         ALOGE("Failed getting bounding box 3D!");
         return false;
     }
+    if (app.Recorder.IsOpen()) {
+        app.Recorder.WriteBoundingBox3D(app.LastPredictedDisplayTime, volume.Space, boundingBox3D);
+    }
     const auto labels = GetSemanticLabels(app, volume.Space);
 
     volume.Update(boundingBox3D, GetColorForSemanticLabels(labels));
     return true;
 }
 
-bool UpdateOvrMesh(ovrApp& app, ovrMesh& mesh) {
+// Runs on the mesh pipeline thread.
+bool FetchOvrMesh(
+    ovrApp& app,
+    XrSpace space,
+    std::vector<XrVector3f>& vertices,
+    std::vector<uint32_t>& indices) {
     XrResult res;
     const XrSpaceTriangleMeshGetInfoMETA getInfo = {XR_TYPE_SPACE_TRIANGLE_MESH_GET_INFO_META};
     XrSpaceTriangleMeshMETA triangleMesh = {XR_TYPE_SPACE_TRIANGLE_MESH_META};
     assert(app.FunPtrs.xrGetSpaceTriangleMeshMETA != nullptr);
     // First call
-    OXR(res = app.FunPtrs.xrGetSpaceTriangleMeshMETA(mesh.Space, &getInfo, &triangleMesh));
+    OXR(res = app.FunPtrs.xrGetSpaceTriangleMeshMETA(space, &getInfo, &triangleMesh));
     if (XR_FAILED(res)) {
         ALOGE("Failed getting triangle mesh!");
         return false;
     }
     // Second call
-    std::vector<XrVector3f> vertices(triangleMesh.vertexCountOutput);
-    std::vector<uint32_t> indices(triangleMesh.indexCountOutput);
+    vertices.resize(triangleMesh.vertexCountOutput);
+    indices.resize(triangleMesh.indexCountOutput);
     triangleMesh.vertexCapacityInput = vertices.size();
     triangleMesh.vertices = vertices.data();
     triangleMesh.indexCapacityInput = indices.size();
     triangleMesh.indices = indices.data();
-    OXR(res = app.FunPtrs.xrGetSpaceTriangleMeshMETA(mesh.Space, &getInfo, &triangleMesh));
+    OXR(res = app.FunPtrs.xrGetSpaceTriangleMeshMETA(space, &getInfo, &triangleMesh));
     if (XR_FAILED(res)) {
         ALOGE("Failed getting triangle mesh!");
         return false;
     }
-    mesh.Update(triangleMesh);
+    vertices.resize(triangleMesh.vertexCountOutput);
+    indices.resize(triangleMesh.indexCountOutput);
+    if (app.Recorder.IsOpen()) {
+        // No display time here; the replay serves the mesh from the start.
+        app.Recorder.WriteTriangleMesh(
+            0,
+            space,
+            vertices.data(),
+            static_cast<uint32_t>(vertices.size()),
+            indices.data(),
+            static_cast<uint32_t>(indices.size()));
+    }
     return true;
 }
 
+// Queues the mesh of space on the mesh pipeline; CommitSceneMeshes adds it to the scene,
+// or refreshes it there, once it is processed. previous is the mesh in the scene, if any.
+// A space that is not in the scene yet gets its mesh from an earlier session first, when
+// the cache has it.
+void SubmitOvrMesh(ovrApp& app, XrSpace space, const ovrMesh* previous) {
+    // Adaptive subdivision refines more near the user, so it needs the head in mesh space.
+    ovrMeshProcessingSettings settings = app.MeshProcessing;
+    if (app.LastPredictedDisplayTime != 0) {
+        XrResult res;
+        XrSpaceLocation headLocation = {XR_TYPE_SPACE_LOCATION};
+        OXR(res = xrLocateSpace(app.HeadSpace, space, app.LastPredictedDisplayTime, &headLocation));
+        if (XR_SUCCEEDED(res) && (headLocation.locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT)) {
+            settings.Adaptive.HasViewer = true;
+            settings.Adaptive.ViewerPosition = headLocation.pose.position;
+        }
+    }
+    XrUuidEXT uuid = {};
+    XrResult res;
+    OXR(res = app.FunPtrs.xrGetSpaceUuidFB(space, &uuid));
+    app.MeshLoader->Submit(
+        space,
+        settings,
+        previous != nullptr ? previous->Processed() : nullptr,
+        XR_SUCCEEDED(res) ? &uuid : nullptr);
+}
+
+// Writes the record of space to the scene trace, before those of its components, the
+// first time it is added while recording.
+void RecordSpace(ovrApp& app, XrSpace space) {
+    if (!app.Recorder.IsOpen() || !app.RecordedSpaces.insert(space).second) {
+        return;
+    }
+    static const XrSpaceComponentTypeFB kRecordedComponents[] = {
+        XR_SPACE_COMPONENT_TYPE_LOCATABLE_FB,
+        XR_SPACE_COMPONENT_TYPE_BOUNDED_2D_FB,
+        XR_SPACE_COMPONENT_TYPE_BOUNDED_3D_FB,
+        XR_SPACE_COMPONENT_TYPE_SEMANTIC_LABELS_FB,
+        XR_SPACE_COMPONENT_TYPE_ROOM_LAYOUT_FB,
+        XR_SPACE_COMPONENT_TYPE_SPACE_CONTAINER_FB,
+        XR_SPACE_COMPONENT_TYPE_TRIANGLE_MESH_META};
+    uint32_t components = 0;
+    for (const XrSpaceComponentTypeFB type : kRecordedComponents) {
+        if (app.IsComponentEnabled(space, type)) {
+            components |= SceneTraceComponentBit(type);
+        }
+    }
+    XrUuidEXT uuid = {};
+    OXR(app.FunPtrs.xrGetSpaceUuidFB(space, &uuid));
+    app.Recorder.WriteSpace(app.LastPredictedDisplayTime, space, uuid, components);
+}
+
 void AddSpaceToScene(ovrApp& app, XrSpace space) {
+    RecordSpace(app, space);
     if (app.IsComponentEnabled(space, XR_SPACE_COMPONENT_TYPE_BOUNDED_2D_FB)) {
         ovrPlane plane(space);
         if (UpdateOvrPlane(app, plane)) {
             app.AppRenderer.Scene.Planes.emplace_back(plane);
+            app.Anchors.Track(space);
         }
     }
     if (app.IsComponentEnabled(space, XR_SPACE_COMPONENT_TYPE_BOUNDED_3D_FB)) {
         ovrVolume volume(space);
         if (UpdateOvrVolume(app, volume)) {
             app.AppRenderer.Scene.Volumes.emplace_back(volume);
+            app.Anchors.Track(space);
         }
     }
     if (app.IsComponentEnabled(space, XR_SPACE_COMPONENT_TYPE_TRIANGLE_MESH_META)) {
-        ovrMesh mesh(space);
-        if (UpdateOvrMesh(app, mesh)) {
-            app.AppRenderer.Scene.Meshes.emplace_back(mesh);
-        }
+        // A space that is already in the scene is refreshed in place, so it can reuse
+        // the subdivision it built last time.
+        const auto& meshes = app.AppRenderer.Scene.Meshes;
+        auto existing = std::find_if(meshes.begin(), meshes.end(), [space](const ovrMesh& mesh) {
+            return mesh.Space == space;
+        });
+        SubmitOvrMesh(app, space, existing != meshes.end() ? &*existing : nullptr);
     }
 }
 
@@ -1035,6 +1154,8 @@ void ovrApp::HandleXrEvents() {
             case XR_TYPE_EVENT_DATA_REFERENCE_SPACE_CHANGE_PENDING:
                 ALOGV(
                     "xrPollEvent: received XR_TYPE_EVENT_DATA_REFERENCE_SPACE_CHANGE_PENDING event");
+                // The anchors move in LocalSpace once the change happens.
+                Anchors.Invalidate();
                 break;
             case XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED: {
                 const XrEventDataSessionStateChanged* session_state_changed_event =
@@ -1345,18 +1466,60 @@ void UpdateStageBounds(ovrApp& app) {
     app.StageBounds = OVR::Vector3f(stageBounds.width * 0.5f, 1.0f, stageBounds.height * 0.5f);
 }
 
-void UpdateScenePlanes(ovrApp& app, const XrFrameState& frameState) {
+// Locates the anchors of the scene's planes, volumes and meshes that are due this frame;
+// see AnchorLocator.
+void UpdateSceneAnchors(ovrApp& app, const XrFrameState& frameState) {
+    app.Anchors.Update(app.Session, app.LocalSpace, frameState.predictedDisplayTime);
+    if (app.Recorder.IsOpen()) {
+        for (const XrSpace space : app.Anchors.LocatedSpaces()) {
+            const AnchorLocator::Location* location = app.Anchors.Find(space);
+            if (location != nullptr && location->IsValid) {
+                app.Recorder.WriteSpacePose(
+                    frameState.predictedDisplayTime,
+                    space,
+                    location->Pose,
+                    XR_SPACE_LOCATION_ORIENTATION_VALID_BIT | XR_SPACE_LOCATION_POSITION_VALID_BIT);
+            }
+        }
+    }
+}
+
+// Starts recording the scene into a new trace in the app's data directory, or stops.
+// The room is loaded again when recording starts, so the trace has all of it.
+void ToggleSceneRecording(ovrApp& app) {
+    if (app.Recorder.IsOpen()) {
+        app.Recorder.Close();
+        const SceneTraceWriter::Stats stats = app.Recorder.GetStats();
+        ALOGV(
+            "Scene recording stopped: %llu records, %llu bytes, %llu dropped %s",
+            static_cast<unsigned long long>(stats.Records),
+            static_cast<unsigned long long>(stats.Bytes),
+            static_cast<unsigned long long>(stats.Dropped),
+            app.Recorder.Error().c_str());
+        return;
+    }
+    char filename[64];
+    snprintf(filename, sizeof(filename), "scene_%lld.xrtrace", static_cast<long long>(time(nullptr)));
+    const std::string path = app.ExternalDataHandler->GetDataDirectory() + filename;
+    if (!app.Recorder.Open(path)) {
+        ALOGE("Failed to start scene recording: %s", app.Recorder.Error().c_str());
+        return;
+    }
+    ALOGV("Recording the scene to %s", path.c_str());
+    app.RecordedSpaces.clear();
+    app.ClearScene = true;
+    app.NextQueryType = ovrApp::QueryType::QueryAllRoomLayoutEnabled;
+    app.QueryAllAnchorsInRoom = true;
+}
+
+void UpdateScenePlanes(ovrApp& app) {
     auto& scene = app.AppRenderer.Scene;
     for (auto& plane : scene.Planes) {
-        XrSpaceLocation spaceLocation = {XR_TYPE_SPACE_LOCATION};
-        XrResult res = XR_SUCCESS;
-        OXR(res = xrLocateSpace(
-                plane.Space, app.LocalSpace, frameState.predictedDisplayTime, &spaceLocation));
-        if (XR_FAILED(res)) {
-            ALOGE("Failed getting anchor pose!");
+        const AnchorLocator::Location* location = app.Anchors.Find(plane.Space);
+        if (location == nullptr || !location->IsValid) {
             continue;
         }
-        plane.SetPose(spaceLocation.pose);
+        plane.SetPose(location->Pose);
     }
 }
 
@@ -1436,35 +1599,50 @@ void CycleSceneVisualizationMode(ovrApp& app) {
                 }
 }
 
-void UpdateSceneVolumes(ovrApp& app, const XrFrameState& frameState) {
+void UpdateSceneVolumes(ovrApp& app) {
     auto& scene = app.AppRenderer.Scene;
 
     for (auto& volume : scene.Volumes) {
-        XrSpaceLocation spaceLocation = {XR_TYPE_SPACE_LOCATION};
-        XrResult res = XR_SUCCESS;
-        OXR(res = xrLocateSpace(
-                volume.Space, app.LocalSpace, frameState.predictedDisplayTime, &spaceLocation));
-        if (XR_FAILED(res)) {
-            ALOGE("Failed getting anchor pose!");
+        const AnchorLocator::Location* location = app.Anchors.Find(volume.Space);
+        if (location == nullptr || !location->IsValid) {
             continue;
         }
-        volume.SetPose(spaceLocation.pose);
+        volume.SetPose(location->Pose);
+    }
+}
+
+// Uploads the meshes the pipeline finished, within the frame's upload budget. New spaces
+// are added to the scene here, so each mesh appears as soon as it is ready.
+void CommitSceneMeshes(ovrApp& app) {
+    std::vector<MeshPipeline::Result> results;
+    const size_t taken = app.MeshLoader->TakeCompleted(app.MeshUploadBudget, results);
+    auto& scene = app.AppRenderer.Scene;
+    auto& meshes = scene.Meshes;
+    for (MeshPipeline::Result& result : results) {
+        auto existing = std::find_if(meshes.begin(), meshes.end(), [&result](const ovrMesh& mesh) {
+            return mesh.Space == result.Space;
+        });
+        if (existing == meshes.end()) {
+            meshes.emplace_back(result.Space);
+            existing = meshes.end() - 1;
+            app.Anchors.Track(result.Space);
+        }
+        existing->Commit(std::move(result.Mesh));
     }
+    // Merged meshes go up here too; repacking their pages takes what is left of the
+    // budget.
+    scene.MergedOccluders.Update(meshes, app.MeshUploadBudget - std::min(taken, app.MeshUploadBudget));
 }
 
-void UpdateSceneMeshes(ovrApp& app, const XrFrameState& frameState) {
+void UpdateSceneMeshes(ovrApp& app) {
     auto& scene = app.AppRenderer.Scene;
 
     for (auto& mesh : scene.Meshes) {
-        XrSpaceLocation spaceLocation = {XR_TYPE_SPACE_LOCATION};
-        XrResult res = XR_SUCCESS;
-        OXR(res = xrLocateSpace(
-                mesh.Space, app.LocalSpace, frameState.predictedDisplayTime, &spaceLocation));
-        if (XR_FAILED(res)) {
-            ALOGE("Failed getting anchor pose!");
+        const AnchorLocator::Location* location = app.Anchors.Find(mesh.Space);
+        if (location == nullptr || !location->IsValid) {
             continue;
         }
-        mesh.SetPose(spaceLocation.pose);
+        mesh.SetPose(location->Pose);
     }
 }
 
@@ -1569,6 +1747,12 @@ int main() {
     };
     const uint32_t numRequiredExtensions =
         sizeof(requiredExtensionNames) / sizeof(requiredExtensionNames[0]);
+    std::vector<const char*> enabledExtensionNames(
+        requiredExtensionNames, requiredExtensionNames + numRequiredExtensions);
+#if defined(XR_KHR_locate_spaces)
+    // Optional: locating all scene anchors with one call per frame
+    bool locateSpacesSupported = false;
+#endif
 
     // Check the list of required extensions against what is supported by the runtime.
     {
@@ -1599,6 +1783,17 @@ int main() {
                 exit(1);
             }
         }
+
+#if defined(XR_KHR_locate_spaces)
+        for (uint32_t j = 0; j < numOutputExtensions; j++) {
+            if (!strcmp(XR_KHR_LOCATE_SPACES_EXTENSION_NAME, extensionProperties[j].extensionName)) {
+                ALOGV("Found optional extension %s", XR_KHR_LOCATE_SPACES_EXTENSION_NAME);
+                enabledExtensionNames.push_back(XR_KHR_LOCATE_SPACES_EXTENSION_NAME);
+                locateSpacesSupported = true;
+                break;
+            }
+        }
+#endif
     }
 
     // Create the OpenXR instance.
@@ -1614,8 +1809,8 @@ int main() {
     instanceCreateInfo.applicationInfo = appInfo;
     instanceCreateInfo.enabledApiLayerCount = 0;
     instanceCreateInfo.enabledApiLayerNames = NULL;
-    instanceCreateInfo.enabledExtensionCount = numRequiredExtensions;
-    instanceCreateInfo.enabledExtensionNames = requiredExtensionNames;
+    instanceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensionNames.size());
+    instanceCreateInfo.enabledExtensionNames = enabledExtensionNames.data();
 
     XrResult initResult;
     OXR(initResult = xrCreateInstance(&instanceCreateInfo, &instance));
@@ -2034,11 +2229,29 @@ int main() {
         (PFN_xrVoidFunction*)(&app.FunPtrs.xrRequestSceneCaptureFB)));
 #endif
 
+#if defined(XR_KHR_locate_spaces)
+    if (locateSpacesSupported) {
+        OXR(xrGetInstanceProcAddr(
+            instance, "xrLocateSpacesKHR", (PFN_xrVoidFunction*)(&app.FunPtrs.xrLocateSpacesKHR)));
+        app.Anchors.SetLocateSpaces(app.FunPtrs.xrLocateSpacesKHR);
+    }
+#endif
+
+    app.MeshCache =
+        std::make_unique<ProcessedMeshCache>(app.ExternalDataHandler->GetDataDirectory() + "mesh_cache/");
+    app.MeshLoader = std::make_unique<MeshPipeline>(
+        [&app](XrSpace space, std::vector<XrVector3f>& vertices, std::vector<uint32_t>& indices) {
+            return FetchOvrMesh(app, space, vertices, indices);
+        },
+        app.MeshWorkers.get(),
+        app.MeshCache.get());
+
     // Create passthrough
     CreatePassthrough(app);
 
     // Two values for left and right controllers.
     std::array<XrTime, 2> lastInputTimes = {0, 0};
+    XrTime lastStatsLogTime = 0;
 #if defined(XR_USE_PLATFORM_ANDROID)
     while (androidApp->destroyRequested == 0)
 #else
@@ -2116,10 +2329,12 @@ int main() {
             app.AppRenderer.Scene.Volumes.clear();
 
             for (auto& mesh : app.AppRenderer.Scene.Meshes) {
-                mesh.Geometry.DestroyVAO();
-                mesh.Geometry.Destroy();
+                mesh.DestroyGeometry();
             }
             app.AppRenderer.Scene.Meshes.clear();
+            app.AppRenderer.Scene.MergedOccluders.Destroy();
+            app.MeshLoader->Cancel();
+            app.Anchors.Clear();
 
             app.ClearScene = false;
 
@@ -2182,6 +2397,10 @@ int main() {
         XrSpaceLocation loc = {XR_TYPE_SPACE_LOCATION};
         OXR(xrLocateSpace(app.HeadSpace, app.LocalSpace, frameState.predictedDisplayTime, &loc));
         XrPosef xfLocalFromHead = loc.pose;
+        app.LastPredictedDisplayTime = frameState.predictedDisplayTime;
+        if (app.Recorder.IsOpen()) {
+            app.Recorder.WriteHeadPose(frameState.predictedDisplayTime, loc.pose, loc.locationFlags);
+        }
 
         XrViewState viewState = {XR_TYPE_VIEW_STATE};
 
@@ -2201,11 +2420,15 @@ int main() {
             &projectionCountOutput,
             projections));
 
-        UpdateScenePlanes(app, frameState);
+        CommitSceneMeshes(app);
+
+        UpdateSceneAnchors(app, frameState);
 
-        UpdateSceneVolumes(app, frameState);
+        UpdateScenePlanes(app);
 
-        UpdateSceneMeshes(app, frameState);
+        UpdateSceneVolumes(app);
+
+        UpdateSceneMeshes(app);
 
         assert(input != nullptr);
         // A Button: Refresh all by querying room entity that has room layout component enabled.
@@ -2230,6 +2453,12 @@ int main() {
             lastInputTimes[0] = frameState.predictedDisplayTime;
         }
 
+        // Y Button: Start or stop recording the scene into a scene trace.
+        if (input->IsButtonYPressed()) {
+            ToggleSceneRecording(app);
+            lastInputTimes[0] = frameState.predictedDisplayTime;
+        }
+
         // X Button: Refresh anchors by querying group in the file.
         //if (input->IsButtonXPressed()) {
         //    app.ClearScene = true;
@@ -2314,12 +2543,20 @@ int main() {
             // for 0.1 second to give the user a sense of feedback.
             frameIn.RenderController[controllerIndex] =
                 frameState.predictedDisplayTime > lastInputTimes[controllerIndex] + 100000000;
-            if (frameIn.RenderController[controllerIndex]) {
-                frameIn.ControllerPoses[controllerIndex] = input->FromControllerSpace(
+            if (frameIn.RenderController[controllerIndex] || app.Recorder.IsOpen()) {
+                const OVR::Posef controllerPose = input->FromControllerSpace(
                     controllerIndex == 0 ? SimpleXrInput::Side_Left : SimpleXrInput::Side_Right,
                     SimpleXrInput::Controller_Aim,
                     app.LocalSpace,
                     frameState.predictedDisplayTime);
+                frameIn.ControllerPoses[controllerIndex] = controllerPose;
+                if (app.Recorder.IsOpen()) {
+                    app.Recorder.WriteControllerPose(
+                        frameState.predictedDisplayTime,
+                        controllerIndex,
+                        ToXrPosef(controllerPose),
+                        XR_SPACE_LOCATION_ORIENTATION_VALID_BIT | XR_SPACE_LOCATION_POSITION_VALID_BIT);
+                }
             }
         }
 
@@ -2340,6 +2577,37 @@ int main() {
 
         app.AppRenderer.RenderFrame(frameIn);
 
+        // Once a second, what culling left of the scene in the frame just rendered and the
+        // GL calls it took to draw that
+        if (frameState.predictedDisplayTime >= lastStatsLogTime + 1000000000) {
+            lastStatsLogTime = frameState.predictedDisplayTime;
+            const ovrAppRenderer::CullingStats& culling = app.AppRenderer.LastCullingStats();
+            ALOGV(
+                "Culling: meshes %u tested, %u culled, %u drawn (%u coarse); meshlets %u tested, %u culled, "
+                "%u drawn; objects %u tested, %u occluded",
+                culling.MeshesTested,
+                culling.MeshesCulled,
+                culling.MeshesDrawn,
+                culling.MeshesCoarse,
+                culling.MeshletsTested,
+                culling.MeshletsCulled,
+                culling.MeshletsDrawn,
+                culling.ObjectsTested,
+                culling.ObjectsOccluded);
+            const ovrGlStateCache::Counters& calls = app.AppRenderer.LastDrawCounters();
+            ALOGV(
+                "Draw calls: %u draws of %u elements; binds %u program, %u vertex array, %u buffer, %u texture; "
+                "%u uniform updates, %u redundant binds skipped",
+                calls.Draws,
+                calls.Elements,
+                calls.ProgramBinds,
+                calls.VertexArrayBinds,
+                calls.BufferBinds,
+                calls.TextureBinds,
+                calls.UniformUpdates,
+                calls.SkippedBinds);
+        }
+
         XrSwapchainImageReleaseInfo releaseInfo = {XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO, NULL};
         OXR(xrReleaseSwapchainImage(app.ColorSwapChain, &releaseInfo));
 
@@ -2404,6 +2672,11 @@ int main() {
 
     delete input;
 
+    // Stops the pipeline thread before the session and its spaces go away.
+    app.MeshLoader.reset();
+    // Finishes the trace of a recording still running.
+    app.Recorder.Close();
+
     app.AppRenderer.Destroy();
 
     // Destroy passthrough
@@ -0,0 +1,529 @@
+#include "SceneTrace.h"
+
+#include <cstring>
+
+namespace {
+
+size_t PaddedSize(size_t size) {
+    return (size + kSceneTraceAlignment - 1) & ~(kSceneTraceAlignment - 1);
+}
+
+const std::vector<uint32_t> kNoRecords;
+
+} // namespace
+
+uint32_t SceneTraceComponentBit(XrSpaceComponentTypeFB type) {
+    switch (type) {
+        case XR_SPACE_COMPONENT_TYPE_LOCATABLE_FB:
+            return SCENE_TRACE_COMPONENT_LOCATABLE;
+        case XR_SPACE_COMPONENT_TYPE_BOUNDED_2D_FB:
+            return SCENE_TRACE_COMPONENT_BOUNDED_2D;
+        case XR_SPACE_COMPONENT_TYPE_BOUNDED_3D_FB:
+            return SCENE_TRACE_COMPONENT_BOUNDED_3D;
+        case XR_SPACE_COMPONENT_TYPE_SEMANTIC_LABELS_FB:
+            return SCENE_TRACE_COMPONENT_SEMANTIC_LABELS;
+        case XR_SPACE_COMPONENT_TYPE_ROOM_LAYOUT_FB:
+            return SCENE_TRACE_COMPONENT_ROOM_LAYOUT;
+        case XR_SPACE_COMPONENT_TYPE_SPACE_CONTAINER_FB:
+            return SCENE_TRACE_COMPONENT_SPACE_CONTAINER;
+        case XR_SPACE_COMPONENT_TYPE_TRIANGLE_MESH_META:
+            return SCENE_TRACE_COMPONENT_TRIANGLE_MESH;
+        default:
+            return 0;
+    }
+}
+
+SceneTraceReader::~SceneTraceReader() {
+    Close();
+}
+
+bool SceneTraceReader::Open(const std::string& path) {
+    Close();
+
+    if (!File_.Open(path)) {
+        Error_ = File_.Error();
+        return false;
+    }
+    Data_ = File_.Data();
+    Size_ = File_.Size();
+
+    SceneTraceHeader header;
+    if (Size_ < sizeof(header)) {
+        Close();
+        Error_ = path + " is not a scene trace";
+        return false;
+    }
+    std::memcpy(&header, Data_, sizeof(header));
+    if (std::memcmp(header.Magic, kSceneTraceMagic, sizeof(header.Magic)) != 0) {
+        Close();
+        Error_ = path + " is not a scene trace";
+        return false;
+    }
+    if (header.Version != kSceneTraceVersion) {
+        Close();
+        Error_ = path + " has unsupported version " + std::to_string(header.Version);
+        return false;
+    }
+
+    if (!ReadIndex()) {
+        WalkRecords();
+    }
+    for (size_t i = 0; i < Records_.size(); ++i) {
+        const size_t type = static_cast<size_t>(Records_[i].Type);
+        if (type >= ByType_.size()) {
+            ByType_.resize(type + 1);
+        }
+        ByType_[type].push_back(static_cast<uint32_t>(i));
+    }
+    return true;
+}
+
+void SceneTraceReader::Close() {
+    File_.Close();
+    Data_ = nullptr;
+    Size_ = 0;
+    Records_.clear();
+    ByType_.clear();
+    Error_.clear();
+}
+
+// Reads the index that the footer points at; false when there is none or it does not
+// describe records inside the file.
+bool SceneTraceReader::ReadIndex() {
+    if (Size_ < sizeof(SceneTraceHeader) + sizeof(SceneTraceFooter)) {
+        return false;
+    }
+    SceneTraceFooter footer;
+    std::memcpy(&footer, Data_ + Size_ - sizeof(footer), sizeof(footer));
+    if (std::memcmp(footer.Magic, kSceneTraceIndexMagic, sizeof(footer.Magic)) != 0) {
+        return false;
+    }
+    const size_t indexEnd = Size_ - sizeof(footer);
+    if (footer.IndexOffset < sizeof(SceneTraceHeader) || footer.IndexOffset > indexEnd ||
+        footer.IndexCount > (indexEnd - footer.IndexOffset) / sizeof(SceneTraceIndexEntry)) {
+        return false;
+    }
+
+    Records_.resize(static_cast<size_t>(footer.IndexCount));
+    std::memcpy(
+        Records_.data(),
+        Data_ + footer.IndexOffset,
+        Records_.size() * sizeof(SceneTraceIndexEntry));
+    for (const SceneTraceIndexEntry& entry : Records_) {
+        if (entry.Offset < sizeof(SceneTraceHeader) ||
+            entry.Offset + sizeof(SceneTraceRecordHeader) > footer.IndexOffset ||
+            entry.Size > footer.IndexOffset - entry.Offset - sizeof(SceneTraceRecordHeader)) {
+            Records_.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Finds the records of a trace without an index, stopping at the first one that does
+// not fit in the file, which is where its writer was stopped.
+void SceneTraceReader::WalkRecords() {
+    Records_.clear();
+    size_t offset = sizeof(SceneTraceHeader);
+    while (Size_ - offset >= sizeof(SceneTraceRecordHeader)) {
+        SceneTraceRecordHeader header;
+        std::memcpy(&header, Data_ + offset, sizeof(header));
+        const size_t payload = offset + sizeof(header);
+        if (header.Size > Size_ - payload) {
+            break;
+        }
+        Records_.push_back({offset, header.Type, header.Size, header.Time, header.Space});
+        offset = payload + PaddedSize(header.Size);
+        if (offset > Size_) {
+            break;
+        }
+    }
+}
+
+SceneTraceReader::Record SceneTraceReader::GetRecord(size_t index) const {
+    const SceneTraceIndexEntry& entry = Records_[index];
+    return {
+        entry.Type,
+        entry.Size,
+        entry.Time,
+        entry.Space,
+        Data_ + entry.Offset + sizeof(SceneTraceRecordHeader)};
+}
+
+const std::vector<uint32_t>& SceneTraceReader::RecordsOfType(SceneTraceRecordType type) const {
+    const size_t index = static_cast<size_t>(type);
+    return index < ByType_.size() ? ByType_[index] : kNoRecords;
+}
+
+bool SceneTraceReader::ReadSpace(const Record& record, SceneTraceSpace& space) {
+    if (record.Type != SceneTraceRecordType::Space || record.Size < sizeof(space)) {
+        return false;
+    }
+    std::memcpy(&space, record.Data, sizeof(space));
+    return true;
+}
+
+bool SceneTraceReader::ReadTriangleMesh(const Record& record, TriangleMesh& mesh) {
+    SceneTraceTriangleMesh header;
+    if (record.Type != SceneTraceRecordType::TriangleMesh || record.Size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, record.Data, sizeof(header));
+    const uint64_t size = sizeof(header) + uint64_t(header.VertexCount) * sizeof(XrVector3f) +
+        uint64_t(header.IndexCount) * sizeof(uint32_t);
+    if (size > record.Size) {
+        return false;
+    }
+    mesh.Vertices = reinterpret_cast<const XrVector3f*>(record.Data + sizeof(header));
+    mesh.VertexCount = header.VertexCount;
+    mesh.Indices = reinterpret_cast<const uint32_t*>(mesh.Vertices + header.VertexCount);
+    mesh.IndexCount = header.IndexCount;
+    return true;
+}
+
+bool SceneTraceReader::ReadBoundary2D(const Record& record, Boundary2D& boundary) {
+    SceneTraceBoundary2D header;
+    if (record.Type != SceneTraceRecordType::Boundary2D || record.Size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, record.Data, sizeof(header));
+    if (sizeof(header) + uint64_t(header.VertexCount) * sizeof(XrVector2f) > record.Size) {
+        return false;
+    }
+    boundary.Vertices = reinterpret_cast<const XrVector2f*>(record.Data + sizeof(header));
+    boundary.VertexCount = header.VertexCount;
+    return true;
+}
+
+bool SceneTraceReader::ReadSemanticLabels(const Record& record, std::string& labels) {
+    SceneTraceSemanticLabels header;
+    if (record.Type != SceneTraceRecordType::SemanticLabels || record.Size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, record.Data, sizeof(header));
+    if (sizeof(header) + uint64_t(header.Length) > record.Size) {
+        return false;
+    }
+    labels.assign(reinterpret_cast<const char*>(record.Data + sizeof(header)), header.Length);
+    return true;
+}
+
+bool SceneTraceReader::ReadPose(const Record& record, SceneTracePose& pose) {
+    if ((record.Type != SceneTraceRecordType::SpacePose &&
+         record.Type != SceneTraceRecordType::HeadPose &&
+         record.Type != SceneTraceRecordType::ControllerPose) ||
+        record.Size < sizeof(pose)) {
+        return false;
+    }
+    std::memcpy(&pose, record.Data, sizeof(pose));
+    return true;
+}
+
+bool SceneTraceReader::ReadDepthFrame(const Record& record, DepthFrame& frame) {
+    if (record.Type != SceneTraceRecordType::DepthFrame ||
+        record.Size < sizeof(SceneTraceDepthFrame)) {
+        return false;
+    }
+    frame.Frame = reinterpret_cast<const SceneTraceDepthFrame*>(record.Data);
+    const uint64_t texels = 2 * uint64_t(frame.Frame->Width) * frame.Frame->Height;
+    if (sizeof(SceneTraceDepthFrame) + texels * sizeof(uint16_t) > record.Size) {
+        return false;
+    }
+    frame.Texels = reinterpret_cast<const uint16_t*>(record.Data + sizeof(SceneTraceDepthFrame));
+    return true;
+}
+
+namespace {
+
+uint64_t SpaceId(XrSpace space) {
+    return (uint64_t)space;
+}
+
+SceneTracePose MakePose(const XrPosef& pose, XrSpaceLocationFlags flags) {
+    SceneTracePose tracePose = {};
+    tracePose.Pose = pose;
+    tracePose.LocationFlags = flags;
+    return tracePose;
+}
+
+} // namespace
+
+SceneTraceWriter::SceneTraceWriter(size_t bufferBytes) : BufferBytes_(bufferBytes) {}
+
+SceneTraceWriter::~SceneTraceWriter() {
+    Close();
+}
+
+bool SceneTraceWriter::Open(const std::string& path) {
+    Close();
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        Error_ = "cannot create " + path;
+        return false;
+    }
+    // Records are small and many; write them to the file in larger pieces.
+    std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    SceneTraceHeader header = {};
+    std::memcpy(header.Magic, kSceneTraceMagic, sizeof(header.Magic));
+    header.Version = kSceneTraceVersion;
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+        std::fclose(file);
+        std::lock_guard<std::mutex> lock(Mutex_);
+        Error_ = "cannot write " + path;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        File_ = file;
+        Stopping_ = false;
+        Failed_ = false;
+        Error_.clear();
+        Stats_ = Stats();
+    }
+    Index_.clear();
+    FileOffset_ = sizeof(header);
+    Thread_ = std::thread(&SceneTraceWriter::ThreadMain, this);
+    return true;
+}
+
+void SceneTraceWriter::Close() {
+    if (!Thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        Stopping_ = true;
+    }
+    RecordAvailable_.notify_one();
+    Thread_.join();
+
+    std::lock_guard<std::mutex> lock(Mutex_);
+    if (!Failed_) {
+        SceneTraceFooter footer = {};
+        footer.IndexOffset = FileOffset_;
+        footer.IndexCount = Index_.size();
+        std::memcpy(footer.Magic, kSceneTraceIndexMagic, sizeof(footer.Magic));
+        if (std::fwrite(Index_.data(), sizeof(SceneTraceIndexEntry), Index_.size(), File_) !=
+                Index_.size() ||
+            std::fwrite(&footer, sizeof(footer), 1, File_) != 1) {
+            Error_ = "cannot write the index";
+        }
+    }
+    if (std::fclose(File_) != 0 && Error_.empty()) {
+        Error_ = "cannot write the trace";
+    }
+    File_ = nullptr;
+    Queue_.clear();
+    QueuedBytes_ = 0;
+    Index_.clear();
+}
+
+bool SceneTraceWriter::IsOpen() const {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    return File_ != nullptr;
+}
+
+std::string SceneTraceWriter::Error() const {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    return Error_;
+}
+
+SceneTraceWriter::Stats SceneTraceWriter::GetStats() const {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    return Stats_;
+}
+
+void SceneTraceWriter::WriteSpace(
+    XrTime time,
+    XrSpace space,
+    const XrUuidEXT& uuid,
+    uint32_t components) {
+    SceneTraceSpace traceSpace = {};
+    traceSpace.Uuid = uuid;
+    traceSpace.Components = components;
+    Append(SceneTraceRecordType::Space, time, SpaceId(space), {{&traceSpace, sizeof(traceSpace)}}, false);
+}
+
+void SceneTraceWriter::WriteTriangleMesh(
+    XrTime time,
+    XrSpace space,
+    const XrVector3f* vertices,
+    uint32_t vertexCount,
+    const uint32_t* indices,
+    uint32_t indexCount) {
+    const SceneTraceTriangleMesh header = {vertexCount, indexCount};
+    Append(
+        SceneTraceRecordType::TriangleMesh,
+        time,
+        SpaceId(space),
+        {{&header, sizeof(header)},
+         {vertices, vertexCount * sizeof(XrVector3f)},
+         {indices, indexCount * sizeof(uint32_t)}},
+        false);
+}
+
+void SceneTraceWriter::WriteBoundary2D(
+    XrTime time,
+    XrSpace space,
+    const XrVector2f* vertices,
+    uint32_t vertexCount) {
+    const SceneTraceBoundary2D header = {vertexCount, 0};
+    Append(
+        SceneTraceRecordType::Boundary2D,
+        time,
+        SpaceId(space),
+        {{&header, sizeof(header)}, {vertices, vertexCount * sizeof(XrVector2f)}},
+        false);
+}
+
+void SceneTraceWriter::WriteBoundingBox2D(XrTime time, XrSpace space, const XrRect2Df& boundingBox) {
+    Append(
+        SceneTraceRecordType::BoundingBox2D, time, SpaceId(space), {{&boundingBox, sizeof(boundingBox)}}, false);
+}
+
+void SceneTraceWriter::WriteBoundingBox3D(XrTime time, XrSpace space, const XrRect3DfFB& boundingBox) {
+    Append(
+        SceneTraceRecordType::BoundingBox3D, time, SpaceId(space), {{&boundingBox, sizeof(boundingBox)}}, false);
+}
+
+void SceneTraceWriter::WriteSemanticLabels(XrTime time, XrSpace space, const std::string& labels) {
+    const SceneTraceSemanticLabels header = {static_cast<uint32_t>(labels.size()), 0};
+    Append(
+        SceneTraceRecordType::SemanticLabels,
+        time,
+        SpaceId(space),
+        {{&header, sizeof(header)}, {labels.data(), labels.size()}},
+        false);
+}
+
+void SceneTraceWriter::WriteSpacePose(
+    XrTime time,
+    XrSpace space,
+    const XrPosef& pose,
+    XrSpaceLocationFlags flags) {
+    const SceneTracePose tracePose = MakePose(pose, flags);
+    Append(SceneTraceRecordType::SpacePose, time, SpaceId(space), {{&tracePose, sizeof(tracePose)}}, true);
+}
+
+void SceneTraceWriter::WriteHeadPose(XrTime time, const XrPosef& pose, XrSpaceLocationFlags flags) {
+    const SceneTracePose tracePose = MakePose(pose, flags);
+    Append(SceneTraceRecordType::HeadPose, time, 0, {{&tracePose, sizeof(tracePose)}}, true);
+}
+
+void SceneTraceWriter::WriteControllerPose(
+    XrTime time,
+    int hand,
+    const XrPosef& pose,
+    XrSpaceLocationFlags flags) {
+    const SceneTracePose tracePose = MakePose(pose, flags);
+    Append(
+        SceneTraceRecordType::ControllerPose,
+        time,
+        static_cast<uint64_t>(hand),
+        {{&tracePose, sizeof(tracePose)}},
+        true);
+}
+
+void SceneTraceWriter::WriteDepthFrame(
+    XrTime time,
+    const SceneTraceDepthFrame& frame,
+    const uint16_t* texels) {
+    const size_t texelCount = size_t(2) * frame.Width * frame.Height;
+    Append(
+        SceneTraceRecordType::DepthFrame,
+        time,
+        0,
+        {{&frame, sizeof(frame)}, {texels, texelCount * sizeof(uint16_t)}},
+        true);
+}
+
+void SceneTraceWriter::Append(
+    SceneTraceRecordType type,
+    XrTime time,
+    uint64_t space,
+    std::initializer_list<Part> parts,
+    bool droppable) {
+    size_t payloadSize = 0;
+    for (const Part& part : parts) {
+        payloadSize += part.Size;
+    }
+    const size_t recordSize = sizeof(SceneTraceRecordHeader) + PaddedSize(payloadSize);
+    {
+        // Checked before copying, so a dropped depth frame costs nothing.
+        std::lock_guard<std::mutex> lock(Mutex_);
+        if (File_ == nullptr || Failed_ || payloadSize > UINT32_MAX) {
+            return;
+        }
+        if (droppable && QueuedBytes_ + recordSize > BufferBytes_) {
+            Stats_.Dropped++;
+            return;
+        }
+    }
+
+    std::vector<uint8_t> record(recordSize, 0);
+    SceneTraceRecordHeader header = {};
+    header.Type = type;
+    header.Size = static_cast<uint32_t>(payloadSize);
+    header.Time = time;
+    header.Space = space;
+    std::memcpy(record.data(), &header, sizeof(header));
+    size_t offset = sizeof(header);
+    for (const Part& part : parts) {
+        if (part.Size > 0) {
+            std::memcpy(record.data() + offset, part.Data, part.Size);
+        }
+        offset += part.Size;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        if (File_ == nullptr || Stopping_) {
+            return;
+        }
+        if (droppable) {
+            QueuedBytes_ += record.size();
+        }
+        Queue_.push_back({std::move(record), droppable});
+    }
+    RecordAvailable_.notify_one();
+}
+
+void SceneTraceWriter::ThreadMain() {
+    std::unique_lock<std::mutex> lock(Mutex_);
+    for (;;) {
+        RecordAvailable_.wait(lock, [this] { return Stopping_ || !Queue_.empty(); });
+        if (Queue_.empty()) {
+            return; // stopping, with everything written
+        }
+        Encoded encoded = std::move(Queue_.front());
+        Queue_.pop_front();
+        const std::vector<uint8_t>& record = encoded.Bytes;
+        const size_t queuedBytes = encoded.Droppable ? record.size() : 0;
+        if (Failed_) {
+            QueuedBytes_ -= queuedBytes;
+            continue;
+        }
+
+        // The file is only written here, so it can be written without the lock.
+        lock.unlock();
+        const bool written = std::fwrite(record.data(), 1, record.size(), File_) == record.size();
+        if (written) {
+            SceneTraceRecordHeader header;
+            std::memcpy(&header, record.data(), sizeof(header));
+            Index_.push_back({FileOffset_, header.Type, header.Size, header.Time, header.Space});
+            FileOffset_ += record.size();
+        }
+        lock.lock();
+
+        QueuedBytes_ -= queuedBytes;
+        if (written) {
+            Stats_.Records++;
+            Stats_.Bytes += record.size();
+        } else {
+            Failed_ = true;
+            Error_ = "cannot write the trace";
+        }
+    }
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <openxr/openxr.h>
+
+#include "MappedFile.h"
+
+// A scene trace: what the runtime reported about a room and the user in it during a
+// session, recorded by SceneTraceWriter, for replaying it off the headset (the
+// benchmark's ReplayRuntime).
+//
+// The file is a header, a sequence of records and an index of them, and is read in
+// place from a memory mapping:
+//
+//   SceneTraceHeader
+//   SceneTraceRecordHeader, payload, padding to 8 bytes    (repeated)
+//   SceneTraceIndexEntry[IndexCount]
+//   SceneTraceFooter
+//
+// Every record carries the time it describes and the space it belongs to, as the
+// recorded XrSpace handle value (0 for none). Payloads are the POD structs below,
+// followed by their arrays. A file whose writer did not finish has no index or footer;
+// the reader then finds the records by walking them from the header. All values are
+// little endian, which every platform the sample runs on is.
+enum class SceneTraceRecordType : uint32_t {
+    Space = 1, // SceneTraceSpace: one per space, before its other records
+    TriangleMesh = 2, // SceneTraceTriangleMesh, XrVector3f[VertexCount], uint32_t[IndexCount]
+    Boundary2D = 3, // SceneTraceBoundary2D, XrVector2f[VertexCount]
+    BoundingBox2D = 4, // XrRect2Df
+    BoundingBox3D = 5, // XrRect3DfFB
+    SemanticLabels = 6, // SceneTraceSemanticLabels, char[Length], not null terminated
+    SpacePose = 7, // SceneTracePose of an anchor in the recording's local space
+    HeadPose = 8, // SceneTracePose in the local space, space 0
+    ControllerPose = 9, // SceneTracePose in the local space, space is the hand, 0 or 1
+    DepthFrame = 10, // SceneTraceDepthFrame, uint16_t[2][Height][Width]
+};
+
+struct SceneTraceHeader {
+    char Magic[8]; // kSceneTraceMagic
+    uint32_t Version;
+    uint32_t Flags;
+};
+
+struct SceneTraceRecordHeader {
+    SceneTraceRecordType Type;
+    uint32_t Size; // of the payload, without padding
+    int64_t Time; // XrTime
+    uint64_t Space;
+};
+
+struct SceneTraceIndexEntry {
+    uint64_t Offset; // of the record header, from the start of the file
+    SceneTraceRecordType Type;
+    uint32_t Size;
+    int64_t Time;
+    uint64_t Space;
+};
+
+struct SceneTraceFooter {
+    uint64_t IndexOffset;
+    uint64_t IndexCount;
+    char Magic[8]; // kSceneTraceIndexMagic
+};
+
+// Component bits of SceneTraceSpace::Components
+enum SceneTraceComponent : uint32_t {
+    SCENE_TRACE_COMPONENT_LOCATABLE = 1 << 0,
+    SCENE_TRACE_COMPONENT_BOUNDED_2D = 1 << 1,
+    SCENE_TRACE_COMPONENT_BOUNDED_3D = 1 << 2,
+    SCENE_TRACE_COMPONENT_SEMANTIC_LABELS = 1 << 3,
+    SCENE_TRACE_COMPONENT_ROOM_LAYOUT = 1 << 4,
+    SCENE_TRACE_COMPONENT_SPACE_CONTAINER = 1 << 5,
+    SCENE_TRACE_COMPONENT_TRIANGLE_MESH = 1 << 6,
+};
+
+// The SceneTraceComponent bit of type, or 0 for a component a trace does not record.
+uint32_t SceneTraceComponentBit(XrSpaceComponentTypeFB type);
+
+struct SceneTraceSpace {
+    XrUuidEXT Uuid;
+    uint32_t Components; // enabled SceneTraceComponent bits
+    uint32_t Reserved;
+};
+
+struct SceneTraceTriangleMesh {
+    uint32_t VertexCount;
+    uint32_t IndexCount;
+};
+
+struct SceneTraceBoundary2D {
+    uint32_t VertexCount;
+    uint32_t Reserved;
+};
+
+struct SceneTraceSemanticLabels {
+    uint32_t Length;
+    uint32_t Reserved;
+};
+
+struct SceneTracePose {
+    XrPosef Pose;
+    uint64_t LocationFlags; // XrSpaceLocationFlags
+};
+
+// An environment depth image as acquired, with the texels of both views. Depth is
+// normalized to [0, 1] between NearZ and FarZ like the runtime's D16 swapchain, with
+// FarZ infinite when it is +inf.
+struct SceneTraceDepthFrame {
+    uint32_t Width;
+    uint32_t Height;
+    float NearZ;
+    float FarZ;
+    XrPosef ViewPoses[2]; // in the recording's local space
+    XrFovf ViewFovs[2];
+};
+
+constexpr char kSceneTraceMagic[8] = {'X', 'R', 'S', 'C', 'E', 'N', 'E', 'T'};
+constexpr char kSceneTraceIndexMagic[8] = {'X', 'R', 'S', 'T', 'I', 'N', 'D', 'X'};
+constexpr uint32_t kSceneTraceVersion = 1;
+constexpr size_t kSceneTraceAlignment = 8;
+
+// Read-only view of a scene trace file. Record payloads point into the mapping and stay
+// valid until Close.
+class SceneTraceReader {
+public:
+    struct Record {
+        SceneTraceRecordType Type;
+        uint32_t Size;
+        int64_t Time;
+        uint64_t Space;
+        const uint8_t* Data; // payload
+    };
+
+    // Typed views of payloads; the pointers are into the mapping.
+    struct TriangleMesh {
+        const XrVector3f* Vertices;
+        uint32_t VertexCount;
+        const uint32_t* Indices;
+        uint32_t IndexCount;
+    };
+
+    struct Boundary2D {
+        const XrVector2f* Vertices;
+        uint32_t VertexCount;
+    };
+
+    struct DepthFrame {
+        const SceneTraceDepthFrame* Frame;
+        const uint16_t* Texels; // view 0, then view 1
+    };
+
+    SceneTraceReader() = default;
+    ~SceneTraceReader();
+
+    SceneTraceReader(const SceneTraceReader&) = delete;
+    SceneTraceReader& operator=(const SceneTraceReader&) = delete;
+
+    // Maps path and reads its index, or walks its records when it has none. Returns
+    // false, with Error() set, when the file is not a scene trace or is damaged before
+    // its first record; a damaged tail is dropped.
+    bool Open(const std::string& path);
+    void Close();
+
+    const std::string& Error() const {
+        return Error_;
+    }
+
+    // Records in file order, which is the order they were written in.
+    size_t RecordCount() const {
+        return Records_.size();
+    }
+    Record GetRecord(size_t index) const;
+
+    // Indices of the records of type, in file order.
+    const std::vector<uint32_t>& RecordsOfType(SceneTraceRecordType type) const;
+
+    // Each returns false when record is not of its type or is too short.
+    static bool ReadSpace(const Record& record, SceneTraceSpace& space);
+    static bool ReadTriangleMesh(const Record& record, TriangleMesh& mesh);
+    static bool ReadBoundary2D(const Record& record, Boundary2D& boundary);
+    static bool ReadSemanticLabels(const Record& record, std::string& labels);
+    static bool ReadPose(const Record& record, SceneTracePose& pose);
+    static bool ReadDepthFrame(const Record& record, DepthFrame& frame);
+
+private:
+    bool ReadIndex();
+    void WalkRecords();
+
+    MappedFile File_;
+    const uint8_t* Data_ = nullptr;
+    size_t Size_ = 0;
+    std::vector<SceneTraceIndexEntry> Records_;
+    std::vector<std::vector<uint32_t>> ByType_;
+    std::string Error_;
+};
+
+// Records a scene trace from the app as it runs. The Write methods copy their record
+// into a queue and return; a writer thread appends the queued records to the file, and
+// Close adds the index. They may be called from any thread, e.g. the mesh pipeline's.
+//
+// The queue holds at most bufferBytes of the records that come every frame (poses and
+// depth frames); when the file falls that far behind, those are dropped rather than
+// making the frame loop wait, and counted in Stats. Records of the scene itself come
+// once per space and are always queued.
+class SceneTraceWriter {
+public:
+    struct Stats {
+        uint64_t Records = 0; // written to the file
+        uint64_t Bytes = 0;
+        uint64_t Dropped = 0; // frame records that did not fit in the queue
+    };
+
+    static constexpr size_t kDefaultBufferBytes = 16 << 20;
+
+    explicit SceneTraceWriter(size_t bufferBytes = kDefaultBufferBytes);
+    ~SceneTraceWriter();
+
+    SceneTraceWriter(const SceneTraceWriter&) = delete;
+    SceneTraceWriter& operator=(const SceneTraceWriter&) = delete;
+
+    // Creates path and starts the writer thread. Returns false, with Error() set, when
+    // the file cannot be created.
+    bool Open(const std::string& path);
+    // Writes what is queued, then the index and footer.
+    void Close();
+
+    bool IsOpen() const;
+    // Set when Open failed or a write did; records after a failed write are dropped.
+    std::string Error() const;
+    Stats GetStats() const;
+
+    // time is the XrTime the record describes, or 0 when it has none, e.g. for scene
+    // data fetched off the frame loop. Spaces are identified by their handle.
+    void WriteSpace(XrTime time, XrSpace space, const XrUuidEXT& uuid, uint32_t components);
+    void WriteTriangleMesh(
+        XrTime time,
+        XrSpace space,
+        const XrVector3f* vertices,
+        uint32_t vertexCount,
+        const uint32_t* indices,
+        uint32_t indexCount);
+    void WriteBoundary2D(XrTime time, XrSpace space, const XrVector2f* vertices, uint32_t vertexCount);
+    void WriteBoundingBox2D(XrTime time, XrSpace space, const XrRect2Df& boundingBox);
+    void WriteBoundingBox3D(XrTime time, XrSpace space, const XrRect3DfFB& boundingBox);
+    void WriteSemanticLabels(XrTime time, XrSpace space, const std::string& labels);
+
+    void WriteSpacePose(XrTime time, XrSpace space, const XrPosef& pose, XrSpaceLocationFlags flags);
+    void WriteHeadPose(XrTime time, const XrPosef& pose, XrSpaceLocationFlags flags);
+    void WriteControllerPose(XrTime time, int hand, const XrPosef& pose, XrSpaceLocationFlags flags);
+    // texels holds frame.Width * frame.Height values for view 0, then as many for view 1.
+    void WriteDepthFrame(XrTime time, const SceneTraceDepthFrame& frame, const uint16_t* texels);
+
+private:
+    struct Part {
+        const void* Data;
+        size_t Size;
+    };
+
+    // An encoded record, header and padding included
+    struct Encoded {
+        std::vector<uint8_t> Bytes;
+        bool Droppable;
+    };
+
+    // Queues a record made of parts; a droppable one only when it fits in the queue.
+    void Append(
+        SceneTraceRecordType type,
+        XrTime time,
+        uint64_t space,
+        std::initializer_list<Part> parts,
+        bool droppable);
+    void ThreadMain();
+
+    const size_t BufferBytes_;
+    std::FILE* File_ = nullptr;
+    std::thread Thread_;
+    mutable std::mutex Mutex_;
+    std::condition_variable RecordAvailable_;
+    std::deque<Encoded> Queue_;
+    size_t QueuedBytes_ = 0; // of the droppable records in Queue_
+    bool Stopping_ = false;
+    bool Failed_ = false;
+    std::string Error_;
+    Stats Stats_;
+    // Written by the writer thread only, until Close joins it.
+    std::vector<SceneTraceIndexEntry> Index_;
+    uint64_t FileOffset_ = 0;
+};
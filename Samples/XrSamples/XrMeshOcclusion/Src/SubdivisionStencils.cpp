@@ -0,0 +1,119 @@
+#include "SubdivisionStencils.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+// Output vertices per pool task in Apply.
+constexpr size_t kRowsPerTask = 4096;
+} // namespace
+
+void SubdivisionStencils::Clear() {
+    SourceVertexCount_ = 0;
+    Offsets_.clear();
+    Sources_.clear();
+    Weights_.clear();
+    NextOffsets_.clear();
+    NextSources_.clear();
+    NextWeights_.clear();
+    Accumulator_.clear();
+    Touched_.clear();
+}
+
+void SubdivisionStencils::Begin(size_t sourceVertexCount) {
+    SourceVertexCount_ = sourceVertexCount;
+    Offsets_.resize(sourceVertexCount + 1);
+    Sources_.resize(sourceVertexCount);
+    Weights_.assign(sourceVertexCount, 1.0f);
+    for (size_t i = 0; i < sourceVertexCount; ++i) {
+        Offsets_[i] = static_cast<uint32_t>(i);
+        Sources_[i] = static_cast<uint32_t>(i);
+    }
+    Offsets_[sourceVertexCount] = static_cast<uint32_t>(sourceVertexCount);
+
+    NextOffsets_.assign(1, 0);
+    NextSources_.clear();
+    NextWeights_.clear();
+    Accumulator_.assign(sourceVertexCount, 0.0f);
+    Touched_.clear();
+}
+
+void SubdivisionStencils::AddVertex(const uint32_t* vertices, const float* weights, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t row = vertices[i];
+        for (uint32_t j = Offsets_[row]; j < Offsets_[row + 1]; ++j) {
+            const uint32_t source = Sources_[j];
+            if (Accumulator_[source] == 0.0f) {
+                Touched_.push_back(source);
+            }
+            Accumulator_[source] += weights[i] * Weights_[j];
+        }
+    }
+
+    // Sources in ascending order keep Apply's summation order independent of how the
+    // row was assembled.
+    std::sort(Touched_.begin(), Touched_.end());
+    Touched_.erase(std::unique(Touched_.begin(), Touched_.end()), Touched_.end());
+    for (const uint32_t source : Touched_) {
+        if (Accumulator_[source] != 0.0f) {
+            NextSources_.push_back(source);
+            NextWeights_.push_back(Accumulator_[source]);
+        }
+        Accumulator_[source] = 0.0f;
+    }
+    Touched_.clear();
+    NextOffsets_.push_back(static_cast<uint32_t>(NextSources_.size()));
+}
+
+void SubdivisionStencils::EndLevel() {
+    std::swap(Offsets_, NextOffsets_);
+    std::swap(Sources_, NextSources_);
+    std::swap(Weights_, NextWeights_);
+    NextOffsets_.assign(1, 0);
+    NextSources_.clear();
+    NextWeights_.clear();
+}
+
+void SubdivisionStencils::RemapOutputs(const std::vector<uint32_t>& remap, size_t newOutputCount) {
+    // Row lengths first, then a prefix sum and a copy into the new positions.
+    NextOffsets_.assign(newOutputCount + 1, 0);
+    for (size_t i = 0; i < remap.size(); ++i) {
+        if (remap[i] != kUnusedRow) {
+            NextOffsets_[remap[i] + 1] = Offsets_[i + 1] - Offsets_[i];
+        }
+    }
+    for (size_t i = 0; i < newOutputCount; ++i) {
+        NextOffsets_[i + 1] += NextOffsets_[i];
+    }
+    NextSources_.resize(NextOffsets_[newOutputCount]);
+    NextWeights_.resize(NextOffsets_[newOutputCount]);
+    for (size_t i = 0; i < remap.size(); ++i) {
+        if (remap[i] == kUnusedRow) {
+            continue;
+        }
+        std::copy(Sources_.begin() + Offsets_[i], Sources_.begin() + Offsets_[i + 1], NextSources_.begin() + NextOffsets_[remap[i]]);
+        std::copy(Weights_.begin() + Offsets_[i], Weights_.begin() + Offsets_[i + 1], NextWeights_.begin() + NextOffsets_[remap[i]]);
+    }
+    EndLevel();
+}
+
+void SubdivisionStencils::Apply(
+    const XrVector3f* sourceVertices,
+    std::vector<XrVector3f>& outVertices,
+    ThreadPool* pool) const {
+    outVertices.resize(OutputVertexCount());
+    ParallelFor(pool, outVertices.size(), kRowsPerTask, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            float x = 0.0f;
+            float y = 0.0f;
+            float z = 0.0f;
+            for (uint32_t j = Offsets_[i]; j < Offsets_[i + 1]; ++j) {
+                const XrVector3f& v = sourceVertices[Sources_[j]];
+                const float w = Weights_[j];
+                x += w * v.x;
+                y += w * v.y;
+                z += w * v.z;
+            }
+            outVertices[i] = {x, y, z};
+        }
+    });
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <openxr/openxr.h>
+
+class ThreadPool;
+
+// Subdivision as a sparse matrix: every output vertex is a fixed weighted sum of
+// input vertices. Once recorded for an index buffer, refreshed positions for the same
+// topology are subdivided with a single Apply, without rebuilding any connectivity.
+//
+// Recording works level by level: rows added during a level combine the rows of the
+// previous level (the identity before the first), and EndLevel makes them current.
+class SubdivisionStencils {
+public:
+    void Clear();
+
+    bool IsEmpty() const { return Offsets_.empty(); }
+    size_t SourceVertexCount() const { return SourceVertexCount_; }
+    size_t OutputVertexCount() const { return Offsets_.empty() ? 0 : Offsets_.size() - 1; }
+
+    // Starts recording with output vertex i = source vertex i.
+    void Begin(size_t sourceVertexCount);
+    // Appends the next output vertex of the level being recorded, as a weighted sum of
+    // vertices of the previous level. Repeated vertices are allowed.
+    void AddVertex(const uint32_t* vertices, const float* weights, size_t count);
+    void EndLevel();
+
+    // Moves output row i to remap[i] and drops rows mapped to kUnusedRow, so Apply
+    // produces vertices in an order chosen after recording (e.g. by MeshOptimization).
+    static constexpr uint32_t kUnusedRow = ~0u;
+    void RemapOutputs(const std::vector<uint32_t>& remap, size_t newOutputCount);
+
+    // outVertices[i] = sum of weight * sourceVertices[source] over row i.
+    void Apply(
+        const XrVector3f* sourceVertices,
+        std::vector<XrVector3f>& outVertices,
+        ThreadPool* pool = nullptr) const;
+
+private:
+    size_t SourceVertexCount_ = 0;
+
+    // Current rows, CSR over (Sources_, Weights_).
+    std::vector<uint32_t> Offsets_;
+    std::vector<uint32_t> Sources_;
+    std::vector<float> Weights_;
+
+    // Rows of the level being recorded.
+    std::vector<uint32_t> NextOffsets_;
+    std::vector<uint32_t> NextSources_;
+    std::vector<float> NextWeights_;
+
+    // Dense accumulator over source vertices used to merge rows.
+    std::vector<float> Accumulator_;
+    std::vector<uint32_t> Touched_;
+};
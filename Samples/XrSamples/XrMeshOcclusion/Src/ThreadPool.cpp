@@ -0,0 +1,109 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+// Set on pool worker threads. A ParallelFor issued from inside a chunk runs inline,
+// which keeps nested use from waiting on workers that are busy with the outer job.
+thread_local bool tlsIsPoolWorker = false;
+} // namespace
+
+ThreadPool::ThreadPool(int workerCount) {
+    if (workerCount < 0) {
+        const unsigned hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? static_cast<int>(hardwareThreads) - 1 : 0;
+    }
+    Workers_.reserve(workerCount);
+    for (int i = 0; i < workerCount; ++i) {
+        Workers_.emplace_back([this]() { WorkerMain(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        ShuttingDown_ = true;
+    }
+    WorkAvailable_.notify_all();
+    for (auto& worker : Workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(
+    size_t count,
+    size_t minChunkSize,
+    const std::function<void(size_t begin, size_t end)>& func) {
+    if (count == 0) {
+        return;
+    }
+    minChunkSize = std::max<size_t>(minChunkSize, 1);
+    if (Workers_.empty() || tlsIsPoolWorker || count <= minChunkSize) {
+        func(0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submitLock(SubmitMutex_);
+
+    // A few chunks per thread so uneven chunks balance out.
+    const size_t targetChunks = static_cast<size_t>(ThreadCount()) * 4;
+    Job job;
+    job.Func = &func;
+    job.Count = count;
+    job.ChunkSize = std::max(minChunkSize, (count + targetChunks - 1) / targetChunks);
+    job.ChunkCount = (count + job.ChunkSize - 1) / job.ChunkSize;
+
+    {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        CurrentJob_ = &job;
+        JobGeneration_++;
+    }
+    WorkAvailable_.notify_all();
+
+    RunChunks(job);
+
+    // The job lives on this stack frame, so also wait for every worker to let go of it.
+    std::unique_lock<std::mutex> lock(Mutex_);
+    WorkDone_.wait(lock, [&job]() {
+        return job.DoneChunks.load() == job.ChunkCount && job.ActiveWorkers == 0;
+    });
+    CurrentJob_ = nullptr;
+}
+
+void ThreadPool::RunChunks(Job& job) {
+    for (;;) {
+        const size_t chunk = job.NextChunk.fetch_add(1);
+        if (chunk >= job.ChunkCount) {
+            return;
+        }
+        const size_t begin = chunk * job.ChunkSize;
+        const size_t end = std::min(begin + job.ChunkSize, job.Count);
+        (*job.Func)(begin, end);
+        job.DoneChunks.fetch_add(1);
+    }
+}
+
+void ThreadPool::WorkerMain() {
+    tlsIsPoolWorker = true;
+    uint64_t seenGeneration = 0;
+    for (;;) {
+        Job* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(Mutex_);
+            WorkAvailable_.wait(lock, [this, seenGeneration]() {
+                return ShuttingDown_ || (CurrentJob_ != nullptr && JobGeneration_ != seenGeneration);
+            });
+            if (ShuttingDown_) {
+                return;
+            }
+            seenGeneration = JobGeneration_;
+            job = CurrentJob_;
+            job->ActiveWorkers++;
+        }
+        RunChunks(*job);
+        {
+            std::lock_guard<std::mutex> lock(Mutex_);
+            job->ActiveWorkers--;
+        }
+        WorkDone_.notify_all();
+    }
+}
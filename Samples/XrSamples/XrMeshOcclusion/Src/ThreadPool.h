@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Minimal fork-join pool for the mesh processing stages.
+//
+// ParallelFor splits [0, count) into fixed chunks and blocks until all of them have
+// run; the calling thread works on chunks too. Which thread runs which chunk is not
+// deterministic, so callers must only write results that depend on the chunk itself.
+class ThreadPool {
+public:
+    // workerCount < 0 uses one worker per additional hardware thread.
+    explicit ThreadPool(int workerCount = -1);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads taking part in ParallelFor, including the caller.
+    int ThreadCount() const {
+        return static_cast<int>(Workers_.size()) + 1;
+    }
+
+    // Calls func(begin, end) for consecutive ranges of at least minChunkSize items.
+    void ParallelFor(
+        size_t count,
+        size_t minChunkSize,
+        const std::function<void(size_t begin, size_t end)>& func);
+
+private:
+    struct Job {
+        const std::function<void(size_t, size_t)>* Func = nullptr;
+        size_t Count = 0;
+        size_t ChunkSize = 0;
+        size_t ChunkCount = 0;
+        std::atomic<size_t> NextChunk{0};
+        std::atomic<size_t> DoneChunks{0};
+        int ActiveWorkers = 0; // guarded by Mutex_
+    };
+
+    void WorkerMain();
+    void RunChunks(Job& job);
+
+    std::vector<std::thread> Workers_;
+    std::mutex Mutex_;
+    std::condition_variable WorkAvailable_;
+    std::condition_variable WorkDone_;
+    Job* CurrentJob_ = nullptr;
+    uint64_t JobGeneration_ = 0;
+    bool ShuttingDown_ = false;
+
+    // Serializes ParallelFor calls coming from different threads.
+    std::mutex SubmitMutex_;
+};
+
+// Runs func over [0, count) on the pool, or inline on the caller when there is none.
+inline void ParallelFor(
+    ThreadPool* pool,
+    size_t count,
+    size_t minChunkSize,
+    const std::function<void(size_t begin, size_t end)>& func) {
+    if (pool != nullptr) {
+        pool->ParallelFor(count, minChunkSize, func);
+    } else if (count > 0) {
+        func(0, count);
+    }
+}
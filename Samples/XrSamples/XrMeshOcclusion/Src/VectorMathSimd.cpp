@@ -0,0 +1,269 @@
+#include "VectorMathSimd.h"
+#include "MeshTopology.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define VECTORMATH_SIMD_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VECTORMATH_SIMD_SSE 1
+#endif
+
+namespace VectorMathSimd {
+
+namespace {
+
+// Groups of four vectors per pool task.
+constexpr size_t kGroupsPerTask = 1024;
+
+// Four-wide float helpers; the scalar variant keeps unsupported targets building.
+#if defined(VECTORMATH_SIMD_NEON)
+typedef float32x4_t Float4;
+inline Float4 Load(const float* p) { return vld1q_f32(p); }
+inline void Store(float* p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 Splat(float s) { return vdupq_n_f32(s); }
+inline Float4 Set(float a, float b, float c, float d) {
+    const float lanes[4] = {a, b, c, d};
+    return vld1q_f32(lanes);
+}
+inline Float4 Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return vdivq_f32(a, b); }
+inline Float4 Sqrt(Float4 a) { return vsqrtq_f32(a); }
+inline Float4 Min(Float4 a, Float4 b) { return vminq_f32(a, b); }
+// Lanes where a > b keep value, the others become zero.
+inline Float4 SelectGreater(Float4 a, Float4 b, Float4 value) {
+    return vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(a, b), vreinterpretq_u32_f32(value)));
+}
+#elif defined(VECTORMATH_SIMD_SSE)
+typedef __m128 Float4;
+inline Float4 Load(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+inline Float4 Splat(float s) { return _mm_set1_ps(s); }
+inline Float4 Set(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+inline Float4 Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+inline Float4 Sqrt(Float4 a) { return _mm_sqrt_ps(a); }
+inline Float4 Min(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+inline Float4 SelectGreater(Float4 a, Float4 b, Float4 value) {
+    return _mm_and_ps(_mm_cmpgt_ps(a, b), value);
+}
+#else
+struct Float4 {
+    float v[4];
+};
+inline Float4 Load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void Store(float* p, Float4 a) {
+    for (int i = 0; i < 4; ++i) p[i] = a.v[i];
+}
+inline Float4 Splat(float s) { return {{s, s, s, s}}; }
+inline Float4 Set(float a, float b, float c, float d) { return {{a, b, c, d}}; }
+#define VECTORMATH_SIMD_SCALAR_OP(name, expr)                  \
+    inline Float4 name(Float4 a, Float4 b) {                   \
+        Float4 r;                                              \
+        for (int i = 0; i < 4; ++i) r.v[i] = expr;             \
+        return r;                                              \
+    }
+VECTORMATH_SIMD_SCALAR_OP(Add, a.v[i] + b.v[i])
+VECTORMATH_SIMD_SCALAR_OP(Sub, a.v[i] - b.v[i])
+VECTORMATH_SIMD_SCALAR_OP(Mul, a.v[i] * b.v[i])
+VECTORMATH_SIMD_SCALAR_OP(Div, a.v[i] / b.v[i])
+VECTORMATH_SIMD_SCALAR_OP(Min, std::min(a.v[i], b.v[i]))
+#undef VECTORMATH_SIMD_SCALAR_OP
+inline Float4 Sqrt(Float4 a) {
+    Float4 r;
+    for (int i = 0; i < 4; ++i) r.v[i] = std::sqrt(a.v[i]);
+    return r;
+}
+inline Float4 SelectGreater(Float4 a, Float4 b, Float4 value) {
+    Float4 r;
+    for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] > b.v[i] ? value.v[i] : 0.0f;
+    return r;
+}
+#endif
+
+size_t GroupCount(size_t count) {
+    return (count + 3) / 4;
+}
+
+} // namespace
+
+void Vector3SoA::Resize(size_t count) {
+    // Only the padding is cleared; the kernels overwrite everything else.
+    const size_t padded = GroupCount(count) * 4;
+    X.resize(padded);
+    Y.resize(padded);
+    Z.resize(padded);
+    for (size_t i = count; i < padded; ++i) {
+        X[i] = Y[i] = Z[i] = 0.0f;
+    }
+    Count = count;
+}
+
+void ToSoA(const XrVector3f* vectors, size_t count, Vector3SoA& out) {
+    out.Resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        out.X[i] = vectors[i].x;
+        out.Y[i] = vectors[i].y;
+        out.Z[i] = vectors[i].z;
+    }
+}
+
+void FromSoA(const Vector3SoA& vectors, XrVector3f* out) {
+    for (size_t i = 0; i < vectors.Count; ++i) {
+        out[i] = {vectors.X[i], vectors.Y[i], vectors.Z[i]};
+    }
+}
+
+void FaceNormals(
+    const Vector3SoA& positions,
+    const uint32_t* indices,
+    size_t triangleCount,
+    Vector3SoA& faceNormals,
+    ThreadPool* pool) {
+    faceNormals.Resize(triangleCount);
+    // Full groups of four triangles go through the vector kernel; the last partial group
+    // repeats its final triangle in the unused lanes and only stores the valid ones.
+    const float* px = positions.X.data();
+    const float* py = positions.Y.data();
+    const float* pz = positions.Z.data();
+    ParallelFor(pool, GroupCount(triangleCount), kGroupsPerTask, [&](size_t begin, size_t end) {
+        for (size_t group = begin; group < end; ++group) {
+            const size_t first = group * 4;
+            const size_t last = triangleCount - 1;
+            const uint32_t* t0 = &indices[first * 3];
+            const uint32_t* t1 = &indices[std::min(first + 1, last) * 3];
+            const uint32_t* t2 = &indices[std::min(first + 2, last) * 3];
+            const uint32_t* t3 = &indices[std::min(first + 3, last) * 3];
+            auto corner = [t0, t1, t2, t3](int c, const float* axis) {
+                return Set(axis[t0[c]], axis[t1[c]], axis[t2[c]], axis[t3[c]]);
+            };
+            const Float4 p0x = corner(0, px);
+            const Float4 p0y = corner(0, py);
+            const Float4 p0z = corner(0, pz);
+            const Float4 e1x = Sub(corner(1, px), p0x);
+            const Float4 e1y = Sub(corner(1, py), p0y);
+            const Float4 e1z = Sub(corner(1, pz), p0z);
+            const Float4 e2x = Sub(corner(2, px), p0x);
+            const Float4 e2y = Sub(corner(2, py), p0y);
+            const Float4 e2z = Sub(corner(2, pz), p0z);
+            // Same operation order as VectorMath::cross_product.
+            Store(&faceNormals.X[first], Sub(Mul(e1y, e2z), Mul(e1z, e2y)));
+            Store(&faceNormals.Y[first], Sub(Mul(e1z, e2x), Mul(e1x, e2z)));
+            Store(&faceNormals.Z[first], Sub(Mul(e1x, e2y), Mul(e1y, e2x)));
+        }
+    });
+}
+
+void GatherVertexNormals(
+    const MeshTopology& topology,
+    const Vector3SoA& faceNormals,
+    Vector3SoA& vertexNormals,
+    ThreadPool* pool) {
+    const size_t vertexCount = topology.VertexCount();
+    vertexNormals.Resize(vertexCount);
+    ParallelFor(pool, vertexCount, kGroupsPerTask * 4, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            float x = 0.0f;
+            float y = 0.0f;
+            float z = 0.0f;
+            const uint32_t vertex = static_cast<uint32_t>(i);
+            for (const uint32_t* f = topology.VertexFacesBegin(vertex); f != topology.VertexFacesEnd(vertex); ++f) {
+                x += faceNormals.X[*f];
+                y += faceNormals.Y[*f];
+                z += faceNormals.Z[*f];
+            }
+            vertexNormals.X[i] = x;
+            vertexNormals.Y[i] = y;
+            vertexNormals.Z[i] = z;
+        }
+    });
+}
+
+void NormalizeAndOffset(
+    Vector3SoA& positions,
+    const Vector3SoA& normals,
+    float factor,
+    ThreadPool* pool) {
+    const Float4 one = Splat(1.0f);
+    const Float4 epsilon = Splat(1e-6f);
+    const Float4 scale = Splat(factor);
+    ParallelFor(pool, GroupCount(positions.Count), kGroupsPerTask, [&](size_t begin, size_t end) {
+        for (size_t group = begin; group < end; ++group) {
+            const size_t i = group * 4;
+            const Float4 nx = Load(&normals.X[i]);
+            const Float4 ny = Load(&normals.Y[i]);
+            const Float4 nz = Load(&normals.Z[i]);
+            const Float4 magnitude = Sqrt(Add(Add(Mul(nx, nx), Mul(ny, ny)), Mul(nz, nz)));
+            // 1 / magnitude, or 0 where the normal is degenerate.
+            const Float4 inverse = SelectGreater(magnitude, epsilon, Div(one, magnitude));
+            Store(&positions.X[i], Add(Load(&positions.X[i]), Mul(Mul(nx, inverse), scale)));
+            Store(&positions.Y[i], Add(Load(&positions.Y[i]), Mul(Mul(ny, inverse), scale)));
+            Store(&positions.Z[i], Add(Load(&positions.Z[i]), Mul(Mul(nz, inverse), scale)));
+        }
+    });
+}
+
+void Normalize(Vector3SoA& normals, ThreadPool* pool) {
+    const Float4 one = Splat(1.0f);
+    const Float4 epsilon = Splat(1e-6f);
+    ParallelFor(pool, GroupCount(normals.Count), kGroupsPerTask, [&](size_t begin, size_t end) {
+        for (size_t group = begin; group < end; ++group) {
+            const size_t i = group * 4;
+            const Float4 nx = Load(&normals.X[i]);
+            const Float4 ny = Load(&normals.Y[i]);
+            const Float4 nz = Load(&normals.Z[i]);
+            const Float4 magnitude = Sqrt(Add(Add(Mul(nx, nx), Mul(ny, ny)), Mul(nz, nz)));
+            const Float4 inverse = SelectGreater(magnitude, epsilon, Div(one, magnitude));
+            Store(&normals.X[i], Mul(nx, inverse));
+            Store(&normals.Y[i], Mul(ny, inverse));
+            Store(&normals.Z[i], Mul(nz, inverse));
+        }
+    });
+}
+
+void CullBoxes(
+    const Vector3SoA& centers,
+    const Vector3SoA& extents,
+    const float* planes,
+    size_t planeCount,
+    uint8_t* visible,
+    ThreadPool* pool) {
+    ParallelFor(pool, GroupCount(centers.Count), kGroupsPerTask, [&](size_t begin, size_t end) {
+        for (size_t group = begin; group < end; ++group) {
+            const size_t i = group * 4;
+            const Float4 cx = Load(&centers.X[i]);
+            const Float4 cy = Load(&centers.Y[i]);
+            const Float4 cz = Load(&centers.Z[i]);
+            const Float4 ex = Load(&extents.X[i]);
+            const Float4 ey = Load(&extents.Y[i]);
+            const Float4 ez = Load(&extents.Z[i]);
+            // Signed distance of the box corner furthest along each plane normal; the
+            // box is outside as soon as one of them is negative.
+            Float4 nearest = Splat(1.0f);
+            for (size_t p = 0; p < planeCount; ++p) {
+                const float* plane = &planes[p * 4];
+                const Float4 center = Add(
+                    Add(Add(Mul(cx, Splat(plane[0])), Mul(cy, Splat(plane[1]))), Mul(cz, Splat(plane[2]))),
+                    Splat(plane[3]));
+                const Float4 radius = Add(
+                    Add(Mul(ex, Splat(std::fabs(plane[0]))), Mul(ey, Splat(std::fabs(plane[1])))),
+                    Mul(ez, Splat(std::fabs(plane[2]))));
+                nearest = Min(nearest, Add(center, radius));
+            }
+            float distances[4];
+            Store(distances, nearest);
+            for (size_t k = 0; k < 4 && i + k < centers.Count; ++k) {
+                visible[i + k] = distances[k] >= 0.0f ? 1 : 0;
+            }
+        }
+    });
+}
+
+} // namespace VectorMathSimd
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <openxr/openxr.h>
+
+class MeshTopology;
+class ThreadPool;
+
+// Structure-of-arrays counterparts of the VectorMath helpers, processing four vectors
+// per instruction with NEON on the headset (arm64) and SSE2 on x86 hosts. Other targets
+// get a scalar loop with the same results.
+namespace VectorMathSimd {
+
+// Positions or normals as three separate float arrays, padded to a multiple of four so
+// the kernels never need a scalar tail. Resize keeps capacity, so reusing one object
+// across updates avoids reallocating (and page faulting) the arrays.
+struct Vector3SoA {
+    std::vector<float> X;
+    std::vector<float> Y;
+    std::vector<float> Z;
+    size_t Count = 0;
+
+    void Resize(size_t count);
+};
+
+void ToSoA(const XrVector3f* vectors, size_t count, Vector3SoA& out);
+void FromSoA(const Vector3SoA& vectors, XrVector3f* out);
+
+// Unnormalized (area weighted) normal of every triangle.
+void FaceNormals(
+    const Vector3SoA& positions,
+    const uint32_t* indices,
+    size_t triangleCount,
+    Vector3SoA& faceNormals,
+    ThreadPool* pool = nullptr);
+
+// Sums the normals of the faces around each vertex. Each vertex gathers through its
+// face list instead of faces scattering into vertices, so vertices can be processed
+// in parallel without atomics and the summation order is fixed.
+void GatherVertexNormals(
+    const MeshTopology& topology,
+    const Vector3SoA& faceNormals,
+    Vector3SoA& vertexNormals,
+    ThreadPool* pool = nullptr);
+
+// positions += normalize(normals) * factor. Normals shorter than 1e-6 leave the
+// position unchanged, like VectorMath::normalize returning zero.
+void NormalizeAndOffset(
+    Vector3SoA& positions,
+    const Vector3SoA& normals,
+    float factor,
+    ThreadPool* pool = nullptr);
+
+// normals = normalize(normals), with normals shorter than 1e-6 set to zero.
+void Normalize(Vector3SoA& normals, ThreadPool* pool = nullptr);
+
+// visible[i] = 1 when the box at centers[i] with half extents extents[i] is at least
+// partly on the inner side of every plane, else 0. planes holds planeCount (x, y, z, w)
+// with dot(xyz, p) + w >= 0 inside. extents must have the same count as centers.
+void CullBoxes(
+    const Vector3SoA& centers,
+    const Vector3SoA& extents,
+    const float* planes,
+    size_t planeCount,
+    uint8_t* visible,
+    ThreadPool* pool = nullptr);
+
+} // namespace VectorMathSimd